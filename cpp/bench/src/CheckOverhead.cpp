@@ -0,0 +1,54 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "MosquitoNet.h"
+#include "CountAllocations.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace Enhedron { namespace Bench {
+    using namespace Test;
+
+    using std::string;
+    using std::vector;
+    using std::chrono::steady_clock;
+    using std::chrono::duration_cast;
+    using std::chrono::nanoseconds;
+
+    static constexpr const size_t iterationCount = 200000;
+    static constexpr const size_t checksPerIteration = 5;
+
+    // Passing checks through the full Check path. Run this at a verbosity that doesn't report passing checks, or
+    // reporting them will allocate.
+    static Suite s("Check overhead",
+        given("passing checks", [] (Check& check) {
+            int value = 1;
+            const vector<int> values{1, 2, 3};
+            const string text("a string long enough to be stored on the heap");
+            const auto isOdd = [] (int x) { return x % 2 == 1; };
+
+            auto startAllocations = allocationCount();
+            auto startTime = steady_clock::now();
+
+            for (size_t index = 0; index < iterationCount; ++index) {
+                check(VAR(value) == 1);
+                check("a description that's too long for the small string optimization", VAR(value) == 1);
+                check(VAR(isOdd)(VAR(value)) && VAR(values.size()) == 3u);
+                check(VAR(text) == text, VAR(values));
+                check(text, VAR(value) != 0 || VAR(isOdd)(VAR(value)));
+            }
+
+            auto nanosecondsPerCheck = duration_cast<nanoseconds>(steady_clock::now() - startTime).count() /
+                                       static_cast<long long>(iterationCount * checksPerIteration);
+            auto allocations = allocationCount() - startAllocations;
+
+            check("passing checks don't allocate", VAR(allocations) == 0u, VAR(nanosecondsPerCheck));
+        })
+    );
+}}
@@ -0,0 +1,42 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+// Replaces the global allocation functions, so include this in exactly one file per executable.
+
+#pragma once
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace Enhedron { namespace Bench {
+    inline std::atomic<size_t>& allocationCounter() {
+        static std::atomic<size_t> instance{0};
+        return instance;
+    }
+
+    inline size_t allocationCount() {
+        return allocationCounter().load();
+    }
+
+    inline void* countedAllocate(size_t size) {
+        ++allocationCounter();
+
+        if (void* memory = std::malloc(size == 0 ? 1 : size)) {
+            return memory;
+        }
+
+        throw std::bad_alloc();
+    }
+}}
+
+void* operator new(size_t size) { return Enhedron::Bench::countedAllocate(size); }
+void* operator new[](size_t size) { return Enhedron::Bench::countedAllocate(size); }
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, size_t) noexcept { std::free(memory); }
@@ -0,0 +1,66 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "MosquitoNet.h"
+#include "CountAllocations.h"
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Enhedron { namespace Bench {
+    using namespace Test;
+
+    using std::string;
+    using std::vector;
+    using std::chrono::steady_clock;
+    using std::chrono::duration_cast;
+    using std::chrono::nanoseconds;
+
+    using Assertion::CheckWithFailureHandler;
+    using Assertion::FailureHandler;
+    using Assertion::Variable;
+    using Util::optional;
+
+    struct Silent final: FailureHandler {
+        virtual bool notifyPassing() const override { return false; }
+
+        virtual void pass(optional<string>, const string&, const vector<Variable>&) override {}
+        virtual void fail(optional<string>, const string&, const vector<Variable>&) override {}
+    };
+
+    static constexpr const size_t iterationCount = 100;
+    static constexpr const size_t checksPerIteration = 3;
+
+    void checkLargeVector(Check& check, size_t size) {
+        vector<uint8_t> large(size, 1);
+        const vector<uint8_t> expected(size, 1);
+        Silent silent;
+
+        auto startAllocations = allocationCount();
+        auto startTime = steady_clock::now();
+
+        for (size_t index = 0; index < iterationCount; ++index) {
+            CheckWithFailureHandler(out(silent), VAR(large) == expected);
+            CheckWithFailureHandler(out(silent), VAR(large.size()) == VAR(expected.size()));
+            CheckWithFailureHandler(out(silent), length(VAR(large)) == size);
+        }
+
+        auto nanosecondsPerCheck = duration_cast<nanoseconds>(steady_clock::now() - startTime).count() /
+                                   static_cast<long long>(iterationCount * checksPerIteration);
+        auto allocations = allocationCount() - startAllocations;
+
+        check("checking a variable doesn't allocate", VAR(allocations) == 0u, VAR(nanosecondsPerCheck));
+    }
+
+    static Suite s("Large containers",
+        given("a vector with 1 thousand elements", checkLargeVector, 1000u),
+        given("a vector with 1 million elements", checkLargeVector, 1000000u),
+        given("a vector with 50 million elements", checkLargeVector, 50000000u)
+    );
+}}
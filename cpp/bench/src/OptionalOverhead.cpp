@@ -0,0 +1,113 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "MosquitoNet.h"
+#include "CountAllocations.h"
+
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace Enhedron { namespace Bench {
+    using namespace Test;
+
+    using std::string;
+    using std::unique_ptr;
+    using std::make_unique;
+    using std::move;
+    using std::logic_error;
+    using std::chrono::steady_clock;
+    using std::chrono::duration_cast;
+    using std::chrono::nanoseconds;
+
+    using Util::optional;
+
+    // The heap backed optional that Util::optional replaced, kept for comparison.
+    template<typename Value>
+    class HeapOptional final {
+        unique_ptr<Value> value_;
+    public:
+        HeapOptional() = default;
+
+        HeapOptional(const HeapOptional<Value>& other) {
+            if (other.value_) {
+                value_ = make_unique<Value>(*other.value_);
+            }
+        }
+
+        HeapOptional(HeapOptional<Value>&&) = default;
+
+        HeapOptional(Value value) : value_(make_unique<Value>(move(value))) {}
+
+        const Value& operator*() const { return *value_; }
+
+        operator bool() const { return bool(value_); }
+    };
+
+    static constexpr const size_t iterationCount = 200000;
+
+    // A passing check with a description, reported to a handler. The description is copied as it's passed down
+    // through the handler layers, like WhenRunner, WhenResultRecorder and ContextResultsRecorder do.
+    template<typename Optional>
+    size_t report(Optional description) {
+        return description ? (*description).size() : 0;
+    }
+
+    template<typename Optional>
+    size_t passDown(Optional description, size_t depth) {
+        if (depth == 0) {
+            return report(description);
+        }
+
+        return passDown(description, depth - 1);
+    }
+
+    struct Measurement {
+        size_t allocations;
+        long long nanosecondsPerCheck;
+    };
+
+    template<typename Optional>
+    Measurement measure() {
+        static constexpr const char* description = "short";
+        static constexpr const size_t handlerDepth = 3;
+        size_t total = 0;
+
+        auto startAllocations = allocationCount();
+        auto startTime = steady_clock::now();
+
+        for (size_t index = 0; index < iterationCount; ++index) {
+            total += passDown(Optional(string(description)), handlerDepth);
+        }
+
+        auto nanosecondsPerCheck = duration_cast<nanoseconds>(steady_clock::now() - startTime).count() /
+                                   static_cast<long long>(iterationCount);
+
+        if (total != iterationCount * string(description).size()) {
+            throw logic_error("Descriptions were lost");
+        }
+
+        return Measurement{allocationCount() - startAllocations, nanosecondsPerCheck};
+    }
+
+    static Suite s("Optional overhead",
+        given("descriptions on the check path", [] (Check& check) {
+            auto heap = measure<HeapOptional<string>>();
+            auto inlineStorage = measure<optional<string>>();
+
+            auto heapAllocations = heap.allocations;
+            auto heapNanosecondsPerCheck = heap.nanosecondsPerCheck;
+            auto inlineAllocations = inlineStorage.allocations;
+            auto inlineNanosecondsPerCheck = inlineStorage.nanosecondsPerCheck;
+
+            check("the heap optional allocates", VAR(heapAllocations) > 0u, VAR(heapNanosecondsPerCheck));
+            check("the inline optional doesn't", VAR(inlineAllocations) == 0u, VAR(inlineNanosecondsPerCheck));
+        })
+    );
+}}
@@ -0,0 +1,158 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "MosquitoNet.h"
+
+#include <chrono>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace Enhedron { namespace Bench {
+    using namespace Test;
+
+    using Test::Impl::Impl_Suite::ContextResultsRecorder;
+    using Test::Impl::Impl_Events::EventReplayer;
+
+    using std::string;
+    using std::vector;
+    using std::ostream;
+    using std::streambuf;
+    using std::streamsize;
+    using std::chrono::steady_clock;
+    using std::chrono::duration_cast;
+    using std::chrono::nanoseconds;
+
+    using Util::optional;
+    using Assertion::Variable;
+
+    static constexpr const size_t checkCount = 1000;
+    static constexpr const size_t replayCount = 200;
+
+    // Count the bytes written and throw them away, with a buffer like a file's.
+    class CountingBuffer final: public streambuf {
+        char buffer_[8192];
+        uint64_t bytes_ = 0;
+    public:
+        CountingBuffer() { setp(buffer_, buffer_ + sizeof(buffer_)); }
+
+        uint64_t bytes() const { return bytes_ + static_cast<uint64_t>(pptr() - pbase()); }
+    protected:
+        virtual int_type overflow(int_type character) override {
+            bytes_ += static_cast<uint64_t>(pptr() - pbase());
+            setp(buffer_, buffer_ + sizeof(buffer_));
+
+            if ( ! traits_type::eq_int_type(character, traits_type::eof())) {
+                *pptr() = traits_type::to_char_type(character);
+                pbump(1);
+            }
+
+            return traits_type::not_eof(character);
+        }
+
+        virtual int sync() override { return 0; }
+    };
+
+    // How HumanResults wrote passing checks before OutputBuffer: each piece straight to the stream.
+    class StreamResults final: public ForwardingResults {
+        Out<ostream> output_;
+
+        void indent(size_t indent) {
+            while (indent > 0) {
+                *output_ << "    ";
+                --indent;
+            }
+        }
+    public:
+        StreamResults(Out<Results> results, Out<ostream> output) : ForwardingResults(results), output_(output) {}
+
+        virtual bool notifyPassing() const override { return true; }
+
+        virtual void pass(const NameStack& context,
+                          const string& given,
+                          const NameStack& whenStack,
+                          optional <string> description,
+                          const string &expressionText,
+                          const vector <Variable> &variableList) override
+        {
+            indent(1);
+            (*output_) << "Then : ";
+
+            if (description) {
+                (*output_) << *description << "\n";
+                indent(2);
+            }
+
+            (*output_) << expressionText << "\n";
+
+            for (const auto& variable : variableList) {
+                indent(3);
+                (*output_) << variable.name() << " = " << variable.value()
+                           << ": file \"" << variable.file() << "\", line " << variable.line() << ".\n";
+            }
+        }
+    };
+
+    vector<Event> recordChecks() {
+        EventRecorder events(true);
+        ContextResultsRecorder results(out(events));
+
+        context("output",
+            given("passing checks", [] (Check& check) {
+                for (size_t index = 0; index < checkCount; ++index) {
+                    check("a description", VAR(index) < checkCount, VAR(checkCount));
+                }
+            })
+        )->run(out(results));
+
+        return events.events();
+    }
+
+    // Bytes per second written by results.
+    double throughput(const vector<Event>& eventList, Out<Results> results, const CountingBuffer& buffer) {
+        auto startTime = steady_clock::now();
+
+        for (size_t replay = 0; replay < replayCount; ++replay) {
+            EventReplayer replayer(results);
+            replayer(eventList);
+        }
+
+        results->finish(Stats());
+        auto seconds = static_cast<double>(duration_cast<nanoseconds>(steady_clock::now() - startTime).count()) / 1e9;
+
+        return static_cast<double>(buffer.bytes()) / seconds;
+    }
+
+    static Suite s("Output throughput",
+        given("verbose output for passing checks", [] (Check& check) {
+            auto eventList = recordChecks();
+
+            CountingBuffer streamBuffer;
+            ostream stream(&streamBuffer);
+            CountingBuffer silentBuffer;
+            ostream silent(&silentBuffer);
+            HumanResults silentResults(out(silent), Verbosity::SILENT);
+            StreamResults streamResults(out(silentResults), out(stream));
+            auto streamBytesPerSecond = throughput(eventList, out(streamResults), streamBuffer);
+
+            CountingBuffer bufferedBuffer;
+            ostream buffered(&bufferedBuffer);
+            HumanResults bufferedResults(out(buffered), Verbosity::VARIABLES);
+            auto bufferedBytesPerSecond = throughput(eventList, out(bufferedResults), bufferedBuffer);
+
+            check("both write the checks", VAR(bufferedBuffer.bytes()) >= streamBuffer.bytes());
+            check("bytes per second", VAR(bufferedBytesPerSecond) > 0, VAR(streamBytesPerSecond));
+
+            // Unoptimized, and especially sanitized, builds mostly time the instrumentation of the inlined buffer
+            // code, rather than the stream code in the standard library, which is already optimized.
+            #ifdef __OPTIMIZE__
+                check("the output buffer is faster", VAR(bufferedBytesPerSecond) > streamBytesPerSecond);
+            #endif
+        })
+    );
+}}
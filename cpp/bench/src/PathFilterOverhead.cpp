@@ -0,0 +1,151 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "MosquitoNet.h"
+
+#include <chrono>
+#include <memory>
+#include <regex>
+#include <string>
+#include <vector>
+
+namespace Enhedron { namespace Bench {
+    using namespace Test;
+
+    using Test::Impl::Impl_Suite::Context;
+    using Test::Impl::Impl_Suite::ContextList;
+    using Test::Impl::Impl_Suite::NodeContext;
+
+    using std::string;
+    using std::to_string;
+    using std::vector;
+    using std::unique_ptr;
+    using std::make_unique;
+    using std::move;
+    using std::regex;
+    using std::regex_match;
+    using std::chrono::steady_clock;
+    using std::chrono::duration_cast;
+    using std::chrono::nanoseconds;
+
+    static constexpr const size_t contextCount = 100;
+    static constexpr const size_t givenCount = 100;
+    static constexpr const size_t pathCount = 1000;
+
+    string contextName(size_t index) { return "context " + to_string(index); }
+    string givenName(size_t index) { return "given " + to_string(index); }
+
+    // Every tenth given, like a CI shard file.
+    vector<vector<string>> makePathList() {
+        vector<vector<string>> pathList;
+
+        for (size_t index = 0; index < pathCount; ++index) {
+            pathList.push_back({"root", contextName(index % contextCount), givenName((index / contextCount) * 10)});
+        }
+
+        return pathList;
+    }
+
+    unique_ptr<Context> makeTree() {
+        ContextList contextList;
+
+        for (size_t contextIndex = 0; contextIndex < contextCount; ++contextIndex) {
+            ContextList givenList;
+
+            for (size_t givenIndex = 0; givenIndex < givenCount; ++givenIndex) {
+                givenList.emplace_back(given(givenName(givenIndex), [] (Check&) {}));
+            }
+
+            contextList.emplace_back(make_unique<NodeContext>(contextName(contextIndex), move(givenList)));
+        }
+
+        return make_unique<NodeContext>("root", move(contextList));
+    }
+
+    // The filter PathFilter replaced: every component of every path is a regex, matched at every node.
+    size_t regexSelect(const vector<vector<string>>& pathList) {
+        vector<vector<regex>> regexList;
+
+        for (const auto& path : pathList) {
+            regexList.emplace_back(path.begin(), path.end());
+        }
+
+        size_t selected = 0;
+        vector<const vector<regex>*> rootPaths;
+
+        for (const auto& path : regexList) {
+            if (regex_match("root", path[0])) {
+                rootPaths.push_back(&path);
+            }
+        }
+
+        for (size_t contextIndex = 0; contextIndex < contextCount; ++contextIndex) {
+            vector<const vector<regex>*> matchingPaths;
+
+            for (auto path : rootPaths) {
+                if (regex_match(contextName(contextIndex), (*path)[1])) {
+                    matchingPaths.push_back(path);
+                }
+            }
+
+            for (size_t givenIndex = 0; givenIndex < givenCount; ++givenIndex) {
+                for (auto path : matchingPaths) {
+                    if (regex_match(givenName(givenIndex), (*path)[2])) {
+                        ++selected;
+                        break;
+                    }
+                }
+            }
+        }
+
+        return selected;
+    }
+
+    size_t countSelectedGivens(const Context& root) {
+        size_t selected = 0;
+
+        // Only the givens are leaves, so count the selected ones with list.
+        EventRecorder events(false);
+        Test::Impl::Impl_Suite::ContextResultsRecorder results(out(events));
+        root.list(out(results));
+
+        for (const auto& event : events.events()) {
+            if (event.type == EventType::BEGIN_GIVEN) {
+                ++selected;
+            }
+        }
+
+        return selected;
+    }
+
+    template<typename Functor>
+    long long time(Functor&& functor) {
+        auto startTime = steady_clock::now();
+        functor();
+
+        return duration_cast<nanoseconds>(steady_clock::now() - startTime).count();
+    }
+
+    static Suite s("Path filter overhead",
+        given("a large tree and a shard file", [] (Check& check) {
+            auto pathList = makePathList();
+            auto tree = makeTree();
+            size_t regexSelected = 0;
+
+            auto regexNanoseconds = time([&] { regexSelected = regexSelect(pathList); });
+            auto trieNanoseconds = time([&] {
+                PathFilter filter(pathList);
+                tree->select(filter, filter.root());
+            });
+
+            auto trieSelected = countSelectedGivens(*tree);
+
+            check("both select the same givens", VAR(trieSelected) == regexSelected, VAR(pathCount));
+            check("the trie is faster", VAR(trieNanoseconds) < regexNanoseconds);
+        })
+    );
+}}
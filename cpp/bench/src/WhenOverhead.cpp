@@ -0,0 +1,59 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "MosquitoNet.h"
+#include "CountAllocations.h"
+
+#include <chrono>
+#include <sstream>
+#include <string>
+
+namespace Enhedron { namespace Bench {
+    using namespace Test;
+
+    using Test::Impl::Impl_Suite::ContextResultsRecorder;
+
+    using std::string;
+    using std::ostringstream;
+    using std::chrono::steady_clock;
+    using std::chrono::duration_cast;
+    using std::chrono::nanoseconds;
+
+    static constexpr const size_t whenCount = 50;
+    static constexpr const size_t runCount = 200;
+
+    // A given with whenCount leaf whens runs whenCount times, and passes every when each time.
+    void manyWhens(Check& check) {
+        for (size_t index = 0; index < whenCount; ++index) {
+            check.when("a when with a name too long for the small string optimization", [] {});
+        }
+    }
+
+    static Suite s("When overhead",
+        given("a given with many leaf whens", [] (Check& check) {
+            ostringstream output;
+            HumanResults silentResults(out(output), Verbosity::SILENT);
+            ContextResultsRecorder results(out(silentResults));
+            auto tree = context("root", given("many whens", manyWhens));
+
+            tree->run(out(results));
+
+            auto startAllocations = allocationCount();
+            auto startTime = steady_clock::now();
+
+            for (size_t run = 0; run < runCount; ++run) {
+                tree->run(out(results));
+            }
+
+            auto nanosecondsPerWhen = duration_cast<nanoseconds>(steady_clock::now() - startTime).count() /
+                                      static_cast<long long>(runCount * whenCount * whenCount);
+            auto allocationsPerRun = (allocationCount() - startAllocations) / runCount;
+
+            check("names aren't copied for each pass", VAR(allocationsPerRun) < whenCount, VAR(nanosecondsPerWhen));
+        })
+    );
+}}
@@ -17,6 +17,7 @@
 #include <stdexcept>
 #include <functional>
 #include <tuple>
+#include <memory>
 
 #include <deque>
 #include <forward_list>
@@ -196,10 +197,22 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
     using std::ref;
     using std::cref;
     using std::is_function;
+    using std::is_array;
+    using std::unique_ptr;
+    using std::make_unique;
 
     class Expression {
     };
 
+    // Variables evaluate to a const reference, so checking them never copies the value. Arrays and functions decay
+    // to pointers anyway, so they're returned by value.
+    template<typename Value>
+    using EvaluateType = conditional_t<
+            is_array<remove_reference_t<Value>>::value || is_function<remove_reference_t<Value>>::value,
+            DecayArrayAndFunction_t<Value>,
+            const remove_reference_t<Value>&
+        >;
+
     template<typename Arg>
     using IsExpression = enable_if_t<is_base_of<Expression, Arg>::value>*;
 
@@ -210,23 +223,71 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
     using EitherIsExpression = enable_if_t<
             is_base_of<Expression, Lhs>::value || is_base_of<Expression, Rhs>::value> *;
 
+    template<typename Value>
+    string formatVariable(const void* value) {
+        return Convert<Value>::toString(*static_cast<const remove_reference_t<Value>*>(value));
+    }
+
+    // A variable is a reference to the value, plus a function to format it. Nothing is converted to a string until
+    // value() is called, so reporters that don't print variables don't pay for them. The name and file are
+    // usually string literals.
+    //
+    // The reference is only valid while the check is being reported. Copying a variable takes a formatted copy
+    // of everything, so copy it if you need to keep it.
     class Variable final {
     public:
-        Variable(string name, string value, string file, int line) : name_(move(name)), value_(move(value)),
-                                                                     file_(move(file)), line_(move(line)) { }
+        using Formatter = string (*)(const void*);
 
-        const string &name() const { return name_; }
+        Variable(const char* name, const void* value, Formatter format, const char* file, int line) :
+                name_(name), value_(value), format_(format), file_(file), line_(line) { }
 
-        const string &value() const { return value_; }
+        Variable(string name, string value, string file, int line) :
+                owned_(make_unique<Owned>(Owned{move(name), move(value), move(file)})), line_(line) { }
 
-        const string &file() const { return file_; }
+        Variable(const Variable& other) : line_(other.line_) {
+            copyFrom(other);
+        }
+
+        Variable& operator=(const Variable& other) {
+            if (this != &other) {
+                line_ = other.line_;
+                copyFrom(other);
+            }
+
+            return *this;
+        }
+
+        Variable(Variable&&) = default;
+        Variable& operator=(Variable&&) = default;
+
+        const char* name() const { return owned_ ? owned_->name.c_str() : name_; }
+
+        string value() const { return owned_ ? owned_->value : format_(value_); }
+
+        const char* file() const { return owned_ ? owned_->file.c_str() : file_; }
 
         int line() const { return line_; }
 
     private:
-        string name_;
-        string value_;
-        string file_;
+        struct Owned {
+            string name;
+            string value;
+            string file;
+        };
+
+        void copyFrom(const Variable& other) {
+            owned_ = make_unique<Owned>(Owned{other.name(), other.value(), other.file()});
+            name_ = nullptr;
+            value_ = nullptr;
+            format_ = nullptr;
+            file_ = nullptr;
+        }
+
+        const char* name_ = nullptr;
+        const void* value_ = nullptr;
+        Formatter format_ = nullptr;
+        const char* file_ = nullptr;
+        unique_ptr<Owned> owned_;
         int line_;
     };
 
@@ -281,12 +342,48 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
         Arg arg;
     };
 
+    // Functors for && and ||. BinaryOperator passes them the operand expressions rather than their values, so the
+    // right hand side is only evaluated if it's needed, like the built in operators. VAR(expression) evaluates
+    // expression as soon as the check is built, so use a function, such as VAR(scan)(VAR(p)), to defer evaluation.
+    template<bool shortCircuitResult>
+    struct ShortCircuit final {
+        template<typename Lhs, typename Rhs>
+        bool operator()(Lhs& lhs, Rhs& rhs) const {
+            if (static_cast<bool>(lhs.evaluate()) == shortCircuitResult) {
+                return shortCircuitResult;
+            }
+
+            return static_cast<bool>(rhs.evaluate());
+        }
+    };
+
+    using LogicalAnd = ShortCircuit<false>;
+    using LogicalOr = ShortCircuit<true>;
+
+    template<typename Functor, typename Lhs, typename Rhs>
+    struct BinaryResult {
+        using type = DecayArrayAndFunction_t<result_of_t<Functor(typename Lhs::ResultType, typename Rhs::ResultType)>>;
+    };
+
+    template<bool shortCircuitResult, typename Lhs, typename Rhs>
+    struct BinaryResult<ShortCircuit<shortCircuitResult>, Lhs, Rhs> {
+        using type = bool;
+    };
+
+    template<typename Functor, typename Lhs, typename Rhs>
+    decltype(auto) evaluateBinary(Functor& functor, Lhs& lhs, Rhs& rhs) {
+        return functor(lhs.evaluate(), rhs.evaluate());
+    }
+
+    template<bool shortCircuitResult, typename Lhs, typename Rhs>
+    bool evaluateBinary(ShortCircuit<shortCircuitResult>& functor, Lhs& lhs, Rhs& rhs) {
+        return functor(lhs, rhs);
+    }
+
     template<typename Functor, typename Lhs, typename Rhs>
     class BinaryOperator final : public Expression {
     public:
-        using ResultType = DecayArrayAndFunction_t<result_of_t<Functor(
-                                typename Lhs::ResultType,
-                                typename Rhs::ResultType)>>;
+        using ResultType = typename BinaryResult<Functor, Lhs, Rhs>::type;
 
         explicit BinaryOperator(const char *operatorName, Functor functor, Lhs lhs, Rhs rhs) :
                 operatorName(operatorName),
@@ -307,7 +404,7 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
         }
 
         ResultType evaluate() {
-            return functor(lhs.evaluate(), rhs.evaluate());
+            return evaluateBinary(functor, lhs, rhs);
         }
 
     private:
@@ -335,22 +432,24 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
     public:
         using ResultType = DecayArrayAndFunction_t<result_of_t<Functor&(DecayExpression_t<Args>...)>>;
 
-        explicit FunctionValue(string name, Functor&& functor, const char *file, int line, Args&&... args) :
-                name(move(name)),
+        // Names from VAR are string literals, so they don't need copying.
+        explicit FunctionValue(const char* name, Functor&& functor, const char *file, int line, Args&&... args) :
+                name(name),
                 functor(move(functor)),
-                fileAndLine(FileLine{file, line}),
+                file(file),
+                line(line),
                 args(forward<Args>(args)...)
         {}
 
         explicit FunctionValue(string name, Functor&& functor, Args&&... args) :
-                name(move(name)),
+                ownedName(move(name)),
                 functor(move(functor)),
                 args(forward<Args>(args)...)
         {}
 
         string makeName() const {
             ostringstream valueString;
-            valueString << name << "(";
+            valueString << functionName() << "(";
             extractParameterPack(
                     [this, &valueString] (const Args&... unpackedArgs) {
                         makeParameterNames(out(valueString), unpackedArgs...);
@@ -367,8 +466,10 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
         }
 
         void appendVariables(vector<Variable>& variableList) const {
-            if (fileAndLine) {
-                variableList.emplace_back(name, "function", fileAndLine->file, fileAndLine->line);
+            if (file != nullptr) {
+                variableList.emplace_back(
+                        functionName(), nullptr, [] (const void*) { return string("function"); }, file, line
+                    );
             }
 
             extractParameterPack(
@@ -415,12 +516,14 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
         }
 
         template<typename Arg, IsExpression<Arg> = nullptr>
-        auto getParameterValue(Arg&& arg) {
+        decltype(auto) getParameterValue(Arg&& arg) {
             return arg.evaluate();
         }
 
+        // Pass stored arguments as lvalues. We don't want to copy them, and they mustn't be moved from, as we may
+        // need their values for the failure message.
         template<typename Arg, IsNotExpression<Arg> = nullptr>
-        auto getParameterValue(Arg&& arg) {
+        remove_reference_t<Arg>& getParameterValue(Arg&& arg) {
             return arg;
         }
 
@@ -446,15 +549,15 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
         void appendParameterVariable(vector<Variable>&, const Arg&) const {
         }
 
-        string name;
-        Functor functor;
-
-        struct FileLine {
-            const char* file;
-            int line;
-        };
+        const char* functionName() const {
+            return name != nullptr ? name : ownedName.c_str();
+        }
 
-        optional<FileLine> fileAndLine;
+        const char* name = nullptr;
+        string ownedName;
+        Functor functor;
+        const char* file = nullptr;
+        int line = 0;
         optional<string> exceptionMessage;
         tuple<Args...> args;
     };
@@ -477,6 +580,16 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
         return Function<Functor>(move(name), forward<Functor>(functor));
     }
 
+    template<typename Value, enable_if_t< ! is_function<Value>::value>* = nullptr>
+    Variable makeVariableRecord(const char *name, const Value& value, const char *file, int line) {
+        return Variable(name, &value, &formatVariable<Value>, file, line);
+    }
+
+    template<typename Value, enable_if_t<is_function<Value>::value>* = nullptr>
+    Variable makeVariableRecord(const char *name, Value& value, const char *file, int line) {
+        return Variable(name, nullptr, [] (const void*) { return string("<function>"); }, file, line);
+    }
+
     template<typename Value>
     class VariableRefExpression final : public Expression {
     public:
@@ -493,10 +606,10 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
         }
 
         void appendVariables(vector<Variable> &variableList) const {
-            variableList.emplace_back(variableName, Convert<Value>::toString(value), file, line);
+            variableList.push_back(makeVariableRecord<Value>(variableName, value, file, line));
         }
 
-        ResultType evaluate() {
+        EvaluateType<Value> evaluate() {
             return value;
         }
 
@@ -530,10 +643,10 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
         }
 
         void appendVariables(vector<Variable> &variableList) const {
-            variableList.emplace_back(variableName, Convert<Value>::toString(value), file, line);
+            variableList.push_back(makeVariableRecord<Value>(variableName, value, file, line));
         }
 
-        ResultType evaluate() {
+        EvaluateType<Value> evaluate() {
             return value;
         }
 
@@ -640,12 +753,12 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
 
     template<typename Lhs, typename Rhs, EitherIsExpression<Lhs, Rhs> = nullptr>
     auto operator&&(const Lhs &lhs, const Rhs &rhs) {
-        return apply("&&", [](const auto&lhs, const auto& rhs) { return lhs && rhs; }, lhs, rhs);
+        return apply("&&", LogicalAnd(), lhs, rhs);
     }
 
     template<typename Lhs, typename Rhs, EitherIsExpression<Lhs, Rhs> = nullptr>
     auto operator||(const Lhs &lhs, const Rhs &rhs) {
-        return apply("||", [](const auto&lhs, const auto& rhs) { return lhs || rhs; }, lhs, rhs);
+        return apply("||", LogicalOr(), lhs, rhs);
     }
 
     template<typename Lhs, typename Rhs, EitherIsExpression<Lhs, Rhs> = nullptr>
@@ -729,42 +842,64 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
         return variableList;
     }
 
-    template<typename Expression, typename... ContextVariableList>
+    // Descriptions are only copied into a string when a failure or pass is reported, so passing checks don't
+    // allocate.
+    inline optional<string> makeDescription(const char* description) {
+        return optional<string>(string(description));
+    }
+
+    inline optional<string> makeDescription(const string& description) {
+        return optional<string>(description);
+    }
+
+    inline optional<string> makeDescription(optional<string> description) {
+        return description;
+    }
+
+    template<typename Description, typename Expression, typename... ContextVariableList>
     void processFailure(
             Out<FailureHandler> failureHandler,
-            optional<string> description,
+            const Description& description,
             Expression expression,
             ContextVariableList... contextVariableList
     ) {
-        failureHandler->fail(move(description), expression.makeName(), buildVariableList(expression, contextVariableList...));
+        failureHandler->fail(
+                makeDescription(description),
+                expression.makeName(),
+                buildVariableList(expression, contextVariableList...)
+            );
     }
 
-    template<typename Expression, typename... ContextVariableList>
+    template<typename Description, typename Expression, typename... ContextVariableList>
     void processSuccess(
             Out<FailureHandler> failureHandler,
-            optional<string> description,
+            const Description& description,
             Expression expression,
             ContextVariableList... contextVariableList
     ) {
         if (failureHandler->notifyPassing()) {
-            failureHandler->pass(move(description), expression.makeName(), buildVariableList(expression, contextVariableList...));
+            failureHandler->pass(
+                    makeDescription(description),
+                    expression.makeName(),
+                    buildVariableList(expression, contextVariableList...)
+                );
         }
     }
 
-    template<typename Expression, typename... Tail>
+    template<typename Description, typename Expression, typename... Tail>
     bool CheckWithFailureHandlerImpl(
             Out<FailureHandler> failureHandler,
-            optional<string> description,
+            const Description& description,
             Expression expression,
             Tail... tail
     ) {
         if ( ! static_cast<bool>(expression.evaluate())) {
-            processFailure(failureHandler, move(description), move(expression), move(tail)...);
+            processFailure(failureHandler, description, move(expression), move(tail)...);
 
             return false;
         }
 
-        processSuccess(failureHandler, move(description), move(expression), move(tail)...);
+        processSuccess(failureHandler, description, move(expression), move(tail)...);
 
         return true;
     }
@@ -778,35 +913,45 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
         return CheckWithFailureHandlerImpl(failureHandler, none, move(expression), move(tail)...);
     }
 
-    template<typename... Tail, IsExpression<Expression> = nullptr>
+    template<typename... Tail>
     bool CheckWithFailureHandler(
             Out<FailureHandler> failureHandler,
-            string description,
+            const char* description,
             Tail... tail
     ) {
-        return CheckWithFailureHandlerImpl(failureHandler, move(description), move(tail)...);
+        return CheckWithFailureHandlerImpl(failureHandler, description, move(tail)...);
+    }
+
+    template<typename... Tail>
+    bool CheckWithFailureHandler(
+            Out<FailureHandler> failureHandler,
+            const string& description,
+            Tail... tail
+    ) {
+        return CheckWithFailureHandlerImpl(failureHandler, description, move(tail)...);
     }
 
     template<
             typename Exception,
+            typename Description,
             typename Expression,
             typename... ContextVariableList,
             enable_if_t<is_same<Exception, exception>::value> * = nullptr
     >
     bool CheckThrowsWithFailureHandlerImpl(
             Out<FailureHandler> failureHandler,
-            optional<string> description,
+            const Description& description,
             Expression expression,
             ContextVariableList... contextVariableList
     ) {
         try {
             expression.evaluate();
-            processFailure(failureHandler, move(description), move(expression), move(contextVariableList)...);
+            processFailure(failureHandler, description, move(expression), move(contextVariableList)...);
 
             return false;
         }
         catch (const exception&) {
-            processSuccess(failureHandler, move(description), move(expression), move(contextVariableList)...);
+            processSuccess(failureHandler, description, move(expression), move(contextVariableList)...);
         }
 
         return true;
@@ -814,6 +959,7 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
 
     template<
             typename Exception,
+            typename Description,
             typename Functor,
             typename... Args,
             typename... ContextVariableList,
@@ -821,22 +967,22 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
     >
     bool CheckThrowsWithFailureHandlerImpl(
             Out<FailureHandler> failureHandler,
-            optional<string> description,
+            const Description& description,
             FunctionValue<Functor, Args...> expression,
             ContextVariableList... contextVariableList
     ) {
         try {
             expression.evaluate();
-            processFailure(failureHandler, move(description), move(expression), move(contextVariableList)...);
+            processFailure(failureHandler, description, move(expression), move(contextVariableList)...);
 
             return false;
         }
         catch (const Exception&) {
-            processSuccess(failureHandler, move(description), move(expression), move(contextVariableList)...);
+            processSuccess(failureHandler, description, move(expression), move(contextVariableList)...);
         }
         catch (const exception &e) {
             expression.setException(e);
-            processFailure(failureHandler, move(description), move(expression), move(contextVariableList)...);
+            processFailure(failureHandler, description, move(expression), move(contextVariableList)...);
 
             return false;
         }
@@ -864,10 +1010,22 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
     >
     bool CheckThrowsWithFailureHandler(
             Out<FailureHandler> failureHandler,
-            string description,
+            const char* description,
+            Tail... tail
+    ) {
+        return CheckThrowsWithFailureHandlerImpl<Exception>(failureHandler, description, move(tail)...);
+    }
+
+    template<
+            typename Exception,
+            typename... Tail
+    >
+    bool CheckThrowsWithFailureHandler(
+            Out<FailureHandler> failureHandler,
+            const string& description,
             Tail... tail
     ) {
-        return CheckThrowsWithFailureHandlerImpl<Exception>(failureHandler, move(description), move(tail)...);
+        return CheckThrowsWithFailureHandlerImpl<Exception>(failureHandler, description, move(tail)...);
     }
 }}}}
 
@@ -10,6 +10,7 @@
 #include <type_traits>
 #include <functional>
 #include <memory>
+#include <new>
 
 namespace Enhedron { namespace Impl { namespace Util {
     using std::enable_if;
@@ -17,6 +18,10 @@ namespace Enhedron { namespace Impl { namespace Util {
     using std::move;
     using std::make_unique;
     using std::unique_ptr;
+    using std::aligned_storage_t;
+    using std::integral_constant;
+    using std::true_type;
+    using std::false_type;
 
     class NoCopy {
     public:
@@ -74,6 +79,9 @@ namespace Enhedron { namespace Impl { namespace Util {
         struct BaseFunctor {
             virtual ~BaseFunctor() {}
             virtual void operator()() = 0;
+
+            // Move into storage, which has room for it.
+            virtual BaseFunctor* moveTo(void* storage) = 0;
         };
 
         template<typename Functor>
@@ -83,28 +91,83 @@ namespace Enhedron { namespace Impl { namespace Util {
             DerivedFunctor(Functor f) : f(move(f)) {}
             virtual ~DerivedFunctor() {}
             virtual void operator()() override { f(); }
+
+            virtual BaseFunctor* moveTo(void* storage) override {
+                return new (storage) DerivedFunctor(move(f));
+            }
         };
 
-        unique_ptr<BaseFunctor> functor;
+        // Small functors, like lambdas that capture a few references, are stored inline, so they don't allocate.
+        using Storage = aligned_storage_t<4 * sizeof(void*)>;
+
+        Storage storage;
+        BaseFunctor* functor = nullptr;
+        bool isInline = false;
         bool valid = true;
+
+        void take(Finally& source) {
+            if (source.isInline) {
+                functor = source.functor->moveTo(&storage);
+                isInline = true;
+                source.destroy();
+            }
+            else {
+                functor = source.functor;
+                isInline = false;
+                source.functor = nullptr;
+            }
+
+            valid = source.valid;
+            source.valid = false;
+        }
+
+        void destroy() {
+            if (isInline) {
+                functor->~BaseFunctor();
+            }
+            else {
+                delete functor;
+            }
+
+            functor = nullptr;
+            isInline = false;
+        }
+
+        template<typename Derived, typename Functor>
+        void create(Functor& source, true_type) {
+            functor = new (&storage) Derived(move(source));
+            isInline = true;
+        }
+
+        template<typename Derived, typename Functor>
+        void create(Functor& source, false_type) {
+            functor = new Derived(move(source));
+        }
     public:
         template<typename Functor>
-        Finally(Functor functor) : functor(make_unique<DerivedFunctor<Functor>>(move(functor))) {}
+        Finally(Functor functor) {
+            using Derived = DerivedFunctor<Functor>;
 
-        Finally(Finally&& source) : functor(move(source.functor)), valid(source.valid) {
-            source.valid = false;
+            create<Derived>(
+                    functor,
+                    integral_constant<bool, sizeof(Derived) <= sizeof(Storage) && alignof(Derived) <= alignof(Storage)>()
+                );
+        }
+
+        Finally(Finally&& source) {
+            take(source);
         }
 
         Finally& operator=(Finally&& source) {
-            functor = move(source.functor);
-            valid = move(source.valid);
-            source.valid = false;
+            destroy();
+            take(source);
 
             return *this;
         }
 
         ~Finally() {
             close();
+            destroy();
         }
 
         void close() {
@@ -7,64 +7,108 @@
 
 #pragma once
 
-#include <memory>
+#include <new>
 #include <utility>
 #include <type_traits>
 
 namespace Enhedron { namespace Util { namespace Impl { namespace Impl_Optional {
-    using std::unique_ptr;
-    using std::make_unique;
+    using std::aligned_storage_t;
+    using std::is_nothrow_move_constructible;
+    using std::is_nothrow_move_assignable;
     using std::forward;
+    using std::move;
 
     class None final {};
 
     static constexpr const None none{};
-    
+
+    // The value is stored inline, so an engaged optional doesn't allocate.
     template<typename Value>
     class optional final {
-        unique_ptr<Value> value_;
+        aligned_storage_t<sizeof(Value), alignof(Value)> storage_;
+        bool engaged_ = false;
+
+        Value* pointer() { return reinterpret_cast<Value*>(&storage_); }
+        const Value* pointer() const { return reinterpret_cast<const Value*>(&storage_); }
 
-        template<typename Other>
-        friend class optional;
+        template<typename... Args>
+        void construct(Args&&... args) {
+            new (&storage_) Value(forward<Args>(args)...);
+            engaged_ = true;
+        }
     public:
         optional() = default;
 
         optional(const optional<Value>& other) {
-            if (bool(other)) {
-                value_ = make_unique<Value>(*other.value_);
+            if (other.engaged_) {
+                construct(*other);
             }
-            else {
-                value_.reset();
+        }
+
+        optional(optional<Value>&& other) noexcept(is_nothrow_move_constructible<Value>::value) {
+            if (other.engaged_) {
+                construct(move(*other));
             }
         }
 
+        optional(const Value& value) { construct(value); }
+        optional(Value&& value) { construct(move(value)); }
+        optional(None) {}
+
+        ~optional() { reset(); }
+
         optional<Value>& operator=(const optional<Value>& other) {
-            if (bool(other)) {
-                value_ = make_unique<Value>(*other.value_);
+            if (other.engaged_) {
+                if (engaged_) {
+                    **this = *other;
+                }
+                else {
+                    construct(*other);
+                }
             }
             else {
-                value_.reset();
+                reset();
             }
 
             return *this;
         }
 
-        optional(optional<Value>&&) = default;
-        optional& operator=(optional<Value>&&) = default;
+        optional<Value>& operator=(optional<Value>&& other) noexcept(
+                is_nothrow_move_constructible<Value>::value && is_nothrow_move_assignable<Value>::value
+            )
+        {
+            if (other.engaged_) {
+                if (engaged_) {
+                    **this = move(*other);
+                }
+                else {
+                    construct(move(*other));
+                }
+            }
+            else {
+                reset();
+            }
 
-        optional(const Value& value) : value_(make_unique<Value>(value)) {}
-        optional(Value&& value) : value_(make_unique<Value>(forward<Value>(value))) {}
-        optional(None) {}
+            return *this;
+        }
 
-        Value& get() const { return *value_; }
+        Value& get() { return *pointer(); }
+        const Value& get() const { return *pointer(); }
 
-        Value& operator*() const { return *value_; }
+        Value& operator*() { return *pointer(); }
+        const Value& operator*() const { return *pointer(); }
 
-        Value* operator->() const { return value_.get(); }
+        Value* operator->() { return pointer(); }
+        const Value* operator->() const { return pointer(); }
 
-        void reset() { value_.reset(); }
+        void reset() {
+            if (engaged_) {
+                pointer()->~Value();
+                engaged_ = false;
+            }
+        }
 
-        operator bool() const { return bool(value_); }
+        operator bool() const { return engaged_; }
     };
 
     template<typename Value>
@@ -0,0 +1,60 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <time.h>
+#endif
+
+namespace Enhedron { namespace Util { namespace Impl { namespace Impl_Timer {
+    using std::chrono::steady_clock;
+    using std::chrono::duration_cast;
+    using std::chrono::nanoseconds;
+
+    inline uint64_t wallNanoseconds() {
+        return static_cast<uint64_t>(duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count());
+    }
+
+    // CPU time used by the calling thread. Falls back to process CPU time where that isn't available.
+    inline uint64_t threadCpuNanoseconds() {
+        #if defined(CLOCK_THREAD_CPUTIME_ID)
+            timespec time;
+
+            if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) == 0) {
+                return static_cast<uint64_t>(time.tv_sec) * 1000000000u + static_cast<uint64_t>(time.tv_nsec);
+            }
+
+            return 0;
+        #else
+            return static_cast<uint64_t>(std::clock()) * (1000000000u / CLOCKS_PER_SEC);
+        #endif
+    }
+
+    // Measures monotonic wall clock time and CPU time for the current thread, from construction. Both are in
+    // nanoseconds. The CPU time is only meaningful if read on the thread that constructed the timer.
+    class Timer final {
+        uint64_t wallStart_ = wallNanoseconds();
+        uint64_t cpuStart_ = threadCpuNanoseconds();
+
+        static uint64_t since(uint64_t start, uint64_t now) {
+            return now > start ? now - start : 0;
+        }
+    public:
+        uint64_t wall() const { return since(wallStart_, wallNanoseconds()); }
+        uint64_t cpu() const { return since(cpuStart_, threadCpuNanoseconds()); }
+    };
+}}}}
+
+namespace Enhedron { namespace Util {
+    using Impl::Impl_Timer::Timer;
+    using Impl::Impl_Timer::threadCpuNanoseconds;
+}}
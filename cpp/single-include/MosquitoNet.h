@@ -15,6 +15,7 @@
 #include <type_traits>
 #include <functional>
 #include <memory>
+#include <new>
 
 namespace Enhedron { namespace Impl { namespace Util {
     using std::enable_if;
@@ -22,6 +23,10 @@ namespace Enhedron { namespace Impl { namespace Util {
     using std::move;
     using std::make_unique;
     using std::unique_ptr;
+    using std::aligned_storage_t;
+    using std::integral_constant;
+    using std::true_type;
+    using std::false_type;
 
     class NoCopy {
     public:
@@ -79,6 +84,9 @@ namespace Enhedron { namespace Impl { namespace Util {
         struct BaseFunctor {
             virtual ~BaseFunctor() {}
             virtual void operator()() = 0;
+
+            // Move into storage, which has room for it.
+            virtual BaseFunctor* moveTo(void* storage) = 0;
         };
 
         template<typename Functor>
@@ -88,28 +96,83 @@ namespace Enhedron { namespace Impl { namespace Util {
             DerivedFunctor(Functor f) : f(move(f)) {}
             virtual ~DerivedFunctor() {}
             virtual void operator()() override { f(); }
+
+            virtual BaseFunctor* moveTo(void* storage) override {
+                return new (storage) DerivedFunctor(move(f));
+            }
         };
 
-        unique_ptr<BaseFunctor> functor;
+        // Small functors, like lambdas that capture a few references, are stored inline, so they don't allocate.
+        using Storage = aligned_storage_t<4 * sizeof(void*)>;
+
+        Storage storage;
+        BaseFunctor* functor = nullptr;
+        bool isInline = false;
         bool valid = true;
+
+        void take(Finally& source) {
+            if (source.isInline) {
+                functor = source.functor->moveTo(&storage);
+                isInline = true;
+                source.destroy();
+            }
+            else {
+                functor = source.functor;
+                isInline = false;
+                source.functor = nullptr;
+            }
+
+            valid = source.valid;
+            source.valid = false;
+        }
+
+        void destroy() {
+            if (isInline) {
+                functor->~BaseFunctor();
+            }
+            else {
+                delete functor;
+            }
+
+            functor = nullptr;
+            isInline = false;
+        }
+
+        template<typename Derived, typename Functor>
+        void create(Functor& source, true_type) {
+            functor = new (&storage) Derived(move(source));
+            isInline = true;
+        }
+
+        template<typename Derived, typename Functor>
+        void create(Functor& source, false_type) {
+            functor = new Derived(move(source));
+        }
     public:
         template<typename Functor>
-        Finally(Functor functor) : functor(make_unique<DerivedFunctor<Functor>>(move(functor))) {}
+        Finally(Functor functor) {
+            using Derived = DerivedFunctor<Functor>;
 
-        Finally(Finally&& source) : functor(move(source.functor)), valid(source.valid) {
-            source.valid = false;
+            create<Derived>(
+                    functor,
+                    integral_constant<bool, sizeof(Derived) <= sizeof(Storage) && alignof(Derived) <= alignof(Storage)>()
+                );
+        }
+
+        Finally(Finally&& source) {
+            take(source);
         }
 
         Finally& operator=(Finally&& source) {
-            functor = move(source.functor);
-            valid = move(source.valid);
-            source.valid = false;
+            destroy();
+            take(source);
 
             return *this;
         }
 
         ~Finally() {
             close();
+            destroy();
         }
 
         void close() {
@@ -355,64 +418,108 @@ namespace Enhedron { namespace Util {
 //
 
 
-#include <memory>
+#include <new>
 #include <utility>
 #include <type_traits>
 
 namespace Enhedron { namespace Util { namespace Impl { namespace Impl_Optional {
-    using std::unique_ptr;
-    using std::make_unique;
+    using std::aligned_storage_t;
+    using std::is_nothrow_move_constructible;
+    using std::is_nothrow_move_assignable;
     using std::forward;
+    using std::move;
 
     class None final {};
 
     static constexpr const None none{};
-    
+
+    // The value is stored inline, so an engaged optional doesn't allocate.
     template<typename Value>
     class optional final {
-        unique_ptr<Value> value_;
+        aligned_storage_t<sizeof(Value), alignof(Value)> storage_;
+        bool engaged_ = false;
+
+        Value* pointer() { return reinterpret_cast<Value*>(&storage_); }
+        const Value* pointer() const { return reinterpret_cast<const Value*>(&storage_); }
 
-        template<typename Other>
-        friend class optional;
+        template<typename... Args>
+        void construct(Args&&... args) {
+            new (&storage_) Value(forward<Args>(args)...);
+            engaged_ = true;
+        }
     public:
         optional() = default;
 
         optional(const optional<Value>& other) {
-            if (bool(other)) {
-                value_ = make_unique<Value>(*other.value_);
+            if (other.engaged_) {
+                construct(*other);
             }
-            else {
-                value_.reset();
+        }
+
+        optional(optional<Value>&& other) noexcept(is_nothrow_move_constructible<Value>::value) {
+            if (other.engaged_) {
+                construct(move(*other));
             }
         }
 
+        optional(const Value& value) { construct(value); }
+        optional(Value&& value) { construct(move(value)); }
+        optional(None) {}
+
+        ~optional() { reset(); }
+
         optional<Value>& operator=(const optional<Value>& other) {
-            if (bool(other)) {
-                value_ = make_unique<Value>(*other.value_);
+            if (other.engaged_) {
+                if (engaged_) {
+                    **this = *other;
+                }
+                else {
+                    construct(*other);
+                }
             }
             else {
-                value_.reset();
+                reset();
             }
 
             return *this;
         }
 
-        optional(optional<Value>&&) = default;
-        optional& operator=(optional<Value>&&) = default;
+        optional<Value>& operator=(optional<Value>&& other) noexcept(
+                is_nothrow_move_constructible<Value>::value && is_nothrow_move_assignable<Value>::value
+            )
+        {
+            if (other.engaged_) {
+                if (engaged_) {
+                    **this = move(*other);
+                }
+                else {
+                    construct(move(*other));
+                }
+            }
+            else {
+                reset();
+            }
 
-        optional(const Value& value) : value_(make_unique<Value>(value)) {}
-        optional(Value&& value) : value_(make_unique<Value>(forward<Value>(value))) {}
-        optional(None) {}
+            return *this;
+        }
 
-        Value& get() const { return *value_; }
+        Value& get() { return *pointer(); }
+        const Value& get() const { return *pointer(); }
 
-        Value& operator*() const { return *value_; }
+        Value& operator*() { return *pointer(); }
+        const Value& operator*() const { return *pointer(); }
 
-        Value* operator->() const { return value_.get(); }
+        Value* operator->() { return pointer(); }
+        const Value* operator->() const { return pointer(); }
 
-        void reset() { value_.reset(); }
+        void reset() {
+            if (engaged_) {
+                pointer()->~Value();
+                engaged_ = false;
+            }
+        }
 
-        operator bool() const { return bool(value_); }
+        operator bool() const { return engaged_; }
     };
 
     template<typename Value>
@@ -456,6 +563,7 @@ namespace Enhedron { namespace Util {
 #include <stdexcept>
 #include <functional>
 #include <tuple>
+#include <memory>
 
 #include <deque>
 #include <forward_list>
@@ -635,10 +743,22 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
     using std::ref;
     using std::cref;
     using std::is_function;
+    using std::is_array;
+    using std::unique_ptr;
+    using std::make_unique;
 
     class Expression {
     };
 
+    // Variables evaluate to a const reference, so checking them never copies the value. Arrays and functions decay
+    // to pointers anyway, so they're returned by value.
+    template<typename Value>
+    using EvaluateType = conditional_t<
+            is_array<remove_reference_t<Value>>::value || is_function<remove_reference_t<Value>>::value,
+            DecayArrayAndFunction_t<Value>,
+            const remove_reference_t<Value>&
+        >;
+
     template<typename Arg>
     using IsExpression = enable_if_t<is_base_of<Expression, Arg>::value>*;
 
@@ -649,23 +769,71 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
     using EitherIsExpression = enable_if_t<
             is_base_of<Expression, Lhs>::value || is_base_of<Expression, Rhs>::value> *;
 
+    template<typename Value>
+    string formatVariable(const void* value) {
+        return Convert<Value>::toString(*static_cast<const remove_reference_t<Value>*>(value));
+    }
+
+    // A variable is a reference to the value, plus a function to format it. Nothing is converted to a string until
+    // value() is called, so reporters that don't print variables don't pay for them. The name and file are
+    // usually string literals.
+    //
+    // The reference is only valid while the check is being reported. Copying a variable takes a formatted copy
+    // of everything, so copy it if you need to keep it.
     class Variable final {
     public:
-        Variable(string name, string value, string file, int line) : name_(move(name)), value_(move(value)),
-                                                                     file_(move(file)), line_(move(line)) { }
+        using Formatter = string (*)(const void*);
+
+        Variable(const char* name, const void* value, Formatter format, const char* file, int line) :
+                name_(name), value_(value), format_(format), file_(file), line_(line) { }
+
+        Variable(string name, string value, string file, int line) :
+                owned_(make_unique<Owned>(Owned{move(name), move(value), move(file)})), line_(line) { }
+
+        Variable(const Variable& other) : line_(other.line_) {
+            copyFrom(other);
+        }
+
+        Variable& operator=(const Variable& other) {
+            if (this != &other) {
+                line_ = other.line_;
+                copyFrom(other);
+            }
+
+            return *this;
+        }
 
-        const string &name() const { return name_; }
+        Variable(Variable&&) = default;
+        Variable& operator=(Variable&&) = default;
 
-        const string &value() const { return value_; }
+        const char* name() const { return owned_ ? owned_->name.c_str() : name_; }
 
-        const string &file() const { return file_; }
+        string value() const { return owned_ ? owned_->value : format_(value_); }
+
+        const char* file() const { return owned_ ? owned_->file.c_str() : file_; }
 
         int line() const { return line_; }
 
     private:
-        string name_;
-        string value_;
-        string file_;
+        struct Owned {
+            string name;
+            string value;
+            string file;
+        };
+
+        void copyFrom(const Variable& other) {
+            owned_ = make_unique<Owned>(Owned{other.name(), other.value(), other.file()});
+            name_ = nullptr;
+            value_ = nullptr;
+            format_ = nullptr;
+            file_ = nullptr;
+        }
+
+        const char* name_ = nullptr;
+        const void* value_ = nullptr;
+        Formatter format_ = nullptr;
+        const char* file_ = nullptr;
+        unique_ptr<Owned> owned_;
         int line_;
     };
 
@@ -720,12 +888,48 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
         Arg arg;
     };
 
+    // Functors for && and ||. BinaryOperator passes them the operand expressions rather than their values, so the
+    // right hand side is only evaluated if it's needed, like the built in operators. VAR(expression) evaluates
+    // expression as soon as the check is built, so use a function, such as VAR(scan)(VAR(p)), to defer evaluation.
+    template<bool shortCircuitResult>
+    struct ShortCircuit final {
+        template<typename Lhs, typename Rhs>
+        bool operator()(Lhs& lhs, Rhs& rhs) const {
+            if (static_cast<bool>(lhs.evaluate()) == shortCircuitResult) {
+                return shortCircuitResult;
+            }
+
+            return static_cast<bool>(rhs.evaluate());
+        }
+    };
+
+    using LogicalAnd = ShortCircuit<false>;
+    using LogicalOr = ShortCircuit<true>;
+
+    template<typename Functor, typename Lhs, typename Rhs>
+    struct BinaryResult {
+        using type = DecayArrayAndFunction_t<result_of_t<Functor(typename Lhs::ResultType, typename Rhs::ResultType)>>;
+    };
+
+    template<bool shortCircuitResult, typename Lhs, typename Rhs>
+    struct BinaryResult<ShortCircuit<shortCircuitResult>, Lhs, Rhs> {
+        using type = bool;
+    };
+
+    template<typename Functor, typename Lhs, typename Rhs>
+    decltype(auto) evaluateBinary(Functor& functor, Lhs& lhs, Rhs& rhs) {
+        return functor(lhs.evaluate(), rhs.evaluate());
+    }
+
+    template<bool shortCircuitResult, typename Lhs, typename Rhs>
+    bool evaluateBinary(ShortCircuit<shortCircuitResult>& functor, Lhs& lhs, Rhs& rhs) {
+        return functor(lhs, rhs);
+    }
+
     template<typename Functor, typename Lhs, typename Rhs>
     class BinaryOperator final : public Expression {
     public:
-        using ResultType = DecayArrayAndFunction_t<result_of_t<Functor(
-                                typename Lhs::ResultType,
-                                typename Rhs::ResultType)>>;
+        using ResultType = typename BinaryResult<Functor, Lhs, Rhs>::type;
 
         explicit BinaryOperator(const char *operatorName, Functor functor, Lhs lhs, Rhs rhs) :
                 operatorName(operatorName),
@@ -746,7 +950,7 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
         }
 
         ResultType evaluate() {
-            return functor(lhs.evaluate(), rhs.evaluate());
+            return evaluateBinary(functor, lhs, rhs);
         }
 
     private:
@@ -774,22 +978,24 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
     public:
         using ResultType = DecayArrayAndFunction_t<result_of_t<Functor&(DecayExpression_t<Args>...)>>;
 
-        explicit FunctionValue(string name, Functor&& functor, const char *file, int line, Args&&... args) :
-                name(move(name)),
+        // Names from VAR are string literals, so they don't need copying.
+        explicit FunctionValue(const char* name, Functor&& functor, const char *file, int line, Args&&... args) :
+                name(name),
                 functor(move(functor)),
-                fileAndLine(FileLine{file, line}),
+                file(file),
+                line(line),
                 args(forward<Args>(args)...)
         {}
 
         explicit FunctionValue(string name, Functor&& functor, Args&&... args) :
-                name(move(name)),
+                ownedName(move(name)),
                 functor(move(functor)),
                 args(forward<Args>(args)...)
         {}
 
         string makeName() const {
             ostringstream valueString;
-            valueString << name << "(";
+            valueString << functionName() << "(";
             extractParameterPack(
                     [this, &valueString] (const Args&... unpackedArgs) {
                         makeParameterNames(out(valueString), unpackedArgs...);
@@ -806,8 +1012,10 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
         }
 
         void appendVariables(vector<Variable>& variableList) const {
-            if (fileAndLine) {
-                variableList.emplace_back(name, "function", fileAndLine->file, fileAndLine->line);
+            if (file != nullptr) {
+                variableList.emplace_back(
+                        functionName(), nullptr, [] (const void*) { return string("function"); }, file, line
+                    );
             }
 
             extractParameterPack(
@@ -854,12 +1062,14 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
         }
 
         template<typename Arg, IsExpression<Arg> = nullptr>
-        auto getParameterValue(Arg&& arg) {
+        decltype(auto) getParameterValue(Arg&& arg) {
             return arg.evaluate();
         }
 
+        // Pass stored arguments as lvalues. We don't want to copy them, and they mustn't be moved from, as we may
+        // need their values for the failure message.
         template<typename Arg, IsNotExpression<Arg> = nullptr>
-        auto getParameterValue(Arg&& arg) {
+        remove_reference_t<Arg>& getParameterValue(Arg&& arg) {
             return arg;
         }
 
@@ -885,15 +1095,15 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
         void appendParameterVariable(vector<Variable>&, const Arg&) const {
         }
 
-        string name;
-        Functor functor;
-
-        struct FileLine {
-            const char* file;
-            int line;
-        };
+        const char* functionName() const {
+            return name != nullptr ? name : ownedName.c_str();
+        }
 
-        optional<FileLine> fileAndLine;
+        const char* name = nullptr;
+        string ownedName;
+        Functor functor;
+        const char* file = nullptr;
+        int line = 0;
         optional<string> exceptionMessage;
         tuple<Args...> args;
     };
@@ -916,6 +1126,16 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
         return Function<Functor>(move(name), forward<Functor>(functor));
     }
 
+    template<typename Value, enable_if_t< ! is_function<Value>::value>* = nullptr>
+    Variable makeVariableRecord(const char *name, const Value& value, const char *file, int line) {
+        return Variable(name, &value, &formatVariable<Value>, file, line);
+    }
+
+    template<typename Value, enable_if_t<is_function<Value>::value>* = nullptr>
+    Variable makeVariableRecord(const char *name, Value& value, const char *file, int line) {
+        return Variable(name, nullptr, [] (const void*) { return string("<function>"); }, file, line);
+    }
+
     template<typename Value>
     class VariableRefExpression final : public Expression {
     public:
@@ -932,10 +1152,10 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
         }
 
         void appendVariables(vector<Variable> &variableList) const {
-            variableList.emplace_back(variableName, Convert<Value>::toString(value), file, line);
+            variableList.push_back(makeVariableRecord<Value>(variableName, value, file, line));
         }
 
-        ResultType evaluate() {
+        EvaluateType<Value> evaluate() {
             return value;
         }
 
@@ -969,10 +1189,10 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
         }
 
         void appendVariables(vector<Variable> &variableList) const {
-            variableList.emplace_back(variableName, Convert<Value>::toString(value), file, line);
+            variableList.push_back(makeVariableRecord<Value>(variableName, value, file, line));
         }
 
-        ResultType evaluate() {
+        EvaluateType<Value> evaluate() {
             return value;
         }
 
@@ -1079,12 +1299,12 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
 
     template<typename Lhs, typename Rhs, EitherIsExpression<Lhs, Rhs> = nullptr>
     auto operator&&(const Lhs &lhs, const Rhs &rhs) {
-        return apply("&&", [](const auto&lhs, const auto& rhs) { return lhs && rhs; }, lhs, rhs);
+        return apply("&&", LogicalAnd(), lhs, rhs);
     }
 
     template<typename Lhs, typename Rhs, EitherIsExpression<Lhs, Rhs> = nullptr>
     auto operator||(const Lhs &lhs, const Rhs &rhs) {
-        return apply("||", [](const auto&lhs, const auto& rhs) { return lhs || rhs; }, lhs, rhs);
+        return apply("||", LogicalOr(), lhs, rhs);
     }
 
     template<typename Lhs, typename Rhs, EitherIsExpression<Lhs, Rhs> = nullptr>
@@ -1168,42 +1388,64 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
         return variableList;
     }
 
-    template<typename Expression, typename... ContextVariableList>
+    // Descriptions are only copied into a string when a failure or pass is reported, so passing checks don't
+    // allocate.
+    inline optional<string> makeDescription(const char* description) {
+        return optional<string>(string(description));
+    }
+
+    inline optional<string> makeDescription(const string& description) {
+        return optional<string>(description);
+    }
+
+    inline optional<string> makeDescription(optional<string> description) {
+        return description;
+    }
+
+    template<typename Description, typename Expression, typename... ContextVariableList>
     void processFailure(
             Out<FailureHandler> failureHandler,
-            optional<string> description,
+            const Description& description,
             Expression expression,
             ContextVariableList... contextVariableList
     ) {
-        failureHandler->fail(move(description), expression.makeName(), buildVariableList(expression, contextVariableList...));
+        failureHandler->fail(
+                makeDescription(description),
+                expression.makeName(),
+                buildVariableList(expression, contextVariableList...)
+            );
     }
 
-    template<typename Expression, typename... ContextVariableList>
+    template<typename Description, typename Expression, typename... ContextVariableList>
     void processSuccess(
             Out<FailureHandler> failureHandler,
-            optional<string> description,
+            const Description& description,
             Expression expression,
             ContextVariableList... contextVariableList
     ) {
         if (failureHandler->notifyPassing()) {
-            failureHandler->pass(move(description), expression.makeName(), buildVariableList(expression, contextVariableList...));
+            failureHandler->pass(
+                    makeDescription(description),
+                    expression.makeName(),
+                    buildVariableList(expression, contextVariableList...)
+                );
         }
     }
 
-    template<typename Expression, typename... Tail>
+    template<typename Description, typename Expression, typename... Tail>
     bool CheckWithFailureHandlerImpl(
             Out<FailureHandler> failureHandler,
-            optional<string> description,
+            const Description& description,
             Expression expression,
             Tail... tail
     ) {
         if ( ! static_cast<bool>(expression.evaluate())) {
-            processFailure(failureHandler, move(description), move(expression), move(tail)...);
+            processFailure(failureHandler, description, move(expression), move(tail)...);
 
             return false;
         }
 
-        processSuccess(failureHandler, move(description), move(expression), move(tail)...);
+        processSuccess(failureHandler, description, move(expression), move(tail)...);
 
         return true;
     }
@@ -1217,35 +1459,45 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
         return CheckWithFailureHandlerImpl(failureHandler, none, move(expression), move(tail)...);
     }
 
-    template<typename... Tail, IsExpression<Expression> = nullptr>
+    template<typename... Tail>
+    bool CheckWithFailureHandler(
+            Out<FailureHandler> failureHandler,
+            const char* description,
+            Tail... tail
+    ) {
+        return CheckWithFailureHandlerImpl(failureHandler, description, move(tail)...);
+    }
+
+    template<typename... Tail>
     bool CheckWithFailureHandler(
             Out<FailureHandler> failureHandler,
-            string description,
+            const string& description,
             Tail... tail
     ) {
-        return CheckWithFailureHandlerImpl(failureHandler, move(description), move(tail)...);
+        return CheckWithFailureHandlerImpl(failureHandler, description, move(tail)...);
     }
 
     template<
             typename Exception,
+            typename Description,
             typename Expression,
             typename... ContextVariableList,
             enable_if_t<is_same<Exception, exception>::value> * = nullptr
     >
     bool CheckThrowsWithFailureHandlerImpl(
             Out<FailureHandler> failureHandler,
-            optional<string> description,
+            const Description& description,
             Expression expression,
             ContextVariableList... contextVariableList
     ) {
         try {
             expression.evaluate();
-            processFailure(failureHandler, move(description), move(expression), move(contextVariableList)...);
+            processFailure(failureHandler, description, move(expression), move(contextVariableList)...);
 
             return false;
         }
         catch (const exception&) {
-            processSuccess(failureHandler, move(description), move(expression), move(contextVariableList)...);
+            processSuccess(failureHandler, description, move(expression), move(contextVariableList)...);
         }
 
         return true;
@@ -1253,6 +1505,7 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
 
     template<
             typename Exception,
+            typename Description,
             typename Functor,
             typename... Args,
             typename... ContextVariableList,
@@ -1260,22 +1513,22 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
     >
     bool CheckThrowsWithFailureHandlerImpl(
             Out<FailureHandler> failureHandler,
-            optional<string> description,
+            const Description& description,
             FunctionValue<Functor, Args...> expression,
             ContextVariableList... contextVariableList
     ) {
         try {
             expression.evaluate();
-            processFailure(failureHandler, move(description), move(expression), move(contextVariableList)...);
+            processFailure(failureHandler, description, move(expression), move(contextVariableList)...);
 
             return false;
         }
         catch (const Exception&) {
-            processSuccess(failureHandler, move(description), move(expression), move(contextVariableList)...);
+            processSuccess(failureHandler, description, move(expression), move(contextVariableList)...);
         }
         catch (const exception &e) {
             expression.setException(e);
-            processFailure(failureHandler, move(description), move(expression), move(contextVariableList)...);
+            processFailure(failureHandler, description, move(expression), move(contextVariableList)...);
 
             return false;
         }
@@ -1303,10 +1556,22 @@ namespace Enhedron { namespace Assertion { namespace Impl { namespace Configurab
     >
     bool CheckThrowsWithFailureHandler(
             Out<FailureHandler> failureHandler,
-            string description,
+            const char* description,
+            Tail... tail
+    ) {
+        return CheckThrowsWithFailureHandlerImpl<Exception>(failureHandler, description, move(tail)...);
+    }
+
+    template<
+            typename Exception,
+            typename... Tail
+    >
+    bool CheckThrowsWithFailureHandler(
+            Out<FailureHandler> failureHandler,
+            const string& description,
             Tail... tail
     ) {
-        return CheckThrowsWithFailureHandlerImpl<Exception>(failureHandler, move(description), move(tail)...);
+        return CheckThrowsWithFailureHandlerImpl<Exception>(failureHandler, description, move(tail)...);
     }
 }}}}
 
@@ -1391,7 +1656,7 @@ namespace Enhedron {
 }
 
 #define VAR M_ENHEDRON_VAL
-// File: Enhedron/Test/Results.h
+// File: Enhedron/Test/Process.h
 //
 //          Copyright Simon Bourne 2015.
 // Distributed under the Boost Software License, Version 1.0.
@@ -1401,384 +1666,458 @@ namespace Enhedron {
 
 
 
-#include <memory>
 #include <string>
 #include <stdexcept>
-#include <vector>
-#include <algorithm>
-
-namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Results {
-    using std::exception;
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+    #include <unistd.h>
+    #include <sys/types.h>
+    #include <sys/wait.h>
+    #include <sys/syscall.h>
+    #include <sys/resource.h>
+#endif
+
+namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Process {
     using std::string;
-    using std::unique_ptr;
-    using std::make_unique;
-    using std::ostream;
-    using std::endl;
-    using std::vector;
-    using std::move;
-    using std::min;
-    using std::max;
+    using std::runtime_error;
+    using std::to_string;
+    using std::cout;
+    using std::fflush;
+    using std::strerror;
 
-    using Assertion::FailureHandler;
-    using Assertion::Variable;
     using Util::optional;
+    using Util::none;
 
-    class Stats {
-        uint64_t fixtures_ = 0;
-        uint64_t tests_ = 0;
-        uint64_t checks_ = 0;
-        uint64_t failedTests_ = 0;
-        uint64_t failedChecks_ = 0;
-    public:
-        Stats& operator+=(Stats rhs) {
-            fixtures_ += rhs.fixtures_;
-            tests_ += rhs.tests_;
-            checks_ += rhs.checks_;
-            failedTests_ += rhs.failedTests_;
-            failedChecks_ += rhs.failedChecks_;
-            return *this;
-        }
+    using ProcessId = int;
 
-        void addFixture() { ++fixtures_; }
-        void addTest() { ++tests_; }
-        void addCheck() { ++checks_; }
+    #ifdef __linux__
+        static constexpr const bool processesSupported = true;
+    #else
+        static constexpr const bool processesSupported = false;
+    #endif
 
-        void failTest() { ++failedTests_; }
-        void failCheck() { ++failedChecks_; }
+    inline void throwUnsupported() {
+        throw runtime_error("Child processes are only supported on Linux");
+    }
 
-        uint64_t fixtures() const { return fixtures_; }
-        uint64_t tests() const { return tests_; }
-        uint64_t checks() const { return checks_; }
-        uint64_t failedTests() const { return failedTests_; }
-        uint64_t failedChecks() const { return failedChecks_; }
-    };
+    inline void throwSystemError(const string& operation) {
+        throw runtime_error(operation + " failed: " + strerror(errno));
+    }
 
-    // Wrapper, as we may add more functionality here. Such as tracking how much of the stack has
-    // been seen before.
-    class NameStack final: public NoCopy {
-        vector<string> stack_;
+    class Pipe final: public NoCopy {
+        int readEnd_ = -1;
+        int writeEnd_ = -1;
+
+        static void close(Out<int> fd) {
+            #ifdef __linux__
+                if (*fd >= 0) {
+                    ::close(*fd);
+                    *fd = -1;
+                }
+            #endif
+        }
     public:
-        const vector<string>& stack() const { return stack_; }
+        Pipe() {
+            #ifdef __linux__
+                int fds[2];
+
+                if (::pipe(fds) != 0) {
+                    throwSystemError("pipe");
+                }
 
-        void push(string name) {
-            stack_.emplace_back(move(name));
+                readEnd_ = fds[0];
+                writeEnd_ = fds[1];
+            #else
+                throwUnsupported();
+            #endif
         }
 
-        void pop() {
-            Assert( ! VAR(stack_.empty()));
-            stack_.pop_back();
+        ~Pipe() {
+            closeRead();
+            closeWrite();
         }
+
+        int readEnd() const { return readEnd_; }
+        int writeEnd() const { return writeEnd_; }
+
+        void closeRead() { close(out(readEnd_)); }
+        void closeWrite() { close(out(writeEnd_)); }
     };
 
-    struct Results: public NoCopy {
-        virtual ~Results() {}
+    inline void writeAll(int fd, const string& data) {
+        #ifdef __linux__
+            size_t written = 0;
 
-        virtual void finish(const Stats& stats) = 0;
+            while (written < data.size()) {
+                auto result = ::write(fd, data.data() + written, data.size() - written);
 
-        virtual void beginContext(const NameStack& contextStack, const string& name) = 0;
-        virtual void endContext(const Stats& stats, const NameStack& contextStack, const string& name) = 0;
+                if (result < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
 
-        virtual void beginGiven(const NameStack& context, const string& given) = 0;
-        virtual void endGiven(const Stats& stats, const NameStack& context, const string& given) = 0;
+                    throwSystemError("write");
+                }
 
-        virtual void beginWhen(const NameStack& context,
-                               const string& given,
-                               const NameStack& whenStack,
-                               const string& when) = 0;
-        virtual void endWhen(const Stats& stats,
-                             const NameStack& context,
-                             const string& given,
-                             const NameStack& whenStack,
-                             const string& when) = 0;
+                written += static_cast<size_t>(result);
+            }
+        #else
+            throwUnsupported();
+        #endif
+    }
 
-        virtual bool notifyPassing() const = 0;
+    // Read until every process with the write end open has closed it.
+    inline string readAll(int fd) {
+        string data;
 
-        virtual void fail(const NameStack& context,
-                          const string& given,
-                          const NameStack& whenStack,
-                          optional<string> description,
-                          const string &expressionText,
-                          const vector <Variable> &variableList) = 0;
+        #ifdef __linux__
+            char buffer[4096];
 
-        virtual void pass(const NameStack& context,
-                          const string& given,
-                          const NameStack& whenStack,
-                          optional <string> description,
-                          const string &expressionText,
-                          const vector <Variable> &variableList) = 0;
+            while (true) {
+                auto result = ::read(fd, buffer, sizeof(buffer));
 
-        virtual void failByException(const NameStack& context,
-                                     const string& given,
-                                     const NameStack& whenStack,
-                                     const exception& e) = 0;
-    };
+                if (result < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
 
-    enum class Verbosity {
-        SILENT,
-        SUMMARY,
-        CONTEXTS,
-        FIXTURES,
-        SECTIONS,
-        EXHAUSTIVE_SECTIONS,
-        CHECKS,
-        CHECKS_EXPRESSION,
-        VARIABLES
-    };
+                    throwSystemError("read");
+                }
 
-    enum class WrittenState {
-        NONE,
-        CONTEXT,
-        GIVEN
-    };
+                if (result == 0) {
+                    break;
+                }
 
-    class HumanResults final: public Results {
-        Out<ostream> output_;
-        Verbosity verbosity_;
-        WrittenState writtenState_ = WrittenState::NONE;
-        size_t whenDepth_ = 0;
-        size_t whenWrittenDepth_ = 0;
+                data.append(buffer, static_cast<size_t>(result));
+            }
+        #else
+            throwUnsupported();
+        #endif
 
-        void setMaxWrittenState(WrittenState maxState) {
-            if (writtenState_ > maxState) writtenState_ = maxState;
-        }
+        return data;
+    }
 
-        bool writeNeeded(WrittenState state) {
-            if (writtenState_ < state) {
-                writtenState_ = state;
-                return true;
+    // Returns 0 in the child. Output is flushed first, so buffered output isn't written by both processes. The
+    // standard streams are locked over the fork, as another thread could be writing to them, and the child would
+    // inherit the lock with nobody to release it.
+    inline ProcessId forkProcess() {
+        #ifdef __linux__
+            cout.flush();
+            fflush(nullptr);
+
+            ::flockfile(stdout);
+            ::flockfile(stderr);
+            auto child = ::fork();
+            ::funlockfile(stderr);
+            ::funlockfile(stdout);
+
+            if (child < 0) {
+                throwSystemError("fork");
             }
 
-            return false;
-        }
+            return child;
+        #else
+            throwUnsupported();
+            return 0;
+        #endif
+    }
 
-        void writeContext(const NameStack& contextStack) {
-            if (writeNeeded(WrittenState::CONTEXT)) {
-                if ( ! contextStack.stack().empty()) {
-                    *output_ << contextStack.stack().front();
+    // Close every file descriptor except stdin, stdout, stderr and keep. A long lived child calls this, so it doesn't
+    // hold open pipes and sockets that other threads in the parent created for their own children. Otherwise, the
+    // other ends wouldn't see the end of the stream until this child exits. Nothing here allocates, as another thread
+    // may have held the allocator's lock when we forked.
+    inline void closeFilesExcept(int keep) {
+        #ifdef __linux__
+            auto closeRange = [] (unsigned first, unsigned last) {
+                if (first > last) {
+                    return;
+                }
 
-                    for (
-                            auto contextIter = contextStack.stack().begin() + 1;
-                            contextIter != contextStack.stack().end();
-                            ++contextIter
-                        )
-                    {
-                        *output_ << "/" << *contextIter;
+                #ifdef SYS_close_range
+                    if (::syscall(SYS_close_range, first, last, 0) == 0) {
+                        return;
                     }
+                #endif
+
+                rlimit limit;
+                unsigned fdLimit = 1024;
 
-                    *output_ << "\n";
+                if (::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) {
+                    fdLimit = static_cast<unsigned>(limit.rlim_cur);
                 }
-            }
-        }
 
-        void writeGiven(const NameStack& context, const string& given) {
-            writeContext(context);
+                for (auto fd = first; fd <= last && fd < fdLimit; ++fd) {
+                    ::close(static_cast<int>(fd));
+                }
+            };
 
-            if (writeNeeded(WrittenState::GIVEN)) {
-                indent(1);
-                *output_ << "Given: " << given << "\n";
+            auto maxFd = ~0u;
+
+            if (keep > 2) {
+                closeRange(3, static_cast<unsigned>(keep) - 1);
+                closeRange(static_cast<unsigned>(keep) + 1, maxFd);
             }
-        }
+            else {
+                closeRange(3, maxFd);
+            }
+        #else
+            throwUnsupported();
+        #endif
+    }
 
-        void writeWhenStack(const NameStack& context, const string& given, const NameStack& when) {
-            writeGiven(context, given);
+    // Exit without running destructors or exit handlers, which belong to the parent process.
+    [[noreturn]] inline void exitProcess(int status) {
+        cout.flush();
+        fflush(nullptr);
 
-            size_t depth = whenWrittenDepth_;
-            auto startIndex = static_cast<vector<string>::difference_type>(whenWrittenDepth_);
+        #ifdef __linux__
+            ::_exit(status);
+        #else
+            std::_Exit(status);
+        #endif
+    }
 
-            for (
-                    auto whenIter = when.stack().begin() + startIndex;
-                    whenIter != when.stack().end();
-                    ++whenIter
-                )
-            {
-                ++depth;
-                indent(depth);
-                *output_ << "When : " << *whenIter << "\n";
+    // Wait for a child process to finish. Returns a description of the problem if it didn't exit successfully.
+    inline optional<string> waitForProcess(ProcessId child) {
+        #ifdef __linux__
+            int status = 0;
+
+            while (::waitpid(child, &status, 0) < 0) {
+                if (errno != EINTR) {
+                    throwSystemError("waitpid");
+                }
             }
 
-            whenWrittenDepth_ = when.stack().size();
-        }
+            if (WIFSIGNALED(status)) {
+                auto signal = WTERMSIG(status);
 
-        void printVariables(const vector <Variable> &variableList) {
-            for (const auto& variable : variableList) {
-                indent(whenDepth() + 2);
-                (*output_) << variable.name() << " = " << variable.value()
-                           << ": file \"" << variable.file() << "\", line " << variable.line() << ".\n";
+                return optional<string>("was killed by signal " + to_string(signal) + " (" + strsignal(signal) + ")");
             }
-        }
 
-        void indent(size_t indent) {
-            while (indent > 0) {
-                *output_ << "    ";
-                --indent;
+            if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+                return optional<string>("exited with status " + to_string(WEXITSTATUS(status)));
             }
-        }
+        #else
+            throwUnsupported();
+        #endif
 
-        size_t whenDepth() const {
-            static constexpr const size_t minDepth = 1;
+        return none;
+    }
+}}}}
 
-            return max(minDepth, whenDepth_);
+namespace Enhedron { namespace Test {
+    using Impl::Impl_Process::processesSupported;
+}}
+// File: Enhedron/Test/OutputBuffer.h
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+
+
+#include <string>
+#include <memory>
+#include <ostream>
+#include <iostream>
+#include <type_traits>
+#include <cstring>
+#include <cerrno>
+
+#ifdef __linux__
+    #include <unistd.h>
+    #include <sys/uio.h>
+#endif
+
+namespace Enhedron { namespace Test { namespace Impl { namespace Impl_OutputBuffer {
+    using std::string;
+    using std::ostream;
+    using std::cout;
+    using std::strlen;
+    using std::memcpy;
+    using std::unique_ptr;
+    using std::enable_if_t;
+    using std::is_integral;
+    using std::is_same;
+    using std::make_unsigned_t;
+    using std::streamsize;
+
+    using Impl_Process::throwSystemError;
+
+    // Text for reporters, collected in one large buffer and written out in big chunks, so each piece of output
+    // costs a copy rather than a call into a stream. Output is only written when the owner calls flush, or the
+    // buffer fills up. If the stream is cout, we write to the file descriptor on Linux, with the buffer and any
+    // large piece of text in one writev.
+    class OutputBuffer final: public NoCopy {
+        static constexpr const size_t defaultCapacity = 64 * 1024;
+        static constexpr const size_t indentSize = 4;
+
+        Out<ostream> output_;
+        int fd_ = -1;
+        unique_ptr<char[]> buffer_;
+        size_t capacity_;
+        size_t size_ = 0;
+
+        static const string& spaces() {
+            static const string theSpaces(indentSize * 32, ' ');
+
+            return theSpaces;
         }
-    public:
-        HumanResults(Out<ostream> output, Verbosity verbosity) :
-            output_(output), verbosity_(verbosity)
-        {}
 
-        virtual void finish(const Stats& stats) override {
-            if (verbosity_ >= Verbosity::SUMMARY) {
-                bool failed = false;
+        // Write the buffer, then data, and empty the buffer.
+        void writeOut(const char* data, size_t size) {
+            #ifdef __linux__
+                if (fd_ >= 0) {
+                    // Anything else written to cout has to go first.
+                    output_->flush();
 
-                if (stats.failedTests() > 0) {
-                    *output_ << "FAILED TESTS: " << stats.failedTests() << "\n";
-                    failed = true;
-                }
+                    iovec ioList[2] = {
+                        {buffer_.get(), size_},
+                        {const_cast<char*>(data), size}
+                    };
 
-                if (stats.failedChecks() > 0) {
-                    *output_ << "FAILED CHECKS: " << stats.failedChecks() << "\n";
-                    failed = true;
-                }
+                    iovec* io = ioList;
+                    int ioCount = 2;
 
-                *output_ << "Totals: " <<
-                stats.tests() << " tests, " <<
-                stats.checks() << " checks, " <<
-                stats.fixtures() << " fixtures\n";
+                    while (ioCount > 0) {
+                        auto result = ::writev(fd_, io, ioCount);
 
-                if (failed) {
-                    *output_ << "SOME TESTS FAILED!\n";
+                        if (result < 0) {
+                            if (errno == EINTR) {
+                                continue;
+                            }
+
+                            size_ = 0;
+                            throwSystemError("writev");
+                        }
+
+                        auto written = static_cast<size_t>(result);
+
+                        while (ioCount > 0 && written >= io->iov_len) {
+                            written -= io->iov_len;
+                            ++io;
+                            --ioCount;
+                        }
+
+                        if (ioCount > 0) {
+                            io->iov_base = static_cast<char*>(io->iov_base) + written;
+                            io->iov_len -= written;
+                        }
+                    }
+
+                    size_ = 0;
+
+                    return;
                 }
-            }
-        }
+            #endif
 
-        virtual void beginContext(const NameStack& contextStack, const string& name) override {
-            setMaxWrittenState(WrittenState::NONE);
+            output_->write(buffer_.get(), static_cast<streamsize>(size_));
+            output_->write(data, static_cast<streamsize>(size));
+            output_->flush();
+            size_ = 0;
         }
-
-        virtual void endContext(const Stats& stats, const NameStack& context, const string& name) override {
-            setMaxWrittenState(WrittenState::NONE);
+    public:
+        explicit OutputBuffer(Out<ostream> output, size_t capacity = defaultCapacity) :
+            output_(output), buffer_(new char[capacity]), capacity_(capacity)
+        {
+            #ifdef __linux__
+                if (&*output_ == &cout) {
+                    fd_ = STDOUT_FILENO;
+                }
+            #endif
         }
 
-        virtual void beginGiven(const NameStack& context, const string& given) override {
-            setMaxWrittenState(WrittenState::GIVEN);
-
-            if (verbosity_ >= Verbosity::CONTEXTS) {
-                writeContext(context);
+        ~OutputBuffer() {
+            try {
+                flush();
             }
-
-            if (verbosity_ >= Verbosity::FIXTURES) {
-                writeGiven(context, given);
+            catch (...) {
             }
         }
 
-        virtual void endGiven(const Stats& stats, const NameStack& context, const string& given) override {
-            setMaxWrittenState(WrittenState::CONTEXT);
+        void flush() {
+            if (size_ > 0) {
+                writeOut(nullptr, 0);
+            }
         }
 
-        virtual void beginWhen(const NameStack& context,
-                               const string& given,
-                               const NameStack& whenStack,
-                               const string& when) override {
-            ++whenDepth_;
+        void write(const char* data, size_t size) {
+            if (size_ + size > capacity_) {
+                if (size >= capacity_ / 2) {
+                    writeOut(data, size);
+                    return;
+                }
 
-            if (verbosity_ >= Verbosity::FIXTURES) {
-                writeGiven(context, given);
+                flush();
             }
 
-            if (verbosity_ >= Verbosity::SECTIONS) {
-                indent(whenDepth());
-                *output_ << "When : " << when << "\n";
-                whenWrittenDepth_ = whenDepth_;
-            }
+            memcpy(buffer_.get() + size_, data, size);
+            size_ += size;
         }
 
-        virtual void endWhen(const Stats& stats,
-                             const NameStack& context,
-                             const string& given,
-                             const NameStack& whenStack,
-                             const string& when) override {
-            --whenDepth_;
-            whenWrittenDepth_ = min(whenDepth_, whenWrittenDepth_);
-
-            if (whenDepth_ == 0 && verbosity_ >= Verbosity::CHECKS) {
-                *output_ << "\n";
-            }
+        void indent(size_t levels) {
+            auto size = levels * indentSize;
 
-            if (whenDepth_ == 0) {
-                setMaxWrittenState(WrittenState::CONTEXT);
-            }
-            else {
-                setMaxWrittenState(WrittenState::GIVEN);
+            while (size > 0) {
+                auto chunk = size < spaces().size() ? size : spaces().size();
+                write(spaces().data(), chunk);
+                size -= chunk;
             }
         }
 
-        virtual bool notifyPassing() const override { return verbosity_ >= Verbosity::CHECKS; }
+        OutputBuffer& operator<<(const string& text) {
+            write(text.data(), text.size());
 
-        virtual void fail(const NameStack& context,
-                          const string& given,
-                          const NameStack& whenStack,
-                          optional<string> description,
-                          const string &expressionText,
-                          const vector <Variable> &variableList) override
-        {
-            writeWhenStack(context, given, whenStack);
-            indent(whenDepth());
-            (*output_) << "Then : ";
+            return *this;
+        }
 
-            if (description) {
-                *output_ << *description << "\n";
-                indent(whenDepth() + 1);
-            }
+        OutputBuffer& operator<<(const char* text) {
+            write(text, strlen(text));
 
-            *output_ << "FAILED! " << expressionText << "\n";
-            printVariables(variableList);
+            return *this;
         }
 
-        virtual void pass(const NameStack& context,
-                          const string& given,
-                          const NameStack& whenStack,
-                          optional <string> description,
-                          const string &expressionText,
-                          const vector <Variable> &variableList) override
-        {
-            indent(whenDepth());
-            (*output_) << "Then : ";
+        OutputBuffer& operator<<(char character) {
+            write(&character, 1);
 
-            if (description) {
-                (*output_) << *description << "\n";
-            }
+            return *this;
+        }
 
-            if (verbosity_ >= Verbosity::CHECKS_EXPRESSION || ! description) {
-                if (description) {
-                    indent(whenDepth() + 1);
-                }
+        template<typename Integer>
+        enable_if_t<is_integral<Integer>::value && ! is_same<Integer, bool>::value && ! is_same<Integer, char>::value,
+                    OutputBuffer&>
+        operator<<(Integer value) {
+            using Unsigned = make_unsigned_t<Integer>;
 
-                (*output_) << expressionText;
-            }
+            char digits[24];
+            char* end = digits + sizeof(digits);
+            char* begin = end;
+            bool negative = value < 0;
+            auto magnitude = negative ? Unsigned(0) - static_cast<Unsigned>(value) : static_cast<Unsigned>(value);
 
-            (*output_) << "\n";
+            do {
+                *--begin = static_cast<char>('0' + magnitude % 10);
+                magnitude /= 10;
+            } while (magnitude != 0);
 
-            if (verbosity_ >= Verbosity::VARIABLES) {
-                printVariables(variableList);
+            if (negative) {
+                *--begin = '-';
             }
-        }
 
-        virtual void failByException(const NameStack& context,
-                                     const string& given,
-                                     const NameStack& whenStack,
-                                     const exception& e) override {
-            indent(whenDepth());
-            (*output_) << "TEST FAILED WITH EXCEPTION: " << e.what() << endl;
+            write(begin, static_cast<size_t>(end - begin));
+
+            return *this;
         }
     };
 }}}}
-
-namespace Enhedron { namespace Test {
-    using Impl::Impl_Results::NameStack;
-    using Impl::Impl_Results::Results;
-    using Impl::Impl_Results::HumanResults;
-    using Impl::Impl_Results::Stats;
-    using Impl::Impl_Results::Verbosity;
-}}
-// File: Enhedron/Test/Suite.h
+// File: Enhedron/Test/TestIndex.h
 //
 //          Copyright Simon Bourne 2015.
 // Distributed under the Boost Software License, Version 1.0.
@@ -1788,643 +2127,6635 @@ namespace Enhedron { namespace Test {
 
 
 
-
-#include <functional>
-#include <algorithm>
-#include <memory>
 #include <string>
-#include <utility>
 #include <vector>
-#include <stdexcept>
-#include <tuple>
-#include <iostream>
-#include <regex>
+#include <deque>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
 
-namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Suite {
-    using namespace Assertion;
+#ifdef __linux__
+    #include <pthread.h>
+#endif
 
-    using Util::TaggedValue;
-    using Util::StoreArgs;
-    using Util::DecayArrayAndFunction_t;
-    using Util::bindFirst;
+namespace Enhedron { namespace Test { namespace Impl { namespace Impl_TestIndex {
+    using std::string;
+    using std::vector;
+    using std::deque;
+    using std::unordered_map;
+    using std::mutex;
+    using std::lock_guard;
 
     using Util::optional;
     using Util::none;
 
-    using std::forward;
-    using std::vector;
-    using std::move;
-    using std::exception;
-    using std::function;
-    using std::string;
-    using std::unique_ptr;
-    using std::shared_ptr;
-    using std::make_unique;
-    using std::tuple;
-    using std::index_sequence;
-    using std::index_sequence_for;
-    using std::get;
-    using std::remove_reference;
-    using std::bind;
-    using std::ref;
-    using std::runtime_error;
-    using std::cout;
-    using std::regex;
-    using std::regex_match;
-    using std::reference_wrapper;
-    using std::min;
+    using NodeId = uint32_t;
+
+    // The parent of every top level context. It has no name.
+    static constexpr const NodeId rootNode = 0;
+
+    // Every context, given and path through the whens that's been seen in this process, numbered in the order
+    // they were first seen. Contexts and givens are added when they're registered, so their ids are the same in
+    // every run of the same executable. Whens are added as they're discovered. A node is identified by its parent
+    // and name, so two siblings with the same name share a node, as they share a test path.
+    //
+    // Ids are only meaningful in the process that made them. Results sent from another process are by name, and
+    // get ids when they're replayed here.
+    class TestIndex;
+    TestIndex& testIndex();
+
+    class TestIndex final: public NoCopyMove {
+        struct Node final {
+            NodeId parent;
+            string name;
+            unordered_map<string, NodeId> children;
+        };
 
-    using PathList = vector<shared_ptr<vector<regex>>>;
+        // A plain mutex, as it's safe to unlock in a forked child. NameStack caches nodes, so it's rarely contended.
+        mutable mutex mutex_;
 
-    class ContextResultsRecorder final : public NoCopy {
-        Out<Results> results_;
-        NameStack contextStack_;
+        // A deque, so names stay where they are as nodes are added.
+        deque<Node> nodes_;
+
+        // A child process has one thread, so if another thread held the lock when we forked, it would never be
+        // released. Hold it ourselves across fork instead. Only testIndex() registers these, as they lock its index.
+        static void lockForFork();
+        static void unlockAfterFork();
+
+        friend TestIndex& testIndex();
     public:
-        ContextResultsRecorder(Out<Results> results) : results_(results) {
+        TestIndex() {
+            nodes_.push_back(Node{rootNode, "", {}});
         }
 
-        const NameStack& contextStack() const { return contextStack_; }
+        // Returns the id of parent's child called name, adding it if it's new.
+        NodeId child(NodeId parent, const string& name) {
+            lock_guard<mutex> lock(mutex_);
+            auto inserted = nodes_[parent].children.emplace(name, static_cast<NodeId>(nodes_.size()));
 
-        void push(string name) {
-            results_->beginContext(contextStack_, name);
-            contextStack_.push(move(name));
-        }
+            if (inserted.second) {
+                nodes_.push_back(Node{parent, name, {}});
+            }
 
-        void pop(const Stats& stats) {
-            auto name = contextStack_.stack().back();
-            results_->endContext(stats, contextStack_, name);
-            contextStack_.pop();
+            return inserted.first->second;
         }
 
-        void beginGiven(const string& name) { results_->beginGiven(contextStack_, name); }
+        optional<NodeId> find(NodeId parent, const string& name) const {
+            lock_guard<mutex> lock(mutex_);
+            const auto& children = nodes_[parent].children;
+            auto found = children.find(name);
 
-        void endGiven(const Stats& stats, const string& name) { results_->endGiven(stats, contextStack_, name); }
+            if (found == children.end()) {
+                return none;
+            }
 
-        void beginWhen(const string& given, const NameStack& whenStack, const string& name) {
-            results_->beginWhen(contextStack_, given, whenStack, name);
-        }
-        void endWhen(const Stats& stats, const string& given, const NameStack& whenStack, const string& name) {
-            results_->endWhen(stats, contextStack_, given, whenStack, name);
+            return found->second;
         }
 
-        void failByException(const string& given, const NameStack& whenStack, const exception& e) {
-            results_->failByException(contextStack_, given, whenStack, e);
+        NodeId parent(NodeId node) const {
+            lock_guard<mutex> lock(mutex_);
+
+            return nodes_[node].parent;
         }
 
-        virtual bool notifyPassing() const { return results_->notifyPassing(); }
+        // Names don't change once they're added, so the reference stays valid.
+        const string& name(NodeId node) const {
+            lock_guard<mutex> lock(mutex_);
 
-        virtual void fail(const string& given,
-                          const NameStack& whenStack,
-                          optional<string> description,
-                          const string &expressionText,
-                          const vector <Variable> &variableList) {
-            return results_->fail(contextStack_, given, whenStack, description, expressionText, variableList);
+            return nodes_[node].name;
         }
 
-        virtual void pass(const string& given,
-                          const NameStack& whenStack,
-                          optional<string> description,
-                          const string &expressionText,
-                          const vector <Variable> &variableList) {
-            return results_->pass(contextStack_, given, whenStack, description, expressionText, variableList);
-        }
-    };
+        // The names from the top level context down to node.
+        vector<string> path(NodeId node) const {
+            lock_guard<mutex> lock(mutex_);
+            vector<string> names;
 
-    class WhenResultRecorder final: public FailureHandler {
-        Out<ContextResultsRecorder> results_;
-        string given_;
-        NameStack whenStack_;
-    public:
-        WhenResultRecorder(Out<ContextResultsRecorder> results, string given) :
-                results_(results), given_(move(given)) {}
+            for (; node != rootNode; node = nodes_[node].parent) {
+                names.push_back(nodes_[node].name);
+            }
 
-        void push(string name) {
-            results_->beginWhen(given_, whenStack_, name);
-            whenStack_.push(move(name));
+            return vector<string>(names.rbegin(), names.rend());
         }
 
-        void pop(const Stats& stats) {
-            string name = whenStack_.stack().back();
-            whenStack_.pop();
-            results_->endWhen(stats, given_, whenStack_, name);
-        }
+        // The path, with names separated by "/", as givenPath writes them.
+        string pathName(NodeId node) const {
+            auto names = path(node);
+            string name;
 
-        void failByException(const exception& e) {
-            results_->failByException(given_, whenStack_, e);
-        }
+            for (size_t index = 0; index < names.size(); ++index) {
+                if (index > 0) {
+                    name += "/";
+                }
 
-        virtual bool notifyPassing() const override { return results_->notifyPassing(); }
+                name += names[index];
+            }
 
-        virtual void fail(optional<string> description, const string &expressionText, const vector <Variable> &variableList) override {
-            return results_->fail(given_, whenStack_, description, expressionText, variableList);
+            return name;
         }
 
-        virtual void pass(optional<string> description, const string &expressionText, const vector <Variable> &variableList) override {
-            return results_->pass(given_, whenStack_, description, expressionText, variableList);
-        }
+        size_t size() const {
+            lock_guard<mutex> lock(mutex_);
 
+            return nodes_.size();
+        }
     };
 
-    class Context: public NoCopy {
-    public:
-        virtual ~Context() {}
+    // The index for this process.
+    inline TestIndex& testIndex() {
+        static TestIndex instance;
 
-        virtual void list(const PathList& pathList, Out<ContextResultsRecorder> results, size_t depth) const = 0;
-        virtual Stats run(const PathList& pathList, Out<ContextResultsRecorder> resultStack, size_t depth) = 0;
-    };
+        #ifdef __linux__
+            static const int forkHandlers =
+                ::pthread_atfork(TestIndex::lockForFork, TestIndex::unlockAfterFork, TestIndex::unlockAfterFork);
+            static_cast<void>(forkHandlers);
+        #endif
 
-    using ContextList = vector<unique_ptr<Context>>;
+        return instance;
+    }
 
-    class Register final: public NoCopyMove {
+    inline void TestIndex::lockForFork() {
+        testIndex().mutex_.lock();
+    }
+
+    inline void TestIndex::unlockAfterFork() {
+        testIndex().mutex_.unlock();
+    }
+}}}}
+
+namespace Enhedron { namespace Test {
+    using Impl::Impl_TestIndex::NodeId;
+    using Impl::Impl_TestIndex::rootNode;
+    using Impl::Impl_TestIndex::TestIndex;
+    using Impl::Impl_TestIndex::testIndex;
+}}
+// File: Enhedron/Test/Measurement.h
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Measurement {
+    using std::string;
+    using std::vector;
+    using std::move;
+    using std::sort;
+    using std::sqrt;
+
+    // The time per iteration of a benchmark, from several samples. Each sample times the same number of iterations,
+    // and is stored as nanoseconds per iteration, in the order they were taken.
+    class Measurement final {
+        string name_;
+        uint64_t iterations_ = 0;
+        vector<double> samples_;
+        double mean_ = 0;
+        double median_ = 0;
+        double standardDeviation_ = 0;
+        double minimum_ = 0;
+        double maximum_ = 0;
     public:
-        static void add(unique_ptr<Context> context) {
-            instance().contextList.emplace_back(move(context));
-        }
+        Measurement() = default;
 
-        static void list(const PathList& pathList, Out<Results> results) {
-            ContextResultsRecorder resultsRecorder(results);
+        Measurement(string name, uint64_t iterations, vector<double> samples) :
+            name_(move(name)), iterations_(iterations), samples_(move(samples))
+        {
+            if (samples_.empty()) return;
 
-            for (const auto& context : instance().contextList) {
-                context->list(pathList, out(resultsRecorder), 0);
+            double total = 0;
+
+            for (auto sample : samples_) {
+                total += sample;
             }
-        }
 
-        static Stats run(const PathList& pathList, Out<Results> results) {
-            Stats stats;
+            mean_ = total / samples_.size();
 
-            ContextResultsRecorder resultsRecorder(results);
+            vector<double> sorted(samples_);
+            sort(sorted.begin(), sorted.end());
+            auto middle = sorted.size() / 2;
+            median_ = sorted.size() % 2 == 0 ? (sorted[middle - 1] + sorted[middle]) / 2 : sorted[middle];
+            minimum_ = sorted.front();
+            maximum_ = sorted.back();
 
-            for (const auto& context : instance().contextList) {
-                stats += context->run(pathList, out(resultsRecorder), 0);
+            if (samples_.size() > 1) {
+                double squares = 0;
+
+                for (auto sample : samples_) {
+                    squares += (sample - mean_) * (sample - mean_);
+                }
+
+                standardDeviation_ = sqrt(squares / (samples_.size() - 1));
             }
+        }
 
-            results->finish(stats);
-            return stats;
+        const string& name() const { return name_; }
+
+        // Iterations in each sample.
+        uint64_t iterations() const { return iterations_; }
+
+        const vector<double>& samples() const { return samples_; }
+
+        // Nanoseconds per iteration.
+        double mean() const { return mean_; }
+        double median() const { return median_; }
+        double standardDeviation() const { return standardDeviation_; }
+        double minimum() const { return minimum_; }
+        double maximum() const { return maximum_; }
+    };
+}}}}
+
+namespace Enhedron { namespace Test {
+    using Impl::Impl_Measurement::Measurement;
+}}
+// File: Enhedron/Test/Results.h
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+
+
+#include <memory>
+#include <string>
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <sstream>
+#include <iomanip>
+#include <deque>
+#include <cstring>
+#include <cstdint>
+
+namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Results {
+    using std::exception;
+    using std::string;
+    using std::unique_ptr;
+    using std::make_unique;
+    using std::ostream;
+    using std::vector;
+    using std::move;
+    using std::min;
+    using std::max;
+    using std::partial_sort;
+    using std::unordered_map;
+    using std::ostringstream;
+    using std::fixed;
+    using std::setprecision;
+    using std::deque;
+    using std::strlen;
+    using std::memcmp;
+
+    using Assertion::FailureHandler;
+    using Assertion::Variable;
+    using Util::optional;
+
+    using Impl_OutputBuffer::OutputBuffer;
+    using Impl_TestIndex::NodeId;
+    using Impl_TestIndex::rootNode;
+    using Impl_TestIndex::testIndex;
+    using Impl_Measurement::Measurement;
+
+    class Stats {
+        uint64_t fixtures_ = 0;
+        uint64_t tests_ = 0;
+        uint64_t checks_ = 0;
+        uint64_t failedTests_ = 0;
+        uint64_t failedChecks_ = 0;
+        uint64_t wallTime_ = 0;
+        uint64_t cpuTime_ = 0;
+    public:
+        Stats() = default;
+
+        Stats(
+                uint64_t fixtures,
+                uint64_t tests,
+                uint64_t checks,
+                uint64_t failedTests,
+                uint64_t failedChecks,
+                uint64_t wallTime = 0,
+                uint64_t cpuTime = 0
+            ) :
+            fixtures_(fixtures),
+            tests_(tests),
+            checks_(checks),
+            failedTests_(failedTests),
+            failedChecks_(failedChecks),
+            wallTime_(wallTime),
+            cpuTime_(cpuTime)
+        {}
+
+        Stats& operator+=(Stats rhs) {
+            fixtures_ += rhs.fixtures_;
+            tests_ += rhs.tests_;
+            checks_ += rhs.checks_;
+            failedTests_ += rhs.failedTests_;
+            failedChecks_ += rhs.failedChecks_;
+            wallTime_ += rhs.wallTime_;
+            cpuTime_ += rhs.cpuTime_;
+            return *this;
         }
-    private:
-        Register() = default;
 
-        static Register& instance() {
-            static Register theInstance;
+        void addFixture() { ++fixtures_; }
+        void addTest() { ++tests_; }
+        void addCheck() { ++checks_; }
 
-            return theInstance;
+        void failTest() { ++failedTests_; }
+        void failCheck() { ++failedChecks_; }
+
+        // Times are in nanoseconds. When stats are added together, so are the times, so a context's time is the
+        // total time spent running its givens, even if they ran at the same time on different threads.
+        void addTime(uint64_t wallTime, uint64_t cpuTime) {
+            wallTime_ += wallTime;
+            cpuTime_ += cpuTime;
         }
 
-        ContextList contextList;
+        uint64_t fixtures() const { return fixtures_; }
+        uint64_t tests() const { return tests_; }
+        uint64_t checks() const { return checks_; }
+        uint64_t failedTests() const { return failedTests_; }
+        uint64_t failedChecks() const { return failedChecks_; }
+        uint64_t wallTime() const { return wallTime_; }
+        uint64_t cpuTime() const { return cpuTime_; }
     };
 
-    class NodeContext final: public Context {
+    // A name that belongs to someone else, so it can be looked up without copying it into a string.
+    class NameRef final {
+        const char* data_;
+        size_t size_;
     public:
-        NodeContext(const string& name, vector<unique_ptr<Context>> contextList) :
-            name(name),
-            contextList(move(contextList))
-        {}
+        NameRef(const char* name) : data_(name), size_(strlen(name)) {}
+        NameRef(const string& name) : data_(name.data()), size_(name.size()) {}
 
-        virtual void list(const PathList& pathList, Out<ContextResultsRecorder> results, size_t depth) const override {
-            auto nextPathList = getMatchingPaths(pathList, depth);
-            results->push(name);
+        const char* data() const { return data_; }
+        size_t size() const { return size_; }
 
-            if (nextPathList) {
-                for (const auto& context : contextList) {
-                    context->list(*nextPathList, results, depth + 1);
-                }
+        string str() const { return string(data_, size_); }
+
+        bool operator==(const string& rhs) const {
+            return size_ == rhs.size() && memcmp(data_, rhs.data(), size_) == 0;
+        }
+    };
+
+    // Each distinct name is stored once, and given an id that stays the same for the life of the table. Looking up
+    // a name that's already there doesn't allocate. Ids are kept in an open addressing hash table, with linear
+    // probing.
+    class NameTable final: public NoCopy {
+        static constexpr const size_t initialSlots = 16;
+
+        deque<string> names_;
+
+        // Each slot is an id plus one, or 0 if it's empty. The size is a power of 2.
+        vector<size_t> slots_;
+
+        static size_t hash(NameRef name) {
+            // FNV-1a
+            uint64_t value = 14695981039346656037u;
+
+            for (size_t index = 0; index < name.size(); ++index) {
+                value ^= static_cast<unsigned char>(name.data()[index]);
+                value *= 1099511628211u;
             }
 
-            Stats stats;
-            results->pop(stats); // TODO
+            return static_cast<size_t>(value);
         }
 
-        virtual Stats run(const PathList& pathList, Out<ContextResultsRecorder> results, size_t depth) override {
-            Stats stats;
-            auto nextPathList = getMatchingPaths(pathList, depth);
-            results->push(name);
+        size_t& findSlot(NameRef name) {
+            auto mask = slots_.size() - 1;
 
-            if (nextPathList) {
-                for (const auto& context : contextList) {
-                    stats += context->run(*nextPathList, results, depth + 1);
+            for (auto slot = hash(name) & mask; ; slot = (slot + 1) & mask) {
+                if (slots_[slot] == 0 || name == names_[slots_[slot] - 1]) {
+                    return slots_[slot];
                 }
             }
+        }
 
-            results->pop(stats);
+        // Keep the table at most half full.
+        void grow() {
+            vector<size_t> oldSlots(slots_.size() * 2, 0);
+            oldSlots.swap(slots_);
 
-            return stats;
+            for (auto id : oldSlots) {
+                if (id != 0) {
+                    findSlot(names_[id - 1]) = id;
+                }
+            }
         }
-    private:
-        optional<PathList> getMatchingPaths(const PathList& pathList, size_t depth) const {
-            if (pathList.empty()) {
-                return pathList;
+    public:
+        NameTable() : slots_(initialSlots, 0) {}
+
+        size_t intern(NameRef name) {
+            auto& slot = findSlot(name);
+
+            if (slot != 0) {
+                return slot - 1;
             }
 
-            vector<shared_ptr<vector<regex>>> nextPathList;
+            names_.emplace_back(name.data(), name.size());
+            slot = names_.size();
 
-            for (const auto& path : pathList) {
-                if (path->size() > depth) {
-                    if (regex_match(name, (*path)[depth])) {
-                        nextPathList.push_back(path);
-                    }
+            if (names_.size() * 2 > slots_.size()) {
+                grow();
+            }
+
+            return names_.size() - 1;
+        }
+
+        const string& name(size_t id) const { return names_[id]; }
+
+        size_t size() const { return names_.size(); }
+    };
+
+    // The names of the contexts or whens we're in, outermost first, with their nodes in the TestIndex. Names are
+    // interned in a table that belongs to the stack, so once a name has been seen, pushing and popping it doesn't
+    // allocate, and references to it stay valid after it's popped. Node ids are cached too, so they only need the
+    // TestIndex the first time a name is pushed onto a node.
+    //
+    // A context stack starts at rootNode. A when stack starts at its given's node. The caches aren't thread safe,
+    // so a stack must only be used by one thread at a time, as Results calls are.
+    class NameStack final: public NoCopy {
+        mutable NameTable table_;
+        vector<size_t> stack_;
+        vector<NodeId> nodes_;
+        NodeId base_;
+
+        // Child node ids, by parent node id in the high half, and name id in the low half.
+        mutable unordered_map<uint64_t, NodeId> children_;
+    public:
+        // A view of the names on a stack.
+        class Names final {
+            const NameTable* table_;
+            const vector<size_t>* ids_;
+        public:
+            class Iterator final {
+                const NameTable* table_;
+                vector<size_t>::const_iterator id_;
+            public:
+                Iterator(const NameTable* table, vector<size_t>::const_iterator id) : table_(table), id_(id) {}
+
+                const string& operator*() const { return table_->name(*id_); }
+                const string* operator->() const { return &table_->name(*id_); }
+
+                Iterator& operator++() {
+                    ++id_;
+                    return *this;
                 }
-                else {
-                    return pathList;
+
+                Iterator operator+(size_t offset) const {
+                    return Iterator(table_, id_ + static_cast<vector<size_t>::difference_type>(offset));
+                }
+
+                bool operator==(const Iterator& rhs) const { return id_ == rhs.id_; }
+                bool operator!=(const Iterator& rhs) const { return id_ != rhs.id_; }
+            };
+
+            Names(const NameTable& table, const vector<size_t>& ids) : table_(&table), ids_(&ids) {}
+
+            Iterator begin() const { return Iterator(table_, ids_->begin()); }
+            Iterator end() const { return Iterator(table_, ids_->end()); }
+
+            size_t size() const { return ids_->size(); }
+            bool empty() const { return ids_->empty(); }
+
+            const string& operator[](size_t index) const { return table_->name((*ids_)[index]); }
+            const string& front() const { return table_->name(ids_->front()); }
+            const string& back() const { return table_->name(ids_->back()); }
+        };
+
+        explicit NameStack(NodeId base = rootNode) : base_(base) {}
+
+        Names stack() const { return Names(table_, stack_); }
+
+        // The id of each name in the stack's table, outermost first. They're only meaningful for this stack.
+        const vector<size_t>& nameIds() const { return stack_; }
+
+        // The node of each name, outermost first.
+        const vector<NodeId>& nodes() const { return nodes_; }
+
+        // The node of the innermost name, or the base if the stack is empty.
+        NodeId node() const { return nodes_.empty() ? base_ : nodes_.back(); }
+
+        // Only while the stack is empty.
+        void setBase(NodeId base) {
+            Assert(VAR(stack_.empty()));
+            base_ = base;
+        }
+
+        // Intern a name without pushing it, for a reference that stays valid.
+        const string& intern(NameRef name) {
+            return table_.name(table_.intern(name));
+        }
+
+        // The node for name, if it were pushed.
+        NodeId child(NameRef name) const {
+            auto nameId = table_.intern(name);
+            auto key = (static_cast<uint64_t>(node()) << 32) | nameId;
+            auto found = children_.find(key);
+
+            if (found != children_.end()) {
+                return found->second;
+            }
+
+            auto childNode = testIndex().child(node(), table_.name(nameId));
+            children_.emplace(key, childNode);
+
+            return childNode;
+        }
+
+        void push(NameRef name) {
+            auto childNode = child(name);
+            stack_.push_back(table_.intern(name));
+            nodes_.push_back(childNode);
+        }
+
+        void pop() {
+            Assert( ! VAR(stack_.empty()));
+            stack_.pop_back();
+            nodes_.pop_back();
+        }
+
+        const string& top() const {
+            Assert( ! VAR(stack_.empty()));
+            return table_.name(stack_.back());
+        }
+    };
+
+    struct Results: public NoCopy {
+        virtual ~Results() {}
+
+        virtual void finish(const Stats& stats) = 0;
+
+        virtual void beginContext(const NameStack& contextStack, const string& name) = 0;
+        virtual void endContext(const Stats& stats, const NameStack& contextStack, const string& name) = 0;
+
+        virtual void beginGiven(const NameStack& context, const string& given) = 0;
+        virtual void endGiven(const Stats& stats, const NameStack& context, const string& given) = 0;
+
+        virtual void beginWhen(const NameStack& context,
+                               const string& given,
+                               const NameStack& whenStack,
+                               const string& when) = 0;
+        virtual void endWhen(const Stats& stats,
+                             const NameStack& context,
+                             const string& given,
+                             const NameStack& whenStack,
+                             const string& when) = 0;
+
+        virtual bool notifyPassing() const = 0;
+
+        virtual void fail(const NameStack& context,
+                          const string& given,
+                          const NameStack& whenStack,
+                          optional<string> description,
+                          const string &expressionText,
+                          const vector <Variable> &variableList) = 0;
+
+        virtual void pass(const NameStack& context,
+                          const string& given,
+                          const NameStack& whenStack,
+                          optional <string> description,
+                          const string &expressionText,
+                          const vector <Variable> &variableList) = 0;
+
+        virtual void failByException(const NameStack& context,
+                                     const string& given,
+                                     const NameStack& whenStack,
+                                     const exception& e) = 0;
+
+        // A benchmark has been timed. Only Results that report timings need to do anything with it.
+        virtual void measured(const NameStack& context,
+                              const string& given,
+                              const NameStack& whenStack,
+                              const Measurement& measurement) {}
+    };
+
+    // Nanoseconds, in whichever unit suits them best.
+    inline string formatNanoseconds(double nanoseconds) {
+        static constexpr const char* units[] = {"ns", "us", "ms", "s"};
+        size_t unit = 0;
+
+        while (unit < 3 && nanoseconds >= 1000) {
+            nanoseconds /= 1000;
+            ++unit;
+        }
+
+        ostringstream text;
+        text << fixed << setprecision(3) << nanoseconds << " " << units[unit];
+
+        return text.str();
+    }
+
+    enum class Verbosity {
+        SILENT,
+        SUMMARY,
+        CONTEXTS,
+        FIXTURES,
+        SECTIONS,
+        EXHAUSTIVE_SECTIONS,
+        CHECKS,
+        CHECKS_EXPRESSION,
+        VARIABLES
+    };
+
+    enum class WrittenState {
+        NONE,
+        CONTEXT,
+        GIVEN
+    };
+
+    class HumanResults final: public Results {
+        OutputBuffer output_;
+        Verbosity verbosity_;
+        WrittenState writtenState_ = WrittenState::NONE;
+        size_t whenDepth_ = 0;
+        size_t whenWrittenDepth_ = 0;
+
+        void setMaxWrittenState(WrittenState maxState) {
+            if (writtenState_ > maxState) writtenState_ = maxState;
+        }
+
+        bool writeNeeded(WrittenState state) {
+            if (writtenState_ < state) {
+                writtenState_ = state;
+                return true;
+            }
+
+            return false;
+        }
+
+        void writeContext(const NameStack& contextStack) {
+            if (writeNeeded(WrittenState::CONTEXT)) {
+                if ( ! contextStack.stack().empty()) {
+                    output_ << contextStack.stack().front();
+
+                    for (
+                            auto contextIter = contextStack.stack().begin() + 1;
+                            contextIter != contextStack.stack().end();
+                            ++contextIter
+                        )
+                    {
+                        output_ << "/" << *contextIter;
+                    }
+
+                    output_ << "\n";
+                }
+            }
+        }
+
+        void writeGiven(const NameStack& context, const string& given) {
+            writeContext(context);
+
+            if (writeNeeded(WrittenState::GIVEN)) {
+                indent(1);
+                output_ << "Given: " << given << "\n";
+            }
+        }
+
+        void writeWhenStack(const NameStack& context, const string& given, const NameStack& when) {
+            writeGiven(context, given);
+
+            size_t depth = whenWrittenDepth_;
+
+            for (
+                    auto whenIter = when.stack().begin() + whenWrittenDepth_;
+                    whenIter != when.stack().end();
+                    ++whenIter
+                )
+            {
+                ++depth;
+                indent(depth);
+                output_ << "When : " << *whenIter << "\n";
+            }
+
+            whenWrittenDepth_ = when.stack().size();
+        }
+
+        void printVariables(const vector <Variable> &variableList) {
+            for (const auto& variable : variableList) {
+                indent(whenDepth() + 2);
+                output_ << variable.name() << " = " << variable.value()
+                        << ": file \"" << variable.file() << "\", line " << variable.line() << ".\n";
+            }
+        }
+
+        void indent(size_t indent) {
+            output_.indent(indent);
+        }
+
+        size_t whenDepth() const {
+            static constexpr const size_t minDepth = 1;
+
+            return max(minDepth, whenDepth_);
+        }
+    public:
+        HumanResults(Out<ostream> output, Verbosity verbosity) :
+            output_(output), verbosity_(verbosity)
+        {}
+
+        virtual void finish(const Stats& stats) override {
+            if (verbosity_ >= Verbosity::SUMMARY) {
+                bool failed = false;
+
+                if (stats.failedTests() > 0) {
+                    output_ << "FAILED TESTS: " << stats.failedTests() << "\n";
+                    failed = true;
+                }
+
+                if (stats.failedChecks() > 0) {
+                    output_ << "FAILED CHECKS: " << stats.failedChecks() << "\n";
+                    failed = true;
+                }
+
+                output_ << "Totals: " <<
+                stats.tests() << " tests, " <<
+                stats.checks() << " checks, " <<
+                stats.fixtures() << " fixtures\n";
+
+                if (failed) {
+                    output_ << "SOME TESTS FAILED!\n";
+                }
+            }
+
+            output_.flush();
+        }
+
+        virtual void beginContext(const NameStack& contextStack, const string& name) override {
+            setMaxWrittenState(WrittenState::NONE);
+        }
+
+        virtual void endContext(const Stats& stats, const NameStack& context, const string& name) override {
+            setMaxWrittenState(WrittenState::NONE);
+        }
+
+        virtual void beginGiven(const NameStack& context, const string& given) override {
+            setMaxWrittenState(WrittenState::GIVEN);
+
+            if (verbosity_ >= Verbosity::CONTEXTS) {
+                writeContext(context);
+            }
+
+            if (verbosity_ >= Verbosity::FIXTURES) {
+                writeGiven(context, given);
+            }
+        }
+
+        virtual void endGiven(const Stats& stats, const NameStack& context, const string& given) override {
+            setMaxWrittenState(WrittenState::CONTEXT);
+        }
+
+        virtual void beginWhen(const NameStack& context,
+                               const string& given,
+                               const NameStack& whenStack,
+                               const string& when) override {
+            ++whenDepth_;
+
+            if (verbosity_ >= Verbosity::FIXTURES) {
+                writeGiven(context, given);
+            }
+
+            if (verbosity_ >= Verbosity::SECTIONS) {
+                indent(whenDepth());
+                output_ << "When : " << when << "\n";
+                whenWrittenDepth_ = whenDepth_;
+            }
+        }
+
+        virtual void endWhen(const Stats& stats,
+                             const NameStack& context,
+                             const string& given,
+                             const NameStack& whenStack,
+                             const string& when) override {
+            --whenDepth_;
+            whenWrittenDepth_ = min(whenDepth_, whenWrittenDepth_);
+
+            if (whenDepth_ == 0 && verbosity_ >= Verbosity::CHECKS) {
+                output_ << "\n";
+            }
+
+            if (whenDepth_ == 0) {
+                setMaxWrittenState(WrittenState::CONTEXT);
+            }
+            else {
+                setMaxWrittenState(WrittenState::GIVEN);
+            }
+        }
+
+        virtual bool notifyPassing() const override { return verbosity_ >= Verbosity::CHECKS; }
+
+        virtual void fail(const NameStack& context,
+                          const string& given,
+                          const NameStack& whenStack,
+                          optional<string> description,
+                          const string &expressionText,
+                          const vector <Variable> &variableList) override
+        {
+            writeWhenStack(context, given, whenStack);
+            indent(whenDepth());
+            output_ << "Then : ";
+
+            if (description) {
+                output_ << *description << "\n";
+                indent(whenDepth() + 1);
+            }
+
+            output_ << "FAILED! " << expressionText << "\n";
+            printVariables(variableList);
+            output_.flush();
+        }
+
+        virtual void pass(const NameStack& context,
+                          const string& given,
+                          const NameStack& whenStack,
+                          optional <string> description,
+                          const string &expressionText,
+                          const vector <Variable> &variableList) override
+        {
+            indent(whenDepth());
+            output_ << "Then : ";
+
+            if (description) {
+                output_ << *description << "\n";
+            }
+
+            if (verbosity_ >= Verbosity::CHECKS_EXPRESSION || ! description) {
+                if (description) {
+                    indent(whenDepth() + 1);
+                }
+
+                output_ << expressionText;
+            }
+
+            output_ << "\n";
+
+            if (verbosity_ >= Verbosity::VARIABLES) {
+                printVariables(variableList);
+            }
+        }
+
+        virtual void failByException(const NameStack& context,
+                                     const string& given,
+                                     const NameStack& whenStack,
+                                     const exception& e) override {
+            indent(whenDepth());
+            output_ << "TEST FAILED WITH EXCEPTION: " << e.what() << "\n";
+            output_.flush();
+        }
+
+        virtual void measured(const NameStack& context,
+                              const string& given,
+                              const NameStack& whenStack,
+                              const Measurement& measurement) override
+        {
+            if (verbosity_ < Verbosity::SUMMARY) return;
+
+            writeWhenStack(context, given, whenStack);
+            indent(whenDepth());
+            output_ << "Measured: " << measurement.name() << ": mean " << formatNanoseconds(measurement.mean()) <<
+                ", median " << formatNanoseconds(measurement.median()) << ", standard deviation " <<
+                formatNanoseconds(measurement.standardDeviation()) << " (" << measurement.samples().size() <<
+                " samples of " << measurement.iterations() << " iterations)\n";
+        }
+    };
+
+    inline string formatMilliseconds(uint64_t nanoseconds) {
+        ostringstream text;
+        text << fixed << setprecision(3) << static_cast<double>(nanoseconds) / 1e6 << " ms";
+
+        return text.str();
+    }
+
+    // The name of a given, with its contexts, as used in test paths.
+    inline string givenPath(const NameStack& context, const string& given) {
+        string path;
+
+        for (const auto& contextName : context.stack()) {
+            path += contextName + "/";
+        }
+
+        return path + given;
+    }
+
+    // The node of a given, as used to key results by given.
+    inline NodeId givenNode(const NameStack& context, const string& given) {
+        return context.child(given);
+    }
+
+    // The node of a when, from the stack of whens around it, as passed to beginWhen and endWhen.
+    inline NodeId whenNode(const NameStack& whenStack, const string& when) {
+        return whenStack.child(when);
+    }
+
+    // Pass everything on to another Results object. Derived classes override the calls they're interested in.
+    class ForwardingResults: public Results {
+        Out<Results> results_;
+    public:
+        explicit ForwardingResults(Out<Results> results) : results_(results) {}
+
+        virtual void finish(const Stats& stats) override {
+            results_->finish(stats);
+        }
+
+        virtual void beginContext(const NameStack& contextStack, const string& name) override {
+            results_->beginContext(contextStack, name);
+        }
+
+        virtual void endContext(const Stats& stats, const NameStack& context, const string& name) override {
+            results_->endContext(stats, context, name);
+        }
+
+        virtual void beginGiven(const NameStack& context, const string& given) override {
+            results_->beginGiven(context, given);
+        }
+
+        virtual void endGiven(const Stats& stats, const NameStack& context, const string& given) override {
+            results_->endGiven(stats, context, given);
+        }
+
+        virtual void beginWhen(const NameStack& context,
+                               const string& given,
+                               const NameStack& whenStack,
+                               const string& when) override {
+            results_->beginWhen(context, given, whenStack, when);
+        }
+
+        virtual void endWhen(const Stats& stats,
+                             const NameStack& context,
+                             const string& given,
+                             const NameStack& whenStack,
+                             const string& when) override {
+            results_->endWhen(stats, context, given, whenStack, when);
+        }
+
+        virtual bool notifyPassing() const override { return results_->notifyPassing(); }
+
+        virtual void fail(const NameStack& context,
+                          const string& given,
+                          const NameStack& whenStack,
+                          optional<string> description,
+                          const string &expressionText,
+                          const vector <Variable> &variableList) override
+        {
+            results_->fail(context, given, whenStack, move(description), expressionText, variableList);
+        }
+
+        virtual void pass(const NameStack& context,
+                          const string& given,
+                          const NameStack& whenStack,
+                          optional <string> description,
+                          const string &expressionText,
+                          const vector <Variable> &variableList) override
+        {
+            results_->pass(context, given, whenStack, move(description), expressionText, variableList);
+        }
+
+        virtual void failByException(const NameStack& context,
+                                     const string& given,
+                                     const NameStack& whenStack,
+                                     const exception& e) override {
+            results_->failByException(context, given, whenStack, e);
+        }
+
+        virtual void measured(const NameStack& context,
+                              const string& given,
+                              const NameStack& whenStack,
+                              const Measurement& measurement) override {
+            results_->measured(context, given, whenStack, measurement);
+        }
+    };
+
+    // Keep the time taken by each given and when. Once the run has finished, write the slowest ones out, with their
+    // share of the total time. A when that runs once for each of its nested whens is reported once, with the times
+    // added up.
+    class SlowestResults final: public ForwardingResults {
+        struct Timing {
+            NodeId node;
+            uint64_t wallTime;
+            uint64_t cpuTime;
+        };
+
+        Out<ostream> output_;
+        size_t count_;
+        vector<Timing> timingList_;
+        unordered_map<NodeId, size_t> timingIndex_;
+
+        static string percentage(uint64_t part, uint64_t total) {
+            ostringstream text;
+            text << fixed << setprecision(1) << (total == 0 ? 0.0 : 100.0 * part / total) << "%";
+
+            return text.str();
+        }
+
+        void add(NodeId node, const Stats& stats) {
+            auto inserted = timingIndex_.emplace(node, timingList_.size());
+
+            if (inserted.second) {
+                timingList_.push_back(Timing{node, stats.wallTime(), stats.cpuTime()});
+            }
+            else {
+                auto& timing = timingList_[inserted.first->second];
+                timing.wallTime += stats.wallTime();
+                timing.cpuTime += stats.cpuTime();
+            }
+        }
+    public:
+        SlowestResults(Out<Results> results, Out<ostream> output, size_t count) :
+            ForwardingResults(results), output_(output), count_(count)
+        {}
+
+        virtual void finish(const Stats& stats) override {
+            ForwardingResults::finish(stats);
+
+            auto slowestCount = min(count_, timingList_.size());
+
+            partial_sort(
+                    timingList_.begin(),
+                    timingList_.begin() + static_cast<vector<Timing>::difference_type>(slowestCount),
+                    timingList_.end(),
+                    [] (const Timing& lhs, const Timing& rhs) { return lhs.wallTime > rhs.wallTime; }
+                );
+
+            *output_ << "Slowest " << slowestCount << " of " << timingList_.size() << " givens and whens, out of " <<
+                formatMilliseconds(stats.wallTime()) << " wall time and " << formatMilliseconds(stats.cpuTime()) << " CPU time:\n";
+
+            for (size_t index = 0; index < slowestCount; ++index) {
+                const auto& timing = timingList_[index];
+
+                *output_ << "    " << formatMilliseconds(timing.wallTime) << " wall (" <<
+                    percentage(timing.wallTime, stats.wallTime()) << "), " << formatMilliseconds(timing.cpuTime) <<
+                    " CPU (" << percentage(timing.cpuTime, stats.cpuTime()) << "): " << testIndex().pathName(timing.node) <<
+                    "\n";
+            }
+        }
+
+        virtual void endGiven(const Stats& stats, const NameStack& context, const string& given) override {
+            add(givenNode(context, given), stats);
+            ForwardingResults::endGiven(stats, context, given);
+        }
+
+        virtual void endWhen(const Stats& stats,
+                             const NameStack& context,
+                             const string& given,
+                             const NameStack& whenStack,
+                             const string& when) override {
+            add(whenNode(whenStack, when), stats);
+            ForwardingResults::endWhen(stats, context, given, whenStack, when);
+        }
+    };
+}}}}
+
+namespace Enhedron { namespace Test {
+    using Impl::Impl_Results::NameStack;
+    using Impl::Impl_Results::NameRef;
+    using Impl::Impl_Results::givenNode;
+    using Impl::Impl_Results::whenNode;
+    using Impl::Impl_Results::Results;
+    using Impl::Impl_Results::HumanResults;
+    using Impl::Impl_Results::ForwardingResults;
+    using Impl::Impl_Results::SlowestResults;
+    using Impl::Impl_Results::formatNanoseconds;
+    using Impl::Impl_Results::Stats;
+    using Impl::Impl_Results::Verbosity;
+}}
+// File: Enhedron/Test/Events.h
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+
+namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Events {
+    using std::string;
+    using std::vector;
+    using std::move;
+    using std::exception;
+    using std::runtime_error;
+    using std::memcpy;
+    using std::shared_ptr;
+    using std::make_shared;
+
+    using Assertion::Variable;
+    using Util::optional;
+
+    using namespace Impl_Results;
+
+    enum class EventType {
+        BEGIN_CONTEXT,
+        END_CONTEXT,
+        BEGIN_GIVEN,
+        END_GIVEN,
+        BEGIN_WHEN,
+        END_WHEN,
+        PASS,
+        FAIL,
+        FAIL_BY_EXCEPTION,
+        FINISH,
+        MEASURED
+    };
+
+    static constexpr const EventType lastEventType = EventType::MEASURED;
+
+    // A self contained copy of a single call on the Results interface. The context, given and when stacks aren't
+    // stored, as they can be rebuilt from the begin and end events.
+    struct Event final {
+        EventType type;
+
+        // The context, given or when name, the expression text for PASS and FAIL, or the exception message.
+        string name;
+        Stats stats;
+        optional<string> description;
+        vector<Variable> variableList;
+
+        // Only for MEASURED. It's shared, as it doesn't change once it's been measured.
+        shared_ptr<const Measurement> measurement;
+    };
+
+    // Record events so they can be replayed into another Results object later, possibly on another thread.
+    class EventRecorder final: public Results {
+        vector<Event> events_;
+        bool notifyPassing_;
+
+        void add(EventType type, string name, Stats stats = Stats()) {
+            events_.push_back(Event{type, move(name), stats, optional<string>(), vector<Variable>()});
+        }
+    public:
+        explicit EventRecorder(bool notifyPassing) : notifyPassing_(notifyPassing) {}
+
+        const vector<Event>& events() const { return events_; }
+
+        void clear() {
+            events_.clear();
+            events_.shrink_to_fit();
+        }
+
+        // Pass each event to sink, then forget them. Unlike clear, this keeps the memory, for recording more.
+        template<typename Sink>
+        void drain(Sink&& sink) {
+            for (auto& event : events_) {
+                sink(move(event));
+            }
+
+            events_.clear();
+        }
+
+        virtual void finish(const Stats& stats) override {
+            add(EventType::FINISH, "", stats);
+        }
+
+        virtual void beginContext(const NameStack& contextStack, const string& name) override {
+            add(EventType::BEGIN_CONTEXT, name);
+        }
+
+        virtual void endContext(const Stats& stats, const NameStack& contextStack, const string& name) override {
+            add(EventType::END_CONTEXT, name, stats);
+        }
+
+        virtual void beginGiven(const NameStack& context, const string& given) override {
+            add(EventType::BEGIN_GIVEN, given);
+        }
+
+        virtual void endGiven(const Stats& stats, const NameStack& context, const string& given) override {
+            add(EventType::END_GIVEN, given, stats);
+        }
+
+        virtual void beginWhen(const NameStack& context,
+                               const string& given,
+                               const NameStack& whenStack,
+                               const string& when) override {
+            add(EventType::BEGIN_WHEN, when);
+        }
+
+        virtual void endWhen(const Stats& stats,
+                             const NameStack& context,
+                             const string& given,
+                             const NameStack& whenStack,
+                             const string& when) override {
+            add(EventType::END_WHEN, when, stats);
+        }
+
+        virtual bool notifyPassing() const override { return notifyPassing_; }
+
+        virtual void fail(const NameStack& context,
+                          const string& given,
+                          const NameStack& whenStack,
+                          optional<string> description,
+                          const string &expressionText,
+                          const vector <Variable> &variableList) override {
+            events_.push_back(Event{EventType::FAIL, expressionText, Stats(), move(description), variableList});
+        }
+
+        virtual void pass(const NameStack& context,
+                          const string& given,
+                          const NameStack& whenStack,
+                          optional <string> description,
+                          const string &expressionText,
+                          const vector <Variable> &variableList) override {
+            events_.push_back(Event{EventType::PASS, expressionText, Stats(), move(description), variableList});
+        }
+
+        virtual void failByException(const NameStack& context,
+                                     const string& given,
+                                     const NameStack& whenStack,
+                                     const exception& e) override {
+            add(EventType::FAIL_BY_EXCEPTION, e.what());
+        }
+
+        virtual void measured(const NameStack& context,
+                              const string& given,
+                              const NameStack& whenStack,
+                              const Measurement& measurement) override {
+            add(EventType::MEASURED, measurement.name());
+            events_.back().measurement = make_shared<const Measurement>(measurement);
+        }
+    };
+
+    // Feed recorded events into a Results object, rebuilding the context, given and when stacks as we go.
+    class EventReplayer final: public NoCopy {
+        Out<Results> results_;
+        NameStack contextStack_;
+        string given_;
+        NameStack whenStack_;
+    public:
+        explicit EventReplayer(Out<Results> results) : results_(results) {}
+
+        // Replay events for givens inside an existing context.
+        EventReplayer(Out<Results> results, const NameStack& contextStack) : results_(results) {
+            for (const auto& name : contextStack.stack()) {
+                contextStack_.push(name);
+            }
+        }
+
+        // Replay events from inside a given, which won't include the BEGIN_GIVEN event.
+        EventReplayer(Out<Results> results, const NameStack& contextStack, string given) :
+            EventReplayer(results, contextStack)
+        {
+            given_ = move(given);
+            whenStack_.setBase(givenNode(contextStack_, given_));
+        }
+
+        void operator()(const Event& event) {
+            switch (event.type) {
+                case EventType::BEGIN_CONTEXT:
+                    results_->beginContext(contextStack_, event.name);
+                    contextStack_.push(event.name);
+                    break;
+                case EventType::END_CONTEXT:
+                    contextStack_.pop();
+                    results_->endContext(event.stats, contextStack_, event.name);
+                    break;
+                case EventType::BEGIN_GIVEN:
+                    given_ = event.name;
+                    whenStack_.setBase(givenNode(contextStack_, given_));
+                    results_->beginGiven(contextStack_, given_);
+                    break;
+                case EventType::END_GIVEN:
+                    results_->endGiven(event.stats, contextStack_, event.name);
+                    break;
+                case EventType::BEGIN_WHEN:
+                    results_->beginWhen(contextStack_, given_, whenStack_, event.name);
+                    whenStack_.push(event.name);
+                    break;
+                case EventType::END_WHEN:
+                    whenStack_.pop();
+                    results_->endWhen(event.stats, contextStack_, given_, whenStack_, event.name);
+                    break;
+                case EventType::PASS:
+                    results_->pass(
+                            contextStack_, given_, whenStack_, event.description, event.name, event.variableList
+                        );
+                    break;
+                case EventType::FAIL:
+                    results_->fail(
+                            contextStack_, given_, whenStack_, event.description, event.name, event.variableList
+                        );
+                    break;
+                case EventType::FAIL_BY_EXCEPTION:
+                    results_->failByException(contextStack_, given_, whenStack_, runtime_error(event.name));
+                    break;
+                case EventType::FINISH:
+                    results_->finish(event.stats);
+                    break;
+                case EventType::MEASURED:
+                    results_->measured(contextStack_, given_, whenStack_, *event.measurement);
+                    break;
+            }
+        }
+
+        void operator()(const vector<Event>& eventList) {
+            for (const auto& event : eventList) {
+                (*this)(event);
+            }
+        }
+    };
+
+    // A binary encoding of events and stats, so they can be sent to another process running the same executable.
+    // Integers are written in native byte order.
+    class EventWriter final: public NoCopy {
+        Out<string> output_;
+
+        void write(uint64_t value) {
+            char bytes[sizeof(value)];
+            memcpy(bytes, &value, sizeof(value));
+            output_->append(bytes, sizeof(value));
+        }
+
+        void write(const string& value) {
+            write(static_cast<uint64_t>(value.size()));
+            output_->append(value);
+        }
+
+        void write(double value) {
+            uint64_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            write(bits);
+        }
+    public:
+        explicit EventWriter(Out<string> output) : output_(output) {}
+
+        void operator()(uint64_t value) {
+            write(value);
+        }
+
+        void operator()(const string& value) {
+            write(value);
+        }
+
+        void operator()(const Stats& stats) {
+            write(stats.fixtures());
+            write(stats.tests());
+            write(stats.checks());
+            write(stats.failedTests());
+            write(stats.failedChecks());
+            write(stats.wallTime());
+            write(stats.cpuTime());
+        }
+
+        void operator()(const Event& event) {
+            write(static_cast<uint64_t>(event.type));
+            write(event.name);
+            (*this)(event.stats);
+            write(static_cast<uint64_t>(event.description ? 1 : 0));
+
+            if (event.description) {
+                write(*event.description);
+            }
+
+            write(static_cast<uint64_t>(event.variableList.size()));
+
+            for (const auto& variable : event.variableList) {
+                write(variable.name());
+                write(variable.value());
+                write(variable.file());
+                write(static_cast<uint64_t>(variable.line()));
+            }
+
+            if (event.type == EventType::MEASURED) {
+                write(event.measurement->iterations());
+                write(static_cast<uint64_t>(event.measurement->samples().size()));
+
+                for (auto sample : event.measurement->samples()) {
+                    write(sample);
+                }
+            }
+        }
+
+        void operator()(const vector<Event>& eventList) {
+            write(static_cast<uint64_t>(eventList.size()));
+
+            for (const auto& event : eventList) {
+                (*this)(event);
+            }
+        }
+    };
+
+    // Read data written by EventWriter. Throws runtime_error if the data is truncated.
+    class EventReader final: public NoCopy {
+        const string& input_;
+        size_t position_ = 0;
+
+        void require(size_t size) {
+            if (input_.size() - position_ < size) {
+                throw runtime_error("Truncated event data");
+            }
+        }
+    public:
+        explicit EventReader(const string& input) : input_(input) {}
+
+        bool atEnd() const { return position_ == input_.size(); }
+
+        uint64_t readInteger() {
+            uint64_t value;
+            require(sizeof(value));
+            memcpy(&value, input_.data() + position_, sizeof(value));
+            position_ += sizeof(value);
+
+            return value;
+        }
+
+        double readDouble() {
+            auto bits = readInteger();
+            double value;
+            memcpy(&value, &bits, sizeof(value));
+
+            return value;
+        }
+
+        string readString() {
+            auto size = readInteger();
+            require(size);
+            string value(input_, position_, size);
+            position_ += size;
+
+            return value;
+        }
+
+        Stats readStats() {
+            auto fixtures = readInteger();
+            auto tests = readInteger();
+            auto checks = readInteger();
+            auto failedTests = readInteger();
+            auto failedChecks = readInteger();
+            auto wallTime = readInteger();
+            auto cpuTime = readInteger();
+
+            return Stats(fixtures, tests, checks, failedTests, failedChecks, wallTime, cpuTime);
+        }
+
+        Event readEvent() {
+            auto type = readInteger();
+
+            if (type > static_cast<uint64_t>(lastEventType)) {
+                throw runtime_error("Unknown event type");
+            }
+
+            Event event{static_cast<EventType>(type), readString(), readStats(), optional<string>(), vector<Variable>()};
+
+            if (readInteger() != 0) {
+                event.description = readString();
+            }
+
+            auto variableCount = readInteger();
+
+            for (uint64_t index = 0; index < variableCount; ++index) {
+                auto name = readString();
+                auto value = readString();
+                auto file = readString();
+                auto line = static_cast<int>(readInteger());
+                event.variableList.emplace_back(move(name), move(value), move(file), line);
+            }
+
+            if (event.type == EventType::MEASURED) {
+                auto iterations = readInteger();
+                auto sampleCount = readInteger();
+                require(sampleCount * sizeof(uint64_t));
+                vector<double> samples;
+
+                for (uint64_t index = 0; index < sampleCount; ++index) {
+                    samples.push_back(readDouble());
+                }
+
+                event.measurement = make_shared<const Measurement>(event.name, iterations, move(samples));
+            }
+
+            return event;
+        }
+
+        vector<Event> readEvents() {
+            auto eventCount = readInteger();
+            vector<Event> eventList;
+
+            for (uint64_t index = 0; index < eventCount; ++index) {
+                eventList.push_back(readEvent());
+            }
+
+            return eventList;
+        }
+    };
+}}}}
+
+namespace Enhedron { namespace Test {
+    using Impl::Impl_Events::Event;
+    using Impl::Impl_Events::EventType;
+    using Impl::Impl_Events::EventRecorder;
+    using Impl::Impl_Events::EventReplayer;
+    using Impl::Impl_Events::EventWriter;
+    using Impl::Impl_Events::EventReader;
+}}
+// File: Enhedron/Test/Parallel.h
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <utility>
+#include <algorithm>
+
+namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Parallel {
+    using std::thread;
+    using std::mutex;
+    using std::lock_guard;
+    using std::unique_lock;
+    using std::condition_variable;
+    using std::deque;
+    using std::vector;
+    using std::unique_ptr;
+    using std::make_unique;
+    using std::function;
+    using std::move;
+    using std::forward;
+    using std::max;
+
+    inline size_t defaultThreadCount() {
+        return max(thread::hardware_concurrency(), 1u);
+    }
+
+    // A fixed set of threads, each with its own deque of tasks. Threads take work from the back of their own deque
+    // and steal from the front of other threads' deques when they run out. Threads outside the pool share one extra
+    // deque, which they use in FIFO order, so tasks submitted from outside start roughly in submission order.
+    //
+    // Tasks must not throw. Any thread can help run tasks while it waits for something with helpUntil, so tasks can
+    // submit and wait for subtasks without deadlocking.
+    class TaskPool final: public NoCopyMove {
+        using Task = function<void()>;
+
+        struct TaskQueue {
+            mutex lock;
+            deque<Task> tasks;
+        };
+
+        vector<unique_ptr<TaskQueue>> queueList_;
+        vector<thread> threadList_;
+
+        mutex changedLock_;
+        condition_variable changed_;
+        uint64_t generation_ = 0;
+        bool stopping_ = false;
+
+        struct CurrentThread {
+            const TaskPool* pool = nullptr;
+            size_t index = 0;
+        };
+
+        static CurrentThread& currentThread() {
+            static thread_local CurrentThread instance;
+            return instance;
+        }
+
+        size_t externalIndex() const { return threadList_.size(); }
+
+        size_t currentIndex() const {
+            const auto& current = currentThread();
+
+            if (current.pool == this) {
+                return current.index;
+            }
+
+            return externalIndex();
+        }
+
+        void notifyChanged() {
+            {
+                lock_guard<mutex> lock(changedLock_);
+                ++generation_;
+            }
+
+            changed_.notify_all();
+        }
+
+        bool takeTask(Out<Task> task) {
+            auto index = currentIndex();
+            auto queueCount = queueList_.size();
+
+            {
+                auto& queue = *queueList_[index];
+                lock_guard<mutex> lock(queue.lock);
+
+                if ( ! queue.tasks.empty()) {
+                    if (index == externalIndex()) {
+                        *task = move(queue.tasks.front());
+                        queue.tasks.pop_front();
+                    }
+                    else {
+                        *task = move(queue.tasks.back());
+                        queue.tasks.pop_back();
+                    }
+
+                    return true;
+                }
+            }
+
+            for (size_t offset = 1; offset < queueCount; ++offset) {
+                auto& queue = *queueList_[(index + offset) % queueCount];
+                lock_guard<mutex> lock(queue.lock);
+
+                if ( ! queue.tasks.empty()) {
+                    *task = move(queue.tasks.front());
+                    queue.tasks.pop_front();
+
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        bool runPendingTask() {
+            Task task;
+
+            if ( ! takeTask(out(task))) {
+                return false;
+            }
+
+            task();
+            notifyChanged();
+
+            return true;
+        }
+
+        void workerMain(size_t index) {
+            currentThread().pool = this;
+            currentThread().index = index;
+
+            helpUntil([this] {
+                lock_guard<mutex> lock(changedLock_);
+                return stopping_;
+            });
+        }
+    public:
+        // threadCount is the number of extra threads. The thread that waits for results will also run tasks.
+        explicit TaskPool(size_t threadCount) {
+            for (size_t index = 0; index <= threadCount; ++index) {
+                queueList_.emplace_back(make_unique<TaskQueue>());
+            }
+
+            for (size_t index = 0; index < threadCount; ++index) {
+                threadList_.emplace_back([this, index] { workerMain(index); });
+            }
+        }
+
+        ~TaskPool() {
+            {
+                lock_guard<mutex> lock(changedLock_);
+                stopping_ = true;
+            }
+
+            changed_.notify_all();
+
+            for (auto& worker : threadList_) {
+                worker.join();
+            }
+        }
+
+        size_t threadCount() const { return threadList_.size() + 1; }
+
+        template<typename Functor>
+        void submit(Functor&& functor) {
+            {
+                auto& queue = *queueList_[currentIndex()];
+                lock_guard<mutex> lock(queue.lock);
+                queue.tasks.emplace_back(forward<Functor>(functor));
+            }
+
+            notifyChanged();
+        }
+
+        // Run pending tasks until done() is true. done() must become true as a result of a task finishing.
+        template<typename Predicate>
+        void helpUntil(Predicate&& done) {
+            while (true) {
+                uint64_t seen;
+
+                {
+                    lock_guard<mutex> lock(changedLock_);
+                    seen = generation_;
+                }
+
+                if (done()) {
+                    return;
+                }
+
+                if (runPendingTask()) {
+                    continue;
+                }
+
+                unique_lock<mutex> lock(changedLock_);
+                changed_.wait(lock, [&] { return generation_ != seen || stopping_; });
+
+                if (stopping_ && currentIndex() != externalIndex()) {
+                    return;
+                }
+            }
+        }
+    };
+}}}}
+
+namespace Enhedron { namespace Test {
+    using Impl::Impl_Parallel::TaskPool;
+    using Impl::Impl_Parallel::defaultThreadCount;
+}}
+// File: Enhedron/Test/PathFilter.h
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <regex>
+#include <cstring>
+#include <unordered_map>
+#include <algorithm>
+
+namespace Enhedron { namespace Test { namespace Impl { namespace Impl_PathFilter {
+    using std::string;
+    using std::vector;
+    using std::unique_ptr;
+    using std::make_unique;
+    using std::move;
+    using std::regex;
+    using std::regex_match;
+    using std::strchr;
+    using std::unordered_map;
+    using std::find;
+    using std::pair;
+
+    using Util::optional;
+    using Util::none;
+
+    // One component of a test path. Components are regular expressions, but most are just names, or names followed
+    // by ".*", so those are matched without std::regex.
+    class PathComponent final {
+    public:
+        enum class Kind {
+            LITERAL,
+            PREFIX,
+            MATCH_ALL,
+            REGEX
+        };
+    private:
+        string pattern_;
+        Kind kind_;
+        string text_;
+        unique_ptr<regex> regex_;
+
+        // The literal text, if pattern is only literal characters and escaped special characters.
+        static optional<string> literalText(const string& pattern) {
+            static constexpr const char* specialChars = ".^$|()[]{}*+?\\";
+            string text;
+
+            for (auto character = pattern.begin(); character != pattern.end(); ++character) {
+                if (*character == '\\') {
+                    ++character;
+
+                    if (character == pattern.end() || ! strchr(specialChars, *character)) {
+                        return none;
+                    }
+                }
+                else if (strchr(specialChars, *character)) {
+                    return none;
+                }
+
+                text += *character;
+            }
+
+            return move(text);
+        }
+
+        void classify() {
+            static const string matchAll(".*");
+
+            if (pattern_ == matchAll) {
+                kind_ = Kind::MATCH_ALL;
+                return;
+            }
+
+            auto text = literalText(pattern_);
+
+            if (text) {
+                kind_ = Kind::LITERAL;
+                text_ = move(*text);
+                return;
+            }
+
+            auto prefixSize = pattern_.size() - matchAll.size();
+
+            if (pattern_.size() > matchAll.size() && pattern_.compare(prefixSize, matchAll.size(), matchAll) == 0) {
+                auto prefix = literalText(pattern_.substr(0, prefixSize));
+
+                if (prefix) {
+                    kind_ = Kind::PREFIX;
+                    text_ = move(*prefix);
+                    return;
+                }
+            }
+
+            kind_ = Kind::REGEX;
+            regex_ = make_unique<regex>(pattern_);
+        }
+    public:
+        explicit PathComponent(string pattern) : pattern_(move(pattern)) {
+            classify();
+        }
+
+        const string& pattern() const { return pattern_; }
+        Kind kind() const { return kind_; }
+
+        // For LITERAL and PREFIX components.
+        const string& text() const { return text_; }
+
+        bool matches(const string& name) const {
+            switch (kind_) {
+                case Kind::LITERAL:
+                    return name == text_;
+                case Kind::PREFIX:
+                    return name.compare(0, text_.size(), text_) == 0;
+                case Kind::MATCH_ALL:
+                    return true;
+                case Kind::REGEX:
+                    break;
+            }
+
+            return regex_match(name, *regex_);
+        }
+    };
+
+    // Test paths, compiled into a trie so paths with the same leading components are only matched once. Literal
+    // components are looked up by name, so thousands of paths cost about the same as one.
+    class PathFilter final: public NoCopy {
+        struct Node final: public NoCopy {
+            // A path ends here, so everything below this node is included.
+            bool terminal = false;
+            unordered_map<string, unique_ptr<Node>> literalChildren;
+            vector<pair<PathComponent, unique_ptr<Node>>> patternChildren;
+
+            Out<Node> child(string pattern) {
+                PathComponent component(move(pattern));
+
+                if (component.kind() == PathComponent::Kind::LITERAL) {
+                    auto& literalChild = literalChildren[component.text()];
+
+                    if ( ! literalChild) {
+                        literalChild = make_unique<Node>();
+                    }
+
+                    return out(*literalChild);
+                }
+
+                for (auto& patternChild : patternChildren) {
+                    if (patternChild.first.pattern() == component.pattern()) {
+                        return out(*patternChild.second);
+                    }
+                }
+
+                patternChildren.emplace_back(move(component), make_unique<Node>());
+
+                return out(*patternChildren.back().second);
+            }
+        };
+
+        Node root_;
+    public:
+        // Where we've got to in the trie. Either everything below here is included, or only the nodes matching one
+        // of nodeList's children.
+        class State final {
+            friend class PathFilter;
+
+            bool all_ = false;
+            vector<const Node*> nodeList_;
+        public:
+            bool all() const { return all_; }
+        };
+
+        // Include everything.
+        PathFilter() {
+            root_.terminal = true;
+        }
+
+        // Each path is a list of regular expressions, matched against the names of contexts and givens, starting at
+        // the top level. Everything below a matched path is included. An empty list includes everything.
+        explicit PathFilter(const vector<vector<string>>& pathList) {
+            if (pathList.empty()) {
+                root_.terminal = true;
+            }
+
+            for (const auto& path : pathList) {
+                Out<Node> node(root_);
+
+                for (const auto& component : path) {
+                    node = node->child(component);
+                }
+
+                node->terminal = true;
+            }
+        }
+
+        State root() const {
+            State state;
+
+            if (root_.terminal) {
+                state.all_ = true;
+            }
+            else {
+                state.nodeList_.push_back(&root_);
+            }
+
+            return state;
+        }
+
+        // The state for a child called name, or none if nothing below it is included.
+        optional<State> match(const State& state, const string& name) const {
+            if (state.all_) {
+                return state;
+            }
+
+            State next;
+
+            auto add = [&] (const Node& node) {
+                if (node.terminal) {
+                    next.all_ = true;
+                }
+                else if (find(next.nodeList_.begin(), next.nodeList_.end(), &node) == next.nodeList_.end()) {
+                    next.nodeList_.push_back(&node);
+                }
+            };
+
+            for (auto node : state.nodeList_) {
+                auto literalChild = node->literalChildren.find(name);
+
+                if (literalChild != node->literalChildren.end()) {
+                    add(*literalChild->second);
+                }
+
+                for (const auto& patternChild : node->patternChildren) {
+                    if (patternChild.first.matches(name)) {
+                        add(*patternChild.second);
+                    }
+                }
+
+                if (next.all_) {
+                    next.nodeList_.clear();
+                    return next;
+                }
+            }
+
+            if (next.nodeList_.empty()) {
+                return none;
+            }
+
+            return move(next);
+        }
+    };
+}}}}
+
+namespace Enhedron { namespace Test {
+    using Impl::Impl_PathFilter::PathFilter;
+}}
+// File: Enhedron/Test/Shard.h
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <numeric>
+#include <unordered_map>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <cstdint>
+
+namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Shard {
+    using std::string;
+    using std::vector;
+    using std::pair;
+    using std::move;
+    using std::sort;
+    using std::iota;
+    using std::min_element;
+    using std::unordered_map;
+    using std::istream;
+    using std::ostream;
+    using std::getline;
+    using std::runtime_error;
+    using std::stoull;
+    using std::to_string;
+    using std::exception;
+
+    using namespace Impl_Results;
+
+    // Wall time in nanoseconds for each given, keyed by givenPath.
+    using Timings = unordered_map<string, uint64_t>;
+
+    // One line per given, with the time, a space, then the path.
+    inline Timings readTimings(Out<istream> input) {
+        Timings timings;
+        string line;
+        size_t lineNumber = 0;
+
+        while (getline(*input, line)) {
+            ++lineNumber;
+
+            if (line.empty()) {
+                continue;
+            }
+
+            auto separator = line.find(' ');
+
+            try {
+                if (separator == string::npos) {
+                    throw runtime_error("No path");
+                }
+
+                size_t end = 0;
+                auto time = stoull(line.substr(0, separator), &end);
+
+                if (end != separator) {
+                    throw runtime_error("Invalid time");
+                }
+
+                timings[line.substr(separator + 1)] += time;
+            }
+            catch (const exception&) {
+                throw runtime_error("Invalid timings on line " + to_string(lineNumber) + ": \"" + line + "\"");
+            }
+        }
+
+        return timings;
+    }
+
+    inline void writeTimings(Out<ostream> output, const vector<pair<string, uint64_t>>& timingList) {
+        for (const auto& timing : timingList) {
+            *output << timing.second << " " << timing.first << "\n";
+        }
+    }
+
+    // Assign each given to a shard. givenPathList is in tree order, so the result only depends on the tree, the
+    // shard count and the timings. Without timings, givens are dealt out in turn. With timings, the slowest given
+    // goes to the least loaded shard, and so on. Givens without a timing are assumed to take the mean time.
+    inline vector<size_t> assignShards(const vector<string>& givenPathList, size_t shardCount, const Timings& timings) {
+        vector<size_t> shardList(givenPathList.size());
+
+        if (timings.empty()) {
+            for (size_t index = 0; index < givenPathList.size(); ++index) {
+                shardList[index] = index % shardCount;
+            }
+
+            return shardList;
+        }
+
+        vector<uint64_t> timeList;
+        uint64_t knownTotal = 0;
+        uint64_t knownCount = 0;
+
+        for (const auto& path : givenPathList) {
+            auto timing = timings.find(path);
+
+            if (timing != timings.end()) {
+                knownTotal += timing->second;
+                ++knownCount;
+            }
+        }
+
+        auto defaultTime = knownCount == 0 ? 1 : knownTotal / knownCount;
+
+        for (const auto& path : givenPathList) {
+            auto timing = timings.find(path);
+            timeList.push_back(timing == timings.end() ? defaultTime : timing->second);
+        }
+
+        vector<size_t> order(givenPathList.size());
+        iota(order.begin(), order.end(), 0);
+
+        sort(order.begin(), order.end(), [&] (size_t lhs, size_t rhs) {
+            return timeList[lhs] > timeList[rhs] || (timeList[lhs] == timeList[rhs] && lhs < rhs);
+        });
+
+        vector<uint64_t> load(shardCount, 0);
+
+        for (auto index : order) {
+            auto shard = static_cast<size_t>(min_element(load.begin(), load.end()) - load.begin());
+            shardList[index] = shard;
+            load[shard] += timeList[index];
+        }
+
+        return shardList;
+    }
+
+    // Record the wall time of each given, and write them out when the run finishes, for readTimings.
+    class TimingsResults final: public ForwardingResults {
+        Out<ostream> output_;
+        vector<pair<NodeId, uint64_t>> timingList_;
+    public:
+        TimingsResults(Out<Results> results, Out<ostream> output) : ForwardingResults(results), output_(output) {}
+
+        virtual void finish(const Stats& stats) override {
+            ForwardingResults::finish(stats);
+            vector<pair<string, uint64_t>> timingList;
+            timingList.reserve(timingList_.size());
+
+            for (const auto& timing : timingList_) {
+                timingList.emplace_back(testIndex().pathName(timing.first), timing.second);
+            }
+
+            writeTimings(output_, timingList);
+        }
+
+        virtual void endGiven(const Stats& stats, const NameStack& context, const string& given) override {
+            timingList_.emplace_back(givenNode(context, given), stats.wallTime());
+            ForwardingResults::endGiven(stats, context, given);
+        }
+    };
+}}}}
+
+namespace Enhedron { namespace Test {
+    using Impl::Impl_Shard::TimingsResults;
+}}
+// File: Enhedron/Test/Channel.h
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+
+#ifdef __linux__
+    #include <unistd.h>
+    #include <sys/types.h>
+    #include <sys/socket.h>
+    #include <poll.h>
+#endif
+
+namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Channel {
+    using std::string;
+    using std::runtime_error;
+    using std::memcpy;
+    using std::move;
+    using std::pair;
+    using std::vector;
+
+    using Util::optional;
+    using Util::none;
+
+    using Impl_Process::throwUnsupported;
+    using Impl_Process::throwSystemError;
+
+    // Messages over a reliable byte stream, each sent as a frame: the size as a native 64 bit integer, then the
+    // bytes. Nothing here depends on the kind of stream, so it works the same over a Unix or TCP socket. The
+    // channel owns the socket, and closing it is how either end says it's finished.
+    class Channel final: public NoCopy {
+        int socket_;
+
+        // Returns false if the stream ended before any bytes were read.
+        bool receiveAll(char* data, size_t size) {
+            #ifdef __linux__
+                size_t received = 0;
+
+                while (received < size) {
+                    auto result = ::recv(socket_, data + received, size - received, 0);
+
+                    if (result < 0) {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+
+                        throwSystemError("recv");
+                    }
+
+                    if (result == 0) {
+                        if (received == 0) {
+                            return false;
+                        }
+
+                        throw runtime_error("Truncated frame");
+                    }
+
+                    received += static_cast<size_t>(result);
+                }
+            #else
+                throwUnsupported();
+            #endif
+
+            return true;
+        }
+
+        void sendAll(const char* data, size_t size) {
+            #ifdef __linux__
+                size_t sent = 0;
+
+                while (sent < size) {
+                    // MSG_NOSIGNAL, so a peer that's gone is reported as an error rather than killing us with SIGPIPE.
+                    auto result = ::send(socket_, data + sent, size - sent, MSG_NOSIGNAL);
+
+                    if (result < 0) {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+
+                        throwSystemError("send");
+                    }
+
+                    sent += static_cast<size_t>(result);
+                }
+            #else
+                throwUnsupported();
+            #endif
+        }
+    public:
+        explicit Channel(int socket) : socket_(socket) {}
+
+        Channel(Channel&& other) : socket_(other.socket_) {
+            other.socket_ = -1;
+        }
+
+        Channel& operator=(Channel&& other) {
+            close();
+            socket_ = other.socket_;
+            other.socket_ = -1;
+
+            return *this;
+        }
+
+        ~Channel() {
+            close();
+        }
+
+        int socket() const { return socket_; }
+
+        // Forget the socket without closing it, when something else has already closed it.
+        void release() {
+            socket_ = -1;
+        }
+
+        void close() {
+            #ifdef __linux__
+                if (socket_ >= 0) {
+                    ::close(socket_);
+                    socket_ = -1;
+                }
+            #endif
+        }
+
+        void send(const string& message) {
+            uint64_t size = message.size();
+            char header[sizeof(size)];
+            memcpy(header, &size, sizeof(size));
+            sendAll(header, sizeof(size));
+            sendAll(message.data(), message.size());
+        }
+
+        // Returns none if the other end closed the channel between messages.
+        optional<string> receive() {
+            uint64_t size;
+            char header[sizeof(size)];
+
+            if ( ! receiveAll(header, sizeof(size))) {
+                return none;
+            }
+
+            memcpy(&size, header, sizeof(size));
+            string message(size, '\0');
+
+            if (size > 0 && ! receiveAll(&message[0], size)) {
+                throw runtime_error("Truncated frame");
+            }
+
+            return move(message);
+        }
+    };
+
+    // Channels over a connected pair of local stream sockets.
+    inline pair<Channel, Channel> makeChannelPair() {
+        int sockets[2] = {-1, -1};
+
+        #ifdef __linux__
+            if (::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0) {
+                throwSystemError("socketpair");
+            }
+        #else
+            throwUnsupported();
+        #endif
+
+        return pair<Channel, Channel>(Channel(sockets[0]), Channel(sockets[1]));
+    }
+
+    // Wait until at least one of the channels has a message, or has been closed by the other end. Returns their
+    // indices in channelList.
+    inline vector<size_t> waitForChannels(const vector<const Channel*>& channelList) {
+        vector<size_t> readyList;
+
+        #ifdef __linux__
+            vector<pollfd> pollList;
+
+            for (auto channel : channelList) {
+                pollList.push_back(pollfd{channel->socket(), POLLIN, 0});
+            }
+
+            while (::poll(pollList.data(), pollList.size(), -1) < 0) {
+                if (errno != EINTR) {
+                    throwSystemError("poll");
+                }
+            }
+
+            for (size_t index = 0; index < pollList.size(); ++index) {
+                if (pollList[index].revents != 0) {
+                    readyList.push_back(index);
+                }
+            }
+        #else
+            throwUnsupported();
+        #endif
+
+        return readyList;
+    }
+}}}}
+// File: Enhedron/Util/Timer.h
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <time.h>
+#endif
+
+namespace Enhedron { namespace Util { namespace Impl { namespace Impl_Timer {
+    using std::chrono::steady_clock;
+    using std::chrono::duration_cast;
+    using std::chrono::nanoseconds;
+
+    inline uint64_t wallNanoseconds() {
+        return static_cast<uint64_t>(duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count());
+    }
+
+    // CPU time used by the calling thread. Falls back to process CPU time where that isn't available.
+    inline uint64_t threadCpuNanoseconds() {
+        #if defined(CLOCK_THREAD_CPUTIME_ID)
+            timespec time;
+
+            if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) == 0) {
+                return static_cast<uint64_t>(time.tv_sec) * 1000000000u + static_cast<uint64_t>(time.tv_nsec);
+            }
+
+            return 0;
+        #else
+            return static_cast<uint64_t>(std::clock()) * (1000000000u / CLOCKS_PER_SEC);
+        #endif
+    }
+
+    // Measures monotonic wall clock time and CPU time for the current thread, from construction. Both are in
+    // nanoseconds. The CPU time is only meaningful if read on the thread that constructed the timer.
+    class Timer final {
+        uint64_t wallStart_ = wallNanoseconds();
+        uint64_t cpuStart_ = threadCpuNanoseconds();
+
+        static uint64_t since(uint64_t start, uint64_t now) {
+            return now > start ? now - start : 0;
+        }
+    public:
+        uint64_t wall() const { return since(wallStart_, wallNanoseconds()); }
+        uint64_t cpu() const { return since(cpuStart_, threadCpuNanoseconds()); }
+    };
+}}}}
+
+namespace Enhedron { namespace Util {
+    using Impl::Impl_Timer::Timer;
+    using Impl::Impl_Timer::threadCpuNanoseconds;
+}}
+// File: Enhedron/Test/Benchmark.h
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Benchmark {
+    using std::string;
+    using std::vector;
+    using std::move;
+    using std::min;
+    using std::max;
+    using std::atomic_signal_fence;
+    using std::memory_order_seq_cst;
+
+    using Util::Impl::Impl_Timer::wallNanoseconds;
+
+    using Impl_Measurement::Measurement;
+
+    struct BenchmarkOptions final {
+        // Samples to take once the benchmark is calibrated and warmed up.
+        size_t samples = 30;
+
+        // Each sample runs enough iterations to take at least this long, in nanoseconds.
+        uint64_t sampleTime = 1000000;
+
+        // How long to run for before taking samples, in nanoseconds, including calibration.
+        uint64_t warmupTime = 10000000;
+
+        // Don't run more than this many iterations in a sample, however quick they are.
+        uint64_t maxIterations = 1000000000;
+
+        // A measurement with a baseline regresses if it's slower with this significance, and its median is slower
+        // by more than regressionThreshold, as a fraction of the baseline median. See compareToBaseline.
+        double significance = 0.01;
+        double regressionThreshold = 0.05;
+    };
+
+    // Make the compiler assume value is read, so the code that computes it isn't optimized away.
+    template<typename Value>
+    inline void doNotOptimize(const Value& value) {
+        #if defined(__GNUC__)
+            asm volatile("" : : "r,m"(value) : "memory");
+        #else
+            atomic_signal_fence(memory_order_seq_cst);
+            static_cast<void>(&value);
+        #endif
+    }
+
+    // Make the compiler assume all memory is read and written, so stores before it aren't optimized away.
+    inline void clobberMemory() {
+        #if defined(__GNUC__)
+            asm volatile("" : : : "memory");
+        #else
+            atomic_signal_fence(memory_order_seq_cst);
+        #endif
+    }
+
+    // Wall time in nanoseconds to call functor iterations times.
+    template<typename Functor>
+    uint64_t timeIterations(Functor& functor, uint64_t iterations) {
+        auto start = wallNanoseconds();
+
+        for (uint64_t iteration = 0; iteration < iterations; ++iteration) {
+            functor();
+        }
+
+        auto end = wallNanoseconds();
+
+        return end > start ? end - start : 0;
+    }
+
+    // Time functor. Double the iterations per sample, or more if a sample is far too quick, until a sample takes
+    // options.sampleTime. Keep running samples until options.warmupTime has passed, then take options.samples.
+    template<typename Functor>
+    Measurement measure(string name, const BenchmarkOptions& options, Functor&& functor) {
+        static constexpr const uint64_t maxGrowth = 10;
+
+        auto warmupStart = wallNanoseconds();
+        uint64_t iterations = 1;
+
+        for (;;) {
+            auto time = timeIterations(functor, iterations);
+
+            if (time >= options.sampleTime || iterations >= options.maxIterations) {
+                break;
+            }
+
+            // Aim a bit past sampleTime, so noise doesn't leave us just short of it.
+            uint64_t growth = time == 0 ? maxGrowth : (options.sampleTime + options.sampleTime / 2) / time;
+            iterations = min(options.maxIterations, iterations * max<uint64_t>(2, min(maxGrowth, growth)));
+        }
+
+        while (wallNanoseconds() - warmupStart < options.warmupTime) {
+            timeIterations(functor, iterations);
+        }
+
+        vector<double> samples;
+        samples.reserve(options.samples);
+
+        for (size_t sample = 0; sample < options.samples; ++sample) {
+            samples.push_back(static_cast<double>(timeIterations(functor, iterations)) / iterations);
+        }
+
+        return Measurement(move(name), iterations, move(samples));
+    }
+}}}}
+
+namespace Enhedron { namespace Test {
+    using Impl::Impl_Benchmark::BenchmarkOptions;
+    using Impl::Impl_Benchmark::doNotOptimize;
+    using Impl::Impl_Benchmark::clobberMemory;
+}}
+// File: Enhedron/Test/Baseline.h
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <unordered_map>
+#include <istream>
+#include <ostream>
+#include <iomanip>
+#include <stdexcept>
+#include <cmath>
+#include <cstddef>
+
+namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Baseline {
+    using std::string;
+    using std::vector;
+    using std::pair;
+    using std::move;
+    using std::sort;
+    using std::unordered_map;
+    using std::istream;
+    using std::ostream;
+    using std::getline;
+    using std::fixed;
+    using std::setprecision;
+    using std::runtime_error;
+    using std::stod;
+    using std::to_string;
+    using std::exception;
+    using std::sqrt;
+    using std::erfc;
+
+    using namespace Impl_Results;
+    using Impl_Measurement::Measurement;
+
+    // Samples in nanoseconds per iteration for each measurement, keyed by baselineKey.
+    using Baselines = unordered_map<string, vector<double>>;
+
+    // The path to the given or when a measurement was taken in, then the measurement's name.
+    inline string baselineKey(const NameStack& whenStack, const string& name) {
+        return testIndex().pathName(whenStack.node()) + "/" + name;
+    }
+
+    // One line per measurement, with the samples separated by commas, a space, then the key.
+    inline Baselines readBaselines(Out<istream> input) {
+        Baselines baselines;
+        string line;
+        size_t lineNumber = 0;
+
+        while (getline(*input, line)) {
+            ++lineNumber;
+
+            if (line.empty()) {
+                continue;
+            }
+
+            auto separator = line.find(' ');
+
+            try {
+                if (separator == string::npos) {
+                    throw runtime_error("No path");
+                }
+
+                auto& samples = baselines[line.substr(separator + 1)];
+                size_t start = 0;
+
+                while (start <= separator) {
+                    auto end = line.find(',', start);
+
+                    if (end == string::npos || end > separator) {
+                        end = separator;
+                    }
+
+                    size_t size = 0;
+                    auto text = line.substr(start, end - start);
+                    samples.push_back(stod(text, &size));
+
+                    if (size != text.size()) {
+                        throw runtime_error("Invalid sample");
+                    }
+
+                    start = end + 1;
+                }
+            }
+            catch (const exception&) {
+                throw runtime_error("Invalid baselines on line " + to_string(lineNumber) + ": \"" + line + "\"");
+            }
+        }
+
+        return baselines;
+    }
+
+    inline void writeBaselines(Out<ostream> output, const vector<pair<string, vector<double>>>& baselineList) {
+        *output << fixed << setprecision(3);
+
+        for (const auto& baseline : baselineList) {
+            for (size_t index = 0; index < baseline.second.size(); ++index) {
+                if (index > 0) {
+                    *output << ",";
+                }
+
+                *output << baseline.second[index];
+            }
+
+            *output << " " << baseline.first << "\n";
+        }
+    }
+
+    // The probability of samples being at least this much slower than baseline if they were from the same
+    // distribution, from a one sided Mann-Whitney U test. It uses the normal approximation, with corrections for
+    // ties and continuity, so it's only accurate with more than a few samples of each.
+    inline double mannWhitneyPValue(const vector<double>& baseline, const vector<double>& samples) {
+        if (baseline.empty() || samples.empty()) {
+            return 1;
+        }
+
+        // Each value, and whether it's from samples.
+        vector<pair<double, bool>> values;
+        values.reserve(baseline.size() + samples.size());
+
+        for (auto value : baseline) {
+            values.emplace_back(value, false);
+        }
+
+        for (auto value : samples) {
+            values.emplace_back(value, true);
+        }
+
+        sort(values.begin(), values.end());
+
+        double rankSum = 0;
+        double tieCorrection = 0;
+
+        for (size_t start = 0; start < values.size(); ) {
+            auto end = start + 1;
+
+            while (end < values.size() && values[end].first == values[start].first) {
+                ++end;
+            }
+
+            // Tied values share the mean of their ranks, counting from 1.
+            double rank = (start + end + 1) / 2.0;
+            double ties = end - start;
+            tieCorrection += ties * ties * ties - ties;
+
+            for (auto index = start; index < end; ++index) {
+                if (values[index].second) {
+                    rankSum += rank;
+                }
+            }
+
+            start = end;
+        }
+
+        double baselineSize = baseline.size();
+        double sampleSize = samples.size();
+        double total = baselineSize + sampleSize;
+        double u = rankSum - sampleSize * (sampleSize + 1) / 2;
+        double mean = baselineSize * sampleSize / 2;
+        double variance = baselineSize * sampleSize / 12 * ((total + 1) - tieCorrection / (total * (total - 1)));
+
+        if (variance <= 0) {
+            return 1;
+        }
+
+        double z = (u - mean - 0.5) / sqrt(variance);
+
+        return erfc(z / sqrt(2.0)) / 2;
+    }
+
+    // How a measurement compares to its baseline. change is the difference in medians, as a fraction of the baseline
+    // median, so 0.1 is 10% slower.
+    struct Comparison final {
+        double baselineMedian = 0;
+        double median = 0;
+        double change = 0;
+        double pValue = 1;
+    };
+
+    inline Comparison compareToBaseline(const vector<double>& baseline, const Measurement& measurement) {
+        Comparison comparison;
+        comparison.baselineMedian = Measurement(measurement.name(), 0, baseline).median();
+        comparison.median = measurement.median();
+
+        if (comparison.baselineMedian > 0) {
+            comparison.change = comparison.median / comparison.baselineMedian - 1;
+        }
+
+        comparison.pValue = mannWhitneyPValue(baseline, measurement.samples());
+
+        return comparison;
+    }
+
+    // Record the samples of each measurement, and write them out when the run finishes, for readBaselines. A
+    // measurement that's taken more than once, because its given runs once for each when, keeps all its samples.
+    class BaselinesResults final: public ForwardingResults {
+        Out<ostream> output_;
+        vector<pair<string, vector<double>>> baselineList_;
+        unordered_map<string, size_t> baselineIndex_;
+    public:
+        BaselinesResults(Out<Results> results, Out<ostream> output) : ForwardingResults(results), output_(output) {}
+
+        virtual void finish(const Stats& stats) override {
+            ForwardingResults::finish(stats);
+            writeBaselines(output_, baselineList_);
+        }
+
+        virtual void measured(const NameStack& context,
+                              const string& given,
+                              const NameStack& whenStack,
+                              const Measurement& measurement) override {
+            auto key = baselineKey(whenStack, measurement.name());
+            auto index = baselineIndex_.find(key);
+
+            if (index == baselineIndex_.end()) {
+                index = baselineIndex_.emplace(key, baselineList_.size()).first;
+                baselineList_.emplace_back(move(key), vector<double>());
+            }
+
+            auto& samples = baselineList_[index->second].second;
+            samples.insert(samples.end(), measurement.samples().begin(), measurement.samples().end());
+            ForwardingResults::measured(context, given, whenStack, measurement);
+        }
+    };
+}}}}
+
+namespace Enhedron { namespace Test {
+    using Impl::Impl_Baseline::BaselinesResults;
+}}
+// File: Enhedron/Test/Scaling.h
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <map>
+#include <limits>
+#include <stdexcept>
+#include <cmath>
+#include <cstddef>
+
+namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Scaling {
+    using std::string;
+    using std::vector;
+    using std::pair;
+    using std::move;
+    using std::map;
+    using std::numeric_limits;
+    using std::runtime_error;
+    using std::to_string;
+    using std::log;
+    using std::log2;
+    using std::sqrt;
+    using std::isnan;
+
+    using Impl_Measurement::Measurement;
+
+    // In order of how quickly they grow.
+    enum class Complexity {
+        CONSTANT,
+        LOGARITHMIC,
+        LINEAR,
+        N_LOG_N,
+        QUADRATIC
+    };
+
+    inline const char* complexityName(Complexity complexity) {
+        switch (complexity) {
+            case Complexity::CONSTANT: return "O(1)";
+            case Complexity::LOGARITHMIC: return "O(log n)";
+            case Complexity::LINEAR: return "O(n)";
+            case Complexity::N_LOG_N: return "O(n log n)";
+            case Complexity::QUADRATIC: return "O(n^2)";
+        }
+
+        return "unknown";
+    }
+
+    // exponent is the slope of log(time) against log(n), so about 1 for O(n), 2 for O(n^2), and a bit over 1 for
+    // O(n log n). complexity is the curve, scaled to fit, with the least root mean square error. error is relative
+    // to the mean time.
+    struct ComplexityFit final {
+        Complexity complexity = Complexity::CONSTANT;
+        double exponent = 0;
+        double error = 0;
+    };
+
+    // Fit times against n, for each (n, time). There must be at least 2 different values of n, all positive.
+    inline ComplexityFit fitComplexity(const vector<pair<double, double>>& points) {
+        static constexpr const Complexity complexityList[] = {
+            Complexity::CONSTANT,
+            Complexity::LOGARITHMIC,
+            Complexity::LINEAR,
+            Complexity::N_LOG_N,
+            Complexity::QUADRATIC
+        };
+
+        double minimumN = numeric_limits<double>::infinity();
+        double maximumN = 0;
+        double meanTime = 0;
+
+        for (const auto& point : points) {
+            if ( ! (point.first > 0)) {
+                throw runtime_error("Complexity can only be fitted to positive values of n");
+            }
+
+            minimumN = point.first < minimumN ? point.first : minimumN;
+            maximumN = point.first > maximumN ? point.first : maximumN;
+            meanTime += point.second;
+        }
+
+        if (points.empty() || minimumN == maximumN) {
+            throw runtime_error("Complexity can only be fitted to at least 2 different values of n");
+        }
+
+        meanTime /= points.size();
+
+        // Least squares, for log(time) = exponent * log(n) + constant.
+        double meanLogN = 0;
+        double meanLogTime = 0;
+
+        for (const auto& point : points) {
+            meanLogN += log(point.first);
+            meanLogTime += log(point.second > 0 ? point.second : numeric_limits<double>::min());
+        }
+
+        meanLogN /= points.size();
+        meanLogTime /= points.size();
+        double covariance = 0;
+        double variance = 0;
+
+        for (const auto& point : points) {
+            auto logN = log(point.first) - meanLogN;
+            covariance += logN * (log(point.second > 0 ? point.second : numeric_limits<double>::min()) - meanLogTime);
+            variance += logN * logN;
+        }
+
+        ComplexityFit fit;
+        fit.exponent = covariance / variance;
+        fit.error = numeric_limits<double>::infinity();
+
+        for (auto complexity : complexityList) {
+            auto curve = [complexity] (double n) {
+                switch (complexity) {
+                    case Complexity::CONSTANT: return 1.0;
+                    case Complexity::LOGARITHMIC: return log2(n);
+                    case Complexity::LINEAR: return n;
+                    case Complexity::N_LOG_N: return n * log2(n);
+                    case Complexity::QUADRATIC: return n * n;
+                }
+
+                return 1.0;
+            };
+
+            // Least squares, for time = scale * curve(n).
+            double product = 0;
+            double curveSquared = 0;
+
+            for (const auto& point : points) {
+                product += point.second * curve(point.first);
+                curveSquared += curve(point.first) * curve(point.first);
+            }
+
+            if (curveSquared == 0) {
+                continue;
+            }
+
+            auto scale = product / curveSquared;
+            double squaredError = 0;
+
+            for (const auto& point : points) {
+                auto difference = point.second - scale * curve(point.first);
+                squaredError += difference * difference;
+            }
+
+            auto error = sqrt(squaredError / points.size()) / (meanTime > 0 ? meanTime : 1);
+
+            // Only pick a faster growing curve if it's a better fit.
+            if (error < fit.error) {
+                fit.complexity = complexity;
+                fit.error = error;
+            }
+        }
+
+        return fit;
+    }
+
+    // A measurement from one combination of a sweep's arguments. name is the name it was measured with, without
+    // the arguments. numbers has the value of each numeric argument, or NaN if it isn't numeric.
+    struct SweepRow final {
+        vector<string> arguments;
+        vector<double> numbers;
+        string name;
+        Measurement measurement;
+    };
+
+    // Every measurement from a sweep, in the order they were taken.
+    class Sweep final: public NoCopy {
+        string name_;
+        vector<SweepRow> rows_;
+        vector<string> arguments_;
+        vector<double> numbers_;
+    public:
+        explicit Sweep(string name) : name_(move(name)) {}
+
+        const string& name() const { return name_; }
+
+        const vector<SweepRow>& rows() const { return rows_; }
+
+        // The arguments for the measurements that follow.
+        void setArguments(vector<string> arguments, vector<double> numbers) {
+            arguments_ = move(arguments);
+            numbers_ = move(numbers);
+        }
+
+        void add(string name, Measurement measurement) {
+            rows_.push_back(SweepRow{arguments_, numbers_, move(name), move(measurement)});
+        }
+
+        // Fit the median time of the measurements called name against the numeric argument at index axis. Each
+        // combination of the other arguments is fitted separately, and the fit with the largest exponent is
+        // returned, so a slow case can't hide behind fast ones.
+        ComplexityFit fit(size_t axis, const string& name) const {
+            map<vector<string>, vector<pair<double, double>>> groups;
+
+            for (const auto& row : rows_) {
+                if (row.name != name) continue;
+
+                if (axis >= row.numbers.size() || isnan(row.numbers[axis])) {
+                    throw runtime_error("Argument " + to_string(axis) + " of " + name_ + " isn't a number");
+                }
+
+                auto others = row.arguments;
+                others.erase(others.begin() + axis);
+                groups[others].emplace_back(row.numbers[axis], row.measurement.median());
+            }
+
+            if (groups.empty()) {
+                throw runtime_error("There are no measurements called \"" + name + "\" in " + name_);
+            }
+
+            ComplexityFit worst;
+            worst.exponent = -numeric_limits<double>::infinity();
+
+            for (const auto& group : groups) {
+                auto fit = fitComplexity(group.second);
+
+                if (fit.exponent > worst.exponent) {
+                    worst = fit;
+                }
+            }
+
+            return worst;
+        }
+
+        // Measurements named after the sweep.
+        ComplexityFit fit(size_t axis) const {
+            return fit(axis, name_);
+        }
+    };
+}}}}
+
+namespace Enhedron { namespace Test {
+    using Impl::Impl_Scaling::Complexity;
+    using Impl::Impl_Scaling::complexityName;
+    using Impl::Impl_Scaling::ComplexityFit;
+    using Impl::Impl_Scaling::Sweep;
+}}
+// File: Enhedron/Test/Suite.h
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+
+
+
+#include <functional>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <stdexcept>
+#include <tuple>
+#include <iostream>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <deque>
+#include <unordered_map>
+#include <type_traits>
+#include <limits>
+
+namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Suite {
+    using namespace Assertion;
+
+    using Util::TaggedValue;
+    using Util::StoreArgs;
+    using Util::DecayArrayAndFunction_t;
+    using Util::bindFirst;
+
+    using Util::optional;
+    using Util::none;
+    using Util::Timer;
+    using Util::threadCpuNanoseconds;
+
+    using std::forward;
+    using std::vector;
+    using std::move;
+    using std::exception;
+    using std::function;
+    using std::string;
+    using std::unique_ptr;
+    using std::shared_ptr;
+    using std::make_unique;
+    using std::tuple;
+    using std::index_sequence;
+    using std::index_sequence_for;
+    using std::get;
+    using std::remove_reference;
+    using std::remove_reference_t;
+    using std::declval;
+    using std::begin;
+    using std::bind;
+    using std::ref;
+    using std::runtime_error;
+    using std::cout;
+    using std::reference_wrapper;
+    using std::min;
+    using std::max;
+    using std::atomic;
+    using std::exception_ptr;
+    using std::current_exception;
+    using std::rethrow_exception;
+    using std::memory_order_acquire;
+    using std::memory_order_release;
+    using std::pair;
+    using std::ostream;
+    using std::mutex;
+    using std::lock_guard;
+    using std::sort;
+    using std::deque;
+    using std::unordered_map;
+    using std::is_arithmetic;
+    using std::decay_t;
+    using std::enable_if_t;
+    using std::numeric_limits;
+
+    using Impl_Events::Event;
+    using Impl_Events::EventRecorder;
+    using Impl_Events::EventReplayer;
+    using Impl_Events::EventType;
+    using Impl_Events::EventWriter;
+    using Impl_Events::EventReader;
+    using Impl_Parallel::TaskPool;
+    using Impl_Process::ProcessId;
+    using Impl_Process::Pipe;
+    using Impl_Process::forkProcess;
+    using Impl_Process::exitProcess;
+    using Impl_Process::waitForProcess;
+    using Impl_Process::writeAll;
+    using Impl_Process::readAll;
+    using Impl_Process::closeFilesExcept;
+
+    using Impl_PathFilter::PathFilter;
+    using Impl_Shard::Timings;
+    using Impl_Results::givenPath;
+    using Impl_Results::formatMilliseconds;
+    using Impl_Results::NameRef;
+    using Impl_Results::Measurement;
+    using Impl_Benchmark::BenchmarkOptions;
+    using Impl_Baseline::Baselines;
+    using Impl_Baseline::baselineKey;
+    using Impl_Baseline::compareToBaseline;
+    using Impl_Results::formatNanoseconds;
+    using Impl_Scaling::Sweep;
+    using Impl_Results::givenNode;
+    using Impl_TestIndex::NodeId;
+    using Impl_TestIndex::rootNode;
+    using Impl_TestIndex::testIndex;
+    using Impl_Shard::assignShards;
+    using Impl_Channel::Channel;
+    using Impl_Channel::makeChannelPair;
+    using Impl_Channel::waitForChannels;
+
+    // How Register::run runs givens.
+    struct RunOptions final {
+        // Run givens on this many threads.
+        size_t jobs = 1;
+
+        // Run each given in a child process, which forks again at each when. See ForkedWhens.
+        bool forkWhens = false;
+
+        // When running on a pool, run the paths through the whens of each given as separate tasks. See
+        // WhenRunner::runParallel.
+        bool parallelWhens = false;
+
+        // Split the selected givens into shardCount shards, and only run the ones in shardIndex. See assignShards.
+        size_t shardIndex = 0;
+        size_t shardCount = 1;
+
+        // Used to balance the shards, if there are any.
+        shared_ptr<const Timings> timings;
+
+        // Run givens in this many worker processes. See WorkerPool.
+        size_t workers = 0;
+
+        // Run each given in its own process, forked from a worker. Implies at least one worker.
+        bool isolate = false;
+
+        // How benchmarks are calibrated and sampled.
+        BenchmarkOptions benchmark;
+
+        // Each benchmark measurement with a baseline is checked against it. See Bench::measure.
+        shared_ptr<const Baselines> baselines;
+    };
+
+    class WorkerPool;
+
+    class ContextResultsRecorder final : public NoCopy {
+        Out<Results> results_;
+        NameStack contextStack_;
+        optional<TaskPool&> pool_;
+        RunOptions options_;
+        optional<WorkerPool&> workers_;
+    public:
+        ContextResultsRecorder(
+                Out<Results> results,
+                optional<TaskPool&> pool = none,
+                RunOptions options = RunOptions(),
+                optional<WorkerPool&> workers = none
+            ) :
+            results_(results), pool_(pool), options_(options), workers_(workers)
+        {
+        }
+
+        const NameStack& contextStack() const { return contextStack_; }
+
+        // Record results from inside a context, without reporting that we've entered it. Recorded results are
+        // replayed by name, so this only gives the recorded node ids the same meaning they'll have when replayed.
+        void setContextNode(NodeId node) { contextStack_.setBase(node); }
+
+        // The pool to run tasks on, if we're running in parallel.
+        optional<TaskPool&> pool() const { return pool_; }
+
+        // The worker processes to run givens in, if there are any.
+        optional<WorkerPool&> workers() const { return workers_; }
+
+        const RunOptions& options() const { return options_; }
+
+        // Replay events recorded on another thread, as if they happened in the current context.
+        void replay(const vector<Event>& eventList) {
+            EventReplayer replayer(results_, contextStack_);
+            replayer(eventList);
+        }
+
+        // Replay events recorded inside a given in another process.
+        void replay(const vector<Event>& eventList, const string& given) {
+            EventReplayer replayer(results_, contextStack_, given);
+            replayer(eventList);
+        }
+
+        void push(const string& name) {
+            results_->beginContext(contextStack_, name);
+            contextStack_.push(name);
+        }
+
+        void pop(const Stats& stats) {
+            const auto& name = contextStack_.top();
+            results_->endContext(stats, contextStack_, name);
+            contextStack_.pop();
+        }
+
+        void beginGiven(const string& name) { results_->beginGiven(contextStack_, name); }
+
+        void endGiven(const Stats& stats, const string& name) { results_->endGiven(stats, contextStack_, name); }
+
+        void beginWhen(const string& given, const NameStack& whenStack, const string& name) {
+            results_->beginWhen(contextStack_, given, whenStack, name);
+        }
+        void endWhen(const Stats& stats, const string& given, const NameStack& whenStack, const string& name) {
+            results_->endWhen(stats, contextStack_, given, whenStack, name);
+        }
+
+        void failByException(const string& given, const NameStack& whenStack, const exception& e) {
+            results_->failByException(contextStack_, given, whenStack, e);
+        }
+
+        virtual bool notifyPassing() const { return results_->notifyPassing(); }
+
+        virtual void fail(const string& given,
+                          const NameStack& whenStack,
+                          optional<string> description,
+                          const string &expressionText,
+                          const vector <Variable> &variableList) {
+            return results_->fail(contextStack_, given, whenStack, description, expressionText, variableList);
+        }
+
+        virtual void pass(const string& given,
+                          const NameStack& whenStack,
+                          optional<string> description,
+                          const string &expressionText,
+                          const vector <Variable> &variableList) {
+            return results_->pass(contextStack_, given, whenStack, description, expressionText, variableList);
+        }
+
+        void measured(const string& given, const NameStack& whenStack, const Measurement& measurement) {
+            results_->measured(contextStack_, given, whenStack, measurement);
+        }
+    };
+
+    class WhenResultRecorder final: public FailureHandler {
+        Out<ContextResultsRecorder> results_;
+        string given_;
+        NameStack whenStack_;
+
+        // Cached, so a passing check costs at most one indirect call when passes aren't reported.
+        bool notifyPassing_;
+    public:
+        WhenResultRecorder(Out<ContextResultsRecorder> results, string given) :
+                results_(results),
+                given_(move(given)),
+                whenStack_(givenNode(results->contextStack(), given_)),
+                notifyPassing_(results->notifyPassing())
+        {}
+
+        void push(NameRef name) {
+            const auto& interned = whenStack_.intern(name);
+            results_->beginWhen(given_, whenStack_, interned);
+            whenStack_.push(interned);
+        }
+
+        // The name stays valid after it's popped, as it's interned.
+        void pop(const Stats& stats) {
+            const auto& name = whenStack_.top();
+            whenStack_.pop();
+            results_->endWhen(stats, given_, whenStack_, name);
+        }
+
+        void failByException(const exception& e) {
+            results_->failByException(given_, whenStack_, e);
+        }
+
+        const string& given() const { return given_; }
+
+        const NameStack& whenStack() const { return whenStack_; }
+
+        NodeId contextNode() const { return results_->contextStack().node(); }
+
+        const RunOptions& options() const { return results_->options(); }
+
+        optional<TaskPool&> pool() const { return results_->pool(); }
+
+        void replay(const vector<Event>& eventList) {
+            results_->replay(eventList, given_);
+        }
+
+        virtual bool notifyPassing() const override { return notifyPassing_; }
+
+        virtual void fail(optional<string> description, const string &expressionText, const vector <Variable> &variableList) override {
+            return results_->fail(given_, whenStack_, description, expressionText, variableList);
+        }
+
+        virtual void pass(optional<string> description, const string &expressionText, const vector <Variable> &variableList) override {
+            return results_->pass(given_, whenStack_, description, expressionText, variableList);
+        }
+
+        void measured(const Measurement& measurement) {
+            results_->measured(given_, whenStack_, measurement);
+        }
+    };
+
+    // Work running on another thread. Its results are recorded, so they can be replayed in order once it's done.
+    class RecordedTask final: public NoCopy {
+        EventRecorder events_;
+        RunOptions options_;
+        Stats stats_;
+        exception_ptr error_;
+        atomic<bool> done_{false};
+    public:
+        RecordedTask(bool notifyPassing, const RunOptions& options) : events_(notifyPassing), options_(options) {}
+
+        // Functor takes an Out<ContextResultsRecorder> and returns the Stats. It runs inside contextNode.
+        template<typename Functor>
+        void run(Out<TaskPool> pool, NodeId contextNode, Functor&& functor) {
+            try {
+                ContextResultsRecorder results(out(events_), *pool, options_);
+                results.setContextNode(contextNode);
+                stats_ = functor(out(results));
+            }
+            catch (...) {
+                error_ = current_exception();
+            }
+
+            done_.store(true, memory_order_release);
+        }
+
+        // Wait for the task, helping with other tasks in the meantime, then replay its results.
+        Stats replay(Out<ContextResultsRecorder> results, Out<TaskPool> pool) {
+            pool->helpUntil([this] { return done_.load(memory_order_acquire); });
+
+            if (error_) {
+                rethrow_exception(error_);
+            }
+
+            results->replay(events_.events());
+            events_.clear();
+
+            return stats_;
+        }
+    };
+
+    class Schedule;
+
+    class Context: public NoCopy {
+        bool selected_ = true;
+        size_t shard_ = 0;
+        NodeId node_ = rootNode;
+    protected:
+        void setSelected(bool selected) { selected_ = selected; }
+        void setNode(NodeId node) { node_ = node; }
+    public:
+        virtual ~Context() {}
+
+        // Whether the last call to select included this context. Everything is selected until select is called.
+        bool selected() const { return selected_; }
+
+        size_t shard() const { return shard_; }
+        void setShard(size_t shard) { shard_ = shard; }
+
+        // This context's node in the TestIndex, once it's been indexed.
+        NodeId node() const { return node_; }
+
+        // Add this context and everything in it to the TestIndex, under parent.
+        virtual void index(NodeId parent) = 0;
+
+        // Call visit with the givenPath and context of each selected given, in tree order.
+        virtual void visitGivens(
+                Out<NameStack> contextStack,
+                const function<void(string, Out<Context>)>& visit
+            ) = 0;
+
+        // Deselect givens in other shards, and contexts with nothing left in them. Returns selected().
+        virtual bool selectShard(size_t shard) = 0;
+
+        // Work out which contexts and givens to include once, before they're listed or run. Returns selected().
+        virtual bool select(const PathFilter& filter, const PathFilter::State& state) = 0;
+
+        virtual void list(Out<ContextResultsRecorder> results) const = 0;
+        virtual Stats run(Out<ContextResultsRecorder> resultStack) = 0;
+        virtual void schedule(Out<Schedule> schedule) = 0;
+    };
+
+    using ContextList = vector<unique_ptr<Context>>;
+
+    // The context tree, flattened into the order a serial run would visit it. Each given is a task that can run on
+    // any thread. Its results are recorded, then replayed in tree order, so the output is the same as a serial run.
+    class Schedule final: public NoCopy {
+        enum class StepType {
+            PUSH,
+            POP,
+            RUN
+        };
+
+        struct Step {
+            StepType type;
+            const string* name;
+            size_t taskIndex;
+        };
+
+        struct Task final: public NoCopy {
+            Task(Out<Context> runner, bool notifyPassing, const RunOptions& options) :
+                runner(runner), recorded(notifyPassing, options)
+            {}
+
+            Out<Context> runner;
+            RecordedTask recorded;
+        };
+
+        bool notifyPassing_;
+        RunOptions options_;
+        vector<Step> stepList_;
+        vector<unique_ptr<Task>> taskList_;
+    public:
+        explicit Schedule(bool notifyPassing, RunOptions options = RunOptions()) :
+            notifyPassing_(notifyPassing), options_(options)
+        {}
+
+        void push(const string& name) {
+            stepList_.push_back(Step{StepType::PUSH, &name, 0});
+        }
+
+        void pop() {
+            stepList_.push_back(Step{StepType::POP, nullptr, 0});
+        }
+
+        void add(Out<Context> runner) {
+            stepList_.push_back(Step{StepType::RUN, nullptr, taskList_.size()});
+            taskList_.emplace_back(make_unique<Task>(runner, notifyPassing_, options_));
+        }
+
+        // Must only be called once, as it runs each given.
+        Stats run(Out<ContextResultsRecorder> results, Out<TaskPool> pool) {
+            for (auto& task : taskList_) {
+                Out<Task> currentTask(*task);
+
+                pool->submit([currentTask, pool] () mutable {
+                    auto contextNode = testIndex().parent(currentTask->runner->node());
+
+                    currentTask->recorded.run(
+                            pool,
+                            contextNode,
+                            [currentTask] (Out<ContextResultsRecorder> results) mutable {
+                                return currentTask->runner->run(results);
+                            }
+                        );
+                });
+            }
+
+            vector<Stats> statsStack(1);
+
+            for (const auto& step : stepList_) {
+                switch (step.type) {
+                    case StepType::PUSH:
+                        results->push(*step.name);
+                        statsStack.emplace_back();
+                        break;
+                    case StepType::POP: {
+                        auto stats = statsStack.back();
+                        statsStack.pop_back();
+                        results->pop(stats);
+                        statsStack.back() += stats;
+                        break;
+                    }
+                    case StepType::RUN:
+                        statsStack.back() += taskList_[step.taskIndex]->recorded.replay(results, pool);
+                        break;
+                }
+            }
+
+            return statsStack.front();
+        }
+    };
+
+    // Run givens in worker processes, so a given that crashes only takes its worker with it. Givens are handed out
+    // one at a time, in tree order, to whichever worker is free, over a Channel. Each worker sends back the Stats and
+    // events for its given. The tree is still walked in order in this process, and each given's results are replayed
+    // when it's reached, so the output is the same as a serial run.
+    //
+    // With RunOptions::isolate, workers are zygotes. They're forked before anything runs, and fork a fresh child for
+    // each given, so givens can't see each other's state, and a crash is reported by the zygote that saw it.
+    class WorkerPool final: public NoCopyMove {
+        // What a worker's reply holds, after the given's index.
+        enum class Reply : uint64_t {
+            RESULTS,
+            FAILED
+        };
+
+        struct Worker final: public NoCopy {
+            Worker(ProcessId process, Channel channel) : process(process), channel(move(channel)) {}
+
+            ProcessId process;
+            Channel channel;
+            optional<size_t> given;
+        };
+
+        struct Given final {
+            explicit Given(Out<Context> context) : context(context) {}
+
+            Out<Context> context;
+
+            // The worker's reply, or why the given failed without one.
+            optional<string> result;
+            optional<string> failure;
+        };
+
+        bool notifyPassing_;
+        RunOptions options_;
+        vector<Given> givenList_;
+        unordered_map<const Context*, size_t> givenIndex_;
+        deque<size_t> queue_;
+        vector<unique_ptr<Worker>> workerList_;
+
+        // The Stats and events from running a given.
+        string runGiven(size_t index) {
+            EventRecorder events(notifyPassing_);
+            ContextResultsRecorder results(out(events), none, options_);
+            auto& given = givenList_.at(index).context;
+            results.setContextNode(testIndex().parent(given->node()));
+            auto stats = given->run(out(results));
+
+            string data;
+            EventWriter writer(out(data));
+            writer(stats);
+            writer(events.events());
+
+            return data;
+        }
+
+        void runIsolated(size_t index, Out<Channel> channel, Out<EventWriter> reply) {
+            Pipe pipe;
+            ProcessId child = forkProcess();
+
+            if (child == 0) {
+                channel->close();
+                pipe.closeRead();
+
+                try {
+                    writeAll(pipe.writeEnd(), runGiven(index));
+                }
+                catch (...) {
+                    exitProcess(1);
+                }
+
+                exitProcess(0);
+            }
+
+            pipe.closeWrite();
+            auto data = readAll(pipe.readEnd());
+            auto failure = waitForProcess(child);
+
+            if (failure) {
+                (*reply)(static_cast<uint64_t>(Reply::FAILED));
+                (*reply)("The process running this given " + *failure);
+            }
+            else {
+                (*reply)(static_cast<uint64_t>(Reply::RESULTS));
+                (*reply)(data);
+            }
+        }
+
+        [[noreturn]] void workerMain(Channel channel) {
+            try {
+                while (auto message = channel.receive()) {
+                    EventReader reader(*message);
+                    auto index = reader.readInteger();
+
+                    string reply;
+                    EventWriter writer(out(reply));
+                    writer(index);
+
+                    if (options_.isolate) {
+                        runIsolated(index, out(channel), out(writer));
+                    }
+                    else {
+                        writer(static_cast<uint64_t>(Reply::RESULTS));
+                        writer(runGiven(index));
+                    }
+
+                    channel.send(reply);
+                }
+            }
+            catch (...) {
+                exitProcess(1);
+            }
+
+            exitProcess(0);
+        }
+
+        void startWorker() {
+            auto channels = makeChannelPair();
+            auto process = forkProcess();
+
+            if (process == 0) {
+                // Only the coordinator should hold the other ends, so each worker sees the end of its channel. Other
+                // threads may be running their own workers, so close everything rather than just our channels.
+                closeFilesExcept(channels.second.socket());
+                channels.first.release();
+
+                for (auto& worker : workerList_) {
+                    worker->channel.release();
+                }
+
+                workerMain(move(channels.second));
+            }
+
+            channels.second.close();
+            workerList_.emplace_back(make_unique<Worker>(process, move(channels.first)));
+        }
+
+        // The worker has gone, so reap it, and fail the given it was running. Only start another one if there's
+        // something for it to do.
+        void workerFailed(size_t workerIndex) {
+            auto& worker = workerList_[workerIndex];
+            worker->channel.close();
+            auto failure = waitForProcess(worker->process);
+
+            if (worker->given) {
+                givenList_[*worker->given].failure =
+                    "The worker process running this given " + (failure ? *failure : string("exited"));
+            }
+
+            workerList_.erase(workerList_.begin() + static_cast<ptrdiff_t>(workerIndex));
+
+            if ( ! queue_.empty()) {
+                startWorker();
+            }
+        }
+
+        void dispatch() {
+            for (size_t workerIndex = 0; workerIndex < workerList_.size() && ! queue_.empty(); ++workerIndex) {
+                auto& worker = workerList_[workerIndex];
+
+                if (worker->given) {
+                    continue;
+                }
+
+                auto index = queue_.front();
+                queue_.pop_front();
+
+                string message;
+                EventWriter writer(out(message));
+                writer(index);
+
+                try {
+                    worker->channel.send(message);
+                    worker->given = index;
+                }
+                catch (const exception&) {
+                    // The worker died before it got the given, so give it to someone else.
+                    queue_.push_front(index);
+                    workerFailed(workerIndex);
+                    --workerIndex;
+                }
+            }
+        }
+
+        // Wait for at least one busy worker to finish its given, or fail.
+        void receive() {
+            vector<const Channel*> channelList;
+            vector<size_t> busyList;
+
+            for (size_t workerIndex = 0; workerIndex < workerList_.size(); ++workerIndex) {
+                if (workerList_[workerIndex]->given) {
+                    channelList.push_back(&workerList_[workerIndex]->channel);
+                    busyList.push_back(workerIndex);
+                }
+            }
+
+            if (busyList.empty()) {
+                throw runtime_error("No worker is running a given");
+            }
+
+            auto readyList = waitForChannels(channelList);
+
+            // Backwards, as workerFailed removes the worker.
+            for (auto ready = readyList.rbegin(); ready != readyList.rend(); ++ready) {
+                auto workerIndex = busyList[*ready];
+                auto& worker = workerList_[workerIndex];
+
+                try {
+                    auto message = worker->channel.receive();
+
+                    if (message) {
+                        EventReader reader(*message);
+
+                        if (reader.readInteger() != *worker->given) {
+                            throw runtime_error("Results for the wrong given");
+                        }
+
+                        auto& given = givenList_[*worker->given];
+
+                        if (static_cast<Reply>(reader.readInteger()) == Reply::FAILED) {
+                            given.failure = reader.readString();
+                        }
+                        else {
+                            given.result = reader.readString();
+                        }
+
+                        worker->given = none;
+                        continue;
+                    }
+                }
+                catch (const exception&) {
+                }
+
+                workerFailed(workerIndex);
+            }
+        }
+    public:
+        // Start the workers, and hand out the first givens. givenList must be in the order the givens will be run.
+        WorkerPool(size_t workerCount, bool notifyPassing, const RunOptions& options, const vector<Out<Context>>& givenList) :
+            notifyPassing_(notifyPassing),
+            options_(options)
+        {
+            options_.workers = 0;
+
+            for (auto given : givenList) {
+                givenIndex_.emplace(&*given, givenList_.size());
+                queue_.push_back(givenList_.size());
+                givenList_.emplace_back(given);
+            }
+
+            for (size_t index = 0; index < workerCount && index < givenList_.size(); ++index) {
+                startWorker();
+            }
+
+            dispatch();
+        }
+
+        // Closing its channel tells a worker to exit.
+        ~WorkerPool() {
+            for (auto& worker : workerList_) {
+                worker->channel.close();
+            }
+
+            for (auto& worker : workerList_) {
+                waitForProcess(worker->process);
+            }
+        }
+
+        // Wait for the given's results from its worker, and replay them. A given whose process failed is reported as
+        // failing by exception.
+        Stats replay(const Context& context, const string& name, Out<ContextResultsRecorder> results) {
+            auto& given = givenList_[givenIndex_.at(&context)];
+
+            while ( ! given.result && ! given.failure) {
+                receive();
+                dispatch();
+            }
+
+            Stats stats;
+
+            if (given.failure) {
+                results->beginGiven(name);
+                results->failByException(name, NameStack(), runtime_error(*given.failure));
+                stats.addFixture();
+                stats.addTest();
+                stats.failTest();
+                results->endGiven(stats, name);
+
+                return stats;
+            }
+
+            EventReader reader(*given.result);
+            stats = reader.readStats();
+            results->replay(reader.readEvents());
+            given.result = none;
+
+            return stats;
+        }
+    };
+
+    class Register final: public NoCopyMove {
+    public:
+        static void add(unique_ptr<Context> context) {
+            context->index(rootNode);
+            instance().contextList.emplace_back(move(context));
+        }
+
+        static void list(const PathFilter& filter, Out<Results> results) {
+            select(filter);
+            ContextResultsRecorder resultsRecorder(results);
+
+            for (const auto& context : instance().contextList) {
+                context->list(out(resultsRecorder));
+            }
+        }
+
+        // Write the shard that each selected given would run in, then how many givens and how much time from
+        // options.timings each shard has.
+        static void listShards(const PathFilter& filter, const RunOptions& options, Out<ostream> output) {
+            select(filter);
+            auto givenList = shardGivens(options);
+            vector<size_t> givenCounts(options.shardCount, 0);
+            vector<uint64_t> times(options.shardCount, 0);
+            vector<size_t> untimedCounts(options.shardCount, 0);
+
+            for (const auto& given : givenList) {
+                auto shard = given.second->shard();
+                *output << shard << " " << given.first << "\n";
+                ++givenCounts[shard];
+
+                if (options.timings && options.timings->count(given.first)) {
+                    times[shard] += options.timings->at(given.first);
+                }
+                else {
+                    ++untimedCounts[shard];
+                }
+            }
+
+            for (size_t shard = 0; shard < options.shardCount; ++shard) {
+                *output << "Shard " << shard << ": " << givenCounts[shard] << " givens, " <<
+                    formatMilliseconds(times[shard]);
+
+                if (untimedCounts[shard] > 0) {
+                    *output << ", " << untimedCounts[shard] << " without timings";
+                }
+
+                *output << "\n";
+            }
+        }
+
+        static Stats run(const PathFilter& filter, Out<Results> results, const RunOptions& options = RunOptions()) {
+            select(filter);
+
+            if (options.shardCount > 1) {
+                shardGivens(options);
+
+                for (const auto& context : instance().contextList) {
+                    context->selectShard(options.shardIndex);
+                }
+            }
+
+            Stats stats;
+
+            if (options.workers > 0 || options.isolate) {
+                vector<Out<Context>> givenList;
+                NameStack contextStack;
+
+                for (const auto& context : instance().contextList) {
+                    context->visitGivens(out(contextStack), [&] (string, Out<Context> given) {
+                        givenList.push_back(given);
+                    });
+                }
+
+                WorkerPool workers(max<size_t>(options.workers, 1), results->notifyPassing(), options, givenList);
+                ContextResultsRecorder resultsRecorder(results, none, options, workers);
+
+                for (const auto& context : instance().contextList) {
+                    stats += context->run(out(resultsRecorder));
+                }
+            }
+            else if (options.jobs <= 1) {
+                ContextResultsRecorder resultsRecorder(results, none, options);
+
+                for (const auto& context : instance().contextList) {
+                    stats += context->run(out(resultsRecorder));
+                }
+            }
+            else {
+                Schedule schedule(results->notifyPassing(), options);
+
+                for (const auto& context : instance().contextList) {
+                    context->schedule(out(schedule));
+                }
+
+                // The pool must be destroyed before the schedule, as running tasks refer to it.
+                TaskPool pool(options.jobs - 1);
+                ContextResultsRecorder resultsRecorder(results, pool, options);
+                stats = schedule.run(out(resultsRecorder), out(pool));
+            }
+
+            results->finish(stats);
+            return stats;
+        }
+    private:
+        Register() = default;
+
+        static void select(const PathFilter& filter) {
+            for (const auto& context : instance().contextList) {
+                context->select(filter, filter.root());
+            }
+        }
+
+        // Assign each selected given to a shard. Returns the givens, with their paths, in tree order.
+        static vector<pair<string, Out<Context>>> shardGivens(const RunOptions& options) {
+            vector<pair<string, Out<Context>>> givenList;
+            vector<string> pathList;
+            NameStack contextStack;
+
+            for (const auto& context : instance().contextList) {
+                context->visitGivens(out(contextStack), [&] (string path, Out<Context> given) {
+                    pathList.push_back(path);
+                    givenList.emplace_back(move(path), given);
+                });
+            }
+
+            auto shardList = assignShards(pathList, options.shardCount, options.timings ? *options.timings : Timings());
+
+            for (size_t index = 0; index < givenList.size(); ++index) {
+                givenList[index].second->setShard(shardList[index]);
+            }
+
+            return givenList;
+        }
+
+        static Register& instance() {
+            static Register theInstance;
+
+            return theInstance;
+        }
+
+        ContextList contextList;
+    };
+
+    class NodeContext final: public Context {
+    public:
+        NodeContext(const string& name, vector<unique_ptr<Context>> contextList) :
+            name(name),
+            contextList(move(contextList))
+        {}
+
+        virtual void index(NodeId parent) override {
+            setNode(testIndex().child(parent, name));
+
+            for (const auto& context : contextList) {
+                context->index(node());
+            }
+        }
+
+        // A context is only selected if something in it is, unless the filter includes everything below it.
+        virtual bool select(const PathFilter& filter, const PathFilter::State& state) override {
+            auto childState = filter.match(state, name);
+            bool anySelected = false;
+
+            if (childState) {
+                anySelected = childState->all();
+
+                for (const auto& context : contextList) {
+                    anySelected = context->select(filter, *childState) || anySelected;
+                }
+            }
+
+            setSelected(anySelected);
+
+            return anySelected;
+        }
+
+        virtual void visitGivens(
+                Out<NameStack> contextStack,
+                const function<void(string, Out<Context>)>& visit
+            ) override
+        {
+            if ( ! selected()) return;
+
+            contextStack->push(name);
+
+            for (const auto& context : contextList) {
+                context->visitGivens(contextStack, visit);
+            }
+
+            contextStack->pop();
+        }
+
+        virtual bool selectShard(size_t shard) override {
+            if ( ! selected()) return false;
+
+            bool anySelected = false;
+
+            for (const auto& context : contextList) {
+                anySelected = context->selectShard(shard) || anySelected;
+            }
+
+            setSelected(anySelected);
+
+            return anySelected;
+        }
+
+        virtual void list(Out<ContextResultsRecorder> results) const override {
+            if ( ! selected()) return;
+
+            results->push(name);
+
+            for (const auto& context : contextList) {
+                context->list(results);
+            }
+
+            Stats stats;
+            results->pop(stats); // TODO
+        }
+
+        virtual Stats run(Out<ContextResultsRecorder> results) override {
+            Stats stats;
+
+            if ( ! selected()) return stats;
+
+            results->push(name);
+
+            for (const auto& context : contextList) {
+                stats += context->run(results);
+            }
+
+            results->pop(stats);
+
+            return stats;
+        }
+
+        virtual void schedule(Out<Schedule> schedule) override {
+            if ( ! selected()) return;
+
+            schedule->push(name);
+
+            for (const auto& context : contextList) {
+                context->schedule(schedule);
+            }
+
+            schedule->pop();
+        }
+    private:
+        string name;
+        vector<unique_ptr<Context>> contextList;
+    };
+
+    template<typename... ContextListType>
+    void makeContextList(Out<ContextList> contextList, unique_ptr<Context> childContext, ContextListType&&... childContextList) {
+        contextList->emplace_back(move(childContext));
+        makeContextList(contextList, forward<ContextListType>(childContextList)...);
+    }
+
+    inline void makeContextList(Out<ContextList>) {
+    }
+
+    template<typename... ContextListType>
+    unique_ptr<Context> context(const string& name, ContextListType&&... childContextList) {
+        ContextList contextList;
+        makeContextList(out(contextList), forward<ContextListType>(childContextList)...);
+
+        return make_unique<NodeContext>(name, move(contextList));
+    }
+
+    class Suite: public NoCopy {
+    public:
+        template<typename... ContextListType>
+        Suite(const string& name, ContextListType&&... childContextList) {
+            Register::add(context(name, forward<ContextListType>(childContextList)...));
+        }
+    };
+
+    // The state of a process running a given with RunOptions::forkWhens. Every process that reaches a when forks a
+    // child to run it, then waits for the child before carrying on, so whens run in the same order as a serial run.
+    // A child skips any later siblings of its when, as its parent runs those. Only leaf processes, which never
+    // fork, send their results to the test process. Each path through the whens is reported once, as it would be
+    // by a serial run, but the code leading up to a when only runs once.
+    class ForkedWhens final: public NoCopy {
+        int output_;
+        Out<EventRecorder> events_;
+        vector<bool> entered_;
+        bool forked_ = false;
+    public:
+        ForkedWhens(int output, Out<EventRecorder> events) : output_(output), events_(events) {}
+
+        // Whether this process is running one of the when's earlier siblings.
+        bool skip(size_t depth) const {
+            return depth < entered_.size() && entered_[depth];
+        }
+
+        // Called in a new child, which runs the when at depth and hasn't forked yet.
+        void enter(size_t depth) {
+            if (entered_.size() <= depth) {
+                entered_.resize(depth + 1, false);
+            }
+
+            entered_[depth] = true;
+            forked_ = false;
+        }
+
+        void forked() { forked_ = true; }
+
+        bool isLeaf() const { return ! forked_; }
+
+        const vector<Event>& events() const { return events_->events(); }
+
+        void send(const Stats& stats, const vector<Event>& eventList) {
+            string data;
+            EventWriter writer(out(data));
+            writer(stats);
+            writer(eventList);
+            writeAll(output_, data);
+        }
+    };
+
+    class Check;
+
+    class WhenRunner final: public FailureHandler {
+        struct StackElement {
+            size_t index = 0;
+            size_t current = 0;
+        };
+
+        Stats stats_;
+        vector<StackElement> whenStack;
+        WhenResultRecorder whenResultRecorder_;
+        size_t whenDepth_ = 0;
+        bool forkWhens_;
+        optional<ForkedWhens&> forkedWhens_;
+        optional<const Check&> currentCheck_;
+
+        bool topWhenDone() const {
+            const auto& top = whenStack.back();
+
+            return top.current == top.index + 1;
+        }
+
+        template<typename Functor, typename... Args>
+        void runOnce(Functor&& functor, Args&&... args);
+
+        template<typename Functor, typename... Args>
+        void runParallel(Out<TaskPool> pool, Functor& functor, Args&... args);
+
+        template<typename Functor, typename... Args>
+        void runForked(Functor&& functor, Args&&... args);
+
+        template<typename Functor, typename... Args>
+        [[noreturn]] void runForkedWhens(Functor&& functor, Args&&... args);
+
+        template<typename Functor>
+        void forkedWhen(NameRef description, Functor&& functor);
+
+        void reportCrashedWhen(const string& description, const string& failure);
+    public:
+        WhenRunner(Out<ContextResultsRecorder> results, string given) :
+                whenResultRecorder_(results, move(given)), forkWhens_(results->options().forkWhens) {}
+
+        // Run inside a process forked for ForkedWhens.
+        WhenRunner(Out<ContextResultsRecorder> results, string given, Out<ForkedWhens> forkedWhens) :
+                whenResultRecorder_(results, move(given)), forkWhens_(false), forkedWhens_(*forkedWhens) {}
+
+        template<typename Functor, typename... Args>
+        void run(Functor&& functor, Args&&... args);
+
+        // Run every path through the whens in this process and thread, whatever the options, so the runs can share
+        // state.
+        template<typename Functor, typename... Args>
+        void runInProcess(Functor&& functor, Args&&... args);
+
+        // Run the path through the whens that starts with prefix, then takes the first when at each depth. path is
+        // set to the index of the when taken at each depth, and siblingCounts to the number of whens seen there.
+        template<typename Functor, typename... Args>
+        void runPath(
+                const vector<size_t>& prefix,
+                Out<vector<size_t>> path,
+                Out<vector<size_t>> siblingCounts,
+                Functor&& functor,
+                Args&&... args
+            );
+
+        template<typename Functor>
+        void when(NameRef description, Functor&& functor) {
+            if (forkedWhens_) {
+                forkedWhen(description, forward<Functor>(functor));
+                return;
+            }
+
+            if (whenStack.size() <= whenDepth_) {
+                whenStack.push_back(StackElement{});
+            }
+
+            Finally stack([&] { ++whenStack[whenDepth_].current; });
+
+            if (whenStack[whenDepth_].index == whenStack[whenDepth_].current) {
+                ++whenDepth_;
+                whenResultRecorder_.push(description);
+                Timer timer;
+
+                Finally depth([&] {
+                    --whenDepth_;
+                    Stats stats; // TODO
+                    stats.addTime(timer.wall(), timer.cpu());
+                    whenResultRecorder_.pop(stats);
+                });
+
+                functor();
+            }
+        }
+
+        virtual bool notifyPassing() const override { return whenResultRecorder_.notifyPassing(); }
+
+        virtual void fail(optional<string> description, const string &expressionText, const vector <Variable> &variableList) override {
+            return whenResultRecorder_.fail(description, expressionText, variableList);
+        }
+
+        virtual void pass(optional<string> description, const string &expressionText, const vector <Variable> &variableList) override {
+            return whenResultRecorder_.pass(description, expressionText, variableList);
+        }
+
+        void measured(const Measurement& measurement) {
+            whenResultRecorder_.measured(measurement);
+        }
+
+        const NameStack& whenNames() const { return whenResultRecorder_.whenStack(); }
+
+        const Stats& stats() const { return stats_; }
+    };
+
+    class Check : public NoCopy {
+        Out<WhenRunner> whenRunner_;
+        Stats stats_;
+
+        friend inline Stats checkStats(const Check& check) {
+            return check.stats_;
+        }
+
+        friend class Bench;
+
+        bool addCheck(bool ok) {
+            stats_.addCheck();
+
+            if ( ! ok) {
+                stats_.failCheck();
+            }
+
+            return ok;
+        }
+    public:
+        Check(Out<WhenRunner> whenRunner) : whenRunner_(whenRunner) {}
+
+        template<typename Functor>
+        void when(NameRef description, Functor&& functor) {
+            whenRunner_->when(description, forward<Functor>(functor));
+        }
+
+        template<typename... Args>
+        bool operator()(Args&&... args) {
+            return addCheck(CheckWithFailureHandler(
+                    whenRunner_,
+                    forward<Args>(args)...
+            ));
+        }
+
+        template<typename Exception = exception, typename... Args>
+        bool throws(Args&&... args) {
+            return addCheck(CheckThrowsWithFailureHandler<Exception>(
+                    whenRunner_,
+                    forward<Args>(args)...
+            ));
+        }
+
+        template<typename Expression, typename... ContextVariableList>
+        void fail(Expression expression, ContextVariableList... contextVariableList) {
+            processFailure(whenRunner_, none, move(expression), move(contextVariableList)...);
+            stats_.failCheck();
+        }
+    };
+
+    // What a benchmark is given. Time code with measure, which reports each measurement, and check it as a given
+    // would.
+    class Bench final: public NoCopy {
+        Check& check_;
+        string name_;
+        BenchmarkOptions options_;
+        shared_ptr<const Baselines> baselines_;
+
+        // For a sweep, the arguments, formatted to add to measurement names, and where to record the measurements.
+        string arguments_;
+        optional<Sweep&> sweep_;
+
+        // A regression is a failed check, so it's reported and fails the run like any other.
+        void checkBaseline(const Measurement& measurement) {
+            if ( ! baselines_) return;
+
+            auto baseline = baselines_->find(baselineKey(check_.whenRunner_->whenNames(), measurement.name()));
+
+            if (baseline == baselines_->end()) return;
+
+            auto comparison = compareToBaseline(baseline->second, measurement);
+            const auto& significance = options_.significance;
+            const auto& regressionThreshold = options_.regressionThreshold;
+
+            check_(
+                    measurement.name() + " is no slower than its baseline, with a median of " +
+                        formatNanoseconds(comparison.median) + " against " +
+                        formatNanoseconds(comparison.baselineMedian),
+                    VAR(comparison.change) <= VAR(regressionThreshold) ||
+                        VAR(comparison.pValue) >= VAR(significance)
+                );
+        }
+    public:
+        Bench(Check& check,
+              string name,
+              BenchmarkOptions options,
+              shared_ptr<const Baselines> baselines,
+              string arguments = string(),
+              optional<Sweep&> sweep = none) :
+            check_(check),
+            name_(move(name)),
+            options_(options),
+            baselines_(move(baselines)),
+            arguments_(move(arguments)),
+            sweep_(sweep)
+        {}
+
+        // The options for the rest of this benchmark, starting with RunOptions::benchmark.
+        BenchmarkOptions& options() { return options_; }
+
+        // Time functor, named after the benchmark. If there's a baseline for the measurement, check it's no slower.
+        template<typename Functor>
+        Measurement measure(Functor&& functor) {
+            return measure(name_, forward<Functor>(functor));
+        }
+
+        // In a sweep, the arguments are added to name.
+        template<typename Functor>
+        Measurement measure(string name, Functor&& functor) {
+            auto measurement = Impl_Benchmark::measure(name + arguments_, options_, forward<Functor>(functor));
+            check_.whenRunner_->measured(measurement);
+            checkBaseline(measurement);
+
+            if (sweep_) {
+                sweep_->add(move(name), measurement);
+            }
+
+            return measurement;
+        }
+
+        template<typename Functor>
+        void when(NameRef description, Functor&& functor) {
+            check_.when(description, forward<Functor>(functor));
+        }
+
+        template<typename... Args>
+        bool operator()(Args&&... args) {
+            return check_(forward<Args>(args)...);
+        }
+
+        template<typename Exception = exception, typename... Args>
+        bool throws(Args&&... args) {
+            return check_.template throws<Exception>(forward<Args>(args)...);
+        }
+    };
+
+    template<typename Functor, typename... Args>
+    void WhenRunner::run(Functor&& functor, Args&&... args) {
+        if (forkWhens_) {
+            runForked(forward<Functor>(functor), forward<Args>(args)...);
+            return;
+        }
+
+        auto pool = whenResultRecorder_.pool();
+
+        if (pool && whenResultRecorder_.options().parallelWhens) {
+            runParallel(out(*pool), functor, args...);
+            return;
+        }
+
+        runInProcess(forward<Functor>(functor), forward<Args>(args)...);
+    }
+
+    template<typename Functor, typename... Args>
+    void WhenRunner::runInProcess(Functor&& functor, Args&&... args) {
+        whenStack.clear();
+        whenDepth_ = 0;
+        stats_.addFixture(); // TODO:
+
+        do {
+            runOnce(functor, forward<Args>(args)...);
+
+            while ( ! whenStack.empty() && topWhenDone()) {
+                whenStack.pop_back();
+            }
+
+            if ( ! whenStack.empty()) {
+                ++whenStack.back().index;
+            }
+        } while ( ! whenStack.empty());
+
+        if (stats_.tests() == 0) {
+            stats_.addTest();
+        }
+    }
+
+    // Run the given once, along the path through the whens set by whenStack.
+    template<typename Functor, typename... Args>
+    void WhenRunner::runOnce(Functor&& functor, Args&&... args) {
+        for (auto& element : whenStack) {
+            element.current = 0;
+        }
+
+        Timer timer;
+        Check check(out(*this));
+
+        try {
+            functor(check, forward<Args>(args)...);
+        }
+        catch (const exception& e) {
+            whenResultRecorder_.failByException(e);
+            stats_.failTest();
+        }
+
+        stats_.addTest(); // TODO
+        stats_ += checkStats(check);
+        stats_.addTime(timer.wall(), timer.cpu());
+    }
+
+    template<typename Functor, typename... Args>
+    void WhenRunner::runPath(
+            const vector<size_t>& prefix,
+            Out<vector<size_t>> path,
+            Out<vector<size_t>> siblingCounts,
+            Functor&& functor,
+            Args&&... args
+        )
+    {
+        whenStack.clear();
+        whenDepth_ = 0;
+
+        for (auto index : prefix) {
+            whenStack.push_back(StackElement{index, 0});
+        }
+
+        runOnce(functor, forward<Args>(args)...);
+        path->clear();
+        siblingCounts->clear();
+
+        for (const auto& element : whenStack) {
+            path->push_back(element.index);
+            siblingCounts->push_back(element.current);
+        }
+    }
+
+    // Each path through the whens runs as a separate task, with its own WhenRunner. The first task takes the first
+    // when at every depth, which tells us how many whens there are at each depth on its path. It then submits a task
+    // for each later sibling, and so on, so the tree is discovered as it runs and each path runs exactly once. Paths
+    // are replayed in lexicographic order of their when indices, which is the order a serial run would visit them.
+    template<typename Functor, typename... Args>
+    void WhenRunner::runParallel(Out<TaskPool> pool, Functor& functor, Args&... args) {
+        struct WhenPath final: public NoCopy {
+            explicit WhenPath(vector<size_t> prefix, bool notifyPassing) :
+                prefix(move(prefix)), events(notifyPassing)
+            {}
+
+            vector<size_t> prefix;
+            vector<size_t> path;
+            EventRecorder events;
+            Stats stats;
+            exception_ptr error;
+        };
+
+        stats_.addFixture();
+
+        mutex pathListMutex;
+        vector<unique_ptr<WhenPath>> pathList;
+        atomic<size_t> outstanding{0};
+        const string& given = whenResultRecorder_.given();
+        auto contextNode = whenResultRecorder_.contextNode();
+        bool notifyPassing = whenResultRecorder_.notifyPassing();
+        RunOptions options = whenResultRecorder_.options();
+
+        auto addPath = [&] (vector<size_t> prefix) {
+            lock_guard<mutex> lock(pathListMutex);
+            pathList.emplace_back(make_unique<WhenPath>(move(prefix), notifyPassing));
+
+            return out(*pathList.back());
+        };
+
+        function<void(vector<size_t>)> submitPath = [&] (vector<size_t> prefix) {
+            auto whenPath = addPath(move(prefix));
+            ++outstanding;
+
+            pool->submit([&, whenPath] () mutable {
+                vector<size_t> siblingCounts;
+
+                try {
+                    ContextResultsRecorder results(out(whenPath->events), *pool, options);
+                    results.setContextNode(contextNode);
+                    WhenRunner whenRunner(out(results), given);
+                    whenRunner.runPath(whenPath->prefix, out(whenPath->path), out(siblingCounts), functor, args...);
+                    whenPath->stats = whenRunner.stats();
+
+                    for (size_t depth = whenPath->prefix.size(); depth < whenPath->path.size(); ++depth) {
+                        for (size_t sibling = 1; sibling < siblingCounts[depth]; ++sibling) {
+                            vector<size_t> siblingPrefix(whenPath->path.begin(), whenPath->path.begin() + depth);
+                            siblingPrefix.push_back(sibling);
+                            submitPath(move(siblingPrefix));
+                        }
+                    }
+                }
+                catch (...) {
+                    whenPath->error = current_exception();
+                }
+
+                outstanding.fetch_sub(1, memory_order_release);
+            });
+        };
+
+        submitPath(vector<size_t>());
+        pool->helpUntil([&] { return outstanding.load(memory_order_acquire) == 0; });
+
+        sort(pathList.begin(), pathList.end(), [] (const unique_ptr<WhenPath>& lhs, const unique_ptr<WhenPath>& rhs) {
+            return lhs->path < rhs->path;
+        });
+
+        for (const auto& whenPath : pathList) {
+            if (whenPath->error) {
+                rethrow_exception(whenPath->error);
+            }
+
+            whenResultRecorder_.replay(whenPath->events.events());
+            stats_ += whenPath->stats;
+        }
+    }
+
+    template<typename Functor, typename... Args>
+    void WhenRunner::runForked(Functor&& functor, Args&&... args) {
+        stats_.addFixture();
+        Timer timer;
+        Pipe pipe;
+        ProcessId child = forkProcess();
+
+        if (child == 0) {
+            pipe.closeRead();
+            EventRecorder events(whenResultRecorder_.notifyPassing());
+            ContextResultsRecorder results(out(events));
+            results.setContextNode(whenResultRecorder_.contextNode());
+            ForkedWhens forkedWhens(pipe.writeEnd(), out(events));
+            WhenRunner whenRunner(out(results), whenResultRecorder_.given(), out(forkedWhens));
+            whenRunner.runForkedWhens(forward<Functor>(functor), forward<Args>(args)...);
+        }
+
+        pipe.closeWrite();
+        auto data = readAll(pipe.readEnd());
+        auto failure = waitForProcess(child);
+
+        try {
+            EventReader reader(data);
+
+            while ( ! reader.atEnd()) {
+                stats_ += reader.readStats();
+                whenResultRecorder_.replay(reader.readEvents());
+            }
+        }
+        catch (const exception& e) {
+            whenResultRecorder_.failByException(e);
+            stats_.addTest();
+            stats_.failTest();
+        }
+
+        if (failure) {
+            whenResultRecorder_.failByException(runtime_error("The process running this given " + *failure));
+            stats_.addTest();
+            stats_.failTest();
+        }
+
+        // CPU time comes from the leaf processes.
+        stats_.addTime(timer.wall(), 0);
+
+        if (stats_.tests() == 0) {
+            stats_.addTest();
+        }
+    }
+
+    // Every process forked for the given ends here.
+    template<typename Functor, typename... Args>
+    void WhenRunner::runForkedWhens(Functor&& functor, Args&&... args) {
+        Check check(out(*this));
+        currentCheck_ = check;
+        bool failed = false;
+
+        try {
+            functor(check, forward<Args>(args)...);
+        }
+        catch (const exception& e) {
+            whenResultRecorder_.failByException(e);
+            failed = true;
+        }
+
+        if (forkedWhens_->isLeaf()) {
+            auto stats = checkStats(check);
+            stats.addTest();
+
+            // A new process starts with no CPU time, so this is the time since the last fork.
+            stats.addTime(0, threadCpuNanoseconds());
+
+            if (failed) {
+                stats.failTest();
+            }
+
+            forkedWhens_->send(stats, forkedWhens_->events());
+        }
+
+        exitProcess(0);
+    }
+
+    template<typename Functor>
+    void WhenRunner::forkedWhen(NameRef description, Functor&& functor) {
+        if (forkedWhens_->skip(whenDepth_)) {
+            return;
+        }
+
+        ProcessId child = forkProcess();
+
+        if (child != 0) {
+            forkedWhens_->forked();
+            auto failure = waitForProcess(child);
+
+            if (failure) {
+                reportCrashedWhen(description.str(), *failure);
+            }
+
+            return;
+        }
+
+        forkedWhens_->enter(whenDepth_);
+        ++whenDepth_;
+        whenResultRecorder_.push(description);
+        Timer timer;
+
+        // The when may end in a descendant process, whose CPU time starts again from zero, so only wall time is
+        // recorded.
+        Finally depth([&] {
+            --whenDepth_;
+            Stats stats; // TODO
+            stats.addTime(timer.wall(), 0);
+            whenResultRecorder_.pop(stats);
+        });
+
+        functor();
+    }
+
+    // The child's results are lost, so report what this process has seen so far, then the crash.
+    inline void WhenRunner::reportCrashedWhen(const string& description, const string& failure) {
+        auto eventList = forkedWhens_->events();
+        auto addEvent = [&] (EventType type, const string& name) {
+            eventList.push_back(Event{type, name, Stats(), optional<string>(), vector<Variable>()});
+        };
+
+        addEvent(EventType::BEGIN_WHEN, description);
+        addEvent(EventType::FAIL_BY_EXCEPTION, "The process running this when " + failure);
+        addEvent(EventType::END_WHEN, description);
+
+        auto openWhens = whenResultRecorder_.whenStack().stack();
+
+        for (auto depth = openWhens.size(); depth > 0; --depth) {
+            addEvent(EventType::END_WHEN, openWhens[depth - 1]);
+        }
+
+        auto stats = checkStats(*currentCheck_);
+        stats.addTest();
+        stats.failTest();
+        forkedWhens_->send(stats, eventList);
+    }
+
+
+    template<typename Functor, typename... Args>
+    class Runner final: public Context {
+        string name;
+        Functor runTest;
+        StoreArgs<Args...> args;
+    public:
+        Runner(string name, Functor runTest, Args&&... args) :
+            name(move(name)), runTest(move(runTest)), args(forward<Args>(args)...)
+        {}
+
+        virtual void index(NodeId parent) override {
+            setNode(testIndex().child(parent, name));
+        }
+
+        virtual bool select(const PathFilter& filter, const PathFilter::State& state) override {
+            setSelected(filter.match(state, name));
+
+            return selected();
+        }
+
+        virtual void visitGivens(
+                Out<NameStack> contextStack,
+                const function<void(string, Out<Context>)>& visit
+            ) override
+        {
+            if (selected()) {
+                visit(givenPath(*contextStack, name), out(*this));
+            }
+        }
+
+        virtual bool selectShard(size_t shard) override {
+            setSelected(selected() && this->shard() == shard);
+
+            return selected();
+        }
+
+        virtual void list(Out<ContextResultsRecorder> results) const override {
+            if ( ! selected()) return;
+
+            results->beginGiven(name);
+            Stats stats; // TODO
+            results->endGiven(stats, name);
+        }
+
+        // Must only be called once as it forwards the constructor arguments to the class.
+        virtual Stats run(Out<ContextResultsRecorder> results) override {
+            Stats stats;
+
+            if ( ! selected()) return stats;
+
+            auto workers = results->workers();
+
+            if (workers) {
+                return workers->replay(*this, name, results);
+            }
+
+            results->beginGiven(name);
+            stats += args.applyExtraBefore(runTest, name, results);
+            results->endGiven(stats, name);
+
+            return stats;
+        }
+
+        virtual void schedule(Out<Schedule> schedule) override {
+            if (selected()) {
+                schedule->add(out(*this));
+            }
+        }
+    };
+
+    template<typename Functor, typename... Args>
+    class RunTest final: public NoCopy {
+        Functor runTest;
+    public:
+        RunTest(Functor runTest) : runTest(move(runTest)) {}
+
+        // Visual C++ 2015 seems to generate a dodgy move constructor here.
+        RunTest(RunTest&& other) : runTest(move(other.runTest)) {}
+
+        RunTest operator=(RunTest&& other) {
+            runTest = move(other.runTest);
+        }
+
+        Stats operator()(const string& name, Out<ContextResultsRecorder> results, Args&&... args) {
+            WhenRunner whenRunner(results, name);
+            whenRunner.run(runTest, forward<Args>(args)...);
+
+            return whenRunner.stats();
+        }
+    };
+
+    // Workaround for MSVC bug. We should be able to use std forward, but it doesn't work for decayed arrays.
+    template<typename T>
+    struct Forward {
+        static constexpr T&& run( typename std::remove_reference<T>::type& t ) {
+            return std::forward<T>(t);
+        }
+
+        static constexpr T&& run( typename std::remove_reference<T>::type&& t ) {
+            return std::forward<T>(t);
+        }
+    };
+
+    template<typename T>
+    struct Forward<T*> {
+        static T* run(T* t ) {
+            return t;
+        }
+    };
+
+    template<typename Functor, typename... Args>
+    unique_ptr<Context> given(string name, Functor runTest, Args&&... args) {
+        return make_unique<Runner<RunTest<Functor, DecayArrayAndFunction_t<Args>...>, DecayArrayAndFunction_t<Args>...>>(
+                move(name),
+                RunTest<Functor, DecayArrayAndFunction_t<Args>...>(runTest),
+                Forward<DecayArrayAndFunction_t<Args>>::run(args)...
+            );
+    }
+
+    template<typename Functor, typename... Args>
+    class RunBenchmark final: public NoCopy {
+        Functor runBenchmark;
+    public:
+        RunBenchmark(Functor runBenchmark) : runBenchmark(move(runBenchmark)) {}
+
+        Stats operator()(const string& name, Out<ContextResultsRecorder> results, Args&&... args) {
+            const auto& options = results->options();
+            WhenRunner whenRunner(results, name);
+
+            whenRunner.run(
+                    [&] (Check& check, auto&&... benchmarkArgs) {
+                        Bench bench(check, name, options.benchmark, options.baselines);
+                        runBenchmark(bench, benchmarkArgs...);
+                    },
+                    forward<Args>(args)...
+                );
+
+            return whenRunner.stats();
+        }
+    };
+
+    // A given that times code, with a Bench instead of a Check. It's listed, filtered and sharded like any other
+    // given, and its measurements are reported through Results::measured.
+    template<typename Functor, typename... Args>
+    unique_ptr<Context> benchmark(string name, Functor runBenchmark, Args&&... args) {
+        return make_unique<Runner<RunBenchmark<Functor, DecayArrayAndFunction_t<Args>...>, DecayArrayAndFunction_t<Args>...>>(
+                move(name),
+                RunBenchmark<Functor, DecayArrayAndFunction_t<Args>...>(runBenchmark),
+                Forward<DecayArrayAndFunction_t<Args>>::run(args)...
+            );
+    }
+
+    template<typename Value, enable_if_t<is_arithmetic<Value>::value>* = nullptr>
+    double argumentNumber(const Value& value) {
+        return static_cast<double>(value);
+    }
+
+    template<typename Value, enable_if_t< ! is_arithmetic<Value>::value>* = nullptr>
+    double argumentNumber(const Value&) {
+        return numeric_limits<double>::quiet_NaN();
+    }
+
+    // Every combination of values from a list of containers, numbered so that the last container varies fastest.
+    // This is the same order the serial recursion in RunExhaustive uses.
+    template<typename... Containers>
+    class Combinations final: public NoCopy {
+        template<typename Container>
+        using ElementList = vector<const remove_reference_t<decltype(*begin(declval<const Container&>()))>*>;
+
+        // Declared before elementLists_, as makeElementList updates it.
+        size_t size_ = 1;
+        tuple<ElementList<Containers>...> elementLists_;
+
+        template<typename Container>
+        ElementList<Container> makeElementList(const Container& container) {
+            ElementList<Container> elementList;
+
+            for (const auto& value : container) {
+                elementList.push_back(&value);
+            }
+
+            size_ *= elementList.size();
+
+            return elementList;
+        }
+
+        template<typename Functor, size_t... indices>
+        void applyImpl(size_t combination, Functor&& functor, index_sequence<indices...>) const {
+            size_t positions[sizeof...(indices) + 1] = {};
+            size_t axisSizes[] = {0, get<indices>(elementLists_).size()...};
+
+            for (size_t axis = sizeof...(indices); axis > 0; --axis) {
+                positions[axis] = combination % axisSizes[axis];
+                combination /= axisSizes[axis];
+            }
+
+            functor(*get<indices>(elementLists_)[positions[indices + 1]]...);
+        }
+    public:
+        explicit Combinations(const Containers&... containers) :
+            elementLists_(makeElementList(containers)...)
+        {}
+
+        size_t size() const { return size_; }
+
+        // Call functor with the values for combination.
+        template<typename Functor>
+        void apply(size_t combination, Functor&& functor) const {
+            applyImpl(combination, forward<Functor>(functor), index_sequence_for<Containers...>());
+        }
+    };
+
+    template<typename Functor, typename... Args>
+    class RunExhaustive final: public NoCopy {
+        static constexpr const size_t rangesPerThread = 4;
+
+        Functor runTest;
+        StoreArgs<Args...> args;
+
+        template<typename BoundFunctor>
+        static Stats exhaustive(BoundFunctor&& functor,
+                                const string& name,
+                                Out<ContextResultsRecorder> results)
+        {
+            WhenRunner whenRunner(results, name);
+            whenRunner.run(forward<BoundFunctor>(functor));
+
+            return whenRunner.stats();
+        }
+
+        template<typename BoundFunctor, typename Container, typename... BoundArgs>
+        static Stats exhaustive(
+                BoundFunctor&& functor,
+                const string& name,
+                Out<ContextResultsRecorder> results,
+                const Container& container,
+                const BoundArgs&... tail
+            )
+        {
+            Stats stats;
+
+            for (const auto& value : container) {
+                stats += exhaustive(
+                        [&] (Check& check, auto&&... args) {
+                            functor(ref(check), value, args...);
+                        },
+                        name,
+                        results,
+                        tail...
+                    );
+            }
+
+            return stats;
+        }
+
+        // Split the combinations into contiguous ranges and run them on the pool. Each range has its own results,
+        // which are replayed in order, so the output is the same as the serial version.
+        Stats parallelExhaustive(
+                const string& name,
+                Out<ContextResultsRecorder> results,
+                Out<TaskPool> pool,
+                const Args&... extractedArgs
+            )
+        {
+            Combinations<Args...> combinations(extractedArgs...);
+            size_t combinationCount = combinations.size();
+            size_t rangeCount = min(combinationCount, pool->threadCount() * rangesPerThread);
+            vector<unique_ptr<RecordedTask>> rangeList;
+            auto contextNode = results->contextStack().node();
+
+            for (size_t rangeIndex = 0; rangeIndex < rangeCount; ++rangeIndex) {
+                rangeList.emplace_back(make_unique<RecordedTask>(results->notifyPassing(), results->options()));
+                Out<RecordedTask> range(*rangeList.back());
+                size_t begin = combinationCount * rangeIndex / rangeCount;
+                size_t end = combinationCount * (rangeIndex + 1) / rangeCount;
+
+                pool->submit([this, &name, &combinations, pool, range, begin, end, contextNode] () mutable {
+                    range->run(pool, contextNode, [&] (Out<ContextResultsRecorder> rangeResults) {
+                        Stats stats;
+
+                        for (size_t combination = begin; combination < end; ++combination) {
+                            WhenRunner whenRunner(rangeResults, name);
+
+                            whenRunner.run([&] (Check& check) {
+                                combinations.apply(combination, [&] (const auto&... values) {
+                                    runTest(check, values...);
+                                });
+                            });
+
+                            stats += whenRunner.stats();
+                        }
+
+                        return stats;
+                    });
+                });
+            }
+
+            Stats stats;
+
+            for (auto& range : rangeList) {
+                stats += range->replay(results, pool);
+            }
+
+            return stats;
+        }
+    public:
+        RunExhaustive(Functor runTest, StoreArgs<Args...> args) : runTest(move(runTest)), args(move(args)) {}
+
+        Stats operator()(const string& name, Out<ContextResultsRecorder> results) {
+            return args.apply([&] (const Args&... extractedArgs) {
+                auto pool = results->pool();
+
+                if (pool) {
+                    return parallelExhaustive(name, results, out(*pool), extractedArgs...);
+                }
+
+                return exhaustive(move(runTest), name, results, extractedArgs...);
+            });
+        }
+    };
+
+    // Run a benchmark for each combination of arguments, then check how it scales. Combinations are always run in
+    // turn, in this process and thread, so they aren't timed while another one runs.
+    template<typename Functor, typename CheckScaling, typename... Args>
+    class RunSweep final: public NoCopy {
+        Functor runBenchmark;
+        CheckScaling checkScaling;
+        StoreArgs<Args...> args;
+    public:
+        RunSweep(Functor runBenchmark, CheckScaling checkScaling, StoreArgs<Args...> args) :
+            runBenchmark(move(runBenchmark)), checkScaling(move(checkScaling)), args(move(args))
+        {}
+
+        Stats operator()(const string& name, Out<ContextResultsRecorder> results) {
+            return args.apply([&] (const Args&... extractedArgs) {
+                const auto& options = results->options();
+                Combinations<Args...> combinations(extractedArgs...);
+                Sweep sweep(name);
+                Stats stats;
+
+                for (size_t combination = 0; combination < combinations.size(); ++combination) {
+                    WhenRunner whenRunner(results, name);
+
+                    whenRunner.runInProcess([&] (Check& check) {
+                        combinations.apply(combination, [&] (const auto&... values) {
+                            vector<string> argumentList{Convert<decay_t<decltype(values)>>::toString(values)...};
+                            string arguments("(");
+
+                            for (size_t index = 0; index < argumentList.size(); ++index) {
+                                arguments += (index == 0 ? "" : ", ") + argumentList[index];
+                            }
+
+                            sweep.setArguments(move(argumentList), vector<double>{argumentNumber(values)...});
+                            Bench bench(check, name, options.benchmark, options.baselines, arguments + ")", sweep);
+                            runBenchmark(bench, values...);
+                        });
+                    });
+
+                    stats += whenRunner.stats();
+                }
+
+                WhenRunner whenRunner(results, name);
+                whenRunner.runInProcess([&] (Check& check) { checkScaling(check, sweep); });
+                stats += whenRunner.stats();
+
+                return stats;
+            });
+        }
+    };
+
+    template<typename Value, typename... Args>
+    vector<Value> choice(Value value, Args&&... tail) {
+        return vector<Value>{value, forward<Args>(tail)...};
+    }
+
+    template<typename Value>
+    vector<Value> constant(Value value) {
+        return vector<Value>(1, value);
+    }
+
+    template<typename... Args>
+    class Exhaustive final: public NoCopy {
+        StoreArgs<Args...> args;
+    public:
+        Exhaustive(Args&&... args) : args(forward<Args>(args)...) {}
+
+        template<typename Functor>
+        unique_ptr<Context> given(string name, Functor runTest) {
+            return make_unique<Runner<RunExhaustive<Functor, Args...>>>(
+                    move(name),
+                    RunExhaustive<Functor, Args...>(move(runTest), move(args))
+            );
+        }
+
+        // A benchmark for each combination, with the arguments in each measurement's name. Once they've all run,
+        // checkScaling is called with a Check and the Sweep, to fit how the times scale with an argument.
+        template<typename Functor, typename CheckScaling>
+        unique_ptr<Context> benchmark(string name, Functor runBenchmark, CheckScaling checkScaling) {
+            return make_unique<Runner<RunSweep<Functor, CheckScaling, Args...>>>(
+                    move(name),
+                    RunSweep<Functor, CheckScaling, Args...>(move(runBenchmark), move(checkScaling), move(args))
+            );
+        }
+
+        template<typename Functor>
+        unique_ptr<Context> benchmark(string name, Functor runBenchmark) {
+            return benchmark(move(name), move(runBenchmark), [] (Check&, const Sweep&) {});
+        }
+    };
+
+    template<typename... Args>
+    Exhaustive<Args...> exhaustive(Args&&... args) {
+        return Exhaustive<DecayArrayAndFunction_t< Args>...>(forward<DecayArrayAndFunction_t< Args>>(args)...);
+    }
+
+    inline void list(const PathFilter& filter, Out<Results> results) {
+        Register::list(filter, results);
+    }
+
+    inline bool run(const PathFilter& filter, Out<Results> results, const RunOptions& options = RunOptions()) {
+        auto stats = Register::run(filter, results, options);
+
+        return stats.failedTests() == 0 && stats.failedChecks() == 0;
+    }
+
+    inline void listShards(const PathFilter& filter, const RunOptions& options, Out<ostream> output) {
+        Register::listShards(filter, options, output);
+    }
+
+    inline void list(const PathFilter& filter, Verbosity verbosity) {
+        HumanResults results(out(cout), verbosity);
+        return list(filter, out(results));
+    }
+
+    inline bool run(const PathFilter& filter, Verbosity verbosity, const RunOptions& options = RunOptions()) {
+        HumanResults results(out(cout), verbosity);
+        return run(filter, out(results), options);
+    }
+}}}}
+
+namespace Enhedron { namespace Test {
+    using namespace Assertion;
+
+    using Impl::Impl_Suite::Suite;
+    using Impl::Impl_Suite::context;
+    using Impl::Impl_Suite::Check;
+    using Impl::Impl_Suite::given;
+    using Impl::Impl_Suite::benchmark;
+    using Impl::Impl_Suite::Bench;
+    using Impl::Impl_Suite::Exhaustive;
+    using Impl::Impl_Suite::exhaustive;
+    using Impl::Impl_Suite::choice;
+    using Impl::Impl_Suite::constant;
+    using Impl::Impl_Suite::list;
+    using Impl::Impl_Suite::listShards;
+    using Impl::Impl_Suite::run;
+    using Impl::Impl_Suite::RunOptions;
+}}
+// File: Enhedron/Test/AsyncResults.h
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <vector>
+#include <utility>
+#include <string>
+#include <cstdint>
+
+namespace Enhedron { namespace Test { namespace Impl { namespace Impl_AsyncResults {
+    using std::atomic;
+    using std::memory_order_relaxed;
+    using std::memory_order_acquire;
+    using std::memory_order_release;
+    using std::memory_order_seq_cst;
+    using std::thread;
+    using std::mutex;
+    using std::unique_lock;
+    using std::lock_guard;
+    using std::condition_variable;
+    using std::exception_ptr;
+    using std::current_exception;
+    using std::rethrow_exception;
+    using std::vector;
+    using std::move;
+    using std::string;
+    using std::exception;
+
+    using Util::optional;
+    using Assertion::Variable;
+
+    namespace this_thread = std::this_thread;
+
+    using namespace Impl_Results;
+    using Impl_Events::Event;
+    using Impl_Events::EventType;
+    using Impl_Events::EventRecorder;
+    using Impl_Events::EventReplayer;
+
+    // A fixed size ring buffer for one producer thread and one consumer thread, without locks. Indices only ever
+    // increase, so full and empty can be told apart without wasting a slot. Pushes and empty are sequentially
+    // consistent, so a consumer that flags it's going to sleep, then checks empty, can't miss a push from a producer
+    // that pushes, then checks the flag.
+    template<typename Value>
+    class SpscQueue final: public NoCopyMove {
+        vector<Value> slots_;
+        atomic<size_t> head_{0};
+        atomic<size_t> tail_{0};
+    public:
+        explicit SpscQueue(size_t capacity) : slots_(capacity == 0 ? 1 : capacity) {}
+
+        size_t capacity() const { return slots_.size(); }
+
+        // Consumer only.
+        bool empty() const {
+            return head_.load(memory_order_relaxed) == tail_.load(memory_order_seq_cst);
+        }
+
+        // Producer only. Leaves value alone if the queue is full.
+        bool tryPush(Value& value) {
+            auto tail = tail_.load(memory_order_relaxed);
+
+            if (tail - head_.load(memory_order_acquire) == slots_.size()) {
+                return false;
+            }
+
+            slots_[tail % slots_.size()] = move(value);
+            tail_.store(tail + 1, memory_order_seq_cst);
+
+            return true;
+        }
+
+        // Consumer only.
+        bool tryPop(Out<Value> value) {
+            auto head = head_.load(memory_order_relaxed);
+
+            if (head == tail_.load(memory_order_acquire)) {
+                return false;
+            }
+
+            *value = move(slots_[head % slots_.size()]);
+            head_.store(head + 1, memory_order_release);
+
+            return true;
+        }
+    };
+
+    // Pass results to another Results object on a separate thread, so tests don't wait for it to format and write
+    // them. Calls are recorded as events, and replayed in order, so the output is the same as calling it directly.
+    //
+    // At most capacity events are queued. After that, the test thread waits for the reporter to catch up. finish
+    // waits for everything to be passed on, and rethrows anything the other Results object threw. Calls must come
+    // from one thread at a time, which is how Register::run makes them, even when it runs givens in parallel.
+    class AsyncResults final: public Results {
+        // How many times the reporter checks for more events before it sleeps.
+        static constexpr const size_t spinCount = 64;
+
+        Out<Results> results_;
+        bool notifyPassing_;
+        EventRecorder staging_;
+        SpscQueue<Event> queue_;
+
+        mutex lock_;
+        condition_variable changed_;
+        atomic<bool> reporterWaiting_{false};
+        atomic<bool> stopping_{false};
+        atomic<uint64_t> published_{0};
+        atomic<uint64_t> reported_{0};
+        exception_ptr error_;
+
+        thread reporter_;
+
+        void notifyReporter() {
+            // Either we see the reporter waiting, or it sees our event. See SpscQueue.
+            if (reporterWaiting_.load(memory_order_seq_cst)) {
+                lock_guard<mutex> lock(lock_);
+                changed_.notify_all();
+            }
+        }
+
+        void publish() {
+            staging_.drain([this] (Event&& event) {
+                while ( ! queue_.tryPush(event)) {
+                    this_thread::yield();
+                }
+
+                published_.fetch_add(1, memory_order_relaxed);
+                notifyReporter();
+            });
+        }
+
+        // Returns false if we're stopping and there's nothing left.
+        bool waitForEvents() {
+            for (size_t spin = 0; spin < spinCount; ++spin) {
+                if ( ! queue_.empty()) {
+                    return true;
+                }
+
+                this_thread::yield();
+            }
+
+            unique_lock<mutex> lock(lock_);
+            reporterWaiting_.store(true, memory_order_seq_cst);
+
+            changed_.wait(lock, [this] {
+                return ! queue_.empty() || stopping_.load(memory_order_acquire);
+            });
+
+            reporterWaiting_.store(false, memory_order_relaxed);
+
+            return ! queue_.empty();
+        }
+
+        void report() {
+            EventReplayer replayer(results_);
+            Event event{EventType::FINISH, "", Stats(), optional<string>(), vector<Variable>()};
+
+            while (waitForEvents()) {
+                while (queue_.tryPop(out(event))) {
+                    // Keep draining after an error, so the test thread doesn't wait forever for space.
+                    if ( ! error_) {
+                        try {
+                            replayer(event);
+                        }
+                        catch (...) {
+                            error_ = current_exception();
+                        }
+                    }
+
+                    reported_.store(reported_.load(memory_order_relaxed) + 1, memory_order_release);
+                }
+
+                lock_guard<mutex> lock(lock_);
+                changed_.notify_all();
+            }
+        }
+    public:
+        explicit AsyncResults(Out<Results> results, size_t capacity = 4096) :
+            results_(results),
+            notifyPassing_(results->notifyPassing()),
+            staging_(notifyPassing_),
+            queue_(capacity),
+            reporter_([this] { report(); })
+        {}
+
+        ~AsyncResults() {
+            {
+                lock_guard<mutex> lock(lock_);
+                stopping_.store(true, memory_order_release);
+                changed_.notify_all();
+            }
+
+            reporter_.join();
+        }
+
+        virtual void finish(const Stats& stats) override {
+            staging_.finish(stats);
+            publish();
+
+            auto published = published_.load(memory_order_relaxed);
+            unique_lock<mutex> lock(lock_);
+
+            changed_.wait(lock, [&] { return reported_.load(memory_order_acquire) == published; });
+
+            if (error_) {
+                rethrow_exception(error_);
+            }
+        }
+
+        virtual void beginContext(const NameStack& context, const string& name) override {
+            staging_.beginContext(context, name);
+            publish();
+        }
+
+        virtual void endContext(const Stats& stats, const NameStack& context, const string& name) override {
+            staging_.endContext(stats, context, name);
+            publish();
+        }
+
+        virtual void beginGiven(const NameStack& context, const string& given) override {
+            staging_.beginGiven(context, given);
+            publish();
+        }
+
+        virtual void endGiven(const Stats& stats, const NameStack& context, const string& given) override {
+            staging_.endGiven(stats, context, given);
+            publish();
+        }
+
+        virtual void beginWhen(const NameStack& context,
+                               const string& given,
+                               const NameStack& whenStack,
+                               const string& when) override {
+            staging_.beginWhen(context, given, whenStack, when);
+            publish();
+        }
+
+        virtual void endWhen(const Stats& stats,
+                             const NameStack& context,
+                             const string& given,
+                             const NameStack& whenStack,
+                             const string& when) override {
+            staging_.endWhen(stats, context, given, whenStack, when);
+            publish();
+        }
+
+        virtual bool notifyPassing() const override { return notifyPassing_; }
+
+        virtual void fail(const NameStack& context,
+                          const string& given,
+                          const NameStack& whenStack,
+                          optional<string> description,
+                          const string &expressionText,
+                          const vector <Variable> &variableList) override {
+            staging_.fail(context, given, whenStack, move(description), expressionText, variableList);
+            publish();
+        }
+
+        virtual void pass(const NameStack& context,
+                          const string& given,
+                          const NameStack& whenStack,
+                          optional<string> description,
+                          const string &expressionText,
+                          const vector <Variable> &variableList) override {
+            staging_.pass(context, given, whenStack, move(description), expressionText, variableList);
+            publish();
+        }
+
+        virtual void failByException(const NameStack& context,
+                                     const string& given,
+                                     const NameStack& whenStack,
+                                     const exception& e) override {
+            staging_.failByException(context, given, whenStack, e);
+            publish();
+        }
+
+        virtual void measured(const NameStack& context,
+                              const string& given,
+                              const NameStack& whenStack,
+                              const Measurement& measurement) override {
+            staging_.measured(context, given, whenStack, measurement);
+            publish();
+        }
+    };
+}}}}
+
+namespace Enhedron { namespace Test {
+    using Impl::Impl_AsyncResults::AsyncResults;
+}}
+// File: Enhedron/Test/Reporters.h
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <exception>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+
+namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Reporters {
+    using std::string;
+    using std::vector;
+    using std::ostream;
+    using std::exception;
+    using std::strlen;
+    using std::move;
+    using std::to_string;
+    using std::snprintf;
+
+    using Util::optional;
+    using Assertion::Variable;
+
+    using namespace Impl_Results;
+    using Impl_OutputBuffer::OutputBuffer;
+
+    // Text collected in a string, for output that has to wait. Clearing it keeps the memory for next time.
+    class TextOutput final: public NoCopy {
+        string text_;
+    public:
+        void write(const char* data, size_t size) { text_.append(data, size); }
+        void clear() { text_.clear(); }
+
+        const string& text() const { return text_; }
+    };
+
+    // Write text for an XML attribute value or element in one pass, copying runs of ordinary characters in one go.
+    // Control characters that XML 1.0 doesn't allow are replaced with U+FFFD. In attributes, whitespace is written
+    // as character references, so parsers don't normalize it to spaces.
+    template<typename Output>
+    void writeXml(Output& output, const char* text, size_t size, bool attribute) {
+        size_t runStart = 0;
+
+        for (size_t index = 0; index < size; ++index) {
+            const char* replacement = nullptr;
+
+            switch (text[index]) {
+                case '&': replacement = "&amp;"; break;
+                case '<': replacement = "&lt;"; break;
+                case '>': replacement = "&gt;"; break;
+                case '"': replacement = attribute ? "&quot;" : nullptr; break;
+                case '\'': replacement = attribute ? "&apos;" : nullptr; break;
+                case '\t': replacement = attribute ? "&#9;" : nullptr; break;
+                case '\n': replacement = attribute ? "&#10;" : nullptr; break;
+                case '\r': replacement = "&#13;"; break;
+                default:
+                    if (static_cast<unsigned char>(text[index]) < 0x20) {
+                        replacement = "&#xFFFD;";
+                    }
+            }
+
+            if (replacement != nullptr) {
+                output.write(text + runStart, index - runStart);
+                output.write(replacement, strlen(replacement));
+                runStart = index + 1;
+            }
+        }
+
+        output.write(text + runStart, size - runStart);
+    }
+
+    template<typename Output>
+    void writeXml(Output& output, const string& text, bool attribute) {
+        writeXml(output, text.data(), text.size(), attribute);
+    }
+
+    // Write a quoted JSON string in one pass. Bytes from 0x80 up are passed through, so UTF-8 stays as it is.
+    template<typename Output>
+    void writeJson(Output& output, const char* text, size_t size) {
+        static const char hexDigits[] = "0123456789abcdef";
+
+        output.write("\"", 1);
+        size_t runStart = 0;
+
+        for (size_t index = 0; index < size; ++index) {
+            auto character = static_cast<unsigned char>(text[index]);
+            const char* replacement = nullptr;
+            char unicode[] = "\\u0000";
+
+            switch (character) {
+                case '"': replacement = "\\\""; break;
+                case '\\': replacement = "\\\\"; break;
+                case '\b': replacement = "\\b"; break;
+                case '\f': replacement = "\\f"; break;
+                case '\n': replacement = "\\n"; break;
+                case '\r': replacement = "\\r"; break;
+                case '\t': replacement = "\\t"; break;
+                default:
+                    if (character < 0x20) {
+                        unicode[4] = hexDigits[character >> 4];
+                        unicode[5] = hexDigits[character & 0xf];
+                        replacement = unicode;
+                    }
+            }
+
+            if (replacement != nullptr) {
+                output.write(text + runStart, index - runStart);
+                output.write(replacement, strlen(replacement));
+                runStart = index + 1;
+            }
+        }
+
+        output.write(text + runStart, size - runStart);
+        output.write("\"", 1);
+    }
+
+    template<typename Output>
+    void writeJson(Output& output, const string& text) {
+        writeJson(output, text.data(), text.size());
+    }
+
+    // Nanoseconds as seconds, with microsecond precision.
+    inline void writeSeconds(OutputBuffer& output, uint64_t nanoseconds) {
+        auto micros = nanoseconds / 1000;
+        auto fraction = micros % 1000000;
+        char digits[] = "000000";
+
+        for (size_t index = 6; index > 0; --index) {
+            digits[index - 1] = static_cast<char>('0' + fraction % 10);
+            fraction /= 10;
+        }
+
+        output << micros / 1000000 << '.';
+        output.write(digits, 6);
+    }
+
+    // Nanoseconds, to the nearest picosecond.
+    inline void writeNanoseconds(OutputBuffer& output, double nanoseconds) {
+        char text[32];
+        auto size = snprintf(text, sizeof(text), "%.3f", nanoseconds);
+        output.write(text, static_cast<size_t>(size));
+    }
+
+    // Write a CSV field, quoted if it has to be.
+    template<typename Output>
+    void writeCsv(Output& output, const string& text) {
+        if (text.find_first_of(",\"\r\n") == string::npos) {
+            output.write(text.data(), text.size());
+            return;
+        }
+
+        output.write("\"", 1);
+        size_t runStart = 0;
+
+        for (size_t index = 0; index < text.size(); ++index) {
+            if (text[index] == '"') {
+                output.write(text.data() + runStart, index + 1 - runStart);
+                output.write("\"", 1);
+                runStart = index + 1;
+            }
+        }
+
+        output.write(text.data() + runStart, text.size() - runStart);
+        output.write("\"", 1);
+    }
+
+    // Write a JUnit XML report as the tests run. Each given is a testcase, in one testsuite, with its contexts as
+    // the classname. A testcase is written when its given ends, so its time is known, but the testsuite counts
+    // never are, so they're left out. That's allowed, and CI servers count the testcases themselves.
+    //
+    // Failures are kept until their given ends, up to maxFailures of them, so memory doesn't grow with the number
+    // of exhaustive combinations that fail. After that, they're only counted.
+    class JUnitResults final: public ForwardingResults {
+        static constexpr const size_t maxFailures = 100;
+
+        OutputBuffer output_;
+        TextOutput failures_;
+        size_t failureCount_ = 0;
+
+        void writeWhens(const NameStack& whenStack) {
+            for (const auto& when : whenStack.stack()) {
+                failures_.write("When: ", 6);
+                writeXml(failures_, when, false);
+                failures_.write("\n", 1);
+            }
+        }
+
+        // Returns false if the failure should only be counted.
+        bool beginFailure(const char* element, const string& message) {
+            ++failureCount_;
+
+            if (failureCount_ > maxFailures) {
+                return false;
+            }
+
+            failures_.write("    <", 5);
+            failures_.write(element, strlen(element));
+            failures_.write(" message=\"", 10);
+            writeXml(failures_, message, true);
+            failures_.write("\">", 2);
+
+            return true;
+        }
+
+        void endFailure(const char* element) {
+            failures_.write("</", 2);
+            failures_.write(element, strlen(element));
+            failures_.write(">\n", 2);
+        }
+    public:
+        JUnitResults(Out<Results> results, Out<ostream> output) : ForwardingResults(results), output_(output) {
+            output_ << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<testsuites>\n<testsuite name=\"MosquitoNet\">\n";
+        }
+
+        virtual void finish(const Stats& stats) override {
+            output_ << "</testsuite>\n</testsuites>\n";
+            output_.flush();
+            ForwardingResults::finish(stats);
+        }
+
+        virtual void beginGiven(const NameStack& context, const string& given) override {
+            failures_.clear();
+            failureCount_ = 0;
+            ForwardingResults::beginGiven(context, given);
+        }
+
+        virtual void endGiven(const Stats& stats, const NameStack& context, const string& given) override {
+            output_ << "  <testcase classname=\"";
+            bool first = true;
+
+            for (const auto& contextName : context.stack()) {
+                if ( ! first) {
+                    output_ << '/';
+                }
+
+                writeXml(output_, contextName, true);
+                first = false;
+            }
+
+            output_ << "\" name=\"";
+            writeXml(output_, given, true);
+            output_ << "\" time=\"";
+            writeSeconds(output_, stats.wallTime());
+
+            if (failureCount_ == 0) {
+                output_ << "\"/>\n";
+            }
+            else {
+                output_ << "\">\n" << failures_.text();
+
+                if (failureCount_ > maxFailures) {
+                    output_ << "    <system-err>" << failureCount_ - maxFailures << " more failures</system-err>\n";
+                }
+
+                output_ << "  </testcase>\n";
+            }
+
+            failures_.clear();
+            failureCount_ = 0;
+            ForwardingResults::endGiven(stats, context, given);
+        }
+
+        virtual void fail(const NameStack& context,
+                          const string& given,
+                          const NameStack& whenStack,
+                          optional<string> description,
+                          const string &expressionText,
+                          const vector <Variable> &variableList) override
+        {
+            if (beginFailure("failure", description ? *description : expressionText)) {
+                writeWhens(whenStack);
+
+                if (description) {
+                    writeXml(failures_, *description, false);
+                    failures_.write("\n", 1);
+                }
+
+                writeXml(failures_, expressionText, false);
+                failures_.write("\n", 1);
+
+                for (const auto& variable : variableList) {
+                    writeXml(failures_, variable.name(), strlen(variable.name()), false);
+                    failures_.write(" = ", 3);
+                    writeXml(failures_, variable.value(), false);
+                    failures_.write(": file \"", 8);
+                    writeXml(failures_, variable.file(), strlen(variable.file()), false);
+                    auto line = "\", line " + to_string(variable.line()) + ".\n";
+                    failures_.write(line.data(), line.size());
+                }
+
+                endFailure("failure");
+            }
+
+            ForwardingResults::fail(context, given, whenStack, move(description), expressionText, variableList);
+        }
+
+        virtual void failByException(const NameStack& context,
+                                     const string& given,
+                                     const NameStack& whenStack,
+                                     const exception& e) override {
+            if (beginFailure("error", e.what())) {
+                writeWhens(whenStack);
+                writeXml(failures_, e.what(), strlen(e.what()), false);
+                failures_.write("\n", 1);
+                endFailure("error");
+            }
+
+            ForwardingResults::failByException(context, given, whenStack, e);
+        }
+    };
+
+    // Write a JSON object on its own line as each given or when ends, each check fails, or a test throws, then a
+    // summary when the run finishes. Nothing is kept between lines, however many events there are.
+    class JsonResults final: public ForwardingResults {
+        OutputBuffer output_;
+
+        void writeNames(const NameStack& names, const string* last = nullptr) {
+            output_ << '[';
+            bool first = true;
+
+            for (const auto& name : names.stack()) {
+                if ( ! first) {
+                    output_ << ',';
+                }
+
+                writeJson(output_, name);
+                first = false;
+            }
+
+            if (last != nullptr) {
+                if ( ! first) {
+                    output_ << ',';
+                }
+
+                writeJson(output_, *last);
+            }
+
+            output_ << ']';
+        }
+
+        void writeLocation(const char* type, const NameStack& context, const string& given) {
+            output_ << "{\"type\":\"" << type << "\",\"context\":";
+            writeNames(context);
+            output_ << ",\"given\":";
+            writeJson(output_, given);
+        }
+
+        void writeStats(const Stats& stats) {
+            output_ << ",\"tests\":" << stats.tests() << ",\"checks\":" << stats.checks() <<
+                ",\"failedTests\":" << stats.failedTests() << ",\"failedChecks\":" << stats.failedChecks() <<
+                ",\"wallTime\":" << stats.wallTime() << ",\"cpuTime\":" << stats.cpuTime() << "}\n";
+        }
+    public:
+        JsonResults(Out<Results> results, Out<ostream> output) : ForwardingResults(results), output_(output) {}
+
+        virtual void finish(const Stats& stats) override {
+            output_ << "{\"type\":\"finish\"";
+            writeStats(stats);
+            output_.flush();
+            ForwardingResults::finish(stats);
+        }
+
+        virtual void endGiven(const Stats& stats, const NameStack& context, const string& given) override {
+            writeLocation("given", context, given);
+            writeStats(stats);
+            ForwardingResults::endGiven(stats, context, given);
+        }
+
+        virtual void endWhen(const Stats& stats,
+                             const NameStack& context,
+                             const string& given,
+                             const NameStack& whenStack,
+                             const string& when) override {
+            writeLocation("when", context, given);
+            output_ << ",\"whens\":";
+            writeNames(whenStack, &when);
+            writeStats(stats);
+            ForwardingResults::endWhen(stats, context, given, whenStack, when);
+        }
+
+        virtual void fail(const NameStack& context,
+                          const string& given,
+                          const NameStack& whenStack,
+                          optional<string> description,
+                          const string &expressionText,
+                          const vector <Variable> &variableList) override
+        {
+            writeLocation("failure", context, given);
+            output_ << ",\"whens\":";
+            writeNames(whenStack);
+            output_ << ",\"description\":";
+
+            if (description) {
+                writeJson(output_, *description);
+            }
+            else {
+                output_ << "null";
+            }
+
+            output_ << ",\"expression\":";
+            writeJson(output_, expressionText);
+            output_ << ",\"variables\":[";
+            bool first = true;
+
+            for (const auto& variable : variableList) {
+                output_ << (first ? "{\"name\":" : ",{\"name\":");
+                writeJson(output_, variable.name(), strlen(variable.name()));
+                output_ << ",\"value\":";
+                writeJson(output_, variable.value());
+                output_ << ",\"file\":";
+                writeJson(output_, variable.file(), strlen(variable.file()));
+                output_ << ",\"line\":" << variable.line() << '}';
+                first = false;
+            }
+
+            output_ << "]}\n";
+            ForwardingResults::fail(context, given, whenStack, move(description), expressionText, variableList);
+        }
+
+        virtual void failByException(const NameStack& context,
+                                     const string& given,
+                                     const NameStack& whenStack,
+                                     const exception& e) override {
+            writeLocation("exception", context, given);
+            output_ << ",\"whens\":";
+            writeNames(whenStack);
+            output_ << ",\"message\":";
+            writeJson(output_, e.what(), strlen(e.what()));
+            output_ << "}\n";
+            ForwardingResults::failByException(context, given, whenStack, e);
+        }
+
+        virtual void measured(const NameStack& context,
+                              const string& given,
+                              const NameStack& whenStack,
+                              const Measurement& measurement) override {
+            writeLocation("measurement", context, given);
+            output_ << ",\"whens\":";
+            writeNames(whenStack);
+            output_ << ",\"name\":";
+            writeJson(output_, measurement.name());
+            output_ << ",\"iterations\":" << measurement.iterations() << ",\"samples\":" <<
+                measurement.samples().size() << ",\"mean\":";
+            writeNanoseconds(output_, measurement.mean());
+            output_ << ",\"median\":";
+            writeNanoseconds(output_, measurement.median());
+            output_ << ",\"standardDeviation\":";
+            writeNanoseconds(output_, measurement.standardDeviation());
+            output_ << ",\"minimum\":";
+            writeNanoseconds(output_, measurement.minimum());
+            output_ << ",\"maximum\":";
+            writeNanoseconds(output_, measurement.maximum());
+            output_ << "}\n";
+            ForwardingResults::measured(context, given, whenStack, measurement);
+        }
+    };
+
+    // Write each benchmark measurement as a CSV row, with times in nanoseconds per iteration. The path is to the
+    // given or when it was measured in. A sweep has a row for each combination of arguments, with the arguments in
+    // the name, so this is its scaling table.
+    class MeasurementsResults final: public ForwardingResults {
+        OutputBuffer output_;
+    public:
+        MeasurementsResults(Out<Results> results, Out<ostream> output) : ForwardingResults(results), output_(output) {
+            output_ << "path,name,iterations,samples,mean,median,standard deviation,minimum,maximum\n";
+        }
+
+        virtual void finish(const Stats& stats) override {
+            output_.flush();
+            ForwardingResults::finish(stats);
+        }
+
+        virtual void measured(const NameStack& context,
+                              const string& given,
+                              const NameStack& whenStack,
+                              const Measurement& measurement) override {
+            writeCsv(output_, testIndex().pathName(whenStack.node()));
+            output_ << ',';
+            writeCsv(output_, measurement.name());
+            output_ << ',' << measurement.iterations() << ',' << measurement.samples().size() << ',';
+            writeNanoseconds(output_, measurement.mean());
+            output_ << ',';
+            writeNanoseconds(output_, measurement.median());
+            output_ << ',';
+            writeNanoseconds(output_, measurement.standardDeviation());
+            output_ << ',';
+            writeNanoseconds(output_, measurement.minimum());
+            output_ << ',';
+            writeNanoseconds(output_, measurement.maximum());
+            output_ << '\n';
+            ForwardingResults::measured(context, given, whenStack, measurement);
+        }
+    };
+}}}}
+
+namespace Enhedron { namespace Test {
+    using Impl::Impl_Reporters::JUnitResults;
+    using Impl::Impl_Reporters::JsonResults;
+    using Impl::Impl_Reporters::MeasurementsResults;
+}}
+// File: Enhedron/Test/EventLog.h
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+
+#ifdef __linux__
+    #include <unistd.h>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+namespace Enhedron { namespace Test { namespace Impl { namespace Impl_EventLog {
+    using std::string;
+    using std::vector;
+    using std::unordered_map;
+    using std::move;
+    using std::exception;
+    using std::runtime_error;
+    using std::max;
+    using std::memcpy;
+    using std::make_shared;
+    using std::memcmp;
+    using std::strlen;
+    using std::strerror;
+
+    using Util::optional;
+    using Assertion::Variable;
+
+    using namespace Impl_Results;
+    using Impl_Events::Event;
+    using Impl_Events::EventType;
+    using Impl_Events::lastEventType;
+    using Impl_Events::EventReplayer;
+    using Impl_Process::throwSystemError;
+
+    // An event log starts with a header: the magic bytes, then the length of the records that have been committed,
+    // as a native 64 bit integer. Records follow, each starting with a tag, which is an EventType, or stringTag to
+    // define the next string id. All integers in records are unsigned LEB128, so most of them are one byte.
+    //
+    // Names, expressions, descriptions and file names are interned, as they're repeated for every check that runs
+    // the same code. Variable values and exception messages are written in place, as they're rarely repeated.
+    static constexpr const char logMagic[8] = {'M', 'N', 'E', 'T', 'L', 'O', 'G', '1'};
+    static constexpr const size_t logHeaderSize = sizeof(logMagic) + sizeof(uint64_t);
+    static constexpr const uint64_t stringTag = 16;
+
+    inline void throwLogUnsupported() {
+        throw runtime_error("Event logs are only supported on Linux");
+    }
+
+    // A file that grows as it's appended to, and is written through a shared memory mapping. The header only counts
+    // data once it's committed, so if the process dies, the file has everything up to the last commit, and a reader
+    // ignores anything after that.
+    class MappedLog final: public NoCopy {
+        int fd_ = -1;
+        char* data_ = nullptr;
+        size_t capacity_ = 0;
+        size_t size_ = logHeaderSize;
+
+        void reserve(size_t required) {
+            if (required <= capacity_) {
+                return;
+            }
+
+            #ifdef __linux__
+                auto capacity = max(required, capacity_ * 2);
+
+                if (::ftruncate(fd_, static_cast<off_t>(capacity)) != 0) {
+                    throwSystemError("ftruncate");
                 }
-            }
 
-            if (nextPathList.empty()) {
-                return none;
-            }
+                auto data = ::mremap(data_, capacity_, capacity, MREMAP_MAYMOVE);
 
-            return move(nextPathList);
-        }
+                if (data == MAP_FAILED) {
+                    throwSystemError("mremap");
+                }
 
-        string name;
-        vector<unique_ptr<Context>> contextList;
-    };
+                data_ = static_cast<char*>(data);
+                capacity_ = capacity;
+            #else
+                throwLogUnsupported();
+            #endif
+        }
+    public:
+        MappedLog(const string& fileName, size_t initialCapacity) {
+            #ifdef __linux__
+                capacity_ = max(initialCapacity, logHeaderSize);
+                fd_ = ::open(fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
 
-    template<typename... ContextListType>
-    void makeContextList(Out<ContextList> contextList, unique_ptr<Context> childContext, ContextListType&&... childContextList) {
-        contextList->emplace_back(move(childContext));
-        makeContextList(contextList, forward<ContextListType>(childContextList)...);
-    }
+                if (fd_ < 0) {
+                    throw runtime_error("Unable to write event log \"" + fileName + "\": " + strerror(errno));
+                }
 
-    inline void makeContextList(Out<ContextList>) {
-    }
+                if (::ftruncate(fd_, static_cast<off_t>(capacity_)) != 0) {
+                    ::close(fd_);
+                    throwSystemError("ftruncate");
+                }
 
-    template<typename... ContextListType>
-    unique_ptr<Context> context(const string& name, ContextListType&&... childContextList) {
-        ContextList contextList;
-        makeContextList(out(contextList), forward<ContextListType>(childContextList)...);
+                auto data = ::mmap(nullptr, capacity_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
 
-        return make_unique<NodeContext>(name, move(contextList));
-    }
+                if (data == MAP_FAILED) {
+                    ::close(fd_);
+                    throwSystemError("mmap");
+                }
 
-    class Suite: public NoCopy {
-    public:
-        template<typename... ContextListType>
-        Suite(const string& name, ContextListType&&... childContextList) {
-            Register::add(context(name, forward<ContextListType>(childContextList)...));
+                data_ = static_cast<char*>(data);
+                memcpy(data_, logMagic, sizeof(logMagic));
+                commit();
+            #else
+                throwLogUnsupported();
+            #endif
         }
-    };
 
-    class WhenRunner final: public FailureHandler {
-        struct StackElement {
-            size_t index = 0;
-            size_t current = 0;
-        };
+        // Trim the file to what's been committed.
+        ~MappedLog() {
+            #ifdef __linux__
+                ::munmap(data_, capacity_);
 
-        Stats stats_;
-        vector<StackElement> whenStack;
-        WhenResultRecorder whenResultRecorder_;
-        size_t whenDepth_ = 0;
+                if (::ftruncate(fd_, static_cast<off_t>(size_)) != 0) {
+                    // Nothing we can do. Readers ignore anything after the committed length anyway.
+                }
 
-        bool topWhenDone() const {
-            const auto& top = whenStack.back();
+                ::close(fd_);
+            #endif
+        }
 
-            return top.current == top.index + 1;
+        void append(const string& data) {
+            reserve(size_ + data.size());
+            memcpy(data_ + size_, data.data(), data.size());
+            size_ += data.size();
         }
-    public:
-        WhenRunner(Out<ContextResultsRecorder> results, string given) :
-                whenResultRecorder_(results, move(given)) {}
 
-        template<typename Functor, typename... Args>
-        void run(Functor&& functor, Args&&... args);
+        void commit() {
+            uint64_t committed = size_ - logHeaderSize;
+            memcpy(data_ + sizeof(logMagic), &committed, sizeof(committed));
+        }
+    };
 
-        template<typename Functor>
-        void when(string description, Functor&& functor) {
-            if (whenStack.size() <= whenDepth_) {
-                whenStack.push_back(StackElement{});
+    // Record every event to an event log, and pass them on. Passing checks are always recorded, so a replay can
+    // use any verbosity, but they're only passed on if the other Results object wants them.
+    class EventLogResults final: public ForwardingResults {
+        static constexpr const size_t defaultCapacity = 1024 * 1024;
+
+        MappedLog log_;
+        bool forwardPassing_;
+        unordered_map<string, uint64_t> stringIds_;
+        string definitions_;
+        string record_;
+
+        static void writeInteger(Out<string> output, uint64_t value) {
+            while (value >= 0x80) {
+                output->push_back(static_cast<char>((value & 0x7f) | 0x80));
+                value >>= 7;
             }
 
-            Finally stack([&] { ++whenStack[whenDepth_].current; });
+            output->push_back(static_cast<char>(value));
+        }
 
-            if (whenStack[whenDepth_].index == whenStack[whenDepth_].current) {
-                ++whenDepth_;
-                whenResultRecorder_.push(move(description));
+        static void writeText(Out<string> output, const char* text, size_t size) {
+            writeInteger(output, size);
+            output->append(text, size);
+        }
 
-                Finally depth([&] {
-                    --whenDepth_;
-                    Stats stats; // TODO
-                    whenResultRecorder_.pop(stats);
-                });
+        void writeName(const string& name) {
+            auto found = stringIds_.find(name);
 
-                functor();
+            if (found == stringIds_.end()) {
+                found = stringIds_.emplace(name, stringIds_.size()).first;
+                writeInteger(out(definitions_), stringTag);
+                writeText(out(definitions_), name.data(), name.size());
             }
-        }
 
-        virtual bool notifyPassing() const override { return whenResultRecorder_.notifyPassing(); }
+            writeInteger(out(record_), found->second);
+        }
 
-        virtual void fail(optional<string> description, const string &expressionText, const vector <Variable> &variableList) override {
-            return whenResultRecorder_.fail(description, expressionText, variableList);
+        void writeStats(const Stats& stats) {
+            writeInteger(out(record_), stats.fixtures());
+            writeInteger(out(record_), stats.tests());
+            writeInteger(out(record_), stats.checks());
+            writeInteger(out(record_), stats.failedTests());
+            writeInteger(out(record_), stats.failedChecks());
+            writeInteger(out(record_), stats.wallTime());
+            writeInteger(out(record_), stats.cpuTime());
         }
 
-        virtual void pass(optional<string> description, const string &expressionText, const vector <Variable> &variableList) override {
-            return whenResultRecorder_.pass(description, expressionText, variableList);
+        void begin(EventType type) {
+            writeInteger(out(record_), static_cast<uint64_t>(type));
         }
 
-        const Stats& stats() const { return stats_; }
-    };
+        // Any strings the record uses are defined first, and they're committed together.
+        void commit() {
+            log_.append(definitions_);
+            log_.append(record_);
+            log_.commit();
+            definitions_.clear();
+            record_.clear();
+        }
 
-    class Check : public NoCopy {
-        Out<WhenRunner> whenRunner_;
-        Stats stats_;
+        void writeCheck(EventType type,
+                        const optional<string>& description,
+                        const string& expressionText,
+                        const vector<Variable>& variableList)
+        {
+            begin(type);
+            writeName(expressionText);
 
-        friend inline Stats checkStats(const Check& check) {
-            return check.stats_;
-        }
+            if (description) {
+                writeInteger(out(record_), 1);
+                writeName(*description);
+            }
+            else {
+                writeInteger(out(record_), 0);
+            }
 
-        bool addCheck(bool ok) {
-            stats_.addCheck();
+            writeInteger(out(record_), variableList.size());
 
-            if ( ! ok) {
-                stats_.failCheck();
+            for (const auto& variable : variableList) {
+                writeName(variable.name());
+                auto value = variable.value();
+                writeText(out(record_), value.data(), value.size());
+                writeName(variable.file());
+                writeInteger(out(record_), static_cast<uint64_t>(variable.line()));
             }
 
-            return ok;
+            commit();
+        }
+
+        void writeNamed(EventType type, const string& name) {
+            begin(type);
+            writeName(name);
+            commit();
+        }
+
+        void writeNamed(EventType type, const string& name, const Stats& stats) {
+            begin(type);
+            writeName(name);
+            writeStats(stats);
+            commit();
         }
     public:
-        Check(Out<WhenRunner> whenRunner) : whenRunner_(whenRunner) {}
+        EventLogResults(Out<Results> results, const string& fileName, size_t capacity = defaultCapacity) :
+            ForwardingResults(results), log_(fileName, capacity), forwardPassing_(results->notifyPassing())
+        {}
 
-        template<typename Functor>
-        void when(string description, Functor&& functor) {
-            whenRunner_->when(move(description), forward<Functor>(functor));
+        virtual void finish(const Stats& stats) override {
+            begin(EventType::FINISH);
+            writeStats(stats);
+            commit();
+            ForwardingResults::finish(stats);
         }
 
-        template<typename... Args>
-        bool operator()(Args&&... args) {
-            return addCheck(CheckWithFailureHandler(
-                    whenRunner_,
-                    forward<Args>(args)...
-            ));
+        virtual void beginContext(const NameStack& contextStack, const string& name) override {
+            writeNamed(EventType::BEGIN_CONTEXT, name);
+            ForwardingResults::beginContext(contextStack, name);
         }
 
-        template<typename Exception = exception, typename... Args>
-        bool throws(Args&&... args) {
-            return addCheck(CheckThrowsWithFailureHandler<Exception>(
-                    whenRunner_,
-                    forward<Args>(args)...
-            ));
+        virtual void endContext(const Stats& stats, const NameStack& contextStack, const string& name) override {
+            writeNamed(EventType::END_CONTEXT, name, stats);
+            ForwardingResults::endContext(stats, contextStack, name);
         }
 
-        template<typename Expression, typename... ContextVariableList>
-        void fail(Expression expression, ContextVariableList... contextVariableList) {
-            processFailure(whenRunner_, none, move(expression), move(contextVariableList)...);
-            stats_.failCheck();
+        virtual void beginGiven(const NameStack& context, const string& given) override {
+            writeNamed(EventType::BEGIN_GIVEN, given);
+            ForwardingResults::beginGiven(context, given);
         }
-    };
 
-    template<typename Functor, typename... Args>
-    void WhenRunner::run(Functor&& functor, Args&&... args) {
-        whenStack.clear();
-        whenDepth_ = 0;
-        stats_.addFixture(); // TODO:
+        virtual void endGiven(const Stats& stats, const NameStack& context, const string& given) override {
+            writeNamed(EventType::END_GIVEN, given, stats);
+            ForwardingResults::endGiven(stats, context, given);
+        }
 
-        do {
-            for (auto& element : whenStack) {
-                element.current = 0;
-            }
+        virtual void beginWhen(const NameStack& context,
+                               const string& given,
+                               const NameStack& whenStack,
+                               const string& when) override {
+            writeNamed(EventType::BEGIN_WHEN, when);
+            ForwardingResults::beginWhen(context, given, whenStack, when);
+        }
 
-            Check check(out(*this));
+        virtual void endWhen(const Stats& stats,
+                             const NameStack& context,
+                             const string& given,
+                             const NameStack& whenStack,
+                             const string& when) override {
+            writeNamed(EventType::END_WHEN, when, stats);
+            ForwardingResults::endWhen(stats, context, given, whenStack, when);
+        }
 
-            try {
-                functor(check, forward<Args>(args)...);
-            }
-            catch (const exception& e) {
-                whenResultRecorder_.failByException(e);
-                stats_.failTest();
-            }
+        virtual bool notifyPassing() const override { return true; }
 
-            stats_.addTest(); // TODO
+        virtual void fail(const NameStack& context,
+                          const string& given,
+                          const NameStack& whenStack,
+                          optional<string> description,
+                          const string &expressionText,
+                          const vector <Variable> &variableList) override
+        {
+            writeCheck(EventType::FAIL, description, expressionText, variableList);
+            ForwardingResults::fail(context, given, whenStack, move(description), expressionText, variableList);
+        }
 
-            while ( ! whenStack.empty() && topWhenDone()) {
-                whenStack.pop_back();
-            }
+        virtual void pass(const NameStack& context,
+                          const string& given,
+                          const NameStack& whenStack,
+                          optional <string> description,
+                          const string &expressionText,
+                          const vector <Variable> &variableList) override
+        {
+            writeCheck(EventType::PASS, description, expressionText, variableList);
 
-            if ( ! whenStack.empty()) {
-                ++whenStack.back().index;
+            if (forwardPassing_) {
+                ForwardingResults::pass(context, given, whenStack, move(description), expressionText, variableList);
             }
+        }
 
-            stats_ += checkStats(check);
-        } while ( ! whenStack.empty());
+        virtual void failByException(const NameStack& context,
+                                     const string& given,
+                                     const NameStack& whenStack,
+                                     const exception& e) override {
+            begin(EventType::FAIL_BY_EXCEPTION);
+            writeText(out(record_), e.what(), strlen(e.what()));
+            commit();
+            ForwardingResults::failByException(context, given, whenStack, e);
+        }
+
+        // Samples are written as the bits of each double.
+        virtual void measured(const NameStack& context,
+                              const string& given,
+                              const NameStack& whenStack,
+                              const Measurement& measurement) override {
+            begin(EventType::MEASURED);
+            writeName(measurement.name());
+            writeInteger(out(record_), measurement.iterations());
+            writeInteger(out(record_), measurement.samples().size());
+
+            for (auto sample : measurement.samples()) {
+                uint64_t bits;
+                memcpy(&bits, &sample, sizeof(bits));
+                writeInteger(out(record_), bits);
+            }
 
-        if (stats_.tests() == 0) {
-            stats_.addTest();
+            commit();
+            ForwardingResults::measured(context, given, whenStack, measurement);
         }
-    }
+    };
 
+    // Read the committed events from an event log, through a read only mapping. Throws runtime_error if the file
+    // isn't an event log, or a record is corrupt.
+    class EventLogReader final: public NoCopy {
+        string fileName_;
+        int fd_ = -1;
+        const char* data_ = nullptr;
+        size_t mappedSize_ = 0;
+        size_t position_ = logHeaderSize;
+        size_t end_ = logHeaderSize;
+        vector<string> strings_;
 
-    template<typename Functor, typename... Args>
-    class Runner final: public Context {
-        bool included(const PathList& pathList, size_t depth) const {
-            if (pathList.empty()) {
-                return true;
-            }
+        [[noreturn]] void throwCorrupt() {
+            throw runtime_error("Corrupt event log \"" + fileName_ + "\"");
+        }
 
-            for (const auto& path : pathList) {
-                if (path->size() > depth) {
-                    if (regex_match(name, (*path)[depth])) {
-                        return true;
-                    }
-                }
-                else {
-                    return true;
-                }
-            }
+        uint64_t readInteger() {
+            uint64_t value = 0;
 
-            return false;
-        }
+            for (unsigned shift = 0; shift < 64; shift += 7) {
+                if (position_ == end_) {
+                    throwCorrupt();
+                }
 
-        string name;
-        Functor runTest;
-        StoreArgs<Args...> args;
-    public:
-        Runner(string name, Functor runTest, Args&&... args) :
-            name(move(name)), runTest(move(runTest)), args(forward<Args>(args)...)
-        {}
+                auto byte = static_cast<unsigned char>(data_[position_++]);
+                value |= static_cast<uint64_t>(byte & 0x7f) << shift;
 
-        virtual void list(const PathList& pathList, Out<ContextResultsRecorder> results, size_t depth) const override {
-            if ( ! included(pathList, depth)) return;
+                if ((byte & 0x80) == 0) {
+                    return value;
+                }
+            }
 
-            results->beginGiven(name);
-            Stats stats; // TODO
-            results->endGiven(stats, name);
+            throwCorrupt();
         }
 
-        // Must only be called once as it forwards the constructor arguments to the class.
-        virtual Stats run(const PathList& pathList, Out<ContextResultsRecorder> results, size_t depth) override {
-            results->beginGiven(name);
-            Stats stats;
+        string readText() {
+            auto size = readInteger();
 
-            if (included(pathList, depth)) {
-                stats += args.applyExtraBefore(runTest, name, results);
+            if (size > end_ - position_) {
+                throwCorrupt();
             }
 
-            results->endGiven(stats, name);
+            string text(data_ + position_, size);
+            position_ += size;
 
-            return stats;
+            return text;
         }
-    };
 
-    template<typename Functor, typename... Args>
-    class RunTest final: public NoCopy {
-        Functor runTest;
-    public:
-        RunTest(Functor runTest) : runTest(move(runTest)) {}
+        const string& readName() {
+            auto id = readInteger();
 
-        // Visual C++ 2015 seems to generate a dodgy move constructor here.
-        RunTest(RunTest&& other) : runTest(move(other.runTest)) {}
+            if (id >= strings_.size()) {
+                throwCorrupt();
+            }
 
-        RunTest operator=(RunTest&& other) {
-            runTest = move(other.runTest);
+            return strings_[id];
         }
 
-        Stats operator()(const string& name, Out<ContextResultsRecorder> results, Args&&... args) {
-            WhenRunner whenRunner(results, name);
-            whenRunner.run(runTest, forward<Args>(args)...);
+        Stats readStats() {
+            auto fixtures = readInteger();
+            auto tests = readInteger();
+            auto checks = readInteger();
+            auto failedTests = readInteger();
+            auto failedChecks = readInteger();
+            auto wallTime = readInteger();
+            auto cpuTime = readInteger();
 
-            return whenRunner.stats();
+            return Stats(fixtures, tests, checks, failedTests, failedChecks, wallTime, cpuTime);
         }
-    };
+    public:
+        explicit EventLogReader(string fileName) : fileName_(move(fileName)) {
+            #ifdef __linux__
+                fd_ = ::open(fileName_.c_str(), O_RDONLY | O_CLOEXEC);
 
-    // Workaround for MSVC bug. We should be able to use std forward, but it doesn't work for decayed arrays.
-    template<typename T>
-    struct Forward {
-        static constexpr T&& run( typename std::remove_reference<T>::type& t ) {
-            return std::forward<T>(t);
-        }
+                if (fd_ < 0) {
+                    throw runtime_error("Unable to read event log \"" + fileName_ + "\": " + strerror(errno));
+                }
 
-        static constexpr T&& run( typename std::remove_reference<T>::type&& t ) {
-            return std::forward<T>(t);
-        }
-    };
+                struct stat status;
 
-    template<typename T>
-    struct Forward<T*> {
-        static T* run(T* t ) {
-            return t;
-        }
-    };
+                if (::fstat(fd_, &status) != 0) {
+                    ::close(fd_);
+                    throwSystemError("fstat");
+                }
 
-    template<typename Functor, typename... Args>
-    unique_ptr<Context> given(string name, Functor runTest, Args&&... args) {
-        return make_unique<Runner<RunTest<Functor, DecayArrayAndFunction_t<Args>...>, DecayArrayAndFunction_t<Args>...>>(
-                move(name),
-                RunTest<Functor, DecayArrayAndFunction_t<Args>...>(runTest),
-                Forward<DecayArrayAndFunction_t<Args>>::run(args)...
-            );
-    }
+                mappedSize_ = static_cast<size_t>(status.st_size);
+
+                if (mappedSize_ < logHeaderSize) {
+                    ::close(fd_);
+                    throw runtime_error("\"" + fileName_ + "\" isn't an event log");
+                }
 
-    template<typename Functor, typename... Args>
-    class RunExhaustive final: public NoCopy {
-        Functor runTest;
-        StoreArgs<Args...> args;
+                auto data = ::mmap(nullptr, mappedSize_, PROT_READ, MAP_SHARED, fd_, 0);
 
-        template<typename BoundFunctor>
-        static Stats exhaustive(BoundFunctor&& functor,
-                                const string& name,
-                                Out<ContextResultsRecorder> results)
-        {
-            WhenRunner whenRunner(results, name);
-            whenRunner.run(forward<BoundFunctor>(functor));
+                if (data == MAP_FAILED) {
+                    ::close(fd_);
+                    throwSystemError("mmap");
+                }
 
-            return whenRunner.stats();
-        }
+                data_ = static_cast<const char*>(data);
 
-        template<typename BoundFunctor, typename Container, typename... BoundArgs>
-        static Stats exhaustive(
-                BoundFunctor&& functor,
-                const string& name,
-                Out<ContextResultsRecorder> results,
-                const Container& container,
-                const BoundArgs&... tail
-            )
-        {
-            Stats stats;
+                if (memcmp(data_, logMagic, sizeof(logMagic)) != 0) {
+                    ::munmap(const_cast<char*>(data_), mappedSize_);
+                    ::close(fd_);
+                    throw runtime_error("\"" + fileName_ + "\" isn't an event log");
+                }
 
-            for (const auto& value : container) {
-                stats += exhaustive(
-                        [&] (Check& check, auto&&... args) {
-                            functor(ref(check), value, args...);
-                        },
-                        name,
-                        results,
-                        tail...
-                    );
-            }
+                uint64_t committed;
+                memcpy(&committed, data_ + sizeof(logMagic), sizeof(committed));
 
-            return stats;
+                if (committed > mappedSize_ - logHeaderSize) {
+                    ::munmap(const_cast<char*>(data_), mappedSize_);
+                    ::close(fd_);
+                    throwCorrupt();
+                }
+
+                end_ = logHeaderSize + committed;
+            #else
+                throwLogUnsupported();
+            #endif
         }
-    public:
-        RunExhaustive(Functor runTest, StoreArgs<Args...> args) : runTest(move(runTest)), args(move(args)) {}
 
-        Stats operator()(const string& name, Out<ContextResultsRecorder> results) {
-            return args.apply([&] (const Args&... extractedArgs) {
-                return exhaustive(move(runTest), name, results, extractedArgs...);
-            });
+        ~EventLogReader() {
+            #ifdef __linux__
+                ::munmap(const_cast<char*>(data_), mappedSize_);
+                ::close(fd_);
+            #endif
         }
-    };
 
-    template<typename Value, typename... Args>
-    vector<Value> choice(Value value, Args&&... tail) {
-        return vector<Value>{value, forward<Args>(tail)...};
-    }
+        // Returns false at the end of the committed records.
+        bool next(Out<Event> event) {
+            while (position_ != end_) {
+                auto tag = readInteger();
 
-    template<typename Value>
-    vector<Value> constant(Value value) {
-        return vector<Value>(1, value);
-    }
+                if (tag == stringTag) {
+                    strings_.push_back(readText());
+                    continue;
+                }
 
-    template<typename... Args>
-    class Exhaustive final: public NoCopy {
-        StoreArgs<Args...> args;
-    public:
-        Exhaustive(Args&&... args) : args(forward<Args>(args)...) {}
+                if (tag > static_cast<uint64_t>(lastEventType)) {
+                    throwCorrupt();
+                }
 
-        template<typename Functor>
-        unique_ptr<Context> given(string name, Functor runTest) {
-            return make_unique<Runner<RunExhaustive<Functor, Args...>>>(
-                    move(name),
-                    RunExhaustive<Functor, Args...>(move(runTest), move(args))
-            );
+                event->type = static_cast<EventType>(tag);
+                event->description = optional<string>();
+                event->variableList.clear();
+                event->stats = Stats();
+                event->measurement.reset();
+
+                switch (event->type) {
+                    case EventType::BEGIN_CONTEXT:
+                    case EventType::BEGIN_GIVEN:
+                    case EventType::BEGIN_WHEN:
+                        event->name = readName();
+                        break;
+                    case EventType::END_CONTEXT:
+                    case EventType::END_GIVEN:
+                    case EventType::END_WHEN:
+                        event->name = readName();
+                        event->stats = readStats();
+                        break;
+                    case EventType::PASS:
+                    case EventType::FAIL: {
+                        event->name = readName();
+
+                        if (readInteger() != 0) {
+                            event->description = readName();
+                        }
+
+                        auto variableCount = readInteger();
+
+                        for (uint64_t index = 0; index < variableCount; ++index) {
+                            auto name = readName();
+                            auto value = readText();
+                            auto file = readName();
+                            auto line = static_cast<int>(readInteger());
+                            event->variableList.emplace_back(name, move(value), file, line);
+                        }
+
+                        break;
+                    }
+                    case EventType::FAIL_BY_EXCEPTION:
+                        event->name = readText();
+                        break;
+                    case EventType::FINISH:
+                        event->name.clear();
+                        event->stats = readStats();
+                        break;
+                    case EventType::MEASURED: {
+                        event->name = readName();
+                        auto iterations = readInteger();
+                        auto sampleCount = readInteger();
+
+                        if (sampleCount > end_ - position_) {
+                            throwCorrupt();
+                        }
+
+                        vector<double> samples;
+
+                        for (uint64_t index = 0; index < sampleCount; ++index) {
+                            auto bits = readInteger();
+                            double sample;
+                            memcpy(&sample, &bits, sizeof(sample));
+                            samples.push_back(sample);
+                        }
+
+                        event->measurement = make_shared<const Measurement>(event->name, iterations, move(samples));
+                        break;
+                    }
+                }
+
+                return true;
+            }
+
+            return false;
         }
     };
 
-    template<typename... Args>
-    Exhaustive<Args...> exhaustive(Args&&... args) {
-        return Exhaustive<DecayArrayAndFunction_t< Args>...>(forward<DecayArrayAndFunction_t< Args>>(args)...);
-    }
+    // How far a replayed run got.
+    struct LogReplay final {
+        bool finished;
+        Stats stats;
 
-    inline void list(const PathList& pathList, Out<Results> results) {
-        Register::list(pathList, results);
-    }
+        // The path of the last given that started, if any.
+        optional<string> lastGiven;
+    };
+
+    // Feed the events from a log into results, without running any tests. Passing checks are only passed on if
+    // results wants them. If the run didn't finish, because it crashed, or is still going, results are finished
+    // with the totals of the givens that did.
+    inline LogReplay replayEventLog(const string& fileName, Out<Results> results) {
+        EventLogReader reader(fileName);
+        EventReplayer replayer(results);
+        Event event{EventType::FINISH, "", Stats(), optional<string>(), vector<Variable>()};
+        NameStack contextStack;
+        LogReplay replay{false, Stats(), optional<string>()};
+        auto notifyPassing = results->notifyPassing();
+
+        while (reader.next(out(event))) {
+            switch (event.type) {
+                case EventType::BEGIN_CONTEXT:
+                    contextStack.push(event.name);
+                    break;
+                case EventType::END_CONTEXT:
+                    contextStack.pop();
+                    break;
+                case EventType::BEGIN_GIVEN:
+                    replay.lastGiven = givenPath(contextStack, event.name);
+                    break;
+                case EventType::END_GIVEN:
+                    replay.stats += event.stats;
+                    break;
+                case EventType::FINISH:
+                    replay.finished = true;
+                    replay.stats = event.stats;
+                    break;
+                case EventType::PASS:
+                    if ( ! notifyPassing) {
+                        continue;
+                    }
 
-    inline bool run(const PathList& pathList, Out<Results> results) {
-        auto stats = Register::run(pathList, results);
+                    break;
+                default:
+                    break;
+            }
 
-        return stats.failedTests() == 0 && stats.failedChecks() == 0;
-    }
+            replayer(event);
+        }
 
-    inline void list(const PathList& pathList, Verbosity verbosity) {
-        HumanResults results(out(cout), verbosity);
-        return list(pathList, out(results));
-    }
+        if ( ! replay.finished) {
+            results->finish(replay.stats);
+        }
 
-    inline bool run(const PathList& pathList, Verbosity verbosity) {
-        HumanResults results(out(cout), verbosity);
-        return run(pathList, out(results));
+        return replay;
     }
 }}}}
 
 namespace Enhedron { namespace Test {
-    using namespace Assertion;
-
-    using Impl::Impl_Suite::Suite;
-    using Impl::Impl_Suite::context;
-    using Impl::Impl_Suite::Check;
-    using Impl::Impl_Suite::given;
-    using Impl::Impl_Suite::Exhaustive;
-    using Impl::Impl_Suite::exhaustive;
-    using Impl::Impl_Suite::choice;
-    using Impl::Impl_Suite::constant;
-    using Impl::Impl_Suite::list;
-    using Impl::Impl_Suite::run;
+    using Impl::Impl_EventLog::EventLogResults;
+    using Impl::Impl_EventLog::EventLogReader;
+    using Impl::Impl_EventLog::LogReplay;
+    using Impl::Impl_EventLog::replayEventLog;
 }}
 // File: Enhedron/Util/Math.h
 //
@@ -3119,21 +9450,47 @@ namespace Enhedron { namespace CommandLine {
 #include <algorithm>
 #include <locale>
 #include <cctype>
-#include <regex>
 #include <memory>
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
 
 namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Harness {
     using std::string;
     using std::move;
     using std::vector;
-    using std::shared_ptr;
-    using std::make_shared;
     using std::runtime_error;
     using std::find_first_of;
     using std::tolower;
     using std::locale;
     using std::transform;
-    using std::regex;
+    using std::stoul;
+    using std::stod;
+    using std::invalid_argument;
+    using std::out_of_range;
+    using std::cout;
+    using std::cerr;
+    using std::ostream;
+    using std::ifstream;
+    using std::ofstream;
+    using std::make_shared;
+    using std::unique_ptr;
+    using std::make_unique;
+
+    using Util::optional;
+    using Util::none;
+
+    using Impl_Shard::Timings;
+    using Impl_Shard::readTimings;
+    using Impl_Baseline::Baselines;
+    using Impl_Baseline::readBaselines;
+    using Impl_Baseline::BaselinesResults;
+    using Impl_AsyncResults::AsyncResults;
+    using Impl_Reporters::JUnitResults;
+    using Impl_Reporters::JsonResults;
+    using Impl_Reporters::MeasurementsResults;
+    using Impl_EventLog::EventLogResults;
+    using Impl_EventLog::replayEventLog;
 
     using CommandLine::ExitStatus;
     using CommandLine::Flag;
@@ -3158,11 +9515,113 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Harness {
         throw runtime_error("Unknown verbosity \"" + v + "\"");
     }
 
-    inline ExitStatus runTests(bool listOnly, string verbosityString, vector<string> pathList) {
-        vector<shared_ptr<vector<regex>>> pathRegexs;
+    enum class Reporter {
+        HUMAN,
+        JUNIT,
+        JSON
+    };
+
+    inline Reporter parseReporter(string r) {
+        transform(r.begin(), r.end(), r.begin(),
+                  [](char c) { return tolower(c, locale()); } );
+
+        if (r == "human") return Reporter::HUMAN;
+        if (r == "junit") return Reporter::JUNIT;
+        if (r == "json") return Reporter::JSON;
+
+        throw runtime_error("Unknown reporter \"" + r + "\"");
+    }
+
+    inline size_t parseCount(const string& count, const string& description) {
+        try {
+            size_t end = 0;
+            auto value = stoul(count, &end);
+
+            if (end != count.size()) {
+                throw invalid_argument(count);
+            }
+
+            return value;
+        }
+        catch (const invalid_argument&) {
+            throw runtime_error("Invalid number of " + description + " \"" + count + "\"");
+        }
+        catch (const out_of_range&) {
+            throw runtime_error("Invalid number of " + description + " \"" + count + "\"");
+        }
+    }
+
+    // A percentage, as a fraction.
+    inline double parsePercentage(const string& percentage, const string& description) {
+        try {
+            size_t end = 0;
+            auto value = stod(percentage, &end);
+
+            if (end != percentage.size() || value < 0) {
+                throw invalid_argument(percentage);
+            }
+
+            return value / 100;
+        }
+        catch (const invalid_argument&) {
+            throw runtime_error("Invalid " + description + " \"" + percentage + "\"");
+        }
+        catch (const out_of_range&) {
+            throw runtime_error("Invalid " + description + " \"" + percentage + "\"");
+        }
+    }
+
+    inline size_t parseJobs(const string& jobs) {
+        size_t jobCount = parseCount(jobs, "jobs");
+
+        if (jobCount == 0) {
+            return defaultThreadCount();
+        }
+
+        return jobCount;
+    }
+
+    inline optional<string> singleFile(const vector<string>& fileList, const string& optionName) {
+        if (fileList.size() > 1) {
+            throw runtime_error("Only one file can be given for " + optionName);
+        }
+
+        if (fileList.empty()) {
+            return none;
+        }
+
+        return fileList.front();
+    }
+
+    inline ExitStatus runTests(
+            bool listOnly,
+            string verbosityString,
+            string jobsString,
+            string slowestString,
+            string shardIndexString,
+            string shardCountString,
+            vector<string> timingsFileList,
+            vector<string> writeTimingsFileList,
+            vector<string> baselinesFileList,
+            vector<string> writeBaselinesFileList,
+            string regressionThresholdString,
+            vector<string> writeMeasurementsFileList,
+            string workersString,
+            string reporterString,
+            vector<string> outputFileList,
+            vector<string> recordFileList,
+            vector<string> replayFileList,
+            bool forkWhens,
+            bool parallelWhens,
+            bool isolate,
+            bool asyncOutput,
+            vector<string> pathList
+        )
+    {
+        vector<vector<string>> pathComponentLists;
 
         for (auto& path : pathList) {
-            vector<regex> pathComponentList;
+            vector<string> pathComponentList;
             auto separatorPos = path.begin();
             auto matchChars = "/\\";
             auto matchCharsEnd = matchChars + 2;
@@ -3196,16 +9655,206 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Harness {
                 ++separatorPos;
             }
 
-            pathRegexs.emplace_back(make_shared<vector<regex>>(move(pathComponentList)));
+            pathComponentLists.emplace_back(move(pathComponentList));
         }
 
+        PathFilter filter(pathComponentLists);
+
         Verbosity verbosity = parseVerbosity(verbosityString);
+        RunOptions options;
+        options.jobs = parseJobs(jobsString);
+        options.forkWhens = forkWhens;
+        options.parallelWhens = parallelWhens;
+
+        if (forkWhens && ! processesSupported) {
+            throw runtime_error("--fork-whens is only supported on Linux");
+        }
+
+        if (forkWhens && parallelWhens) {
+            throw runtime_error("--fork-whens and --parallel-whens can't be used together");
+        }
+
+        options.workers = parseCount(workersString, "workers");
+        options.isolate = isolate;
+
+        if ((options.workers > 0 || isolate) && ! processesSupported) {
+            throw runtime_error("--workers and --isolate are only supported on Linux");
+        }
+
+        if ((options.workers > 0 || isolate) && options.jobs > 1) {
+            throw runtime_error("--workers and --isolate can't be used with --jobs");
+        }
+
+        size_t slowest = parseCount(slowestString, "slowest tests");
+        options.shardIndex = parseCount(shardIndexString, "shard index");
+        options.shardCount = parseCount(shardCountString, "shards");
+
+        if (options.shardCount == 0 || options.shardIndex >= options.shardCount) {
+            throw runtime_error("The shard index must be less than the shard count");
+        }
+
+        auto reporter = parseReporter(reporterString);
+        auto outputFile = singleFile(outputFileList, "--output");
+
+        if (reporter != Reporter::HUMAN && ! outputFile && slowest > 0) {
+            throw runtime_error("--slowest writes to standard output, so it needs --output with this reporter");
+        }
+
+        auto recordFile = singleFile(recordFileList, "--record");
+        auto replayFile = singleFile(replayFileList, "--replay");
+        auto timingsFile = singleFile(timingsFileList, "--timings");
+        auto writeTimingsFile = singleFile(writeTimingsFileList, "--write-timings");
+        auto baselinesFile = singleFile(baselinesFileList, "--baselines");
+        auto writeBaselinesFile = singleFile(writeBaselinesFileList, "--write-baselines");
+        auto writeMeasurementsFile = singleFile(writeMeasurementsFileList, "--write-measurements");
+        options.benchmark.regressionThreshold = parsePercentage(regressionThresholdString, "regression threshold");
+
+        if (timingsFile) {
+            ifstream timingsInput(*timingsFile);
+
+            if ( ! timingsInput) {
+                throw runtime_error("Unable to read timings from \"" + *timingsFile + "\"");
+            }
+
+            options.timings = make_shared<const Timings>(readTimings(out(timingsInput)));
+        }
+
+        if (baselinesFile) {
+            ifstream baselinesInput(*baselinesFile);
+
+            if ( ! baselinesInput) {
+                throw runtime_error("Unable to read baselines from \"" + *baselinesFile + "\"");
+            }
+
+            options.baselines = make_shared<const Baselines>(readBaselines(out(baselinesInput)));
+        }
 
         if (listOnly) {
-            Test::list(pathRegexs, verbosity);
+            if (options.shardCount > 1) {
+                Test::listShards(filter, options, out(cout));
+            }
+            else {
+                Test::list(filter, verbosity);
+            }
         }
         else {
-            if ( ! Test::run(pathRegexs, verbosity)) {
+            ofstream fileOutput;
+            Out<ostream> reportOutput(cout);
+
+            if (outputFile) {
+                fileOutput.open(*outputFile);
+
+                if ( ! fileOutput) {
+                    throw runtime_error("Unable to write results to \"" + *outputFile + "\"");
+                }
+
+                reportOutput = out(fileOutput);
+            }
+
+            // Other reporters write to standard output unless there's a file, so then the human readable results
+            // go to standard error. Even when silent, they show failures.
+            Out<ostream> humanOutput(cout);
+
+            if (reporter == Reporter::HUMAN) {
+                humanOutput = reportOutput;
+            }
+            else if ( ! outputFile) {
+                humanOutput = out(cerr);
+            }
+
+            HumanResults humanResults(humanOutput, verbosity);
+            Out<Results> results(humanResults);
+            unique_ptr<Results> reporterResults;
+
+            if (reporter == Reporter::JUNIT) {
+                reporterResults = make_unique<JUnitResults>(results, reportOutput);
+                results = out(*reporterResults);
+            }
+            else if (reporter == Reporter::JSON) {
+                reporterResults = make_unique<JsonResults>(results, reportOutput);
+                results = out(*reporterResults);
+            }
+
+            unique_ptr<AsyncResults> asyncResults;
+
+            if (asyncOutput) {
+                asyncResults = make_unique<AsyncResults>(results);
+                results = out(*asyncResults);
+            }
+
+            SlowestResults slowestResults(results, out(cout), slowest);
+
+            if (slowest > 0) {
+                results = out(slowestResults);
+            }
+
+            ofstream timingsOutput;
+            TimingsResults timingsResults(results, out(timingsOutput));
+
+            if (writeTimingsFile) {
+                timingsOutput.open(*writeTimingsFile);
+
+                if ( ! timingsOutput) {
+                    throw runtime_error("Unable to write timings to \"" + *writeTimingsFile + "\"");
+                }
+
+                results = out(timingsResults);
+            }
+
+            ofstream baselinesOutput;
+            BaselinesResults baselinesResults(results, out(baselinesOutput));
+
+            if (writeBaselinesFile) {
+                baselinesOutput.open(*writeBaselinesFile);
+
+                if ( ! baselinesOutput) {
+                    throw runtime_error("Unable to write baselines to \"" + *writeBaselinesFile + "\"");
+                }
+
+                results = out(baselinesResults);
+            }
+
+            ofstream measurementsOutput;
+            unique_ptr<MeasurementsResults> measurementsResults;
+
+            if (writeMeasurementsFile) {
+                measurementsOutput.open(*writeMeasurementsFile);
+
+                if ( ! measurementsOutput) {
+                    throw runtime_error("Unable to write measurements to \"" + *writeMeasurementsFile + "\"");
+                }
+
+                measurementsResults = make_unique<MeasurementsResults>(results, out(measurementsOutput));
+                results = out(*measurementsResults);
+            }
+
+            unique_ptr<EventLogResults> eventLogResults;
+
+            if (recordFile) {
+                eventLogResults = make_unique<EventLogResults>(results, *recordFile);
+                results = out(*eventLogResults);
+            }
+
+            if (replayFile) {
+                auto replay = replayEventLog(*replayFile, results);
+
+                if ( ! replay.finished) {
+                    cerr << "The event log \"" << *replayFile << "\" ends before the run finished.";
+
+                    if (replay.lastGiven) {
+                        cerr << " The last given to start was \"" << *replay.lastGiven << "\".";
+                    }
+
+                    cerr << "\n";
+
+                    return ExitStatus::SOFTWARE;
+                }
+
+                if (replay.stats.failedTests() > 0 || replay.stats.failedChecks() > 0) {
+                    return ExitStatus::SOFTWARE;
+                }
+            }
+            else if ( ! Test::run(filter, results, options)) {
                 return ExitStatus::SOFTWARE;
             }
         }
@@ -3224,7 +9873,80 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Harness {
                 Option<string>(Name('v', "verbosity", "Set the verbosity"),
                                "silent|summary|contexts|fixtures|sections|checks|checks_expression|variables",
                                "contexts"
-                )
+                ),
+                Option<string>(Name('j', "jobs", "Run givens on this many threads. 0 means one per core."),
+                               "N",
+                               "1"
+                ),
+                Option<string>(Name("slowest", "Print the N slowest givens and whens, with their share of the total "
+                                               "time."),
+                               "N",
+                               "0"
+                ),
+                Option<string>(Name("shard-index", "Only run the givens in this shard, counting from 0."), "I", "0"),
+                Option<string>(Name("shard-count", "Split the givens into this many shards. With --list, show the "
+                                                   "shard each given is in."),
+                               "N",
+                               "1"
+                ),
+                Option<vector<string>>(Name("timings", "Balance the shards using the times in FILE, as written by "
+                                                       "--write-timings."),
+                                       "FILE"
+                ),
+                Option<vector<string>>(Name("write-timings", "Write the time taken by each given to FILE."), "FILE"),
+                Option<vector<string>>(Name("baselines", "Check each benchmark measurement against its samples in "
+                                                         "FILE, as written by --write-baselines. It fails if it's "
+                                                         "significantly slower, by more than the regression "
+                                                         "threshold."),
+                                       "FILE"
+                ),
+                Option<vector<string>>(Name("write-baselines", "Write the samples from each benchmark measurement to "
+                                                               "FILE."),
+                                       "FILE"
+                ),
+                Option<string>(Name("regression-threshold", "How much slower than its baseline a benchmark "
+                                                            "measurement's median can be, as a percentage, before "
+                                                            "it fails."),
+                               "PERCENT",
+                               "5"
+                ),
+                Option<vector<string>>(Name("write-measurements", "Write each benchmark measurement to FILE as CSV. "
+                                                                  "A sweep has a row for each combination of "
+                                                                  "arguments."),
+                                       "FILE"
+                ),
+                Option<string>(Name("workers", "Run givens in N worker processes, handing them out one at a time. A "
+                                               "given that crashes fails without stopping the run. Linux only."),
+                               "N",
+                               "0"
+                ),
+                Option<string>(Name("reporter", "Write results as human readable text, JUnit XML, or JSON with one "
+                                                "object per line. Results are written as each given finishes."),
+                               "human|junit|json",
+                               "human"
+                ),
+                Option<vector<string>>(Name("output", "Write results from the reporter to FILE, instead of standard "
+                                                      "output. With junit or json, human readable results still go "
+                                                      "to standard output, or standard error without --output."),
+                                       "FILE"
+                ),
+                Option<vector<string>>(Name("record", "Record every event to a binary log in FILE, as the tests run. "
+                                                      "If the run crashes, the log has everything up to the crash."),
+                                       "FILE"
+                ),
+                Option<vector<string>>(Name("replay", "Report the events recorded in FILE by --record, instead of "
+                                                      "running tests. Any reporter and verbosity can be used."),
+                                       "FILE"
+                ),
+                Flag("fork-whens", "Run each given in a child process, forking at each when, so the code before a "
+                                   "when only runs once. Threads started before a when won't exist in the child. "
+                                   "Linux only."),
+                Flag("parallel-whens", "Run each path through the whens of a given as a separate task, so whens in "
+                                       "the same given can run at the same time. Only has an effect with --jobs."),
+                Flag("isolate", "Run each given in its own process, forked from a worker started before any tests "
+                                "run. A given that crashes or terminates fails, and the rest still run. Use "
+                                "--workers to run more than one at a time. Linux only."),
+                Flag("async-output", "Format and write results on a separate thread, so tests don't wait for output.")
         );
     }
 }}}}
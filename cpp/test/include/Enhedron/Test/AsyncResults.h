@@ -0,0 +1,303 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include "Enhedron/Util.h"
+#include "Enhedron/Test/Results.h"
+#include "Enhedron/Test/Events.h"
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <vector>
+#include <utility>
+#include <string>
+#include <cstdint>
+
+namespace Enhedron { namespace Test { namespace Impl { namespace Impl_AsyncResults {
+    using std::atomic;
+    using std::memory_order_relaxed;
+    using std::memory_order_acquire;
+    using std::memory_order_release;
+    using std::memory_order_seq_cst;
+    using std::thread;
+    using std::mutex;
+    using std::unique_lock;
+    using std::lock_guard;
+    using std::condition_variable;
+    using std::exception_ptr;
+    using std::current_exception;
+    using std::rethrow_exception;
+    using std::vector;
+    using std::move;
+    using std::string;
+    using std::exception;
+
+    using Util::optional;
+    using Assertion::Variable;
+
+    namespace this_thread = std::this_thread;
+
+    using namespace Impl_Results;
+    using Impl_Events::Event;
+    using Impl_Events::EventType;
+    using Impl_Events::EventRecorder;
+    using Impl_Events::EventReplayer;
+
+    // A fixed size ring buffer for one producer thread and one consumer thread, without locks. Indices only ever
+    // increase, so full and empty can be told apart without wasting a slot. Pushes and empty are sequentially
+    // consistent, so a consumer that flags it's going to sleep, then checks empty, can't miss a push from a producer
+    // that pushes, then checks the flag.
+    template<typename Value>
+    class SpscQueue final: public NoCopyMove {
+        vector<Value> slots_;
+        atomic<size_t> head_{0};
+        atomic<size_t> tail_{0};
+    public:
+        explicit SpscQueue(size_t capacity) : slots_(capacity == 0 ? 1 : capacity) {}
+
+        size_t capacity() const { return slots_.size(); }
+
+        // Consumer only.
+        bool empty() const {
+            return head_.load(memory_order_relaxed) == tail_.load(memory_order_seq_cst);
+        }
+
+        // Producer only. Leaves value alone if the queue is full.
+        bool tryPush(Value& value) {
+            auto tail = tail_.load(memory_order_relaxed);
+
+            if (tail - head_.load(memory_order_acquire) == slots_.size()) {
+                return false;
+            }
+
+            slots_[tail % slots_.size()] = move(value);
+            tail_.store(tail + 1, memory_order_seq_cst);
+
+            return true;
+        }
+
+        // Consumer only.
+        bool tryPop(Out<Value> value) {
+            auto head = head_.load(memory_order_relaxed);
+
+            if (head == tail_.load(memory_order_acquire)) {
+                return false;
+            }
+
+            *value = move(slots_[head % slots_.size()]);
+            head_.store(head + 1, memory_order_release);
+
+            return true;
+        }
+    };
+
+    // Pass results to another Results object on a separate thread, so tests don't wait for it to format and write
+    // them. Calls are recorded as events, and replayed in order, so the output is the same as calling it directly.
+    //
+    // At most capacity events are queued. After that, the test thread waits for the reporter to catch up. finish
+    // waits for everything to be passed on, and rethrows anything the other Results object threw. Calls must come
+    // from one thread at a time, which is how Register::run makes them, even when it runs givens in parallel.
+    class AsyncResults final: public Results {
+        // How many times the reporter checks for more events before it sleeps.
+        static constexpr const size_t spinCount = 64;
+
+        Out<Results> results_;
+        bool notifyPassing_;
+        EventRecorder staging_;
+        SpscQueue<Event> queue_;
+
+        mutex lock_;
+        condition_variable changed_;
+        atomic<bool> reporterWaiting_{false};
+        atomic<bool> stopping_{false};
+        atomic<uint64_t> published_{0};
+        atomic<uint64_t> reported_{0};
+        exception_ptr error_;
+
+        thread reporter_;
+
+        void notifyReporter() {
+            // Either we see the reporter waiting, or it sees our event. See SpscQueue.
+            if (reporterWaiting_.load(memory_order_seq_cst)) {
+                lock_guard<mutex> lock(lock_);
+                changed_.notify_all();
+            }
+        }
+
+        void publish() {
+            staging_.drain([this] (Event&& event) {
+                while ( ! queue_.tryPush(event)) {
+                    this_thread::yield();
+                }
+
+                published_.fetch_add(1, memory_order_relaxed);
+                notifyReporter();
+            });
+        }
+
+        // Returns false if we're stopping and there's nothing left.
+        bool waitForEvents() {
+            for (size_t spin = 0; spin < spinCount; ++spin) {
+                if ( ! queue_.empty()) {
+                    return true;
+                }
+
+                this_thread::yield();
+            }
+
+            unique_lock<mutex> lock(lock_);
+            reporterWaiting_.store(true, memory_order_seq_cst);
+
+            changed_.wait(lock, [this] {
+                return ! queue_.empty() || stopping_.load(memory_order_acquire);
+            });
+
+            reporterWaiting_.store(false, memory_order_relaxed);
+
+            return ! queue_.empty();
+        }
+
+        void report() {
+            EventReplayer replayer(results_);
+            Event event{EventType::FINISH, "", Stats(), optional<string>(), vector<Variable>()};
+
+            while (waitForEvents()) {
+                while (queue_.tryPop(out(event))) {
+                    // Keep draining after an error, so the test thread doesn't wait forever for space.
+                    if ( ! error_) {
+                        try {
+                            replayer(event);
+                        }
+                        catch (...) {
+                            error_ = current_exception();
+                        }
+                    }
+
+                    reported_.store(reported_.load(memory_order_relaxed) + 1, memory_order_release);
+                }
+
+                lock_guard<mutex> lock(lock_);
+                changed_.notify_all();
+            }
+        }
+    public:
+        explicit AsyncResults(Out<Results> results, size_t capacity = 4096) :
+            results_(results),
+            notifyPassing_(results->notifyPassing()),
+            staging_(notifyPassing_),
+            queue_(capacity),
+            reporter_([this] { report(); })
+        {}
+
+        ~AsyncResults() {
+            {
+                lock_guard<mutex> lock(lock_);
+                stopping_.store(true, memory_order_release);
+                changed_.notify_all();
+            }
+
+            reporter_.join();
+        }
+
+        virtual void finish(const Stats& stats) override {
+            staging_.finish(stats);
+            publish();
+
+            auto published = published_.load(memory_order_relaxed);
+            unique_lock<mutex> lock(lock_);
+
+            changed_.wait(lock, [&] { return reported_.load(memory_order_acquire) == published; });
+
+            if (error_) {
+                rethrow_exception(error_);
+            }
+        }
+
+        virtual void beginContext(const NameStack& context, const string& name) override {
+            staging_.beginContext(context, name);
+            publish();
+        }
+
+        virtual void endContext(const Stats& stats, const NameStack& context, const string& name) override {
+            staging_.endContext(stats, context, name);
+            publish();
+        }
+
+        virtual void beginGiven(const NameStack& context, const string& given) override {
+            staging_.beginGiven(context, given);
+            publish();
+        }
+
+        virtual void endGiven(const Stats& stats, const NameStack& context, const string& given) override {
+            staging_.endGiven(stats, context, given);
+            publish();
+        }
+
+        virtual void beginWhen(const NameStack& context,
+                               const string& given,
+                               const NameStack& whenStack,
+                               const string& when) override {
+            staging_.beginWhen(context, given, whenStack, when);
+            publish();
+        }
+
+        virtual void endWhen(const Stats& stats,
+                             const NameStack& context,
+                             const string& given,
+                             const NameStack& whenStack,
+                             const string& when) override {
+            staging_.endWhen(stats, context, given, whenStack, when);
+            publish();
+        }
+
+        virtual bool notifyPassing() const override { return notifyPassing_; }
+
+        virtual void fail(const NameStack& context,
+                          const string& given,
+                          const NameStack& whenStack,
+                          optional<string> description,
+                          const string &expressionText,
+                          const vector <Variable> &variableList) override {
+            staging_.fail(context, given, whenStack, move(description), expressionText, variableList);
+            publish();
+        }
+
+        virtual void pass(const NameStack& context,
+                          const string& given,
+                          const NameStack& whenStack,
+                          optional<string> description,
+                          const string &expressionText,
+                          const vector <Variable> &variableList) override {
+            staging_.pass(context, given, whenStack, move(description), expressionText, variableList);
+            publish();
+        }
+
+        virtual void failByException(const NameStack& context,
+                                     const string& given,
+                                     const NameStack& whenStack,
+                                     const exception& e) override {
+            staging_.failByException(context, given, whenStack, e);
+            publish();
+        }
+
+        virtual void measured(const NameStack& context,
+                              const string& given,
+                              const NameStack& whenStack,
+                              const Measurement& measurement) override {
+            staging_.measured(context, given, whenStack, measurement);
+            publish();
+        }
+    };
+}}}}
+
+namespace Enhedron { namespace Test {
+    using Impl::Impl_AsyncResults::AsyncResults;
+}}
@@ -0,0 +1,241 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include "Enhedron/Util.h"
+#include "Enhedron/Test/Results.h"
+#include "Enhedron/Test/Measurement.h"
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <unordered_map>
+#include <istream>
+#include <ostream>
+#include <iomanip>
+#include <stdexcept>
+#include <cmath>
+#include <cstddef>
+
+namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Baseline {
+    using std::string;
+    using std::vector;
+    using std::pair;
+    using std::move;
+    using std::sort;
+    using std::unordered_map;
+    using std::istream;
+    using std::ostream;
+    using std::getline;
+    using std::fixed;
+    using std::setprecision;
+    using std::runtime_error;
+    using std::stod;
+    using std::to_string;
+    using std::exception;
+    using std::sqrt;
+    using std::erfc;
+
+    using namespace Impl_Results;
+    using Impl_Measurement::Measurement;
+
+    // Samples in nanoseconds per iteration for each measurement, keyed by baselineKey.
+    using Baselines = unordered_map<string, vector<double>>;
+
+    // The path to the given or when a measurement was taken in, then the measurement's name.
+    inline string baselineKey(const NameStack& whenStack, const string& name) {
+        return testIndex().pathName(whenStack.node()) + "/" + name;
+    }
+
+    // One line per measurement, with the samples separated by commas, a space, then the key.
+    inline Baselines readBaselines(Out<istream> input) {
+        Baselines baselines;
+        string line;
+        size_t lineNumber = 0;
+
+        while (getline(*input, line)) {
+            ++lineNumber;
+
+            if (line.empty()) {
+                continue;
+            }
+
+            auto separator = line.find(' ');
+
+            try {
+                if (separator == string::npos) {
+                    throw runtime_error("No path");
+                }
+
+                auto& samples = baselines[line.substr(separator + 1)];
+                size_t start = 0;
+
+                while (start <= separator) {
+                    auto end = line.find(',', start);
+
+                    if (end == string::npos || end > separator) {
+                        end = separator;
+                    }
+
+                    size_t size = 0;
+                    auto text = line.substr(start, end - start);
+                    samples.push_back(stod(text, &size));
+
+                    if (size != text.size()) {
+                        throw runtime_error("Invalid sample");
+                    }
+
+                    start = end + 1;
+                }
+            }
+            catch (const exception&) {
+                throw runtime_error("Invalid baselines on line " + to_string(lineNumber) + ": \"" + line + "\"");
+            }
+        }
+
+        return baselines;
+    }
+
+    inline void writeBaselines(Out<ostream> output, const vector<pair<string, vector<double>>>& baselineList) {
+        *output << fixed << setprecision(3);
+
+        for (const auto& baseline : baselineList) {
+            for (size_t index = 0; index < baseline.second.size(); ++index) {
+                if (index > 0) {
+                    *output << ",";
+                }
+
+                *output << baseline.second[index];
+            }
+
+            *output << " " << baseline.first << "\n";
+        }
+    }
+
+    // The probability of samples being at least this much slower than baseline if they were from the same
+    // distribution, from a one sided Mann-Whitney U test. It uses the normal approximation, with corrections for
+    // ties and continuity, so it's only accurate with more than a few samples of each.
+    inline double mannWhitneyPValue(const vector<double>& baseline, const vector<double>& samples) {
+        if (baseline.empty() || samples.empty()) {
+            return 1;
+        }
+
+        // Each value, and whether it's from samples.
+        vector<pair<double, bool>> values;
+        values.reserve(baseline.size() + samples.size());
+
+        for (auto value : baseline) {
+            values.emplace_back(value, false);
+        }
+
+        for (auto value : samples) {
+            values.emplace_back(value, true);
+        }
+
+        sort(values.begin(), values.end());
+
+        double rankSum = 0;
+        double tieCorrection = 0;
+
+        for (size_t start = 0; start < values.size(); ) {
+            auto end = start + 1;
+
+            while (end < values.size() && values[end].first == values[start].first) {
+                ++end;
+            }
+
+            // Tied values share the mean of their ranks, counting from 1.
+            double rank = (start + end + 1) / 2.0;
+            double ties = end - start;
+            tieCorrection += ties * ties * ties - ties;
+
+            for (auto index = start; index < end; ++index) {
+                if (values[index].second) {
+                    rankSum += rank;
+                }
+            }
+
+            start = end;
+        }
+
+        double baselineSize = baseline.size();
+        double sampleSize = samples.size();
+        double total = baselineSize + sampleSize;
+        double u = rankSum - sampleSize * (sampleSize + 1) / 2;
+        double mean = baselineSize * sampleSize / 2;
+        double variance = baselineSize * sampleSize / 12 * ((total + 1) - tieCorrection / (total * (total - 1)));
+
+        if (variance <= 0) {
+            return 1;
+        }
+
+        double z = (u - mean - 0.5) / sqrt(variance);
+
+        return erfc(z / sqrt(2.0)) / 2;
+    }
+
+    // How a measurement compares to its baseline. change is the difference in medians, as a fraction of the baseline
+    // median, so 0.1 is 10% slower.
+    struct Comparison final {
+        double baselineMedian = 0;
+        double median = 0;
+        double change = 0;
+        double pValue = 1;
+    };
+
+    inline Comparison compareToBaseline(const vector<double>& baseline, const Measurement& measurement) {
+        Comparison comparison;
+        comparison.baselineMedian = Measurement(measurement.name(), 0, baseline).median();
+        comparison.median = measurement.median();
+
+        if (comparison.baselineMedian > 0) {
+            comparison.change = comparison.median / comparison.baselineMedian - 1;
+        }
+
+        comparison.pValue = mannWhitneyPValue(baseline, measurement.samples());
+
+        return comparison;
+    }
+
+    // Record the samples of each measurement, and write them out when the run finishes, for readBaselines. A
+    // measurement that's taken more than once, because its given runs once for each when, keeps all its samples.
+    class BaselinesResults final: public ForwardingResults {
+        Out<ostream> output_;
+        vector<pair<string, vector<double>>> baselineList_;
+        unordered_map<string, size_t> baselineIndex_;
+    public:
+        BaselinesResults(Out<Results> results, Out<ostream> output) : ForwardingResults(results), output_(output) {}
+
+        virtual void finish(const Stats& stats) override {
+            ForwardingResults::finish(stats);
+            writeBaselines(output_, baselineList_);
+        }
+
+        virtual void measured(const NameStack& context,
+                              const string& given,
+                              const NameStack& whenStack,
+                              const Measurement& measurement) override {
+            auto key = baselineKey(whenStack, measurement.name());
+            auto index = baselineIndex_.find(key);
+
+            if (index == baselineIndex_.end()) {
+                index = baselineIndex_.emplace(key, baselineList_.size()).first;
+                baselineList_.emplace_back(move(key), vector<double>());
+            }
+
+            auto& samples = baselineList_[index->second].second;
+            samples.insert(samples.end(), measurement.samples().begin(), measurement.samples().end());
+            ForwardingResults::measured(context, given, whenStack, measurement);
+        }
+    };
+}}}}
+
+namespace Enhedron { namespace Test {
+    using Impl::Impl_Baseline::BaselinesResults;
+}}
@@ -0,0 +1,125 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include "Enhedron/Util/Timer.h"
+#include "Enhedron/Test/Measurement.h"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Benchmark {
+    using std::string;
+    using std::vector;
+    using std::move;
+    using std::min;
+    using std::max;
+    using std::atomic_signal_fence;
+    using std::memory_order_seq_cst;
+
+    using Util::Impl::Impl_Timer::wallNanoseconds;
+
+    using Impl_Measurement::Measurement;
+
+    struct BenchmarkOptions final {
+        // Samples to take once the benchmark is calibrated and warmed up.
+        size_t samples = 30;
+
+        // Each sample runs enough iterations to take at least this long, in nanoseconds.
+        uint64_t sampleTime = 1000000;
+
+        // How long to run for before taking samples, in nanoseconds, including calibration.
+        uint64_t warmupTime = 10000000;
+
+        // Don't run more than this many iterations in a sample, however quick they are.
+        uint64_t maxIterations = 1000000000;
+
+        // A measurement with a baseline regresses if it's slower with this significance, and its median is slower
+        // by more than regressionThreshold, as a fraction of the baseline median. See compareToBaseline.
+        double significance = 0.01;
+        double regressionThreshold = 0.05;
+    };
+
+    // Make the compiler assume value is read, so the code that computes it isn't optimized away.
+    template<typename Value>
+    inline void doNotOptimize(const Value& value) {
+        #if defined(__GNUC__)
+            asm volatile("" : : "r,m"(value) : "memory");
+        #else
+            atomic_signal_fence(memory_order_seq_cst);
+            static_cast<void>(&value);
+        #endif
+    }
+
+    // Make the compiler assume all memory is read and written, so stores before it aren't optimized away.
+    inline void clobberMemory() {
+        #if defined(__GNUC__)
+            asm volatile("" : : : "memory");
+        #else
+            atomic_signal_fence(memory_order_seq_cst);
+        #endif
+    }
+
+    // Wall time in nanoseconds to call functor iterations times.
+    template<typename Functor>
+    uint64_t timeIterations(Functor& functor, uint64_t iterations) {
+        auto start = wallNanoseconds();
+
+        for (uint64_t iteration = 0; iteration < iterations; ++iteration) {
+            functor();
+        }
+
+        auto end = wallNanoseconds();
+
+        return end > start ? end - start : 0;
+    }
+
+    // Time functor. Double the iterations per sample, or more if a sample is far too quick, until a sample takes
+    // options.sampleTime. Keep running samples until options.warmupTime has passed, then take options.samples.
+    template<typename Functor>
+    Measurement measure(string name, const BenchmarkOptions& options, Functor&& functor) {
+        static constexpr const uint64_t maxGrowth = 10;
+
+        auto warmupStart = wallNanoseconds();
+        uint64_t iterations = 1;
+
+        for (;;) {
+            auto time = timeIterations(functor, iterations);
+
+            if (time >= options.sampleTime || iterations >= options.maxIterations) {
+                break;
+            }
+
+            // Aim a bit past sampleTime, so noise doesn't leave us just short of it.
+            uint64_t growth = time == 0 ? maxGrowth : (options.sampleTime + options.sampleTime / 2) / time;
+            iterations = min(options.maxIterations, iterations * max<uint64_t>(2, min(maxGrowth, growth)));
+        }
+
+        while (wallNanoseconds() - warmupStart < options.warmupTime) {
+            timeIterations(functor, iterations);
+        }
+
+        vector<double> samples;
+        samples.reserve(options.samples);
+
+        for (size_t sample = 0; sample < options.samples; ++sample) {
+            samples.push_back(static_cast<double>(timeIterations(functor, iterations)) / iterations);
+        }
+
+        return Measurement(move(name), iterations, move(samples));
+    }
+}}}}
+
+namespace Enhedron { namespace Test {
+    using Impl::Impl_Benchmark::BenchmarkOptions;
+    using Impl::Impl_Benchmark::doNotOptimize;
+    using Impl::Impl_Benchmark::clobberMemory;
+}}
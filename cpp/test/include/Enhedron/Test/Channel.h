@@ -0,0 +1,211 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include "Enhedron/Util.h"
+#include "Enhedron/Util/Optional.h"
+#include "Enhedron/Test/Process.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+
+#ifdef __linux__
+    #include <unistd.h>
+    #include <sys/types.h>
+    #include <sys/socket.h>
+    #include <poll.h>
+#endif
+
+namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Channel {
+    using std::string;
+    using std::runtime_error;
+    using std::memcpy;
+    using std::move;
+    using std::pair;
+    using std::vector;
+
+    using Util::optional;
+    using Util::none;
+
+    using Impl_Process::throwUnsupported;
+    using Impl_Process::throwSystemError;
+
+    // Messages over a reliable byte stream, each sent as a frame: the size as a native 64 bit integer, then the
+    // bytes. Nothing here depends on the kind of stream, so it works the same over a Unix or TCP socket. The
+    // channel owns the socket, and closing it is how either end says it's finished.
+    class Channel final: public NoCopy {
+        int socket_;
+
+        // Returns false if the stream ended before any bytes were read.
+        bool receiveAll(char* data, size_t size) {
+            #ifdef __linux__
+                size_t received = 0;
+
+                while (received < size) {
+                    auto result = ::recv(socket_, data + received, size - received, 0);
+
+                    if (result < 0) {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+
+                        throwSystemError("recv");
+                    }
+
+                    if (result == 0) {
+                        if (received == 0) {
+                            return false;
+                        }
+
+                        throw runtime_error("Truncated frame");
+                    }
+
+                    received += static_cast<size_t>(result);
+                }
+            #else
+                throwUnsupported();
+            #endif
+
+            return true;
+        }
+
+        void sendAll(const char* data, size_t size) {
+            #ifdef __linux__
+                size_t sent = 0;
+
+                while (sent < size) {
+                    // MSG_NOSIGNAL, so a peer that's gone is reported as an error rather than killing us with SIGPIPE.
+                    auto result = ::send(socket_, data + sent, size - sent, MSG_NOSIGNAL);
+
+                    if (result < 0) {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+
+                        throwSystemError("send");
+                    }
+
+                    sent += static_cast<size_t>(result);
+                }
+            #else
+                throwUnsupported();
+            #endif
+        }
+    public:
+        explicit Channel(int socket) : socket_(socket) {}
+
+        Channel(Channel&& other) : socket_(other.socket_) {
+            other.socket_ = -1;
+        }
+
+        Channel& operator=(Channel&& other) {
+            close();
+            socket_ = other.socket_;
+            other.socket_ = -1;
+
+            return *this;
+        }
+
+        ~Channel() {
+            close();
+        }
+
+        int socket() const { return socket_; }
+
+        // Forget the socket without closing it, when something else has already closed it.
+        void release() {
+            socket_ = -1;
+        }
+
+        void close() {
+            #ifdef __linux__
+                if (socket_ >= 0) {
+                    ::close(socket_);
+                    socket_ = -1;
+                }
+            #endif
+        }
+
+        void send(const string& message) {
+            uint64_t size = message.size();
+            char header[sizeof(size)];
+            memcpy(header, &size, sizeof(size));
+            sendAll(header, sizeof(size));
+            sendAll(message.data(), message.size());
+        }
+
+        // Returns none if the other end closed the channel between messages.
+        optional<string> receive() {
+            uint64_t size;
+            char header[sizeof(size)];
+
+            if ( ! receiveAll(header, sizeof(size))) {
+                return none;
+            }
+
+            memcpy(&size, header, sizeof(size));
+            string message(size, '\0');
+
+            if (size > 0 && ! receiveAll(&message[0], size)) {
+                throw runtime_error("Truncated frame");
+            }
+
+            return move(message);
+        }
+    };
+
+    // Channels over a connected pair of local stream sockets.
+    inline pair<Channel, Channel> makeChannelPair() {
+        int sockets[2] = {-1, -1};
+
+        #ifdef __linux__
+            if (::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0) {
+                throwSystemError("socketpair");
+            }
+        #else
+            throwUnsupported();
+        #endif
+
+        return pair<Channel, Channel>(Channel(sockets[0]), Channel(sockets[1]));
+    }
+
+    // Wait until at least one of the channels has a message, or has been closed by the other end. Returns their
+    // indices in channelList.
+    inline vector<size_t> waitForChannels(const vector<const Channel*>& channelList) {
+        vector<size_t> readyList;
+
+        #ifdef __linux__
+            vector<pollfd> pollList;
+
+            for (auto channel : channelList) {
+                pollList.push_back(pollfd{channel->socket(), POLLIN, 0});
+            }
+
+            while (::poll(pollList.data(), pollList.size(), -1) < 0) {
+                if (errno != EINTR) {
+                    throwSystemError("poll");
+                }
+            }
+
+            for (size_t index = 0; index < pollList.size(); ++index) {
+                if (pollList[index].revents != 0) {
+                    readyList.push_back(index);
+                }
+            }
+        #else
+            throwUnsupported();
+        #endif
+
+        return readyList;
+    }
+}}}}
@@ -0,0 +1,650 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include "Enhedron/Util.h"
+#include "Enhedron/Util/Optional.h"
+#include "Enhedron/Test/Results.h"
+#include "Enhedron/Test/Events.h"
+#include "Enhedron/Test/Process.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+
+#ifdef __linux__
+    #include <unistd.h>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+namespace Enhedron { namespace Test { namespace Impl { namespace Impl_EventLog {
+    using std::string;
+    using std::vector;
+    using std::unordered_map;
+    using std::move;
+    using std::exception;
+    using std::runtime_error;
+    using std::max;
+    using std::memcpy;
+    using std::make_shared;
+    using std::memcmp;
+    using std::strlen;
+    using std::strerror;
+
+    using Util::optional;
+    using Assertion::Variable;
+
+    using namespace Impl_Results;
+    using Impl_Events::Event;
+    using Impl_Events::EventType;
+    using Impl_Events::lastEventType;
+    using Impl_Events::EventReplayer;
+    using Impl_Process::throwSystemError;
+
+    // An event log starts with a header: the magic bytes, then the length of the records that have been committed,
+    // as a native 64 bit integer. Records follow, each starting with a tag, which is an EventType, or stringTag to
+    // define the next string id. All integers in records are unsigned LEB128, so most of them are one byte.
+    //
+    // Names, expressions, descriptions and file names are interned, as they're repeated for every check that runs
+    // the same code. Variable values and exception messages are written in place, as they're rarely repeated.
+    static constexpr const char logMagic[8] = {'M', 'N', 'E', 'T', 'L', 'O', 'G', '1'};
+    static constexpr const size_t logHeaderSize = sizeof(logMagic) + sizeof(uint64_t);
+    static constexpr const uint64_t stringTag = 16;
+
+    inline void throwLogUnsupported() {
+        throw runtime_error("Event logs are only supported on Linux");
+    }
+
+    // A file that grows as it's appended to, and is written through a shared memory mapping. The header only counts
+    // data once it's committed, so if the process dies, the file has everything up to the last commit, and a reader
+    // ignores anything after that.
+    class MappedLog final: public NoCopy {
+        int fd_ = -1;
+        char* data_ = nullptr;
+        size_t capacity_ = 0;
+        size_t size_ = logHeaderSize;
+
+        void reserve(size_t required) {
+            if (required <= capacity_) {
+                return;
+            }
+
+            #ifdef __linux__
+                auto capacity = max(required, capacity_ * 2);
+
+                if (::ftruncate(fd_, static_cast<off_t>(capacity)) != 0) {
+                    throwSystemError("ftruncate");
+                }
+
+                auto data = ::mremap(data_, capacity_, capacity, MREMAP_MAYMOVE);
+
+                if (data == MAP_FAILED) {
+                    throwSystemError("mremap");
+                }
+
+                data_ = static_cast<char*>(data);
+                capacity_ = capacity;
+            #else
+                throwLogUnsupported();
+            #endif
+        }
+    public:
+        MappedLog(const string& fileName, size_t initialCapacity) {
+            #ifdef __linux__
+                capacity_ = max(initialCapacity, logHeaderSize);
+                fd_ = ::open(fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+
+                if (fd_ < 0) {
+                    throw runtime_error("Unable to write event log \"" + fileName + "\": " + strerror(errno));
+                }
+
+                if (::ftruncate(fd_, static_cast<off_t>(capacity_)) != 0) {
+                    ::close(fd_);
+                    throwSystemError("ftruncate");
+                }
+
+                auto data = ::mmap(nullptr, capacity_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+
+                if (data == MAP_FAILED) {
+                    ::close(fd_);
+                    throwSystemError("mmap");
+                }
+
+                data_ = static_cast<char*>(data);
+                memcpy(data_, logMagic, sizeof(logMagic));
+                commit();
+            #else
+                throwLogUnsupported();
+            #endif
+        }
+
+        // Trim the file to what's been committed.
+        ~MappedLog() {
+            #ifdef __linux__
+                ::munmap(data_, capacity_);
+
+                if (::ftruncate(fd_, static_cast<off_t>(size_)) != 0) {
+                    // Nothing we can do. Readers ignore anything after the committed length anyway.
+                }
+
+                ::close(fd_);
+            #endif
+        }
+
+        void append(const string& data) {
+            reserve(size_ + data.size());
+            memcpy(data_ + size_, data.data(), data.size());
+            size_ += data.size();
+        }
+
+        void commit() {
+            uint64_t committed = size_ - logHeaderSize;
+            memcpy(data_ + sizeof(logMagic), &committed, sizeof(committed));
+        }
+    };
+
+    // Record every event to an event log, and pass them on. Passing checks are always recorded, so a replay can
+    // use any verbosity, but they're only passed on if the other Results object wants them.
+    class EventLogResults final: public ForwardingResults {
+        static constexpr const size_t defaultCapacity = 1024 * 1024;
+
+        MappedLog log_;
+        bool forwardPassing_;
+        unordered_map<string, uint64_t> stringIds_;
+        string definitions_;
+        string record_;
+
+        static void writeInteger(Out<string> output, uint64_t value) {
+            while (value >= 0x80) {
+                output->push_back(static_cast<char>((value & 0x7f) | 0x80));
+                value >>= 7;
+            }
+
+            output->push_back(static_cast<char>(value));
+        }
+
+        static void writeText(Out<string> output, const char* text, size_t size) {
+            writeInteger(output, size);
+            output->append(text, size);
+        }
+
+        void writeName(const string& name) {
+            auto found = stringIds_.find(name);
+
+            if (found == stringIds_.end()) {
+                found = stringIds_.emplace(name, stringIds_.size()).first;
+                writeInteger(out(definitions_), stringTag);
+                writeText(out(definitions_), name.data(), name.size());
+            }
+
+            writeInteger(out(record_), found->second);
+        }
+
+        void writeStats(const Stats& stats) {
+            writeInteger(out(record_), stats.fixtures());
+            writeInteger(out(record_), stats.tests());
+            writeInteger(out(record_), stats.checks());
+            writeInteger(out(record_), stats.failedTests());
+            writeInteger(out(record_), stats.failedChecks());
+            writeInteger(out(record_), stats.wallTime());
+            writeInteger(out(record_), stats.cpuTime());
+        }
+
+        void begin(EventType type) {
+            writeInteger(out(record_), static_cast<uint64_t>(type));
+        }
+
+        // Any strings the record uses are defined first, and they're committed together.
+        void commit() {
+            log_.append(definitions_);
+            log_.append(record_);
+            log_.commit();
+            definitions_.clear();
+            record_.clear();
+        }
+
+        void writeCheck(EventType type,
+                        const optional<string>& description,
+                        const string& expressionText,
+                        const vector<Variable>& variableList)
+        {
+            begin(type);
+            writeName(expressionText);
+
+            if (description) {
+                writeInteger(out(record_), 1);
+                writeName(*description);
+            }
+            else {
+                writeInteger(out(record_), 0);
+            }
+
+            writeInteger(out(record_), variableList.size());
+
+            for (const auto& variable : variableList) {
+                writeName(variable.name());
+                auto value = variable.value();
+                writeText(out(record_), value.data(), value.size());
+                writeName(variable.file());
+                writeInteger(out(record_), static_cast<uint64_t>(variable.line()));
+            }
+
+            commit();
+        }
+
+        void writeNamed(EventType type, const string& name) {
+            begin(type);
+            writeName(name);
+            commit();
+        }
+
+        void writeNamed(EventType type, const string& name, const Stats& stats) {
+            begin(type);
+            writeName(name);
+            writeStats(stats);
+            commit();
+        }
+    public:
+        EventLogResults(Out<Results> results, const string& fileName, size_t capacity = defaultCapacity) :
+            ForwardingResults(results), log_(fileName, capacity), forwardPassing_(results->notifyPassing())
+        {}
+
+        virtual void finish(const Stats& stats) override {
+            begin(EventType::FINISH);
+            writeStats(stats);
+            commit();
+            ForwardingResults::finish(stats);
+        }
+
+        virtual void beginContext(const NameStack& contextStack, const string& name) override {
+            writeNamed(EventType::BEGIN_CONTEXT, name);
+            ForwardingResults::beginContext(contextStack, name);
+        }
+
+        virtual void endContext(const Stats& stats, const NameStack& contextStack, const string& name) override {
+            writeNamed(EventType::END_CONTEXT, name, stats);
+            ForwardingResults::endContext(stats, contextStack, name);
+        }
+
+        virtual void beginGiven(const NameStack& context, const string& given) override {
+            writeNamed(EventType::BEGIN_GIVEN, given);
+            ForwardingResults::beginGiven(context, given);
+        }
+
+        virtual void endGiven(const Stats& stats, const NameStack& context, const string& given) override {
+            writeNamed(EventType::END_GIVEN, given, stats);
+            ForwardingResults::endGiven(stats, context, given);
+        }
+
+        virtual void beginWhen(const NameStack& context,
+                               const string& given,
+                               const NameStack& whenStack,
+                               const string& when) override {
+            writeNamed(EventType::BEGIN_WHEN, when);
+            ForwardingResults::beginWhen(context, given, whenStack, when);
+        }
+
+        virtual void endWhen(const Stats& stats,
+                             const NameStack& context,
+                             const string& given,
+                             const NameStack& whenStack,
+                             const string& when) override {
+            writeNamed(EventType::END_WHEN, when, stats);
+            ForwardingResults::endWhen(stats, context, given, whenStack, when);
+        }
+
+        virtual bool notifyPassing() const override { return true; }
+
+        virtual void fail(const NameStack& context,
+                          const string& given,
+                          const NameStack& whenStack,
+                          optional<string> description,
+                          const string &expressionText,
+                          const vector <Variable> &variableList) override
+        {
+            writeCheck(EventType::FAIL, description, expressionText, variableList);
+            ForwardingResults::fail(context, given, whenStack, move(description), expressionText, variableList);
+        }
+
+        virtual void pass(const NameStack& context,
+                          const string& given,
+                          const NameStack& whenStack,
+                          optional <string> description,
+                          const string &expressionText,
+                          const vector <Variable> &variableList) override
+        {
+            writeCheck(EventType::PASS, description, expressionText, variableList);
+
+            if (forwardPassing_) {
+                ForwardingResults::pass(context, given, whenStack, move(description), expressionText, variableList);
+            }
+        }
+
+        virtual void failByException(const NameStack& context,
+                                     const string& given,
+                                     const NameStack& whenStack,
+                                     const exception& e) override {
+            begin(EventType::FAIL_BY_EXCEPTION);
+            writeText(out(record_), e.what(), strlen(e.what()));
+            commit();
+            ForwardingResults::failByException(context, given, whenStack, e);
+        }
+
+        // Samples are written as the bits of each double.
+        virtual void measured(const NameStack& context,
+                              const string& given,
+                              const NameStack& whenStack,
+                              const Measurement& measurement) override {
+            begin(EventType::MEASURED);
+            writeName(measurement.name());
+            writeInteger(out(record_), measurement.iterations());
+            writeInteger(out(record_), measurement.samples().size());
+
+            for (auto sample : measurement.samples()) {
+                uint64_t bits;
+                memcpy(&bits, &sample, sizeof(bits));
+                writeInteger(out(record_), bits);
+            }
+
+            commit();
+            ForwardingResults::measured(context, given, whenStack, measurement);
+        }
+    };
+
+    // Read the committed events from an event log, through a read only mapping. Throws runtime_error if the file
+    // isn't an event log, or a record is corrupt.
+    class EventLogReader final: public NoCopy {
+        string fileName_;
+        int fd_ = -1;
+        const char* data_ = nullptr;
+        size_t mappedSize_ = 0;
+        size_t position_ = logHeaderSize;
+        size_t end_ = logHeaderSize;
+        vector<string> strings_;
+
+        [[noreturn]] void throwCorrupt() {
+            throw runtime_error("Corrupt event log \"" + fileName_ + "\"");
+        }
+
+        uint64_t readInteger() {
+            uint64_t value = 0;
+
+            for (unsigned shift = 0; shift < 64; shift += 7) {
+                if (position_ == end_) {
+                    throwCorrupt();
+                }
+
+                auto byte = static_cast<unsigned char>(data_[position_++]);
+                value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+
+                if ((byte & 0x80) == 0) {
+                    return value;
+                }
+            }
+
+            throwCorrupt();
+        }
+
+        string readText() {
+            auto size = readInteger();
+
+            if (size > end_ - position_) {
+                throwCorrupt();
+            }
+
+            string text(data_ + position_, size);
+            position_ += size;
+
+            return text;
+        }
+
+        const string& readName() {
+            auto id = readInteger();
+
+            if (id >= strings_.size()) {
+                throwCorrupt();
+            }
+
+            return strings_[id];
+        }
+
+        Stats readStats() {
+            auto fixtures = readInteger();
+            auto tests = readInteger();
+            auto checks = readInteger();
+            auto failedTests = readInteger();
+            auto failedChecks = readInteger();
+            auto wallTime = readInteger();
+            auto cpuTime = readInteger();
+
+            return Stats(fixtures, tests, checks, failedTests, failedChecks, wallTime, cpuTime);
+        }
+    public:
+        explicit EventLogReader(string fileName) : fileName_(move(fileName)) {
+            #ifdef __linux__
+                fd_ = ::open(fileName_.c_str(), O_RDONLY | O_CLOEXEC);
+
+                if (fd_ < 0) {
+                    throw runtime_error("Unable to read event log \"" + fileName_ + "\": " + strerror(errno));
+                }
+
+                struct stat status;
+
+                if (::fstat(fd_, &status) != 0) {
+                    ::close(fd_);
+                    throwSystemError("fstat");
+                }
+
+                mappedSize_ = static_cast<size_t>(status.st_size);
+
+                if (mappedSize_ < logHeaderSize) {
+                    ::close(fd_);
+                    throw runtime_error("\"" + fileName_ + "\" isn't an event log");
+                }
+
+                auto data = ::mmap(nullptr, mappedSize_, PROT_READ, MAP_SHARED, fd_, 0);
+
+                if (data == MAP_FAILED) {
+                    ::close(fd_);
+                    throwSystemError("mmap");
+                }
+
+                data_ = static_cast<const char*>(data);
+
+                if (memcmp(data_, logMagic, sizeof(logMagic)) != 0) {
+                    ::munmap(const_cast<char*>(data_), mappedSize_);
+                    ::close(fd_);
+                    throw runtime_error("\"" + fileName_ + "\" isn't an event log");
+                }
+
+                uint64_t committed;
+                memcpy(&committed, data_ + sizeof(logMagic), sizeof(committed));
+
+                if (committed > mappedSize_ - logHeaderSize) {
+                    ::munmap(const_cast<char*>(data_), mappedSize_);
+                    ::close(fd_);
+                    throwCorrupt();
+                }
+
+                end_ = logHeaderSize + committed;
+            #else
+                throwLogUnsupported();
+            #endif
+        }
+
+        ~EventLogReader() {
+            #ifdef __linux__
+                ::munmap(const_cast<char*>(data_), mappedSize_);
+                ::close(fd_);
+            #endif
+        }
+
+        // Returns false at the end of the committed records.
+        bool next(Out<Event> event) {
+            while (position_ != end_) {
+                auto tag = readInteger();
+
+                if (tag == stringTag) {
+                    strings_.push_back(readText());
+                    continue;
+                }
+
+                if (tag > static_cast<uint64_t>(lastEventType)) {
+                    throwCorrupt();
+                }
+
+                event->type = static_cast<EventType>(tag);
+                event->description = optional<string>();
+                event->variableList.clear();
+                event->stats = Stats();
+                event->measurement.reset();
+
+                switch (event->type) {
+                    case EventType::BEGIN_CONTEXT:
+                    case EventType::BEGIN_GIVEN:
+                    case EventType::BEGIN_WHEN:
+                        event->name = readName();
+                        break;
+                    case EventType::END_CONTEXT:
+                    case EventType::END_GIVEN:
+                    case EventType::END_WHEN:
+                        event->name = readName();
+                        event->stats = readStats();
+                        break;
+                    case EventType::PASS:
+                    case EventType::FAIL: {
+                        event->name = readName();
+
+                        if (readInteger() != 0) {
+                            event->description = readName();
+                        }
+
+                        auto variableCount = readInteger();
+
+                        for (uint64_t index = 0; index < variableCount; ++index) {
+                            auto name = readName();
+                            auto value = readText();
+                            auto file = readName();
+                            auto line = static_cast<int>(readInteger());
+                            event->variableList.emplace_back(name, move(value), file, line);
+                        }
+
+                        break;
+                    }
+                    case EventType::FAIL_BY_EXCEPTION:
+                        event->name = readText();
+                        break;
+                    case EventType::FINISH:
+                        event->name.clear();
+                        event->stats = readStats();
+                        break;
+                    case EventType::MEASURED: {
+                        event->name = readName();
+                        auto iterations = readInteger();
+                        auto sampleCount = readInteger();
+
+                        if (sampleCount > end_ - position_) {
+                            throwCorrupt();
+                        }
+
+                        vector<double> samples;
+
+                        for (uint64_t index = 0; index < sampleCount; ++index) {
+                            auto bits = readInteger();
+                            double sample;
+                            memcpy(&sample, &bits, sizeof(sample));
+                            samples.push_back(sample);
+                        }
+
+                        event->measurement = make_shared<const Measurement>(event->name, iterations, move(samples));
+                        break;
+                    }
+                }
+
+                return true;
+            }
+
+            return false;
+        }
+    };
+
+    // How far a replayed run got.
+    struct LogReplay final {
+        bool finished;
+        Stats stats;
+
+        // The path of the last given that started, if any.
+        optional<string> lastGiven;
+    };
+
+    // Feed the events from a log into results, without running any tests. Passing checks are only passed on if
+    // results wants them. If the run didn't finish, because it crashed, or is still going, results are finished
+    // with the totals of the givens that did.
+    inline LogReplay replayEventLog(const string& fileName, Out<Results> results) {
+        EventLogReader reader(fileName);
+        EventReplayer replayer(results);
+        Event event{EventType::FINISH, "", Stats(), optional<string>(), vector<Variable>()};
+        NameStack contextStack;
+        LogReplay replay{false, Stats(), optional<string>()};
+        auto notifyPassing = results->notifyPassing();
+
+        while (reader.next(out(event))) {
+            switch (event.type) {
+                case EventType::BEGIN_CONTEXT:
+                    contextStack.push(event.name);
+                    break;
+                case EventType::END_CONTEXT:
+                    contextStack.pop();
+                    break;
+                case EventType::BEGIN_GIVEN:
+                    replay.lastGiven = givenPath(contextStack, event.name);
+                    break;
+                case EventType::END_GIVEN:
+                    replay.stats += event.stats;
+                    break;
+                case EventType::FINISH:
+                    replay.finished = true;
+                    replay.stats = event.stats;
+                    break;
+                case EventType::PASS:
+                    if ( ! notifyPassing) {
+                        continue;
+                    }
+
+                    break;
+                default:
+                    break;
+            }
+
+            replayer(event);
+        }
+
+        if ( ! replay.finished) {
+            results->finish(replay.stats);
+        }
+
+        return replay;
+    }
+}}}}
+
+namespace Enhedron { namespace Test {
+    using Impl::Impl_EventLog::EventLogResults;
+    using Impl::Impl_EventLog::EventLogReader;
+    using Impl::Impl_EventLog::LogReplay;
+    using Impl::Impl_EventLog::replayEventLog;
+}}
@@ -0,0 +1,438 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include "Enhedron/Util.h"
+#include "Enhedron/Util/Optional.h"
+#include "Enhedron/Test/Results.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+
+namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Events {
+    using std::string;
+    using std::vector;
+    using std::move;
+    using std::exception;
+    using std::runtime_error;
+    using std::memcpy;
+    using std::shared_ptr;
+    using std::make_shared;
+
+    using Assertion::Variable;
+    using Util::optional;
+
+    using namespace Impl_Results;
+
+    enum class EventType {
+        BEGIN_CONTEXT,
+        END_CONTEXT,
+        BEGIN_GIVEN,
+        END_GIVEN,
+        BEGIN_WHEN,
+        END_WHEN,
+        PASS,
+        FAIL,
+        FAIL_BY_EXCEPTION,
+        FINISH,
+        MEASURED
+    };
+
+    static constexpr const EventType lastEventType = EventType::MEASURED;
+
+    // A self contained copy of a single call on the Results interface. The context, given and when stacks aren't
+    // stored, as they can be rebuilt from the begin and end events.
+    struct Event final {
+        EventType type;
+
+        // The context, given or when name, the expression text for PASS and FAIL, or the exception message.
+        string name;
+        Stats stats;
+        optional<string> description;
+        vector<Variable> variableList;
+
+        // Only for MEASURED. It's shared, as it doesn't change once it's been measured.
+        shared_ptr<const Measurement> measurement;
+    };
+
+    // Record events so they can be replayed into another Results object later, possibly on another thread.
+    class EventRecorder final: public Results {
+        vector<Event> events_;
+        bool notifyPassing_;
+
+        void add(EventType type, string name, Stats stats = Stats()) {
+            events_.push_back(Event{type, move(name), stats, optional<string>(), vector<Variable>()});
+        }
+    public:
+        explicit EventRecorder(bool notifyPassing) : notifyPassing_(notifyPassing) {}
+
+        const vector<Event>& events() const { return events_; }
+
+        void clear() {
+            events_.clear();
+            events_.shrink_to_fit();
+        }
+
+        // Pass each event to sink, then forget them. Unlike clear, this keeps the memory, for recording more.
+        template<typename Sink>
+        void drain(Sink&& sink) {
+            for (auto& event : events_) {
+                sink(move(event));
+            }
+
+            events_.clear();
+        }
+
+        virtual void finish(const Stats& stats) override {
+            add(EventType::FINISH, "", stats);
+        }
+
+        virtual void beginContext(const NameStack& contextStack, const string& name) override {
+            add(EventType::BEGIN_CONTEXT, name);
+        }
+
+        virtual void endContext(const Stats& stats, const NameStack& contextStack, const string& name) override {
+            add(EventType::END_CONTEXT, name, stats);
+        }
+
+        virtual void beginGiven(const NameStack& context, const string& given) override {
+            add(EventType::BEGIN_GIVEN, given);
+        }
+
+        virtual void endGiven(const Stats& stats, const NameStack& context, const string& given) override {
+            add(EventType::END_GIVEN, given, stats);
+        }
+
+        virtual void beginWhen(const NameStack& context,
+                               const string& given,
+                               const NameStack& whenStack,
+                               const string& when) override {
+            add(EventType::BEGIN_WHEN, when);
+        }
+
+        virtual void endWhen(const Stats& stats,
+                             const NameStack& context,
+                             const string& given,
+                             const NameStack& whenStack,
+                             const string& when) override {
+            add(EventType::END_WHEN, when, stats);
+        }
+
+        virtual bool notifyPassing() const override { return notifyPassing_; }
+
+        virtual void fail(const NameStack& context,
+                          const string& given,
+                          const NameStack& whenStack,
+                          optional<string> description,
+                          const string &expressionText,
+                          const vector <Variable> &variableList) override {
+            events_.push_back(Event{EventType::FAIL, expressionText, Stats(), move(description), variableList});
+        }
+
+        virtual void pass(const NameStack& context,
+                          const string& given,
+                          const NameStack& whenStack,
+                          optional <string> description,
+                          const string &expressionText,
+                          const vector <Variable> &variableList) override {
+            events_.push_back(Event{EventType::PASS, expressionText, Stats(), move(description), variableList});
+        }
+
+        virtual void failByException(const NameStack& context,
+                                     const string& given,
+                                     const NameStack& whenStack,
+                                     const exception& e) override {
+            add(EventType::FAIL_BY_EXCEPTION, e.what());
+        }
+
+        virtual void measured(const NameStack& context,
+                              const string& given,
+                              const NameStack& whenStack,
+                              const Measurement& measurement) override {
+            add(EventType::MEASURED, measurement.name());
+            events_.back().measurement = make_shared<const Measurement>(measurement);
+        }
+    };
+
+    // Feed recorded events into a Results object, rebuilding the context, given and when stacks as we go.
+    class EventReplayer final: public NoCopy {
+        Out<Results> results_;
+        NameStack contextStack_;
+        string given_;
+        NameStack whenStack_;
+    public:
+        explicit EventReplayer(Out<Results> results) : results_(results) {}
+
+        // Replay events for givens inside an existing context.
+        EventReplayer(Out<Results> results, const NameStack& contextStack) : results_(results) {
+            for (const auto& name : contextStack.stack()) {
+                contextStack_.push(name);
+            }
+        }
+
+        // Replay events from inside a given, which won't include the BEGIN_GIVEN event.
+        EventReplayer(Out<Results> results, const NameStack& contextStack, string given) :
+            EventReplayer(results, contextStack)
+        {
+            given_ = move(given);
+            whenStack_.setBase(givenNode(contextStack_, given_));
+        }
+
+        void operator()(const Event& event) {
+            switch (event.type) {
+                case EventType::BEGIN_CONTEXT:
+                    results_->beginContext(contextStack_, event.name);
+                    contextStack_.push(event.name);
+                    break;
+                case EventType::END_CONTEXT:
+                    contextStack_.pop();
+                    results_->endContext(event.stats, contextStack_, event.name);
+                    break;
+                case EventType::BEGIN_GIVEN:
+                    given_ = event.name;
+                    whenStack_.setBase(givenNode(contextStack_, given_));
+                    results_->beginGiven(contextStack_, given_);
+                    break;
+                case EventType::END_GIVEN:
+                    results_->endGiven(event.stats, contextStack_, event.name);
+                    break;
+                case EventType::BEGIN_WHEN:
+                    results_->beginWhen(contextStack_, given_, whenStack_, event.name);
+                    whenStack_.push(event.name);
+                    break;
+                case EventType::END_WHEN:
+                    whenStack_.pop();
+                    results_->endWhen(event.stats, contextStack_, given_, whenStack_, event.name);
+                    break;
+                case EventType::PASS:
+                    results_->pass(
+                            contextStack_, given_, whenStack_, event.description, event.name, event.variableList
+                        );
+                    break;
+                case EventType::FAIL:
+                    results_->fail(
+                            contextStack_, given_, whenStack_, event.description, event.name, event.variableList
+                        );
+                    break;
+                case EventType::FAIL_BY_EXCEPTION:
+                    results_->failByException(contextStack_, given_, whenStack_, runtime_error(event.name));
+                    break;
+                case EventType::FINISH:
+                    results_->finish(event.stats);
+                    break;
+                case EventType::MEASURED:
+                    results_->measured(contextStack_, given_, whenStack_, *event.measurement);
+                    break;
+            }
+        }
+
+        void operator()(const vector<Event>& eventList) {
+            for (const auto& event : eventList) {
+                (*this)(event);
+            }
+        }
+    };
+
+    // A binary encoding of events and stats, so they can be sent to another process running the same executable.
+    // Integers are written in native byte order.
+    class EventWriter final: public NoCopy {
+        Out<string> output_;
+
+        void write(uint64_t value) {
+            char bytes[sizeof(value)];
+            memcpy(bytes, &value, sizeof(value));
+            output_->append(bytes, sizeof(value));
+        }
+
+        void write(const string& value) {
+            write(static_cast<uint64_t>(value.size()));
+            output_->append(value);
+        }
+
+        void write(double value) {
+            uint64_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            write(bits);
+        }
+    public:
+        explicit EventWriter(Out<string> output) : output_(output) {}
+
+        void operator()(uint64_t value) {
+            write(value);
+        }
+
+        void operator()(const string& value) {
+            write(value);
+        }
+
+        void operator()(const Stats& stats) {
+            write(stats.fixtures());
+            write(stats.tests());
+            write(stats.checks());
+            write(stats.failedTests());
+            write(stats.failedChecks());
+            write(stats.wallTime());
+            write(stats.cpuTime());
+        }
+
+        void operator()(const Event& event) {
+            write(static_cast<uint64_t>(event.type));
+            write(event.name);
+            (*this)(event.stats);
+            write(static_cast<uint64_t>(event.description ? 1 : 0));
+
+            if (event.description) {
+                write(*event.description);
+            }
+
+            write(static_cast<uint64_t>(event.variableList.size()));
+
+            for (const auto& variable : event.variableList) {
+                write(variable.name());
+                write(variable.value());
+                write(variable.file());
+                write(static_cast<uint64_t>(variable.line()));
+            }
+
+            if (event.type == EventType::MEASURED) {
+                write(event.measurement->iterations());
+                write(static_cast<uint64_t>(event.measurement->samples().size()));
+
+                for (auto sample : event.measurement->samples()) {
+                    write(sample);
+                }
+            }
+        }
+
+        void operator()(const vector<Event>& eventList) {
+            write(static_cast<uint64_t>(eventList.size()));
+
+            for (const auto& event : eventList) {
+                (*this)(event);
+            }
+        }
+    };
+
+    // Read data written by EventWriter. Throws runtime_error if the data is truncated.
+    class EventReader final: public NoCopy {
+        const string& input_;
+        size_t position_ = 0;
+
+        void require(size_t size) {
+            if (input_.size() - position_ < size) {
+                throw runtime_error("Truncated event data");
+            }
+        }
+    public:
+        explicit EventReader(const string& input) : input_(input) {}
+
+        bool atEnd() const { return position_ == input_.size(); }
+
+        uint64_t readInteger() {
+            uint64_t value;
+            require(sizeof(value));
+            memcpy(&value, input_.data() + position_, sizeof(value));
+            position_ += sizeof(value);
+
+            return value;
+        }
+
+        double readDouble() {
+            auto bits = readInteger();
+            double value;
+            memcpy(&value, &bits, sizeof(value));
+
+            return value;
+        }
+
+        string readString() {
+            auto size = readInteger();
+            require(size);
+            string value(input_, position_, size);
+            position_ += size;
+
+            return value;
+        }
+
+        Stats readStats() {
+            auto fixtures = readInteger();
+            auto tests = readInteger();
+            auto checks = readInteger();
+            auto failedTests = readInteger();
+            auto failedChecks = readInteger();
+            auto wallTime = readInteger();
+            auto cpuTime = readInteger();
+
+            return Stats(fixtures, tests, checks, failedTests, failedChecks, wallTime, cpuTime);
+        }
+
+        Event readEvent() {
+            auto type = readInteger();
+
+            if (type > static_cast<uint64_t>(lastEventType)) {
+                throw runtime_error("Unknown event type");
+            }
+
+            Event event{static_cast<EventType>(type), readString(), readStats(), optional<string>(), vector<Variable>()};
+
+            if (readInteger() != 0) {
+                event.description = readString();
+            }
+
+            auto variableCount = readInteger();
+
+            for (uint64_t index = 0; index < variableCount; ++index) {
+                auto name = readString();
+                auto value = readString();
+                auto file = readString();
+                auto line = static_cast<int>(readInteger());
+                event.variableList.emplace_back(move(name), move(value), move(file), line);
+            }
+
+            if (event.type == EventType::MEASURED) {
+                auto iterations = readInteger();
+                auto sampleCount = readInteger();
+                require(sampleCount * sizeof(uint64_t));
+                vector<double> samples;
+
+                for (uint64_t index = 0; index < sampleCount; ++index) {
+                    samples.push_back(readDouble());
+                }
+
+                event.measurement = make_shared<const Measurement>(event.name, iterations, move(samples));
+            }
+
+            return event;
+        }
+
+        vector<Event> readEvents() {
+            auto eventCount = readInteger();
+            vector<Event> eventList;
+
+            for (uint64_t index = 0; index < eventCount; ++index) {
+                eventList.push_back(readEvent());
+            }
+
+            return eventList;
+        }
+    };
+}}}}
+
+namespace Enhedron { namespace Test {
+    using Impl::Impl_Events::Event;
+    using Impl::Impl_Events::EventType;
+    using Impl::Impl_Events::EventRecorder;
+    using Impl::Impl_Events::EventReplayer;
+    using Impl::Impl_Events::EventWriter;
+    using Impl::Impl_Events::EventReader;
+}}
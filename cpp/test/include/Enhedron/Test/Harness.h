@@ -8,6 +8,9 @@
 #pragma once
 
 #include "Enhedron/Test/Suite.h"
+#include "Enhedron/Test/AsyncResults.h"
+#include "Enhedron/Test/Reporters.h"
+#include "Enhedron/Test/EventLog.h"
 #include "Enhedron/CommandLine/Parameters.h"
 
 #include <string>
@@ -16,21 +19,47 @@
 #include <algorithm>
 #include <locale>
 #include <cctype>
-#include <regex>
 #include <memory>
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
 
 namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Harness {
     using std::string;
     using std::move;
     using std::vector;
-    using std::shared_ptr;
-    using std::make_shared;
     using std::runtime_error;
     using std::find_first_of;
     using std::tolower;
     using std::locale;
     using std::transform;
-    using std::regex;
+    using std::stoul;
+    using std::stod;
+    using std::invalid_argument;
+    using std::out_of_range;
+    using std::cout;
+    using std::cerr;
+    using std::ostream;
+    using std::ifstream;
+    using std::ofstream;
+    using std::make_shared;
+    using std::unique_ptr;
+    using std::make_unique;
+
+    using Util::optional;
+    using Util::none;
+
+    using Impl_Shard::Timings;
+    using Impl_Shard::readTimings;
+    using Impl_Baseline::Baselines;
+    using Impl_Baseline::readBaselines;
+    using Impl_Baseline::BaselinesResults;
+    using Impl_AsyncResults::AsyncResults;
+    using Impl_Reporters::JUnitResults;
+    using Impl_Reporters::JsonResults;
+    using Impl_Reporters::MeasurementsResults;
+    using Impl_EventLog::EventLogResults;
+    using Impl_EventLog::replayEventLog;
 
     using CommandLine::ExitStatus;
     using CommandLine::Flag;
@@ -55,11 +84,113 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Harness {
         throw runtime_error("Unknown verbosity \"" + v + "\"");
     }
 
-    inline ExitStatus runTests(bool listOnly, string verbosityString, vector<string> pathList) {
-        vector<shared_ptr<vector<regex>>> pathRegexs;
+    enum class Reporter {
+        HUMAN,
+        JUNIT,
+        JSON
+    };
+
+    inline Reporter parseReporter(string r) {
+        transform(r.begin(), r.end(), r.begin(),
+                  [](char c) { return tolower(c, locale()); } );
+
+        if (r == "human") return Reporter::HUMAN;
+        if (r == "junit") return Reporter::JUNIT;
+        if (r == "json") return Reporter::JSON;
+
+        throw runtime_error("Unknown reporter \"" + r + "\"");
+    }
+
+    inline size_t parseCount(const string& count, const string& description) {
+        try {
+            size_t end = 0;
+            auto value = stoul(count, &end);
+
+            if (end != count.size()) {
+                throw invalid_argument(count);
+            }
+
+            return value;
+        }
+        catch (const invalid_argument&) {
+            throw runtime_error("Invalid number of " + description + " \"" + count + "\"");
+        }
+        catch (const out_of_range&) {
+            throw runtime_error("Invalid number of " + description + " \"" + count + "\"");
+        }
+    }
+
+    // A percentage, as a fraction.
+    inline double parsePercentage(const string& percentage, const string& description) {
+        try {
+            size_t end = 0;
+            auto value = stod(percentage, &end);
+
+            if (end != percentage.size() || value < 0) {
+                throw invalid_argument(percentage);
+            }
+
+            return value / 100;
+        }
+        catch (const invalid_argument&) {
+            throw runtime_error("Invalid " + description + " \"" + percentage + "\"");
+        }
+        catch (const out_of_range&) {
+            throw runtime_error("Invalid " + description + " \"" + percentage + "\"");
+        }
+    }
+
+    inline size_t parseJobs(const string& jobs) {
+        size_t jobCount = parseCount(jobs, "jobs");
+
+        if (jobCount == 0) {
+            return defaultThreadCount();
+        }
+
+        return jobCount;
+    }
+
+    inline optional<string> singleFile(const vector<string>& fileList, const string& optionName) {
+        if (fileList.size() > 1) {
+            throw runtime_error("Only one file can be given for " + optionName);
+        }
+
+        if (fileList.empty()) {
+            return none;
+        }
+
+        return fileList.front();
+    }
+
+    inline ExitStatus runTests(
+            bool listOnly,
+            string verbosityString,
+            string jobsString,
+            string slowestString,
+            string shardIndexString,
+            string shardCountString,
+            vector<string> timingsFileList,
+            vector<string> writeTimingsFileList,
+            vector<string> baselinesFileList,
+            vector<string> writeBaselinesFileList,
+            string regressionThresholdString,
+            vector<string> writeMeasurementsFileList,
+            string workersString,
+            string reporterString,
+            vector<string> outputFileList,
+            vector<string> recordFileList,
+            vector<string> replayFileList,
+            bool forkWhens,
+            bool parallelWhens,
+            bool isolate,
+            bool asyncOutput,
+            vector<string> pathList
+        )
+    {
+        vector<vector<string>> pathComponentLists;
 
         for (auto& path : pathList) {
-            vector<regex> pathComponentList;
+            vector<string> pathComponentList;
             auto separatorPos = path.begin();
             auto matchChars = "/\\";
             auto matchCharsEnd = matchChars + 2;
@@ -93,16 +224,206 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Harness {
                 ++separatorPos;
             }
 
-            pathRegexs.emplace_back(make_shared<vector<regex>>(move(pathComponentList)));
+            pathComponentLists.emplace_back(move(pathComponentList));
         }
 
+        PathFilter filter(pathComponentLists);
+
         Verbosity verbosity = parseVerbosity(verbosityString);
+        RunOptions options;
+        options.jobs = parseJobs(jobsString);
+        options.forkWhens = forkWhens;
+        options.parallelWhens = parallelWhens;
+
+        if (forkWhens && ! processesSupported) {
+            throw runtime_error("--fork-whens is only supported on Linux");
+        }
+
+        if (forkWhens && parallelWhens) {
+            throw runtime_error("--fork-whens and --parallel-whens can't be used together");
+        }
+
+        options.workers = parseCount(workersString, "workers");
+        options.isolate = isolate;
+
+        if ((options.workers > 0 || isolate) && ! processesSupported) {
+            throw runtime_error("--workers and --isolate are only supported on Linux");
+        }
+
+        if ((options.workers > 0 || isolate) && options.jobs > 1) {
+            throw runtime_error("--workers and --isolate can't be used with --jobs");
+        }
+
+        size_t slowest = parseCount(slowestString, "slowest tests");
+        options.shardIndex = parseCount(shardIndexString, "shard index");
+        options.shardCount = parseCount(shardCountString, "shards");
+
+        if (options.shardCount == 0 || options.shardIndex >= options.shardCount) {
+            throw runtime_error("The shard index must be less than the shard count");
+        }
+
+        auto reporter = parseReporter(reporterString);
+        auto outputFile = singleFile(outputFileList, "--output");
+
+        if (reporter != Reporter::HUMAN && ! outputFile && slowest > 0) {
+            throw runtime_error("--slowest writes to standard output, so it needs --output with this reporter");
+        }
+
+        auto recordFile = singleFile(recordFileList, "--record");
+        auto replayFile = singleFile(replayFileList, "--replay");
+        auto timingsFile = singleFile(timingsFileList, "--timings");
+        auto writeTimingsFile = singleFile(writeTimingsFileList, "--write-timings");
+        auto baselinesFile = singleFile(baselinesFileList, "--baselines");
+        auto writeBaselinesFile = singleFile(writeBaselinesFileList, "--write-baselines");
+        auto writeMeasurementsFile = singleFile(writeMeasurementsFileList, "--write-measurements");
+        options.benchmark.regressionThreshold = parsePercentage(regressionThresholdString, "regression threshold");
+
+        if (timingsFile) {
+            ifstream timingsInput(*timingsFile);
+
+            if ( ! timingsInput) {
+                throw runtime_error("Unable to read timings from \"" + *timingsFile + "\"");
+            }
+
+            options.timings = make_shared<const Timings>(readTimings(out(timingsInput)));
+        }
+
+        if (baselinesFile) {
+            ifstream baselinesInput(*baselinesFile);
+
+            if ( ! baselinesInput) {
+                throw runtime_error("Unable to read baselines from \"" + *baselinesFile + "\"");
+            }
+
+            options.baselines = make_shared<const Baselines>(readBaselines(out(baselinesInput)));
+        }
 
         if (listOnly) {
-            Test::list(pathRegexs, verbosity);
+            if (options.shardCount > 1) {
+                Test::listShards(filter, options, out(cout));
+            }
+            else {
+                Test::list(filter, verbosity);
+            }
         }
         else {
-            if ( ! Test::run(pathRegexs, verbosity)) {
+            ofstream fileOutput;
+            Out<ostream> reportOutput(cout);
+
+            if (outputFile) {
+                fileOutput.open(*outputFile);
+
+                if ( ! fileOutput) {
+                    throw runtime_error("Unable to write results to \"" + *outputFile + "\"");
+                }
+
+                reportOutput = out(fileOutput);
+            }
+
+            // Other reporters write to standard output unless there's a file, so then the human readable results
+            // go to standard error. Even when silent, they show failures.
+            Out<ostream> humanOutput(cout);
+
+            if (reporter == Reporter::HUMAN) {
+                humanOutput = reportOutput;
+            }
+            else if ( ! outputFile) {
+                humanOutput = out(cerr);
+            }
+
+            HumanResults humanResults(humanOutput, verbosity);
+            Out<Results> results(humanResults);
+            unique_ptr<Results> reporterResults;
+
+            if (reporter == Reporter::JUNIT) {
+                reporterResults = make_unique<JUnitResults>(results, reportOutput);
+                results = out(*reporterResults);
+            }
+            else if (reporter == Reporter::JSON) {
+                reporterResults = make_unique<JsonResults>(results, reportOutput);
+                results = out(*reporterResults);
+            }
+
+            unique_ptr<AsyncResults> asyncResults;
+
+            if (asyncOutput) {
+                asyncResults = make_unique<AsyncResults>(results);
+                results = out(*asyncResults);
+            }
+
+            SlowestResults slowestResults(results, out(cout), slowest);
+
+            if (slowest > 0) {
+                results = out(slowestResults);
+            }
+
+            ofstream timingsOutput;
+            TimingsResults timingsResults(results, out(timingsOutput));
+
+            if (writeTimingsFile) {
+                timingsOutput.open(*writeTimingsFile);
+
+                if ( ! timingsOutput) {
+                    throw runtime_error("Unable to write timings to \"" + *writeTimingsFile + "\"");
+                }
+
+                results = out(timingsResults);
+            }
+
+            ofstream baselinesOutput;
+            BaselinesResults baselinesResults(results, out(baselinesOutput));
+
+            if (writeBaselinesFile) {
+                baselinesOutput.open(*writeBaselinesFile);
+
+                if ( ! baselinesOutput) {
+                    throw runtime_error("Unable to write baselines to \"" + *writeBaselinesFile + "\"");
+                }
+
+                results = out(baselinesResults);
+            }
+
+            ofstream measurementsOutput;
+            unique_ptr<MeasurementsResults> measurementsResults;
+
+            if (writeMeasurementsFile) {
+                measurementsOutput.open(*writeMeasurementsFile);
+
+                if ( ! measurementsOutput) {
+                    throw runtime_error("Unable to write measurements to \"" + *writeMeasurementsFile + "\"");
+                }
+
+                measurementsResults = make_unique<MeasurementsResults>(results, out(measurementsOutput));
+                results = out(*measurementsResults);
+            }
+
+            unique_ptr<EventLogResults> eventLogResults;
+
+            if (recordFile) {
+                eventLogResults = make_unique<EventLogResults>(results, *recordFile);
+                results = out(*eventLogResults);
+            }
+
+            if (replayFile) {
+                auto replay = replayEventLog(*replayFile, results);
+
+                if ( ! replay.finished) {
+                    cerr << "The event log \"" << *replayFile << "\" ends before the run finished.";
+
+                    if (replay.lastGiven) {
+                        cerr << " The last given to start was \"" << *replay.lastGiven << "\".";
+                    }
+
+                    cerr << "\n";
+
+                    return ExitStatus::SOFTWARE;
+                }
+
+                if (replay.stats.failedTests() > 0 || replay.stats.failedChecks() > 0) {
+                    return ExitStatus::SOFTWARE;
+                }
+            }
+            else if ( ! Test::run(filter, results, options)) {
                 return ExitStatus::SOFTWARE;
             }
         }
@@ -121,7 +442,80 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Harness {
                 Option<string>(Name('v', "verbosity", "Set the verbosity"),
                                "silent|summary|contexts|fixtures|sections|checks|checks_expression|variables",
                                "contexts"
-                )
+                ),
+                Option<string>(Name('j', "jobs", "Run givens on this many threads. 0 means one per core."),
+                               "N",
+                               "1"
+                ),
+                Option<string>(Name("slowest", "Print the N slowest givens and whens, with their share of the total "
+                                               "time."),
+                               "N",
+                               "0"
+                ),
+                Option<string>(Name("shard-index", "Only run the givens in this shard, counting from 0."), "I", "0"),
+                Option<string>(Name("shard-count", "Split the givens into this many shards. With --list, show the "
+                                                   "shard each given is in."),
+                               "N",
+                               "1"
+                ),
+                Option<vector<string>>(Name("timings", "Balance the shards using the times in FILE, as written by "
+                                                       "--write-timings."),
+                                       "FILE"
+                ),
+                Option<vector<string>>(Name("write-timings", "Write the time taken by each given to FILE."), "FILE"),
+                Option<vector<string>>(Name("baselines", "Check each benchmark measurement against its samples in "
+                                                         "FILE, as written by --write-baselines. It fails if it's "
+                                                         "significantly slower, by more than the regression "
+                                                         "threshold."),
+                                       "FILE"
+                ),
+                Option<vector<string>>(Name("write-baselines", "Write the samples from each benchmark measurement to "
+                                                               "FILE."),
+                                       "FILE"
+                ),
+                Option<string>(Name("regression-threshold", "How much slower than its baseline a benchmark "
+                                                            "measurement's median can be, as a percentage, before "
+                                                            "it fails."),
+                               "PERCENT",
+                               "5"
+                ),
+                Option<vector<string>>(Name("write-measurements", "Write each benchmark measurement to FILE as CSV. "
+                                                                  "A sweep has a row for each combination of "
+                                                                  "arguments."),
+                                       "FILE"
+                ),
+                Option<string>(Name("workers", "Run givens in N worker processes, handing them out one at a time. A "
+                                               "given that crashes fails without stopping the run. Linux only."),
+                               "N",
+                               "0"
+                ),
+                Option<string>(Name("reporter", "Write results as human readable text, JUnit XML, or JSON with one "
+                                                "object per line. Results are written as each given finishes."),
+                               "human|junit|json",
+                               "human"
+                ),
+                Option<vector<string>>(Name("output", "Write results from the reporter to FILE, instead of standard "
+                                                      "output. With junit or json, human readable results still go "
+                                                      "to standard output, or standard error without --output."),
+                                       "FILE"
+                ),
+                Option<vector<string>>(Name("record", "Record every event to a binary log in FILE, as the tests run. "
+                                                      "If the run crashes, the log has everything up to the crash."),
+                                       "FILE"
+                ),
+                Option<vector<string>>(Name("replay", "Report the events recorded in FILE by --record, instead of "
+                                                      "running tests. Any reporter and verbosity can be used."),
+                                       "FILE"
+                ),
+                Flag("fork-whens", "Run each given in a child process, forking at each when, so the code before a "
+                                   "when only runs once. Threads started before a when won't exist in the child. "
+                                   "Linux only."),
+                Flag("parallel-whens", "Run each path through the whens of a given as a separate task, so whens in "
+                                       "the same given can run at the same time. Only has an effect with --jobs."),
+                Flag("isolate", "Run each given in its own process, forked from a worker started before any tests "
+                                "run. A given that crashes or terminates fails, and the rest still run. Use "
+                                "--workers to run more than one at a time. Linux only."),
+                Flag("async-output", "Format and write results on a separate thread, so tests don't wait for output.")
         );
     }
 }}}}
@@ -0,0 +1,86 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Measurement {
+    using std::string;
+    using std::vector;
+    using std::move;
+    using std::sort;
+    using std::sqrt;
+
+    // The time per iteration of a benchmark, from several samples. Each sample times the same number of iterations,
+    // and is stored as nanoseconds per iteration, in the order they were taken.
+    class Measurement final {
+        string name_;
+        uint64_t iterations_ = 0;
+        vector<double> samples_;
+        double mean_ = 0;
+        double median_ = 0;
+        double standardDeviation_ = 0;
+        double minimum_ = 0;
+        double maximum_ = 0;
+    public:
+        Measurement() = default;
+
+        Measurement(string name, uint64_t iterations, vector<double> samples) :
+            name_(move(name)), iterations_(iterations), samples_(move(samples))
+        {
+            if (samples_.empty()) return;
+
+            double total = 0;
+
+            for (auto sample : samples_) {
+                total += sample;
+            }
+
+            mean_ = total / samples_.size();
+
+            vector<double> sorted(samples_);
+            sort(sorted.begin(), sorted.end());
+            auto middle = sorted.size() / 2;
+            median_ = sorted.size() % 2 == 0 ? (sorted[middle - 1] + sorted[middle]) / 2 : sorted[middle];
+            minimum_ = sorted.front();
+            maximum_ = sorted.back();
+
+            if (samples_.size() > 1) {
+                double squares = 0;
+
+                for (auto sample : samples_) {
+                    squares += (sample - mean_) * (sample - mean_);
+                }
+
+                standardDeviation_ = sqrt(squares / (samples_.size() - 1));
+            }
+        }
+
+        const string& name() const { return name_; }
+
+        // Iterations in each sample.
+        uint64_t iterations() const { return iterations_; }
+
+        const vector<double>& samples() const { return samples_; }
+
+        // Nanoseconds per iteration.
+        double mean() const { return mean_; }
+        double median() const { return median_; }
+        double standardDeviation() const { return standardDeviation_; }
+        double minimum() const { return minimum_; }
+        double maximum() const { return maximum_; }
+    };
+}}}}
+
+namespace Enhedron { namespace Test {
+    using Impl::Impl_Measurement::Measurement;
+}}
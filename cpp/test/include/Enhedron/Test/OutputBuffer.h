@@ -0,0 +1,206 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include "Enhedron/Util.h"
+#include "Enhedron/Test/Process.h"
+
+#include <string>
+#include <memory>
+#include <ostream>
+#include <iostream>
+#include <type_traits>
+#include <cstring>
+#include <cerrno>
+
+#ifdef __linux__
+    #include <unistd.h>
+    #include <sys/uio.h>
+#endif
+
+namespace Enhedron { namespace Test { namespace Impl { namespace Impl_OutputBuffer {
+    using std::string;
+    using std::ostream;
+    using std::cout;
+    using std::strlen;
+    using std::memcpy;
+    using std::unique_ptr;
+    using std::enable_if_t;
+    using std::is_integral;
+    using std::is_same;
+    using std::make_unsigned_t;
+    using std::streamsize;
+
+    using Impl_Process::throwSystemError;
+
+    // Text for reporters, collected in one large buffer and written out in big chunks, so each piece of output
+    // costs a copy rather than a call into a stream. Output is only written when the owner calls flush, or the
+    // buffer fills up. If the stream is cout, we write to the file descriptor on Linux, with the buffer and any
+    // large piece of text in one writev.
+    class OutputBuffer final: public NoCopy {
+        static constexpr const size_t defaultCapacity = 64 * 1024;
+        static constexpr const size_t indentSize = 4;
+
+        Out<ostream> output_;
+        int fd_ = -1;
+        unique_ptr<char[]> buffer_;
+        size_t capacity_;
+        size_t size_ = 0;
+
+        static const string& spaces() {
+            static const string theSpaces(indentSize * 32, ' ');
+
+            return theSpaces;
+        }
+
+        // Write the buffer, then data, and empty the buffer.
+        void writeOut(const char* data, size_t size) {
+            #ifdef __linux__
+                if (fd_ >= 0) {
+                    // Anything else written to cout has to go first.
+                    output_->flush();
+
+                    iovec ioList[2] = {
+                        {buffer_.get(), size_},
+                        {const_cast<char*>(data), size}
+                    };
+
+                    iovec* io = ioList;
+                    int ioCount = 2;
+
+                    while (ioCount > 0) {
+                        auto result = ::writev(fd_, io, ioCount);
+
+                        if (result < 0) {
+                            if (errno == EINTR) {
+                                continue;
+                            }
+
+                            size_ = 0;
+                            throwSystemError("writev");
+                        }
+
+                        auto written = static_cast<size_t>(result);
+
+                        while (ioCount > 0 && written >= io->iov_len) {
+                            written -= io->iov_len;
+                            ++io;
+                            --ioCount;
+                        }
+
+                        if (ioCount > 0) {
+                            io->iov_base = static_cast<char*>(io->iov_base) + written;
+                            io->iov_len -= written;
+                        }
+                    }
+
+                    size_ = 0;
+
+                    return;
+                }
+            #endif
+
+            output_->write(buffer_.get(), static_cast<streamsize>(size_));
+            output_->write(data, static_cast<streamsize>(size));
+            output_->flush();
+            size_ = 0;
+        }
+    public:
+        explicit OutputBuffer(Out<ostream> output, size_t capacity = defaultCapacity) :
+            output_(output), buffer_(new char[capacity]), capacity_(capacity)
+        {
+            #ifdef __linux__
+                if (&*output_ == &cout) {
+                    fd_ = STDOUT_FILENO;
+                }
+            #endif
+        }
+
+        ~OutputBuffer() {
+            try {
+                flush();
+            }
+            catch (...) {
+            }
+        }
+
+        void flush() {
+            if (size_ > 0) {
+                writeOut(nullptr, 0);
+            }
+        }
+
+        void write(const char* data, size_t size) {
+            if (size_ + size > capacity_) {
+                if (size >= capacity_ / 2) {
+                    writeOut(data, size);
+                    return;
+                }
+
+                flush();
+            }
+
+            memcpy(buffer_.get() + size_, data, size);
+            size_ += size;
+        }
+
+        void indent(size_t levels) {
+            auto size = levels * indentSize;
+
+            while (size > 0) {
+                auto chunk = size < spaces().size() ? size : spaces().size();
+                write(spaces().data(), chunk);
+                size -= chunk;
+            }
+        }
+
+        OutputBuffer& operator<<(const string& text) {
+            write(text.data(), text.size());
+
+            return *this;
+        }
+
+        OutputBuffer& operator<<(const char* text) {
+            write(text, strlen(text));
+
+            return *this;
+        }
+
+        OutputBuffer& operator<<(char character) {
+            write(&character, 1);
+
+            return *this;
+        }
+
+        template<typename Integer>
+        enable_if_t<is_integral<Integer>::value && ! is_same<Integer, bool>::value && ! is_same<Integer, char>::value,
+                    OutputBuffer&>
+        operator<<(Integer value) {
+            using Unsigned = make_unsigned_t<Integer>;
+
+            char digits[24];
+            char* end = digits + sizeof(digits);
+            char* begin = end;
+            bool negative = value < 0;
+            auto magnitude = negative ? Unsigned(0) - static_cast<Unsigned>(value) : static_cast<Unsigned>(value);
+
+            do {
+                *--begin = static_cast<char>('0' + magnitude % 10);
+                magnitude /= 10;
+            } while (magnitude != 0);
+
+            if (negative) {
+                *--begin = '-';
+            }
+
+            write(begin, static_cast<size_t>(end - begin));
+
+            return *this;
+        }
+    };
+}}}}
@@ -0,0 +1,224 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include "Enhedron/Util.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <utility>
+#include <algorithm>
+
+namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Parallel {
+    using std::thread;
+    using std::mutex;
+    using std::lock_guard;
+    using std::unique_lock;
+    using std::condition_variable;
+    using std::deque;
+    using std::vector;
+    using std::unique_ptr;
+    using std::make_unique;
+    using std::function;
+    using std::move;
+    using std::forward;
+    using std::max;
+
+    inline size_t defaultThreadCount() {
+        return max(thread::hardware_concurrency(), 1u);
+    }
+
+    // A fixed set of threads, each with its own deque of tasks. Threads take work from the back of their own deque
+    // and steal from the front of other threads' deques when they run out. Threads outside the pool share one extra
+    // deque, which they use in FIFO order, so tasks submitted from outside start roughly in submission order.
+    //
+    // Tasks must not throw. Any thread can help run tasks while it waits for something with helpUntil, so tasks can
+    // submit and wait for subtasks without deadlocking.
+    class TaskPool final: public NoCopyMove {
+        using Task = function<void()>;
+
+        struct TaskQueue {
+            mutex lock;
+            deque<Task> tasks;
+        };
+
+        vector<unique_ptr<TaskQueue>> queueList_;
+        vector<thread> threadList_;
+
+        mutex changedLock_;
+        condition_variable changed_;
+        uint64_t generation_ = 0;
+        bool stopping_ = false;
+
+        struct CurrentThread {
+            const TaskPool* pool = nullptr;
+            size_t index = 0;
+        };
+
+        static CurrentThread& currentThread() {
+            static thread_local CurrentThread instance;
+            return instance;
+        }
+
+        size_t externalIndex() const { return threadList_.size(); }
+
+        size_t currentIndex() const {
+            const auto& current = currentThread();
+
+            if (current.pool == this) {
+                return current.index;
+            }
+
+            return externalIndex();
+        }
+
+        void notifyChanged() {
+            {
+                lock_guard<mutex> lock(changedLock_);
+                ++generation_;
+            }
+
+            changed_.notify_all();
+        }
+
+        bool takeTask(Out<Task> task) {
+            auto index = currentIndex();
+            auto queueCount = queueList_.size();
+
+            {
+                auto& queue = *queueList_[index];
+                lock_guard<mutex> lock(queue.lock);
+
+                if ( ! queue.tasks.empty()) {
+                    if (index == externalIndex()) {
+                        *task = move(queue.tasks.front());
+                        queue.tasks.pop_front();
+                    }
+                    else {
+                        *task = move(queue.tasks.back());
+                        queue.tasks.pop_back();
+                    }
+
+                    return true;
+                }
+            }
+
+            for (size_t offset = 1; offset < queueCount; ++offset) {
+                auto& queue = *queueList_[(index + offset) % queueCount];
+                lock_guard<mutex> lock(queue.lock);
+
+                if ( ! queue.tasks.empty()) {
+                    *task = move(queue.tasks.front());
+                    queue.tasks.pop_front();
+
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        bool runPendingTask() {
+            Task task;
+
+            if ( ! takeTask(out(task))) {
+                return false;
+            }
+
+            task();
+            notifyChanged();
+
+            return true;
+        }
+
+        void workerMain(size_t index) {
+            currentThread().pool = this;
+            currentThread().index = index;
+
+            helpUntil([this] {
+                lock_guard<mutex> lock(changedLock_);
+                return stopping_;
+            });
+        }
+    public:
+        // threadCount is the number of extra threads. The thread that waits for results will also run tasks.
+        explicit TaskPool(size_t threadCount) {
+            for (size_t index = 0; index <= threadCount; ++index) {
+                queueList_.emplace_back(make_unique<TaskQueue>());
+            }
+
+            for (size_t index = 0; index < threadCount; ++index) {
+                threadList_.emplace_back([this, index] { workerMain(index); });
+            }
+        }
+
+        ~TaskPool() {
+            {
+                lock_guard<mutex> lock(changedLock_);
+                stopping_ = true;
+            }
+
+            changed_.notify_all();
+
+            for (auto& worker : threadList_) {
+                worker.join();
+            }
+        }
+
+        size_t threadCount() const { return threadList_.size() + 1; }
+
+        template<typename Functor>
+        void submit(Functor&& functor) {
+            {
+                auto& queue = *queueList_[currentIndex()];
+                lock_guard<mutex> lock(queue.lock);
+                queue.tasks.emplace_back(forward<Functor>(functor));
+            }
+
+            notifyChanged();
+        }
+
+        // Run pending tasks until done() is true. done() must become true as a result of a task finishing.
+        template<typename Predicate>
+        void helpUntil(Predicate&& done) {
+            while (true) {
+                uint64_t seen;
+
+                {
+                    lock_guard<mutex> lock(changedLock_);
+                    seen = generation_;
+                }
+
+                if (done()) {
+                    return;
+                }
+
+                if (runPendingTask()) {
+                    continue;
+                }
+
+                unique_lock<mutex> lock(changedLock_);
+                changed_.wait(lock, [&] { return generation_ != seen || stopping_; });
+
+                if (stopping_ && currentIndex() != externalIndex()) {
+                    return;
+                }
+            }
+        }
+    };
+}}}}
+
+namespace Enhedron { namespace Test {
+    using Impl::Impl_Parallel::TaskPool;
+    using Impl::Impl_Parallel::defaultThreadCount;
+}}
@@ -0,0 +1,265 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include "Enhedron/Util.h"
+#include "Enhedron/Util/Optional.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <regex>
+#include <cstring>
+#include <unordered_map>
+#include <algorithm>
+
+namespace Enhedron { namespace Test { namespace Impl { namespace Impl_PathFilter {
+    using std::string;
+    using std::vector;
+    using std::unique_ptr;
+    using std::make_unique;
+    using std::move;
+    using std::regex;
+    using std::regex_match;
+    using std::strchr;
+    using std::unordered_map;
+    using std::find;
+    using std::pair;
+
+    using Util::optional;
+    using Util::none;
+
+    // One component of a test path. Components are regular expressions, but most are just names, or names followed
+    // by ".*", so those are matched without std::regex.
+    class PathComponent final {
+    public:
+        enum class Kind {
+            LITERAL,
+            PREFIX,
+            MATCH_ALL,
+            REGEX
+        };
+    private:
+        string pattern_;
+        Kind kind_;
+        string text_;
+        unique_ptr<regex> regex_;
+
+        // The literal text, if pattern is only literal characters and escaped special characters.
+        static optional<string> literalText(const string& pattern) {
+            static constexpr const char* specialChars = ".^$|()[]{}*+?\\";
+            string text;
+
+            for (auto character = pattern.begin(); character != pattern.end(); ++character) {
+                if (*character == '\\') {
+                    ++character;
+
+                    if (character == pattern.end() || ! strchr(specialChars, *character)) {
+                        return none;
+                    }
+                }
+                else if (strchr(specialChars, *character)) {
+                    return none;
+                }
+
+                text += *character;
+            }
+
+            return move(text);
+        }
+
+        void classify() {
+            static const string matchAll(".*");
+
+            if (pattern_ == matchAll) {
+                kind_ = Kind::MATCH_ALL;
+                return;
+            }
+
+            auto text = literalText(pattern_);
+
+            if (text) {
+                kind_ = Kind::LITERAL;
+                text_ = move(*text);
+                return;
+            }
+
+            auto prefixSize = pattern_.size() - matchAll.size();
+
+            if (pattern_.size() > matchAll.size() && pattern_.compare(prefixSize, matchAll.size(), matchAll) == 0) {
+                auto prefix = literalText(pattern_.substr(0, prefixSize));
+
+                if (prefix) {
+                    kind_ = Kind::PREFIX;
+                    text_ = move(*prefix);
+                    return;
+                }
+            }
+
+            kind_ = Kind::REGEX;
+            regex_ = make_unique<regex>(pattern_);
+        }
+    public:
+        explicit PathComponent(string pattern) : pattern_(move(pattern)) {
+            classify();
+        }
+
+        const string& pattern() const { return pattern_; }
+        Kind kind() const { return kind_; }
+
+        // For LITERAL and PREFIX components.
+        const string& text() const { return text_; }
+
+        bool matches(const string& name) const {
+            switch (kind_) {
+                case Kind::LITERAL:
+                    return name == text_;
+                case Kind::PREFIX:
+                    return name.compare(0, text_.size(), text_) == 0;
+                case Kind::MATCH_ALL:
+                    return true;
+                case Kind::REGEX:
+                    break;
+            }
+
+            return regex_match(name, *regex_);
+        }
+    };
+
+    // Test paths, compiled into a trie so paths with the same leading components are only matched once. Literal
+    // components are looked up by name, so thousands of paths cost about the same as one.
+    class PathFilter final: public NoCopy {
+        struct Node final: public NoCopy {
+            // A path ends here, so everything below this node is included.
+            bool terminal = false;
+            unordered_map<string, unique_ptr<Node>> literalChildren;
+            vector<pair<PathComponent, unique_ptr<Node>>> patternChildren;
+
+            Out<Node> child(string pattern) {
+                PathComponent component(move(pattern));
+
+                if (component.kind() == PathComponent::Kind::LITERAL) {
+                    auto& literalChild = literalChildren[component.text()];
+
+                    if ( ! literalChild) {
+                        literalChild = make_unique<Node>();
+                    }
+
+                    return out(*literalChild);
+                }
+
+                for (auto& patternChild : patternChildren) {
+                    if (patternChild.first.pattern() == component.pattern()) {
+                        return out(*patternChild.second);
+                    }
+                }
+
+                patternChildren.emplace_back(move(component), make_unique<Node>());
+
+                return out(*patternChildren.back().second);
+            }
+        };
+
+        Node root_;
+    public:
+        // Where we've got to in the trie. Either everything below here is included, or only the nodes matching one
+        // of nodeList's children.
+        class State final {
+            friend class PathFilter;
+
+            bool all_ = false;
+            vector<const Node*> nodeList_;
+        public:
+            bool all() const { return all_; }
+        };
+
+        // Include everything.
+        PathFilter() {
+            root_.terminal = true;
+        }
+
+        // Each path is a list of regular expressions, matched against the names of contexts and givens, starting at
+        // the top level. Everything below a matched path is included. An empty list includes everything.
+        explicit PathFilter(const vector<vector<string>>& pathList) {
+            if (pathList.empty()) {
+                root_.terminal = true;
+            }
+
+            for (const auto& path : pathList) {
+                Out<Node> node(root_);
+
+                for (const auto& component : path) {
+                    node = node->child(component);
+                }
+
+                node->terminal = true;
+            }
+        }
+
+        State root() const {
+            State state;
+
+            if (root_.terminal) {
+                state.all_ = true;
+            }
+            else {
+                state.nodeList_.push_back(&root_);
+            }
+
+            return state;
+        }
+
+        // The state for a child called name, or none if nothing below it is included.
+        optional<State> match(const State& state, const string& name) const {
+            if (state.all_) {
+                return state;
+            }
+
+            State next;
+
+            auto add = [&] (const Node& node) {
+                if (node.terminal) {
+                    next.all_ = true;
+                }
+                else if (find(next.nodeList_.begin(), next.nodeList_.end(), &node) == next.nodeList_.end()) {
+                    next.nodeList_.push_back(&node);
+                }
+            };
+
+            for (auto node : state.nodeList_) {
+                auto literalChild = node->literalChildren.find(name);
+
+                if (literalChild != node->literalChildren.end()) {
+                    add(*literalChild->second);
+                }
+
+                for (const auto& patternChild : node->patternChildren) {
+                    if (patternChild.first.matches(name)) {
+                        add(*patternChild.second);
+                    }
+                }
+
+                if (next.all_) {
+                    next.nodeList_.clear();
+                    return next;
+                }
+            }
+
+            if (next.nodeList_.empty()) {
+                return none;
+            }
+
+            return move(next);
+        }
+    };
+}}}}
+
+namespace Enhedron { namespace Test {
+    using Impl::Impl_PathFilter::PathFilter;
+}}
@@ -0,0 +1,259 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include "Enhedron/Util.h"
+#include "Enhedron/Util/Optional.h"
+
+#include <string>
+#include <stdexcept>
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+    #include <unistd.h>
+    #include <sys/types.h>
+    #include <sys/wait.h>
+    #include <sys/syscall.h>
+    #include <sys/resource.h>
+#endif
+
+namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Process {
+    using std::string;
+    using std::runtime_error;
+    using std::to_string;
+    using std::cout;
+    using std::fflush;
+    using std::strerror;
+
+    using Util::optional;
+    using Util::none;
+
+    using ProcessId = int;
+
+    #ifdef __linux__
+        static constexpr const bool processesSupported = true;
+    #else
+        static constexpr const bool processesSupported = false;
+    #endif
+
+    inline void throwUnsupported() {
+        throw runtime_error("Child processes are only supported on Linux");
+    }
+
+    inline void throwSystemError(const string& operation) {
+        throw runtime_error(operation + " failed: " + strerror(errno));
+    }
+
+    class Pipe final: public NoCopy {
+        int readEnd_ = -1;
+        int writeEnd_ = -1;
+
+        static void close(Out<int> fd) {
+            #ifdef __linux__
+                if (*fd >= 0) {
+                    ::close(*fd);
+                    *fd = -1;
+                }
+            #endif
+        }
+    public:
+        Pipe() {
+            #ifdef __linux__
+                int fds[2];
+
+                if (::pipe(fds) != 0) {
+                    throwSystemError("pipe");
+                }
+
+                readEnd_ = fds[0];
+                writeEnd_ = fds[1];
+            #else
+                throwUnsupported();
+            #endif
+        }
+
+        ~Pipe() {
+            closeRead();
+            closeWrite();
+        }
+
+        int readEnd() const { return readEnd_; }
+        int writeEnd() const { return writeEnd_; }
+
+        void closeRead() { close(out(readEnd_)); }
+        void closeWrite() { close(out(writeEnd_)); }
+    };
+
+    inline void writeAll(int fd, const string& data) {
+        #ifdef __linux__
+            size_t written = 0;
+
+            while (written < data.size()) {
+                auto result = ::write(fd, data.data() + written, data.size() - written);
+
+                if (result < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+
+                    throwSystemError("write");
+                }
+
+                written += static_cast<size_t>(result);
+            }
+        #else
+            throwUnsupported();
+        #endif
+    }
+
+    // Read until every process with the write end open has closed it.
+    inline string readAll(int fd) {
+        string data;
+
+        #ifdef __linux__
+            char buffer[4096];
+
+            while (true) {
+                auto result = ::read(fd, buffer, sizeof(buffer));
+
+                if (result < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+
+                    throwSystemError("read");
+                }
+
+                if (result == 0) {
+                    break;
+                }
+
+                data.append(buffer, static_cast<size_t>(result));
+            }
+        #else
+            throwUnsupported();
+        #endif
+
+        return data;
+    }
+
+    // Returns 0 in the child. Output is flushed first, so buffered output isn't written by both processes. The
+    // standard streams are locked over the fork, as another thread could be writing to them, and the child would
+    // inherit the lock with nobody to release it.
+    inline ProcessId forkProcess() {
+        #ifdef __linux__
+            cout.flush();
+            fflush(nullptr);
+
+            ::flockfile(stdout);
+            ::flockfile(stderr);
+            auto child = ::fork();
+            ::funlockfile(stderr);
+            ::funlockfile(stdout);
+
+            if (child < 0) {
+                throwSystemError("fork");
+            }
+
+            return child;
+        #else
+            throwUnsupported();
+            return 0;
+        #endif
+    }
+
+    // Close every file descriptor except stdin, stdout, stderr and keep. A long lived child calls this, so it doesn't
+    // hold open pipes and sockets that other threads in the parent created for their own children. Otherwise, the
+    // other ends wouldn't see the end of the stream until this child exits. Nothing here allocates, as another thread
+    // may have held the allocator's lock when we forked.
+    inline void closeFilesExcept(int keep) {
+        #ifdef __linux__
+            auto closeRange = [] (unsigned first, unsigned last) {
+                if (first > last) {
+                    return;
+                }
+
+                #ifdef SYS_close_range
+                    if (::syscall(SYS_close_range, first, last, 0) == 0) {
+                        return;
+                    }
+                #endif
+
+                rlimit limit;
+                unsigned fdLimit = 1024;
+
+                if (::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) {
+                    fdLimit = static_cast<unsigned>(limit.rlim_cur);
+                }
+
+                for (auto fd = first; fd <= last && fd < fdLimit; ++fd) {
+                    ::close(static_cast<int>(fd));
+                }
+            };
+
+            auto maxFd = ~0u;
+
+            if (keep > 2) {
+                closeRange(3, static_cast<unsigned>(keep) - 1);
+                closeRange(static_cast<unsigned>(keep) + 1, maxFd);
+            }
+            else {
+                closeRange(3, maxFd);
+            }
+        #else
+            throwUnsupported();
+        #endif
+    }
+
+    // Exit without running destructors or exit handlers, which belong to the parent process.
+    [[noreturn]] inline void exitProcess(int status) {
+        cout.flush();
+        fflush(nullptr);
+
+        #ifdef __linux__
+            ::_exit(status);
+        #else
+            std::_Exit(status);
+        #endif
+    }
+
+    // Wait for a child process to finish. Returns a description of the problem if it didn't exit successfully.
+    inline optional<string> waitForProcess(ProcessId child) {
+        #ifdef __linux__
+            int status = 0;
+
+            while (::waitpid(child, &status, 0) < 0) {
+                if (errno != EINTR) {
+                    throwSystemError("waitpid");
+                }
+            }
+
+            if (WIFSIGNALED(status)) {
+                auto signal = WTERMSIG(status);
+
+                return optional<string>("was killed by signal " + to_string(signal) + " (" + strsignal(signal) + ")");
+            }
+
+            if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+                return optional<string>("exited with status " + to_string(WEXITSTATUS(status)));
+            }
+        #else
+            throwUnsupported();
+        #endif
+
+        return none;
+    }
+}}}}
+
+namespace Enhedron { namespace Test {
+    using Impl::Impl_Process::processesSupported;
+}}
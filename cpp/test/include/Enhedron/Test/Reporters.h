@@ -0,0 +1,512 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include "Enhedron/Util.h"
+#include "Enhedron/Util/Optional.h"
+#include "Enhedron/Test/Results.h"
+#include "Enhedron/Test/OutputBuffer.h"
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <exception>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+
+namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Reporters {
+    using std::string;
+    using std::vector;
+    using std::ostream;
+    using std::exception;
+    using std::strlen;
+    using std::move;
+    using std::to_string;
+    using std::snprintf;
+
+    using Util::optional;
+    using Assertion::Variable;
+
+    using namespace Impl_Results;
+    using Impl_OutputBuffer::OutputBuffer;
+
+    // Text collected in a string, for output that has to wait. Clearing it keeps the memory for next time.
+    class TextOutput final: public NoCopy {
+        string text_;
+    public:
+        void write(const char* data, size_t size) { text_.append(data, size); }
+        void clear() { text_.clear(); }
+
+        const string& text() const { return text_; }
+    };
+
+    // Write text for an XML attribute value or element in one pass, copying runs of ordinary characters in one go.
+    // Control characters that XML 1.0 doesn't allow are replaced with U+FFFD. In attributes, whitespace is written
+    // as character references, so parsers don't normalize it to spaces.
+    template<typename Output>
+    void writeXml(Output& output, const char* text, size_t size, bool attribute) {
+        size_t runStart = 0;
+
+        for (size_t index = 0; index < size; ++index) {
+            const char* replacement = nullptr;
+
+            switch (text[index]) {
+                case '&': replacement = "&amp;"; break;
+                case '<': replacement = "&lt;"; break;
+                case '>': replacement = "&gt;"; break;
+                case '"': replacement = attribute ? "&quot;" : nullptr; break;
+                case '\'': replacement = attribute ? "&apos;" : nullptr; break;
+                case '\t': replacement = attribute ? "&#9;" : nullptr; break;
+                case '\n': replacement = attribute ? "&#10;" : nullptr; break;
+                case '\r': replacement = "&#13;"; break;
+                default:
+                    if (static_cast<unsigned char>(text[index]) < 0x20) {
+                        replacement = "&#xFFFD;";
+                    }
+            }
+
+            if (replacement != nullptr) {
+                output.write(text + runStart, index - runStart);
+                output.write(replacement, strlen(replacement));
+                runStart = index + 1;
+            }
+        }
+
+        output.write(text + runStart, size - runStart);
+    }
+
+    template<typename Output>
+    void writeXml(Output& output, const string& text, bool attribute) {
+        writeXml(output, text.data(), text.size(), attribute);
+    }
+
+    // Write a quoted JSON string in one pass. Bytes from 0x80 up are passed through, so UTF-8 stays as it is.
+    template<typename Output>
+    void writeJson(Output& output, const char* text, size_t size) {
+        static const char hexDigits[] = "0123456789abcdef";
+
+        output.write("\"", 1);
+        size_t runStart = 0;
+
+        for (size_t index = 0; index < size; ++index) {
+            auto character = static_cast<unsigned char>(text[index]);
+            const char* replacement = nullptr;
+            char unicode[] = "\\u0000";
+
+            switch (character) {
+                case '"': replacement = "\\\""; break;
+                case '\\': replacement = "\\\\"; break;
+                case '\b': replacement = "\\b"; break;
+                case '\f': replacement = "\\f"; break;
+                case '\n': replacement = "\\n"; break;
+                case '\r': replacement = "\\r"; break;
+                case '\t': replacement = "\\t"; break;
+                default:
+                    if (character < 0x20) {
+                        unicode[4] = hexDigits[character >> 4];
+                        unicode[5] = hexDigits[character & 0xf];
+                        replacement = unicode;
+                    }
+            }
+
+            if (replacement != nullptr) {
+                output.write(text + runStart, index - runStart);
+                output.write(replacement, strlen(replacement));
+                runStart = index + 1;
+            }
+        }
+
+        output.write(text + runStart, size - runStart);
+        output.write("\"", 1);
+    }
+
+    template<typename Output>
+    void writeJson(Output& output, const string& text) {
+        writeJson(output, text.data(), text.size());
+    }
+
+    // Nanoseconds as seconds, with microsecond precision.
+    inline void writeSeconds(OutputBuffer& output, uint64_t nanoseconds) {
+        auto micros = nanoseconds / 1000;
+        auto fraction = micros % 1000000;
+        char digits[] = "000000";
+
+        for (size_t index = 6; index > 0; --index) {
+            digits[index - 1] = static_cast<char>('0' + fraction % 10);
+            fraction /= 10;
+        }
+
+        output << micros / 1000000 << '.';
+        output.write(digits, 6);
+    }
+
+    // Nanoseconds, to the nearest picosecond.
+    inline void writeNanoseconds(OutputBuffer& output, double nanoseconds) {
+        char text[32];
+        auto size = snprintf(text, sizeof(text), "%.3f", nanoseconds);
+        output.write(text, static_cast<size_t>(size));
+    }
+
+    // Write a CSV field, quoted if it has to be.
+    template<typename Output>
+    void writeCsv(Output& output, const string& text) {
+        if (text.find_first_of(",\"\r\n") == string::npos) {
+            output.write(text.data(), text.size());
+            return;
+        }
+
+        output.write("\"", 1);
+        size_t runStart = 0;
+
+        for (size_t index = 0; index < text.size(); ++index) {
+            if (text[index] == '"') {
+                output.write(text.data() + runStart, index + 1 - runStart);
+                output.write("\"", 1);
+                runStart = index + 1;
+            }
+        }
+
+        output.write(text.data() + runStart, text.size() - runStart);
+        output.write("\"", 1);
+    }
+
+    // Write a JUnit XML report as the tests run. Each given is a testcase, in one testsuite, with its contexts as
+    // the classname. A testcase is written when its given ends, so its time is known, but the testsuite counts
+    // never are, so they're left out. That's allowed, and CI servers count the testcases themselves.
+    //
+    // Failures are kept until their given ends, up to maxFailures of them, so memory doesn't grow with the number
+    // of exhaustive combinations that fail. After that, they're only counted.
+    class JUnitResults final: public ForwardingResults {
+        static constexpr const size_t maxFailures = 100;
+
+        OutputBuffer output_;
+        TextOutput failures_;
+        size_t failureCount_ = 0;
+
+        void writeWhens(const NameStack& whenStack) {
+            for (const auto& when : whenStack.stack()) {
+                failures_.write("When: ", 6);
+                writeXml(failures_, when, false);
+                failures_.write("\n", 1);
+            }
+        }
+
+        // Returns false if the failure should only be counted.
+        bool beginFailure(const char* element, const string& message) {
+            ++failureCount_;
+
+            if (failureCount_ > maxFailures) {
+                return false;
+            }
+
+            failures_.write("    <", 5);
+            failures_.write(element, strlen(element));
+            failures_.write(" message=\"", 10);
+            writeXml(failures_, message, true);
+            failures_.write("\">", 2);
+
+            return true;
+        }
+
+        void endFailure(const char* element) {
+            failures_.write("</", 2);
+            failures_.write(element, strlen(element));
+            failures_.write(">\n", 2);
+        }
+    public:
+        JUnitResults(Out<Results> results, Out<ostream> output) : ForwardingResults(results), output_(output) {
+            output_ << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<testsuites>\n<testsuite name=\"MosquitoNet\">\n";
+        }
+
+        virtual void finish(const Stats& stats) override {
+            output_ << "</testsuite>\n</testsuites>\n";
+            output_.flush();
+            ForwardingResults::finish(stats);
+        }
+
+        virtual void beginGiven(const NameStack& context, const string& given) override {
+            failures_.clear();
+            failureCount_ = 0;
+            ForwardingResults::beginGiven(context, given);
+        }
+
+        virtual void endGiven(const Stats& stats, const NameStack& context, const string& given) override {
+            output_ << "  <testcase classname=\"";
+            bool first = true;
+
+            for (const auto& contextName : context.stack()) {
+                if ( ! first) {
+                    output_ << '/';
+                }
+
+                writeXml(output_, contextName, true);
+                first = false;
+            }
+
+            output_ << "\" name=\"";
+            writeXml(output_, given, true);
+            output_ << "\" time=\"";
+            writeSeconds(output_, stats.wallTime());
+
+            if (failureCount_ == 0) {
+                output_ << "\"/>\n";
+            }
+            else {
+                output_ << "\">\n" << failures_.text();
+
+                if (failureCount_ > maxFailures) {
+                    output_ << "    <system-err>" << failureCount_ - maxFailures << " more failures</system-err>\n";
+                }
+
+                output_ << "  </testcase>\n";
+            }
+
+            failures_.clear();
+            failureCount_ = 0;
+            ForwardingResults::endGiven(stats, context, given);
+        }
+
+        virtual void fail(const NameStack& context,
+                          const string& given,
+                          const NameStack& whenStack,
+                          optional<string> description,
+                          const string &expressionText,
+                          const vector <Variable> &variableList) override
+        {
+            if (beginFailure("failure", description ? *description : expressionText)) {
+                writeWhens(whenStack);
+
+                if (description) {
+                    writeXml(failures_, *description, false);
+                    failures_.write("\n", 1);
+                }
+
+                writeXml(failures_, expressionText, false);
+                failures_.write("\n", 1);
+
+                for (const auto& variable : variableList) {
+                    writeXml(failures_, variable.name(), strlen(variable.name()), false);
+                    failures_.write(" = ", 3);
+                    writeXml(failures_, variable.value(), false);
+                    failures_.write(": file \"", 8);
+                    writeXml(failures_, variable.file(), strlen(variable.file()), false);
+                    auto line = "\", line " + to_string(variable.line()) + ".\n";
+                    failures_.write(line.data(), line.size());
+                }
+
+                endFailure("failure");
+            }
+
+            ForwardingResults::fail(context, given, whenStack, move(description), expressionText, variableList);
+        }
+
+        virtual void failByException(const NameStack& context,
+                                     const string& given,
+                                     const NameStack& whenStack,
+                                     const exception& e) override {
+            if (beginFailure("error", e.what())) {
+                writeWhens(whenStack);
+                writeXml(failures_, e.what(), strlen(e.what()), false);
+                failures_.write("\n", 1);
+                endFailure("error");
+            }
+
+            ForwardingResults::failByException(context, given, whenStack, e);
+        }
+    };
+
+    // Write a JSON object on its own line as each given or when ends, each check fails, or a test throws, then a
+    // summary when the run finishes. Nothing is kept between lines, however many events there are.
+    class JsonResults final: public ForwardingResults {
+        OutputBuffer output_;
+
+        void writeNames(const NameStack& names, const string* last = nullptr) {
+            output_ << '[';
+            bool first = true;
+
+            for (const auto& name : names.stack()) {
+                if ( ! first) {
+                    output_ << ',';
+                }
+
+                writeJson(output_, name);
+                first = false;
+            }
+
+            if (last != nullptr) {
+                if ( ! first) {
+                    output_ << ',';
+                }
+
+                writeJson(output_, *last);
+            }
+
+            output_ << ']';
+        }
+
+        void writeLocation(const char* type, const NameStack& context, const string& given) {
+            output_ << "{\"type\":\"" << type << "\",\"context\":";
+            writeNames(context);
+            output_ << ",\"given\":";
+            writeJson(output_, given);
+        }
+
+        void writeStats(const Stats& stats) {
+            output_ << ",\"tests\":" << stats.tests() << ",\"checks\":" << stats.checks() <<
+                ",\"failedTests\":" << stats.failedTests() << ",\"failedChecks\":" << stats.failedChecks() <<
+                ",\"wallTime\":" << stats.wallTime() << ",\"cpuTime\":" << stats.cpuTime() << "}\n";
+        }
+    public:
+        JsonResults(Out<Results> results, Out<ostream> output) : ForwardingResults(results), output_(output) {}
+
+        virtual void finish(const Stats& stats) override {
+            output_ << "{\"type\":\"finish\"";
+            writeStats(stats);
+            output_.flush();
+            ForwardingResults::finish(stats);
+        }
+
+        virtual void endGiven(const Stats& stats, const NameStack& context, const string& given) override {
+            writeLocation("given", context, given);
+            writeStats(stats);
+            ForwardingResults::endGiven(stats, context, given);
+        }
+
+        virtual void endWhen(const Stats& stats,
+                             const NameStack& context,
+                             const string& given,
+                             const NameStack& whenStack,
+                             const string& when) override {
+            writeLocation("when", context, given);
+            output_ << ",\"whens\":";
+            writeNames(whenStack, &when);
+            writeStats(stats);
+            ForwardingResults::endWhen(stats, context, given, whenStack, when);
+        }
+
+        virtual void fail(const NameStack& context,
+                          const string& given,
+                          const NameStack& whenStack,
+                          optional<string> description,
+                          const string &expressionText,
+                          const vector <Variable> &variableList) override
+        {
+            writeLocation("failure", context, given);
+            output_ << ",\"whens\":";
+            writeNames(whenStack);
+            output_ << ",\"description\":";
+
+            if (description) {
+                writeJson(output_, *description);
+            }
+            else {
+                output_ << "null";
+            }
+
+            output_ << ",\"expression\":";
+            writeJson(output_, expressionText);
+            output_ << ",\"variables\":[";
+            bool first = true;
+
+            for (const auto& variable : variableList) {
+                output_ << (first ? "{\"name\":" : ",{\"name\":");
+                writeJson(output_, variable.name(), strlen(variable.name()));
+                output_ << ",\"value\":";
+                writeJson(output_, variable.value());
+                output_ << ",\"file\":";
+                writeJson(output_, variable.file(), strlen(variable.file()));
+                output_ << ",\"line\":" << variable.line() << '}';
+                first = false;
+            }
+
+            output_ << "]}\n";
+            ForwardingResults::fail(context, given, whenStack, move(description), expressionText, variableList);
+        }
+
+        virtual void failByException(const NameStack& context,
+                                     const string& given,
+                                     const NameStack& whenStack,
+                                     const exception& e) override {
+            writeLocation("exception", context, given);
+            output_ << ",\"whens\":";
+            writeNames(whenStack);
+            output_ << ",\"message\":";
+            writeJson(output_, e.what(), strlen(e.what()));
+            output_ << "}\n";
+            ForwardingResults::failByException(context, given, whenStack, e);
+        }
+
+        virtual void measured(const NameStack& context,
+                              const string& given,
+                              const NameStack& whenStack,
+                              const Measurement& measurement) override {
+            writeLocation("measurement", context, given);
+            output_ << ",\"whens\":";
+            writeNames(whenStack);
+            output_ << ",\"name\":";
+            writeJson(output_, measurement.name());
+            output_ << ",\"iterations\":" << measurement.iterations() << ",\"samples\":" <<
+                measurement.samples().size() << ",\"mean\":";
+            writeNanoseconds(output_, measurement.mean());
+            output_ << ",\"median\":";
+            writeNanoseconds(output_, measurement.median());
+            output_ << ",\"standardDeviation\":";
+            writeNanoseconds(output_, measurement.standardDeviation());
+            output_ << ",\"minimum\":";
+            writeNanoseconds(output_, measurement.minimum());
+            output_ << ",\"maximum\":";
+            writeNanoseconds(output_, measurement.maximum());
+            output_ << "}\n";
+            ForwardingResults::measured(context, given, whenStack, measurement);
+        }
+    };
+
+    // Write each benchmark measurement as a CSV row, with times in nanoseconds per iteration. The path is to the
+    // given or when it was measured in. A sweep has a row for each combination of arguments, with the arguments in
+    // the name, so this is its scaling table.
+    class MeasurementsResults final: public ForwardingResults {
+        OutputBuffer output_;
+    public:
+        MeasurementsResults(Out<Results> results, Out<ostream> output) : ForwardingResults(results), output_(output) {
+            output_ << "path,name,iterations,samples,mean,median,standard deviation,minimum,maximum\n";
+        }
+
+        virtual void finish(const Stats& stats) override {
+            output_.flush();
+            ForwardingResults::finish(stats);
+        }
+
+        virtual void measured(const NameStack& context,
+                              const string& given,
+                              const NameStack& whenStack,
+                              const Measurement& measurement) override {
+            writeCsv(output_, testIndex().pathName(whenStack.node()));
+            output_ << ',';
+            writeCsv(output_, measurement.name());
+            output_ << ',' << measurement.iterations() << ',' << measurement.samples().size() << ',';
+            writeNanoseconds(output_, measurement.mean());
+            output_ << ',';
+            writeNanoseconds(output_, measurement.median());
+            output_ << ',';
+            writeNanoseconds(output_, measurement.standardDeviation());
+            output_ << ',';
+            writeNanoseconds(output_, measurement.minimum());
+            output_ << ',';
+            writeNanoseconds(output_, measurement.maximum());
+            output_ << '\n';
+            ForwardingResults::measured(context, given, whenStack, measurement);
+        }
+    };
+}}}}
+
+namespace Enhedron { namespace Test {
+    using Impl::Impl_Reporters::JUnitResults;
+    using Impl::Impl_Reporters::JsonResults;
+    using Impl::Impl_Reporters::MeasurementsResults;
+}}
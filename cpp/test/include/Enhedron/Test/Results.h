@@ -9,12 +9,21 @@
 
 #include "Enhedron/Util.h"
 #include "Enhedron/Util/Optional.h"
+#include "Enhedron/Test/OutputBuffer.h"
+#include "Enhedron/Test/TestIndex.h"
+#include "Enhedron/Test/Measurement.h"
 
 #include <memory>
 #include <string>
 #include <stdexcept>
 #include <vector>
 #include <algorithm>
+#include <unordered_map>
+#include <sstream>
+#include <iomanip>
+#include <deque>
+#include <cstring>
+#include <cstdint>
 
 namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Results {
     using std::exception;
@@ -22,29 +31,66 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Results {
     using std::unique_ptr;
     using std::make_unique;
     using std::ostream;
-    using std::endl;
     using std::vector;
     using std::move;
     using std::min;
     using std::max;
+    using std::partial_sort;
+    using std::unordered_map;
+    using std::ostringstream;
+    using std::fixed;
+    using std::setprecision;
+    using std::deque;
+    using std::strlen;
+    using std::memcmp;
 
     using Assertion::FailureHandler;
     using Assertion::Variable;
     using Util::optional;
 
+    using Impl_OutputBuffer::OutputBuffer;
+    using Impl_TestIndex::NodeId;
+    using Impl_TestIndex::rootNode;
+    using Impl_TestIndex::testIndex;
+    using Impl_Measurement::Measurement;
+
     class Stats {
         uint64_t fixtures_ = 0;
         uint64_t tests_ = 0;
         uint64_t checks_ = 0;
         uint64_t failedTests_ = 0;
         uint64_t failedChecks_ = 0;
+        uint64_t wallTime_ = 0;
+        uint64_t cpuTime_ = 0;
     public:
+        Stats() = default;
+
+        Stats(
+                uint64_t fixtures,
+                uint64_t tests,
+                uint64_t checks,
+                uint64_t failedTests,
+                uint64_t failedChecks,
+                uint64_t wallTime = 0,
+                uint64_t cpuTime = 0
+            ) :
+            fixtures_(fixtures),
+            tests_(tests),
+            checks_(checks),
+            failedTests_(failedTests),
+            failedChecks_(failedChecks),
+            wallTime_(wallTime),
+            cpuTime_(cpuTime)
+        {}
+
         Stats& operator+=(Stats rhs) {
             fixtures_ += rhs.fixtures_;
             tests_ += rhs.tests_;
             checks_ += rhs.checks_;
             failedTests_ += rhs.failedTests_;
             failedChecks_ += rhs.failedChecks_;
+            wallTime_ += rhs.wallTime_;
+            cpuTime_ += rhs.cpuTime_;
             return *this;
         }
 
@@ -55,27 +101,220 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Results {
         void failTest() { ++failedTests_; }
         void failCheck() { ++failedChecks_; }
 
+        // Times are in nanoseconds. When stats are added together, so are the times, so a context's time is the
+        // total time spent running its givens, even if they ran at the same time on different threads.
+        void addTime(uint64_t wallTime, uint64_t cpuTime) {
+            wallTime_ += wallTime;
+            cpuTime_ += cpuTime;
+        }
+
         uint64_t fixtures() const { return fixtures_; }
         uint64_t tests() const { return tests_; }
         uint64_t checks() const { return checks_; }
         uint64_t failedTests() const { return failedTests_; }
         uint64_t failedChecks() const { return failedChecks_; }
+        uint64_t wallTime() const { return wallTime_; }
+        uint64_t cpuTime() const { return cpuTime_; }
+    };
+
+    // A name that belongs to someone else, so it can be looked up without copying it into a string.
+    class NameRef final {
+        const char* data_;
+        size_t size_;
+    public:
+        NameRef(const char* name) : data_(name), size_(strlen(name)) {}
+        NameRef(const string& name) : data_(name.data()), size_(name.size()) {}
+
+        const char* data() const { return data_; }
+        size_t size() const { return size_; }
+
+        string str() const { return string(data_, size_); }
+
+        bool operator==(const string& rhs) const {
+            return size_ == rhs.size() && memcmp(data_, rhs.data(), size_) == 0;
+        }
+    };
+
+    // Each distinct name is stored once, and given an id that stays the same for the life of the table. Looking up
+    // a name that's already there doesn't allocate. Ids are kept in an open addressing hash table, with linear
+    // probing.
+    class NameTable final: public NoCopy {
+        static constexpr const size_t initialSlots = 16;
+
+        deque<string> names_;
+
+        // Each slot is an id plus one, or 0 if it's empty. The size is a power of 2.
+        vector<size_t> slots_;
+
+        static size_t hash(NameRef name) {
+            // FNV-1a
+            uint64_t value = 14695981039346656037u;
+
+            for (size_t index = 0; index < name.size(); ++index) {
+                value ^= static_cast<unsigned char>(name.data()[index]);
+                value *= 1099511628211u;
+            }
+
+            return static_cast<size_t>(value);
+        }
+
+        size_t& findSlot(NameRef name) {
+            auto mask = slots_.size() - 1;
+
+            for (auto slot = hash(name) & mask; ; slot = (slot + 1) & mask) {
+                if (slots_[slot] == 0 || name == names_[slots_[slot] - 1]) {
+                    return slots_[slot];
+                }
+            }
+        }
+
+        // Keep the table at most half full.
+        void grow() {
+            vector<size_t> oldSlots(slots_.size() * 2, 0);
+            oldSlots.swap(slots_);
+
+            for (auto id : oldSlots) {
+                if (id != 0) {
+                    findSlot(names_[id - 1]) = id;
+                }
+            }
+        }
+    public:
+        NameTable() : slots_(initialSlots, 0) {}
+
+        size_t intern(NameRef name) {
+            auto& slot = findSlot(name);
+
+            if (slot != 0) {
+                return slot - 1;
+            }
+
+            names_.emplace_back(name.data(), name.size());
+            slot = names_.size();
+
+            if (names_.size() * 2 > slots_.size()) {
+                grow();
+            }
+
+            return names_.size() - 1;
+        }
+
+        const string& name(size_t id) const { return names_[id]; }
+
+        size_t size() const { return names_.size(); }
     };
 
-    // Wrapper, as we may add more functionality here. Such as tracking how much of the stack has
-    // been seen before.
+    // The names of the contexts or whens we're in, outermost first, with their nodes in the TestIndex. Names are
+    // interned in a table that belongs to the stack, so once a name has been seen, pushing and popping it doesn't
+    // allocate, and references to it stay valid after it's popped. Node ids are cached too, so they only need the
+    // TestIndex the first time a name is pushed onto a node.
+    //
+    // A context stack starts at rootNode. A when stack starts at its given's node. The caches aren't thread safe,
+    // so a stack must only be used by one thread at a time, as Results calls are.
     class NameStack final: public NoCopy {
-        vector<string> stack_;
+        mutable NameTable table_;
+        vector<size_t> stack_;
+        vector<NodeId> nodes_;
+        NodeId base_;
+
+        // Child node ids, by parent node id in the high half, and name id in the low half.
+        mutable unordered_map<uint64_t, NodeId> children_;
     public:
-        const vector<string>& stack() const { return stack_; }
+        // A view of the names on a stack.
+        class Names final {
+            const NameTable* table_;
+            const vector<size_t>* ids_;
+        public:
+            class Iterator final {
+                const NameTable* table_;
+                vector<size_t>::const_iterator id_;
+            public:
+                Iterator(const NameTable* table, vector<size_t>::const_iterator id) : table_(table), id_(id) {}
+
+                const string& operator*() const { return table_->name(*id_); }
+                const string* operator->() const { return &table_->name(*id_); }
+
+                Iterator& operator++() {
+                    ++id_;
+                    return *this;
+                }
+
+                Iterator operator+(size_t offset) const {
+                    return Iterator(table_, id_ + static_cast<vector<size_t>::difference_type>(offset));
+                }
+
+                bool operator==(const Iterator& rhs) const { return id_ == rhs.id_; }
+                bool operator!=(const Iterator& rhs) const { return id_ != rhs.id_; }
+            };
+
+            Names(const NameTable& table, const vector<size_t>& ids) : table_(&table), ids_(&ids) {}
 
-        void push(string name) {
-            stack_.emplace_back(move(name));
+            Iterator begin() const { return Iterator(table_, ids_->begin()); }
+            Iterator end() const { return Iterator(table_, ids_->end()); }
+
+            size_t size() const { return ids_->size(); }
+            bool empty() const { return ids_->empty(); }
+
+            const string& operator[](size_t index) const { return table_->name((*ids_)[index]); }
+            const string& front() const { return table_->name(ids_->front()); }
+            const string& back() const { return table_->name(ids_->back()); }
+        };
+
+        explicit NameStack(NodeId base = rootNode) : base_(base) {}
+
+        Names stack() const { return Names(table_, stack_); }
+
+        // The id of each name in the stack's table, outermost first. They're only meaningful for this stack.
+        const vector<size_t>& nameIds() const { return stack_; }
+
+        // The node of each name, outermost first.
+        const vector<NodeId>& nodes() const { return nodes_; }
+
+        // The node of the innermost name, or the base if the stack is empty.
+        NodeId node() const { return nodes_.empty() ? base_ : nodes_.back(); }
+
+        // Only while the stack is empty.
+        void setBase(NodeId base) {
+            Assert(VAR(stack_.empty()));
+            base_ = base;
+        }
+
+        // Intern a name without pushing it, for a reference that stays valid.
+        const string& intern(NameRef name) {
+            return table_.name(table_.intern(name));
+        }
+
+        // The node for name, if it were pushed.
+        NodeId child(NameRef name) const {
+            auto nameId = table_.intern(name);
+            auto key = (static_cast<uint64_t>(node()) << 32) | nameId;
+            auto found = children_.find(key);
+
+            if (found != children_.end()) {
+                return found->second;
+            }
+
+            auto childNode = testIndex().child(node(), table_.name(nameId));
+            children_.emplace(key, childNode);
+
+            return childNode;
+        }
+
+        void push(NameRef name) {
+            auto childNode = child(name);
+            stack_.push_back(table_.intern(name));
+            nodes_.push_back(childNode);
         }
 
         void pop() {
             Assert( ! VAR(stack_.empty()));
             stack_.pop_back();
+            nodes_.pop_back();
+        }
+
+        const string& top() const {
+            Assert( ! VAR(stack_.empty()));
+            return table_.name(stack_.back());
         }
     };
 
@@ -120,8 +359,30 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Results {
                                      const string& given,
                                      const NameStack& whenStack,
                                      const exception& e) = 0;
+
+        // A benchmark has been timed. Only Results that report timings need to do anything with it.
+        virtual void measured(const NameStack& context,
+                              const string& given,
+                              const NameStack& whenStack,
+                              const Measurement& measurement) {}
     };
 
+    // Nanoseconds, in whichever unit suits them best.
+    inline string formatNanoseconds(double nanoseconds) {
+        static constexpr const char* units[] = {"ns", "us", "ms", "s"};
+        size_t unit = 0;
+
+        while (unit < 3 && nanoseconds >= 1000) {
+            nanoseconds /= 1000;
+            ++unit;
+        }
+
+        ostringstream text;
+        text << fixed << setprecision(3) << nanoseconds << " " << units[unit];
+
+        return text.str();
+    }
+
     enum class Verbosity {
         SILENT,
         SUMMARY,
@@ -141,7 +402,7 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Results {
     };
 
     class HumanResults final: public Results {
-        Out<ostream> output_;
+        OutputBuffer output_;
         Verbosity verbosity_;
         WrittenState writtenState_ = WrittenState::NONE;
         size_t whenDepth_ = 0;
@@ -163,7 +424,7 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Results {
         void writeContext(const NameStack& contextStack) {
             if (writeNeeded(WrittenState::CONTEXT)) {
                 if ( ! contextStack.stack().empty()) {
-                    *output_ << contextStack.stack().front();
+                    output_ << contextStack.stack().front();
 
                     for (
                             auto contextIter = contextStack.stack().begin() + 1;
@@ -171,10 +432,10 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Results {
                             ++contextIter
                         )
                     {
-                        *output_ << "/" << *contextIter;
+                        output_ << "/" << *contextIter;
                     }
 
-                    *output_ << "\n";
+                    output_ << "\n";
                 }
             }
         }
@@ -184,7 +445,7 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Results {
 
             if (writeNeeded(WrittenState::GIVEN)) {
                 indent(1);
-                *output_ << "Given: " << given << "\n";
+                output_ << "Given: " << given << "\n";
             }
         }
 
@@ -192,17 +453,16 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Results {
             writeGiven(context, given);
 
             size_t depth = whenWrittenDepth_;
-            auto startIndex = static_cast<vector<string>::difference_type>(whenWrittenDepth_);
 
             for (
-                    auto whenIter = when.stack().begin() + startIndex;
+                    auto whenIter = when.stack().begin() + whenWrittenDepth_;
                     whenIter != when.stack().end();
                     ++whenIter
                 )
             {
                 ++depth;
                 indent(depth);
-                *output_ << "When : " << *whenIter << "\n";
+                output_ << "When : " << *whenIter << "\n";
             }
 
             whenWrittenDepth_ = when.stack().size();
@@ -211,16 +471,13 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Results {
         void printVariables(const vector <Variable> &variableList) {
             for (const auto& variable : variableList) {
                 indent(whenDepth() + 2);
-                (*output_) << variable.name() << " = " << variable.value()
-                           << ": file \"" << variable.file() << "\", line " << variable.line() << ".\n";
+                output_ << variable.name() << " = " << variable.value()
+                        << ": file \"" << variable.file() << "\", line " << variable.line() << ".\n";
             }
         }
 
         void indent(size_t indent) {
-            while (indent > 0) {
-                *output_ << "    ";
-                --indent;
-            }
+            output_.indent(indent);
         }
 
         size_t whenDepth() const {
@@ -238,24 +495,26 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Results {
                 bool failed = false;
 
                 if (stats.failedTests() > 0) {
-                    *output_ << "FAILED TESTS: " << stats.failedTests() << "\n";
+                    output_ << "FAILED TESTS: " << stats.failedTests() << "\n";
                     failed = true;
                 }
 
                 if (stats.failedChecks() > 0) {
-                    *output_ << "FAILED CHECKS: " << stats.failedChecks() << "\n";
+                    output_ << "FAILED CHECKS: " << stats.failedChecks() << "\n";
                     failed = true;
                 }
 
-                *output_ << "Totals: " <<
+                output_ << "Totals: " <<
                 stats.tests() << " tests, " <<
                 stats.checks() << " checks, " <<
                 stats.fixtures() << " fixtures\n";
 
                 if (failed) {
-                    *output_ << "SOME TESTS FAILED!\n";
+                    output_ << "SOME TESTS FAILED!\n";
                 }
             }
+
+            output_.flush();
         }
 
         virtual void beginContext(const NameStack& contextStack, const string& name) override {
@@ -288,9 +547,13 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Results {
                                const string& when) override {
             ++whenDepth_;
 
+            if (verbosity_ >= Verbosity::FIXTURES) {
+                writeGiven(context, given);
+            }
+
             if (verbosity_ >= Verbosity::SECTIONS) {
                 indent(whenDepth());
-                *output_ << "When : " << when << "\n";
+                output_ << "When : " << when << "\n";
                 whenWrittenDepth_ = whenDepth_;
             }
         }
@@ -304,10 +567,15 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Results {
             whenWrittenDepth_ = min(whenDepth_, whenWrittenDepth_);
 
             if (whenDepth_ == 0 && verbosity_ >= Verbosity::CHECKS) {
-                *output_ << "\n";
+                output_ << "\n";
             }
 
-            setMaxWrittenState(WrittenState::GIVEN);
+            if (whenDepth_ == 0) {
+                setMaxWrittenState(WrittenState::CONTEXT);
+            }
+            else {
+                setMaxWrittenState(WrittenState::GIVEN);
+            }
         }
 
         virtual bool notifyPassing() const override { return verbosity_ >= Verbosity::CHECKS; }
@@ -321,15 +589,16 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Results {
         {
             writeWhenStack(context, given, whenStack);
             indent(whenDepth());
-            (*output_) << "Then : ";
+            output_ << "Then : ";
 
             if (description) {
-                *output_ << *description << "\n";
+                output_ << *description << "\n";
                 indent(whenDepth() + 1);
             }
 
-            *output_ << "FAILED! " << expressionText << "\n";
+            output_ << "FAILED! " << expressionText << "\n";
             printVariables(variableList);
+            output_.flush();
         }
 
         virtual void pass(const NameStack& context,
@@ -340,10 +609,10 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Results {
                           const vector <Variable> &variableList) override
         {
             indent(whenDepth());
-            (*output_) << "Then : ";
+            output_ << "Then : ";
 
             if (description) {
-                (*output_) << *description << "\n";
+                output_ << *description << "\n";
             }
 
             if (verbosity_ >= Verbosity::CHECKS_EXPRESSION || ! description) {
@@ -351,10 +620,10 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Results {
                     indent(whenDepth() + 1);
                 }
 
-                (*output_) << expressionText;
+                output_ << expressionText;
             }
 
-            (*output_) << "\n";
+            output_ << "\n";
 
             if (verbosity_ >= Verbosity::VARIABLES) {
                 printVariables(variableList);
@@ -366,15 +635,222 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Results {
                                      const NameStack& whenStack,
                                      const exception& e) override {
             indent(whenDepth());
-            (*output_) << "TEST FAILED WITH EXCEPTION: " << e.what() << endl;
+            output_ << "TEST FAILED WITH EXCEPTION: " << e.what() << "\n";
+            output_.flush();
+        }
+
+        virtual void measured(const NameStack& context,
+                              const string& given,
+                              const NameStack& whenStack,
+                              const Measurement& measurement) override
+        {
+            if (verbosity_ < Verbosity::SUMMARY) return;
+
+            writeWhenStack(context, given, whenStack);
+            indent(whenDepth());
+            output_ << "Measured: " << measurement.name() << ": mean " << formatNanoseconds(measurement.mean()) <<
+                ", median " << formatNanoseconds(measurement.median()) << ", standard deviation " <<
+                formatNanoseconds(measurement.standardDeviation()) << " (" << measurement.samples().size() <<
+                " samples of " << measurement.iterations() << " iterations)\n";
+        }
+    };
+
+    inline string formatMilliseconds(uint64_t nanoseconds) {
+        ostringstream text;
+        text << fixed << setprecision(3) << static_cast<double>(nanoseconds) / 1e6 << " ms";
+
+        return text.str();
+    }
+
+    // The name of a given, with its contexts, as used in test paths.
+    inline string givenPath(const NameStack& context, const string& given) {
+        string path;
+
+        for (const auto& contextName : context.stack()) {
+            path += contextName + "/";
+        }
+
+        return path + given;
+    }
+
+    // The node of a given, as used to key results by given.
+    inline NodeId givenNode(const NameStack& context, const string& given) {
+        return context.child(given);
+    }
+
+    // The node of a when, from the stack of whens around it, as passed to beginWhen and endWhen.
+    inline NodeId whenNode(const NameStack& whenStack, const string& when) {
+        return whenStack.child(when);
+    }
+
+    // Pass everything on to another Results object. Derived classes override the calls they're interested in.
+    class ForwardingResults: public Results {
+        Out<Results> results_;
+    public:
+        explicit ForwardingResults(Out<Results> results) : results_(results) {}
+
+        virtual void finish(const Stats& stats) override {
+            results_->finish(stats);
+        }
+
+        virtual void beginContext(const NameStack& contextStack, const string& name) override {
+            results_->beginContext(contextStack, name);
+        }
+
+        virtual void endContext(const Stats& stats, const NameStack& context, const string& name) override {
+            results_->endContext(stats, context, name);
+        }
+
+        virtual void beginGiven(const NameStack& context, const string& given) override {
+            results_->beginGiven(context, given);
+        }
+
+        virtual void endGiven(const Stats& stats, const NameStack& context, const string& given) override {
+            results_->endGiven(stats, context, given);
+        }
+
+        virtual void beginWhen(const NameStack& context,
+                               const string& given,
+                               const NameStack& whenStack,
+                               const string& when) override {
+            results_->beginWhen(context, given, whenStack, when);
+        }
+
+        virtual void endWhen(const Stats& stats,
+                             const NameStack& context,
+                             const string& given,
+                             const NameStack& whenStack,
+                             const string& when) override {
+            results_->endWhen(stats, context, given, whenStack, when);
+        }
+
+        virtual bool notifyPassing() const override { return results_->notifyPassing(); }
+
+        virtual void fail(const NameStack& context,
+                          const string& given,
+                          const NameStack& whenStack,
+                          optional<string> description,
+                          const string &expressionText,
+                          const vector <Variable> &variableList) override
+        {
+            results_->fail(context, given, whenStack, move(description), expressionText, variableList);
+        }
+
+        virtual void pass(const NameStack& context,
+                          const string& given,
+                          const NameStack& whenStack,
+                          optional <string> description,
+                          const string &expressionText,
+                          const vector <Variable> &variableList) override
+        {
+            results_->pass(context, given, whenStack, move(description), expressionText, variableList);
+        }
+
+        virtual void failByException(const NameStack& context,
+                                     const string& given,
+                                     const NameStack& whenStack,
+                                     const exception& e) override {
+            results_->failByException(context, given, whenStack, e);
+        }
+
+        virtual void measured(const NameStack& context,
+                              const string& given,
+                              const NameStack& whenStack,
+                              const Measurement& measurement) override {
+            results_->measured(context, given, whenStack, measurement);
+        }
+    };
+
+    // Keep the time taken by each given and when. Once the run has finished, write the slowest ones out, with their
+    // share of the total time. A when that runs once for each of its nested whens is reported once, with the times
+    // added up.
+    class SlowestResults final: public ForwardingResults {
+        struct Timing {
+            NodeId node;
+            uint64_t wallTime;
+            uint64_t cpuTime;
+        };
+
+        Out<ostream> output_;
+        size_t count_;
+        vector<Timing> timingList_;
+        unordered_map<NodeId, size_t> timingIndex_;
+
+        static string percentage(uint64_t part, uint64_t total) {
+            ostringstream text;
+            text << fixed << setprecision(1) << (total == 0 ? 0.0 : 100.0 * part / total) << "%";
+
+            return text.str();
+        }
+
+        void add(NodeId node, const Stats& stats) {
+            auto inserted = timingIndex_.emplace(node, timingList_.size());
+
+            if (inserted.second) {
+                timingList_.push_back(Timing{node, stats.wallTime(), stats.cpuTime()});
+            }
+            else {
+                auto& timing = timingList_[inserted.first->second];
+                timing.wallTime += stats.wallTime();
+                timing.cpuTime += stats.cpuTime();
+            }
+        }
+    public:
+        SlowestResults(Out<Results> results, Out<ostream> output, size_t count) :
+            ForwardingResults(results), output_(output), count_(count)
+        {}
+
+        virtual void finish(const Stats& stats) override {
+            ForwardingResults::finish(stats);
+
+            auto slowestCount = min(count_, timingList_.size());
+
+            partial_sort(
+                    timingList_.begin(),
+                    timingList_.begin() + static_cast<vector<Timing>::difference_type>(slowestCount),
+                    timingList_.end(),
+                    [] (const Timing& lhs, const Timing& rhs) { return lhs.wallTime > rhs.wallTime; }
+                );
+
+            *output_ << "Slowest " << slowestCount << " of " << timingList_.size() << " givens and whens, out of " <<
+                formatMilliseconds(stats.wallTime()) << " wall time and " << formatMilliseconds(stats.cpuTime()) << " CPU time:\n";
+
+            for (size_t index = 0; index < slowestCount; ++index) {
+                const auto& timing = timingList_[index];
+
+                *output_ << "    " << formatMilliseconds(timing.wallTime) << " wall (" <<
+                    percentage(timing.wallTime, stats.wallTime()) << "), " << formatMilliseconds(timing.cpuTime) <<
+                    " CPU (" << percentage(timing.cpuTime, stats.cpuTime()) << "): " << testIndex().pathName(timing.node) <<
+                    "\n";
+            }
+        }
+
+        virtual void endGiven(const Stats& stats, const NameStack& context, const string& given) override {
+            add(givenNode(context, given), stats);
+            ForwardingResults::endGiven(stats, context, given);
+        }
+
+        virtual void endWhen(const Stats& stats,
+                             const NameStack& context,
+                             const string& given,
+                             const NameStack& whenStack,
+                             const string& when) override {
+            add(whenNode(whenStack, when), stats);
+            ForwardingResults::endWhen(stats, context, given, whenStack, when);
         }
     };
 }}}}
 
 namespace Enhedron { namespace Test {
     using Impl::Impl_Results::NameStack;
+    using Impl::Impl_Results::NameRef;
+    using Impl::Impl_Results::givenNode;
+    using Impl::Impl_Results::whenNode;
     using Impl::Impl_Results::Results;
     using Impl::Impl_Results::HumanResults;
+    using Impl::Impl_Results::ForwardingResults;
+    using Impl::Impl_Results::SlowestResults;
+    using Impl::Impl_Results::formatNanoseconds;
     using Impl::Impl_Results::Stats;
     using Impl::Impl_Results::Verbosity;
 }}
@@ -0,0 +1,248 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include "Enhedron/Util.h"
+#include "Enhedron/Test/Measurement.h"
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <map>
+#include <limits>
+#include <stdexcept>
+#include <cmath>
+#include <cstddef>
+
+namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Scaling {
+    using std::string;
+    using std::vector;
+    using std::pair;
+    using std::move;
+    using std::map;
+    using std::numeric_limits;
+    using std::runtime_error;
+    using std::to_string;
+    using std::log;
+    using std::log2;
+    using std::sqrt;
+    using std::isnan;
+
+    using Impl_Measurement::Measurement;
+
+    // In order of how quickly they grow.
+    enum class Complexity {
+        CONSTANT,
+        LOGARITHMIC,
+        LINEAR,
+        N_LOG_N,
+        QUADRATIC
+    };
+
+    inline const char* complexityName(Complexity complexity) {
+        switch (complexity) {
+            case Complexity::CONSTANT: return "O(1)";
+            case Complexity::LOGARITHMIC: return "O(log n)";
+            case Complexity::LINEAR: return "O(n)";
+            case Complexity::N_LOG_N: return "O(n log n)";
+            case Complexity::QUADRATIC: return "O(n^2)";
+        }
+
+        return "unknown";
+    }
+
+    // exponent is the slope of log(time) against log(n), so about 1 for O(n), 2 for O(n^2), and a bit over 1 for
+    // O(n log n). complexity is the curve, scaled to fit, with the least root mean square error. error is relative
+    // to the mean time.
+    struct ComplexityFit final {
+        Complexity complexity = Complexity::CONSTANT;
+        double exponent = 0;
+        double error = 0;
+    };
+
+    // Fit times against n, for each (n, time). There must be at least 2 different values of n, all positive.
+    inline ComplexityFit fitComplexity(const vector<pair<double, double>>& points) {
+        static constexpr const Complexity complexityList[] = {
+            Complexity::CONSTANT,
+            Complexity::LOGARITHMIC,
+            Complexity::LINEAR,
+            Complexity::N_LOG_N,
+            Complexity::QUADRATIC
+        };
+
+        double minimumN = numeric_limits<double>::infinity();
+        double maximumN = 0;
+        double meanTime = 0;
+
+        for (const auto& point : points) {
+            if ( ! (point.first > 0)) {
+                throw runtime_error("Complexity can only be fitted to positive values of n");
+            }
+
+            minimumN = point.first < minimumN ? point.first : minimumN;
+            maximumN = point.first > maximumN ? point.first : maximumN;
+            meanTime += point.second;
+        }
+
+        if (points.empty() || minimumN == maximumN) {
+            throw runtime_error("Complexity can only be fitted to at least 2 different values of n");
+        }
+
+        meanTime /= points.size();
+
+        // Least squares, for log(time) = exponent * log(n) + constant.
+        double meanLogN = 0;
+        double meanLogTime = 0;
+
+        for (const auto& point : points) {
+            meanLogN += log(point.first);
+            meanLogTime += log(point.second > 0 ? point.second : numeric_limits<double>::min());
+        }
+
+        meanLogN /= points.size();
+        meanLogTime /= points.size();
+        double covariance = 0;
+        double variance = 0;
+
+        for (const auto& point : points) {
+            auto logN = log(point.first) - meanLogN;
+            covariance += logN * (log(point.second > 0 ? point.second : numeric_limits<double>::min()) - meanLogTime);
+            variance += logN * logN;
+        }
+
+        ComplexityFit fit;
+        fit.exponent = covariance / variance;
+        fit.error = numeric_limits<double>::infinity();
+
+        for (auto complexity : complexityList) {
+            auto curve = [complexity] (double n) {
+                switch (complexity) {
+                    case Complexity::CONSTANT: return 1.0;
+                    case Complexity::LOGARITHMIC: return log2(n);
+                    case Complexity::LINEAR: return n;
+                    case Complexity::N_LOG_N: return n * log2(n);
+                    case Complexity::QUADRATIC: return n * n;
+                }
+
+                return 1.0;
+            };
+
+            // Least squares, for time = scale * curve(n).
+            double product = 0;
+            double curveSquared = 0;
+
+            for (const auto& point : points) {
+                product += point.second * curve(point.first);
+                curveSquared += curve(point.first) * curve(point.first);
+            }
+
+            if (curveSquared == 0) {
+                continue;
+            }
+
+            auto scale = product / curveSquared;
+            double squaredError = 0;
+
+            for (const auto& point : points) {
+                auto difference = point.second - scale * curve(point.first);
+                squaredError += difference * difference;
+            }
+
+            auto error = sqrt(squaredError / points.size()) / (meanTime > 0 ? meanTime : 1);
+
+            // Only pick a faster growing curve if it's a better fit.
+            if (error < fit.error) {
+                fit.complexity = complexity;
+                fit.error = error;
+            }
+        }
+
+        return fit;
+    }
+
+    // A measurement from one combination of a sweep's arguments. name is the name it was measured with, without
+    // the arguments. numbers has the value of each numeric argument, or NaN if it isn't numeric.
+    struct SweepRow final {
+        vector<string> arguments;
+        vector<double> numbers;
+        string name;
+        Measurement measurement;
+    };
+
+    // Every measurement from a sweep, in the order they were taken.
+    class Sweep final: public NoCopy {
+        string name_;
+        vector<SweepRow> rows_;
+        vector<string> arguments_;
+        vector<double> numbers_;
+    public:
+        explicit Sweep(string name) : name_(move(name)) {}
+
+        const string& name() const { return name_; }
+
+        const vector<SweepRow>& rows() const { return rows_; }
+
+        // The arguments for the measurements that follow.
+        void setArguments(vector<string> arguments, vector<double> numbers) {
+            arguments_ = move(arguments);
+            numbers_ = move(numbers);
+        }
+
+        void add(string name, Measurement measurement) {
+            rows_.push_back(SweepRow{arguments_, numbers_, move(name), move(measurement)});
+        }
+
+        // Fit the median time of the measurements called name against the numeric argument at index axis. Each
+        // combination of the other arguments is fitted separately, and the fit with the largest exponent is
+        // returned, so a slow case can't hide behind fast ones.
+        ComplexityFit fit(size_t axis, const string& name) const {
+            map<vector<string>, vector<pair<double, double>>> groups;
+
+            for (const auto& row : rows_) {
+                if (row.name != name) continue;
+
+                if (axis >= row.numbers.size() || isnan(row.numbers[axis])) {
+                    throw runtime_error("Argument " + to_string(axis) + " of " + name_ + " isn't a number");
+                }
+
+                auto others = row.arguments;
+                others.erase(others.begin() + axis);
+                groups[others].emplace_back(row.numbers[axis], row.measurement.median());
+            }
+
+            if (groups.empty()) {
+                throw runtime_error("There are no measurements called \"" + name + "\" in " + name_);
+            }
+
+            ComplexityFit worst;
+            worst.exponent = -numeric_limits<double>::infinity();
+
+            for (const auto& group : groups) {
+                auto fit = fitComplexity(group.second);
+
+                if (fit.exponent > worst.exponent) {
+                    worst = fit;
+                }
+            }
+
+            return worst;
+        }
+
+        // Measurements named after the sweep.
+        ComplexityFit fit(size_t axis) const {
+            return fit(axis, name_);
+        }
+    };
+}}}}
+
+namespace Enhedron { namespace Test {
+    using Impl::Impl_Scaling::Complexity;
+    using Impl::Impl_Scaling::complexityName;
+    using Impl::Impl_Scaling::ComplexityFit;
+    using Impl::Impl_Scaling::Sweep;
+}}
@@ -0,0 +1,169 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include "Enhedron/Util.h"
+#include "Enhedron/Test/Results.h"
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <numeric>
+#include <unordered_map>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <cstdint>
+
+namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Shard {
+    using std::string;
+    using std::vector;
+    using std::pair;
+    using std::move;
+    using std::sort;
+    using std::iota;
+    using std::min_element;
+    using std::unordered_map;
+    using std::istream;
+    using std::ostream;
+    using std::getline;
+    using std::runtime_error;
+    using std::stoull;
+    using std::to_string;
+    using std::exception;
+
+    using namespace Impl_Results;
+
+    // Wall time in nanoseconds for each given, keyed by givenPath.
+    using Timings = unordered_map<string, uint64_t>;
+
+    // One line per given, with the time, a space, then the path.
+    inline Timings readTimings(Out<istream> input) {
+        Timings timings;
+        string line;
+        size_t lineNumber = 0;
+
+        while (getline(*input, line)) {
+            ++lineNumber;
+
+            if (line.empty()) {
+                continue;
+            }
+
+            auto separator = line.find(' ');
+
+            try {
+                if (separator == string::npos) {
+                    throw runtime_error("No path");
+                }
+
+                size_t end = 0;
+                auto time = stoull(line.substr(0, separator), &end);
+
+                if (end != separator) {
+                    throw runtime_error("Invalid time");
+                }
+
+                timings[line.substr(separator + 1)] += time;
+            }
+            catch (const exception&) {
+                throw runtime_error("Invalid timings on line " + to_string(lineNumber) + ": \"" + line + "\"");
+            }
+        }
+
+        return timings;
+    }
+
+    inline void writeTimings(Out<ostream> output, const vector<pair<string, uint64_t>>& timingList) {
+        for (const auto& timing : timingList) {
+            *output << timing.second << " " << timing.first << "\n";
+        }
+    }
+
+    // Assign each given to a shard. givenPathList is in tree order, so the result only depends on the tree, the
+    // shard count and the timings. Without timings, givens are dealt out in turn. With timings, the slowest given
+    // goes to the least loaded shard, and so on. Givens without a timing are assumed to take the mean time.
+    inline vector<size_t> assignShards(const vector<string>& givenPathList, size_t shardCount, const Timings& timings) {
+        vector<size_t> shardList(givenPathList.size());
+
+        if (timings.empty()) {
+            for (size_t index = 0; index < givenPathList.size(); ++index) {
+                shardList[index] = index % shardCount;
+            }
+
+            return shardList;
+        }
+
+        vector<uint64_t> timeList;
+        uint64_t knownTotal = 0;
+        uint64_t knownCount = 0;
+
+        for (const auto& path : givenPathList) {
+            auto timing = timings.find(path);
+
+            if (timing != timings.end()) {
+                knownTotal += timing->second;
+                ++knownCount;
+            }
+        }
+
+        auto defaultTime = knownCount == 0 ? 1 : knownTotal / knownCount;
+
+        for (const auto& path : givenPathList) {
+            auto timing = timings.find(path);
+            timeList.push_back(timing == timings.end() ? defaultTime : timing->second);
+        }
+
+        vector<size_t> order(givenPathList.size());
+        iota(order.begin(), order.end(), 0);
+
+        sort(order.begin(), order.end(), [&] (size_t lhs, size_t rhs) {
+            return timeList[lhs] > timeList[rhs] || (timeList[lhs] == timeList[rhs] && lhs < rhs);
+        });
+
+        vector<uint64_t> load(shardCount, 0);
+
+        for (auto index : order) {
+            auto shard = static_cast<size_t>(min_element(load.begin(), load.end()) - load.begin());
+            shardList[index] = shard;
+            load[shard] += timeList[index];
+        }
+
+        return shardList;
+    }
+
+    // Record the wall time of each given, and write them out when the run finishes, for readTimings.
+    class TimingsResults final: public ForwardingResults {
+        Out<ostream> output_;
+        vector<pair<NodeId, uint64_t>> timingList_;
+    public:
+        TimingsResults(Out<Results> results, Out<ostream> output) : ForwardingResults(results), output_(output) {}
+
+        virtual void finish(const Stats& stats) override {
+            ForwardingResults::finish(stats);
+            vector<pair<string, uint64_t>> timingList;
+            timingList.reserve(timingList_.size());
+
+            for (const auto& timing : timingList_) {
+                timingList.emplace_back(testIndex().pathName(timing.first), timing.second);
+            }
+
+            writeTimings(output_, timingList);
+        }
+
+        virtual void endGiven(const Stats& stats, const NameStack& context, const string& given) override {
+            timingList_.emplace_back(givenNode(context, given), stats.wallTime());
+            ForwardingResults::endGiven(stats, context, given);
+        }
+    };
+}}}}
+
+namespace Enhedron { namespace Test {
+    using Impl::Impl_Shard::TimingsResults;
+}}
@@ -13,8 +13,18 @@
 #include "Enhedron/Assertion/Configurable.h"
 #include "Enhedron/Assertion.h"
 #include "Enhedron/Test/Results.h"
+#include "Enhedron/Test/Events.h"
+#include "Enhedron/Test/Parallel.h"
+#include "Enhedron/Test/Process.h"
+#include "Enhedron/Test/PathFilter.h"
+#include "Enhedron/Test/Shard.h"
+#include "Enhedron/Test/Channel.h"
+#include "Enhedron/Test/Benchmark.h"
+#include "Enhedron/Test/Baseline.h"
+#include "Enhedron/Test/Scaling.h"
 
 #include "Enhedron/Util/Optional.h"
+#include "Enhedron/Util/Timer.h"
 
 #include <functional>
 #include <algorithm>
@@ -25,7 +35,13 @@
 #include <stdexcept>
 #include <tuple>
 #include <iostream>
-#include <regex>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <deque>
+#include <unordered_map>
+#include <type_traits>
+#include <limits>
 
 namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Suite {
     using namespace Assertion;
@@ -37,6 +53,8 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Suite {
 
     using Util::optional;
     using Util::none;
+    using Util::Timer;
+    using Util::threadCpuNanoseconds;
 
     using std::forward;
     using std::vector;
@@ -52,33 +70,155 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Suite {
     using std::index_sequence_for;
     using std::get;
     using std::remove_reference;
+    using std::remove_reference_t;
+    using std::declval;
+    using std::begin;
     using std::bind;
     using std::ref;
     using std::runtime_error;
     using std::cout;
-    using std::regex;
-    using std::regex_match;
     using std::reference_wrapper;
     using std::min;
+    using std::max;
+    using std::atomic;
+    using std::exception_ptr;
+    using std::current_exception;
+    using std::rethrow_exception;
+    using std::memory_order_acquire;
+    using std::memory_order_release;
+    using std::pair;
+    using std::ostream;
+    using std::mutex;
+    using std::lock_guard;
+    using std::sort;
+    using std::deque;
+    using std::unordered_map;
+    using std::is_arithmetic;
+    using std::decay_t;
+    using std::enable_if_t;
+    using std::numeric_limits;
+
+    using Impl_Events::Event;
+    using Impl_Events::EventRecorder;
+    using Impl_Events::EventReplayer;
+    using Impl_Events::EventType;
+    using Impl_Events::EventWriter;
+    using Impl_Events::EventReader;
+    using Impl_Parallel::TaskPool;
+    using Impl_Process::ProcessId;
+    using Impl_Process::Pipe;
+    using Impl_Process::forkProcess;
+    using Impl_Process::exitProcess;
+    using Impl_Process::waitForProcess;
+    using Impl_Process::writeAll;
+    using Impl_Process::readAll;
+    using Impl_Process::closeFilesExcept;
+
+    using Impl_PathFilter::PathFilter;
+    using Impl_Shard::Timings;
+    using Impl_Results::givenPath;
+    using Impl_Results::formatMilliseconds;
+    using Impl_Results::NameRef;
+    using Impl_Results::Measurement;
+    using Impl_Benchmark::BenchmarkOptions;
+    using Impl_Baseline::Baselines;
+    using Impl_Baseline::baselineKey;
+    using Impl_Baseline::compareToBaseline;
+    using Impl_Results::formatNanoseconds;
+    using Impl_Scaling::Sweep;
+    using Impl_Results::givenNode;
+    using Impl_TestIndex::NodeId;
+    using Impl_TestIndex::rootNode;
+    using Impl_TestIndex::testIndex;
+    using Impl_Shard::assignShards;
+    using Impl_Channel::Channel;
+    using Impl_Channel::makeChannelPair;
+    using Impl_Channel::waitForChannels;
+
+    // How Register::run runs givens.
+    struct RunOptions final {
+        // Run givens on this many threads.
+        size_t jobs = 1;
+
+        // Run each given in a child process, which forks again at each when. See ForkedWhens.
+        bool forkWhens = false;
+
+        // When running on a pool, run the paths through the whens of each given as separate tasks. See
+        // WhenRunner::runParallel.
+        bool parallelWhens = false;
+
+        // Split the selected givens into shardCount shards, and only run the ones in shardIndex. See assignShards.
+        size_t shardIndex = 0;
+        size_t shardCount = 1;
+
+        // Used to balance the shards, if there are any.
+        shared_ptr<const Timings> timings;
+
+        // Run givens in this many worker processes. See WorkerPool.
+        size_t workers = 0;
+
+        // Run each given in its own process, forked from a worker. Implies at least one worker.
+        bool isolate = false;
+
+        // How benchmarks are calibrated and sampled.
+        BenchmarkOptions benchmark;
+
+        // Each benchmark measurement with a baseline is checked against it. See Bench::measure.
+        shared_ptr<const Baselines> baselines;
+    };
 
-    using PathList = vector<shared_ptr<vector<regex>>>;
+    class WorkerPool;
 
     class ContextResultsRecorder final : public NoCopy {
         Out<Results> results_;
         NameStack contextStack_;
+        optional<TaskPool&> pool_;
+        RunOptions options_;
+        optional<WorkerPool&> workers_;
     public:
-        ContextResultsRecorder(Out<Results> results) : results_(results) {
+        ContextResultsRecorder(
+                Out<Results> results,
+                optional<TaskPool&> pool = none,
+                RunOptions options = RunOptions(),
+                optional<WorkerPool&> workers = none
+            ) :
+            results_(results), pool_(pool), options_(options), workers_(workers)
+        {
         }
 
         const NameStack& contextStack() const { return contextStack_; }
 
-        void push(string name) {
+        // Record results from inside a context, without reporting that we've entered it. Recorded results are
+        // replayed by name, so this only gives the recorded node ids the same meaning they'll have when replayed.
+        void setContextNode(NodeId node) { contextStack_.setBase(node); }
+
+        // The pool to run tasks on, if we're running in parallel.
+        optional<TaskPool&> pool() const { return pool_; }
+
+        // The worker processes to run givens in, if there are any.
+        optional<WorkerPool&> workers() const { return workers_; }
+
+        const RunOptions& options() const { return options_; }
+
+        // Replay events recorded on another thread, as if they happened in the current context.
+        void replay(const vector<Event>& eventList) {
+            EventReplayer replayer(results_, contextStack_);
+            replayer(eventList);
+        }
+
+        // Replay events recorded inside a given in another process.
+        void replay(const vector<Event>& eventList, const string& given) {
+            EventReplayer replayer(results_, contextStack_, given);
+            replayer(eventList);
+        }
+
+        void push(const string& name) {
             results_->beginContext(contextStack_, name);
-            contextStack_.push(move(name));
+            contextStack_.push(name);
         }
 
         void pop(const Stats& stats) {
-            auto name = contextStack_.stack().back();
+            const auto& name = contextStack_.top();
             results_->endContext(stats, contextStack_, name);
             contextStack_.pop();
         }
@@ -115,23 +255,36 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Suite {
                           const vector <Variable> &variableList) {
             return results_->pass(contextStack_, given, whenStack, description, expressionText, variableList);
         }
+
+        void measured(const string& given, const NameStack& whenStack, const Measurement& measurement) {
+            results_->measured(contextStack_, given, whenStack, measurement);
+        }
     };
 
     class WhenResultRecorder final: public FailureHandler {
         Out<ContextResultsRecorder> results_;
         string given_;
         NameStack whenStack_;
+
+        // Cached, so a passing check costs at most one indirect call when passes aren't reported.
+        bool notifyPassing_;
     public:
         WhenResultRecorder(Out<ContextResultsRecorder> results, string given) :
-                results_(results), given_(move(given)) {}
+                results_(results),
+                given_(move(given)),
+                whenStack_(givenNode(results->contextStack(), given_)),
+                notifyPassing_(results->notifyPassing())
+        {}
 
-        void push(string name) {
-            results_->beginWhen(given_, whenStack_, name);
-            whenStack_.push(move(name));
+        void push(NameRef name) {
+            const auto& interned = whenStack_.intern(name);
+            results_->beginWhen(given_, whenStack_, interned);
+            whenStack_.push(interned);
         }
 
+        // The name stays valid after it's popped, as it's interned.
         void pop(const Stats& stats) {
-            string name = whenStack_.stack().back();
+            const auto& name = whenStack_.top();
             whenStack_.pop();
             results_->endWhen(stats, given_, whenStack_, name);
         }
@@ -140,7 +293,21 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Suite {
             results_->failByException(given_, whenStack_, e);
         }
 
-        virtual bool notifyPassing() const override { return results_->notifyPassing(); }
+        const string& given() const { return given_; }
+
+        const NameStack& whenStack() const { return whenStack_; }
+
+        NodeId contextNode() const { return results_->contextStack().node(); }
+
+        const RunOptions& options() const { return results_->options(); }
+
+        optional<TaskPool&> pool() const { return results_->pool(); }
+
+        void replay(const vector<Event>& eventList) {
+            results_->replay(eventList, given_);
+        }
+
+        virtual bool notifyPassing() const override { return notifyPassing_; }
 
         virtual void fail(optional<string> description, const string &expressionText, const vector <Variable> &variableList) override {
             return results_->fail(given_, whenStack_, description, expressionText, variableList);
@@ -150,39 +317,580 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Suite {
             return results_->pass(given_, whenStack_, description, expressionText, variableList);
         }
 
+        void measured(const Measurement& measurement) {
+            results_->measured(given_, whenStack_, measurement);
+        }
+    };
+
+    // Work running on another thread. Its results are recorded, so they can be replayed in order once it's done.
+    class RecordedTask final: public NoCopy {
+        EventRecorder events_;
+        RunOptions options_;
+        Stats stats_;
+        exception_ptr error_;
+        atomic<bool> done_{false};
+    public:
+        RecordedTask(bool notifyPassing, const RunOptions& options) : events_(notifyPassing), options_(options) {}
+
+        // Functor takes an Out<ContextResultsRecorder> and returns the Stats. It runs inside contextNode.
+        template<typename Functor>
+        void run(Out<TaskPool> pool, NodeId contextNode, Functor&& functor) {
+            try {
+                ContextResultsRecorder results(out(events_), *pool, options_);
+                results.setContextNode(contextNode);
+                stats_ = functor(out(results));
+            }
+            catch (...) {
+                error_ = current_exception();
+            }
+
+            done_.store(true, memory_order_release);
+        }
+
+        // Wait for the task, helping with other tasks in the meantime, then replay its results.
+        Stats replay(Out<ContextResultsRecorder> results, Out<TaskPool> pool) {
+            pool->helpUntil([this] { return done_.load(memory_order_acquire); });
+
+            if (error_) {
+                rethrow_exception(error_);
+            }
+
+            results->replay(events_.events());
+            events_.clear();
+
+            return stats_;
+        }
     };
 
+    class Schedule;
+
     class Context: public NoCopy {
+        bool selected_ = true;
+        size_t shard_ = 0;
+        NodeId node_ = rootNode;
+    protected:
+        void setSelected(bool selected) { selected_ = selected; }
+        void setNode(NodeId node) { node_ = node; }
     public:
         virtual ~Context() {}
 
-        virtual void list(const PathList& pathList, Out<ContextResultsRecorder> results, size_t depth) const = 0;
-        virtual Stats run(const PathList& pathList, Out<ContextResultsRecorder> resultStack, size_t depth) = 0;
+        // Whether the last call to select included this context. Everything is selected until select is called.
+        bool selected() const { return selected_; }
+
+        size_t shard() const { return shard_; }
+        void setShard(size_t shard) { shard_ = shard; }
+
+        // This context's node in the TestIndex, once it's been indexed.
+        NodeId node() const { return node_; }
+
+        // Add this context and everything in it to the TestIndex, under parent.
+        virtual void index(NodeId parent) = 0;
+
+        // Call visit with the givenPath and context of each selected given, in tree order.
+        virtual void visitGivens(
+                Out<NameStack> contextStack,
+                const function<void(string, Out<Context>)>& visit
+            ) = 0;
+
+        // Deselect givens in other shards, and contexts with nothing left in them. Returns selected().
+        virtual bool selectShard(size_t shard) = 0;
+
+        // Work out which contexts and givens to include once, before they're listed or run. Returns selected().
+        virtual bool select(const PathFilter& filter, const PathFilter::State& state) = 0;
+
+        virtual void list(Out<ContextResultsRecorder> results) const = 0;
+        virtual Stats run(Out<ContextResultsRecorder> resultStack) = 0;
+        virtual void schedule(Out<Schedule> schedule) = 0;
     };
 
     using ContextList = vector<unique_ptr<Context>>;
 
+    // The context tree, flattened into the order a serial run would visit it. Each given is a task that can run on
+    // any thread. Its results are recorded, then replayed in tree order, so the output is the same as a serial run.
+    class Schedule final: public NoCopy {
+        enum class StepType {
+            PUSH,
+            POP,
+            RUN
+        };
+
+        struct Step {
+            StepType type;
+            const string* name;
+            size_t taskIndex;
+        };
+
+        struct Task final: public NoCopy {
+            Task(Out<Context> runner, bool notifyPassing, const RunOptions& options) :
+                runner(runner), recorded(notifyPassing, options)
+            {}
+
+            Out<Context> runner;
+            RecordedTask recorded;
+        };
+
+        bool notifyPassing_;
+        RunOptions options_;
+        vector<Step> stepList_;
+        vector<unique_ptr<Task>> taskList_;
+    public:
+        explicit Schedule(bool notifyPassing, RunOptions options = RunOptions()) :
+            notifyPassing_(notifyPassing), options_(options)
+        {}
+
+        void push(const string& name) {
+            stepList_.push_back(Step{StepType::PUSH, &name, 0});
+        }
+
+        void pop() {
+            stepList_.push_back(Step{StepType::POP, nullptr, 0});
+        }
+
+        void add(Out<Context> runner) {
+            stepList_.push_back(Step{StepType::RUN, nullptr, taskList_.size()});
+            taskList_.emplace_back(make_unique<Task>(runner, notifyPassing_, options_));
+        }
+
+        // Must only be called once, as it runs each given.
+        Stats run(Out<ContextResultsRecorder> results, Out<TaskPool> pool) {
+            for (auto& task : taskList_) {
+                Out<Task> currentTask(*task);
+
+                pool->submit([currentTask, pool] () mutable {
+                    auto contextNode = testIndex().parent(currentTask->runner->node());
+
+                    currentTask->recorded.run(
+                            pool,
+                            contextNode,
+                            [currentTask] (Out<ContextResultsRecorder> results) mutable {
+                                return currentTask->runner->run(results);
+                            }
+                        );
+                });
+            }
+
+            vector<Stats> statsStack(1);
+
+            for (const auto& step : stepList_) {
+                switch (step.type) {
+                    case StepType::PUSH:
+                        results->push(*step.name);
+                        statsStack.emplace_back();
+                        break;
+                    case StepType::POP: {
+                        auto stats = statsStack.back();
+                        statsStack.pop_back();
+                        results->pop(stats);
+                        statsStack.back() += stats;
+                        break;
+                    }
+                    case StepType::RUN:
+                        statsStack.back() += taskList_[step.taskIndex]->recorded.replay(results, pool);
+                        break;
+                }
+            }
+
+            return statsStack.front();
+        }
+    };
+
+    // Run givens in worker processes, so a given that crashes only takes its worker with it. Givens are handed out
+    // one at a time, in tree order, to whichever worker is free, over a Channel. Each worker sends back the Stats and
+    // events for its given. The tree is still walked in order in this process, and each given's results are replayed
+    // when it's reached, so the output is the same as a serial run.
+    //
+    // With RunOptions::isolate, workers are zygotes. They're forked before anything runs, and fork a fresh child for
+    // each given, so givens can't see each other's state, and a crash is reported by the zygote that saw it.
+    class WorkerPool final: public NoCopyMove {
+        // What a worker's reply holds, after the given's index.
+        enum class Reply : uint64_t {
+            RESULTS,
+            FAILED
+        };
+
+        struct Worker final: public NoCopy {
+            Worker(ProcessId process, Channel channel) : process(process), channel(move(channel)) {}
+
+            ProcessId process;
+            Channel channel;
+            optional<size_t> given;
+        };
+
+        struct Given final {
+            explicit Given(Out<Context> context) : context(context) {}
+
+            Out<Context> context;
+
+            // The worker's reply, or why the given failed without one.
+            optional<string> result;
+            optional<string> failure;
+        };
+
+        bool notifyPassing_;
+        RunOptions options_;
+        vector<Given> givenList_;
+        unordered_map<const Context*, size_t> givenIndex_;
+        deque<size_t> queue_;
+        vector<unique_ptr<Worker>> workerList_;
+
+        // The Stats and events from running a given.
+        string runGiven(size_t index) {
+            EventRecorder events(notifyPassing_);
+            ContextResultsRecorder results(out(events), none, options_);
+            auto& given = givenList_.at(index).context;
+            results.setContextNode(testIndex().parent(given->node()));
+            auto stats = given->run(out(results));
+
+            string data;
+            EventWriter writer(out(data));
+            writer(stats);
+            writer(events.events());
+
+            return data;
+        }
+
+        void runIsolated(size_t index, Out<Channel> channel, Out<EventWriter> reply) {
+            Pipe pipe;
+            ProcessId child = forkProcess();
+
+            if (child == 0) {
+                channel->close();
+                pipe.closeRead();
+
+                try {
+                    writeAll(pipe.writeEnd(), runGiven(index));
+                }
+                catch (...) {
+                    exitProcess(1);
+                }
+
+                exitProcess(0);
+            }
+
+            pipe.closeWrite();
+            auto data = readAll(pipe.readEnd());
+            auto failure = waitForProcess(child);
+
+            if (failure) {
+                (*reply)(static_cast<uint64_t>(Reply::FAILED));
+                (*reply)("The process running this given " + *failure);
+            }
+            else {
+                (*reply)(static_cast<uint64_t>(Reply::RESULTS));
+                (*reply)(data);
+            }
+        }
+
+        [[noreturn]] void workerMain(Channel channel) {
+            try {
+                while (auto message = channel.receive()) {
+                    EventReader reader(*message);
+                    auto index = reader.readInteger();
+
+                    string reply;
+                    EventWriter writer(out(reply));
+                    writer(index);
+
+                    if (options_.isolate) {
+                        runIsolated(index, out(channel), out(writer));
+                    }
+                    else {
+                        writer(static_cast<uint64_t>(Reply::RESULTS));
+                        writer(runGiven(index));
+                    }
+
+                    channel.send(reply);
+                }
+            }
+            catch (...) {
+                exitProcess(1);
+            }
+
+            exitProcess(0);
+        }
+
+        void startWorker() {
+            auto channels = makeChannelPair();
+            auto process = forkProcess();
+
+            if (process == 0) {
+                // Only the coordinator should hold the other ends, so each worker sees the end of its channel. Other
+                // threads may be running their own workers, so close everything rather than just our channels.
+                closeFilesExcept(channels.second.socket());
+                channels.first.release();
+
+                for (auto& worker : workerList_) {
+                    worker->channel.release();
+                }
+
+                workerMain(move(channels.second));
+            }
+
+            channels.second.close();
+            workerList_.emplace_back(make_unique<Worker>(process, move(channels.first)));
+        }
+
+        // The worker has gone, so reap it, and fail the given it was running. Only start another one if there's
+        // something for it to do.
+        void workerFailed(size_t workerIndex) {
+            auto& worker = workerList_[workerIndex];
+            worker->channel.close();
+            auto failure = waitForProcess(worker->process);
+
+            if (worker->given) {
+                givenList_[*worker->given].failure =
+                    "The worker process running this given " + (failure ? *failure : string("exited"));
+            }
+
+            workerList_.erase(workerList_.begin() + static_cast<ptrdiff_t>(workerIndex));
+
+            if ( ! queue_.empty()) {
+                startWorker();
+            }
+        }
+
+        void dispatch() {
+            for (size_t workerIndex = 0; workerIndex < workerList_.size() && ! queue_.empty(); ++workerIndex) {
+                auto& worker = workerList_[workerIndex];
+
+                if (worker->given) {
+                    continue;
+                }
+
+                auto index = queue_.front();
+                queue_.pop_front();
+
+                string message;
+                EventWriter writer(out(message));
+                writer(index);
+
+                try {
+                    worker->channel.send(message);
+                    worker->given = index;
+                }
+                catch (const exception&) {
+                    // The worker died before it got the given, so give it to someone else.
+                    queue_.push_front(index);
+                    workerFailed(workerIndex);
+                    --workerIndex;
+                }
+            }
+        }
+
+        // Wait for at least one busy worker to finish its given, or fail.
+        void receive() {
+            vector<const Channel*> channelList;
+            vector<size_t> busyList;
+
+            for (size_t workerIndex = 0; workerIndex < workerList_.size(); ++workerIndex) {
+                if (workerList_[workerIndex]->given) {
+                    channelList.push_back(&workerList_[workerIndex]->channel);
+                    busyList.push_back(workerIndex);
+                }
+            }
+
+            if (busyList.empty()) {
+                throw runtime_error("No worker is running a given");
+            }
+
+            auto readyList = waitForChannels(channelList);
+
+            // Backwards, as workerFailed removes the worker.
+            for (auto ready = readyList.rbegin(); ready != readyList.rend(); ++ready) {
+                auto workerIndex = busyList[*ready];
+                auto& worker = workerList_[workerIndex];
+
+                try {
+                    auto message = worker->channel.receive();
+
+                    if (message) {
+                        EventReader reader(*message);
+
+                        if (reader.readInteger() != *worker->given) {
+                            throw runtime_error("Results for the wrong given");
+                        }
+
+                        auto& given = givenList_[*worker->given];
+
+                        if (static_cast<Reply>(reader.readInteger()) == Reply::FAILED) {
+                            given.failure = reader.readString();
+                        }
+                        else {
+                            given.result = reader.readString();
+                        }
+
+                        worker->given = none;
+                        continue;
+                    }
+                }
+                catch (const exception&) {
+                }
+
+                workerFailed(workerIndex);
+            }
+        }
+    public:
+        // Start the workers, and hand out the first givens. givenList must be in the order the givens will be run.
+        WorkerPool(size_t workerCount, bool notifyPassing, const RunOptions& options, const vector<Out<Context>>& givenList) :
+            notifyPassing_(notifyPassing),
+            options_(options)
+        {
+            options_.workers = 0;
+
+            for (auto given : givenList) {
+                givenIndex_.emplace(&*given, givenList_.size());
+                queue_.push_back(givenList_.size());
+                givenList_.emplace_back(given);
+            }
+
+            for (size_t index = 0; index < workerCount && index < givenList_.size(); ++index) {
+                startWorker();
+            }
+
+            dispatch();
+        }
+
+        // Closing its channel tells a worker to exit.
+        ~WorkerPool() {
+            for (auto& worker : workerList_) {
+                worker->channel.close();
+            }
+
+            for (auto& worker : workerList_) {
+                waitForProcess(worker->process);
+            }
+        }
+
+        // Wait for the given's results from its worker, and replay them. A given whose process failed is reported as
+        // failing by exception.
+        Stats replay(const Context& context, const string& name, Out<ContextResultsRecorder> results) {
+            auto& given = givenList_[givenIndex_.at(&context)];
+
+            while ( ! given.result && ! given.failure) {
+                receive();
+                dispatch();
+            }
+
+            Stats stats;
+
+            if (given.failure) {
+                results->beginGiven(name);
+                results->failByException(name, NameStack(), runtime_error(*given.failure));
+                stats.addFixture();
+                stats.addTest();
+                stats.failTest();
+                results->endGiven(stats, name);
+
+                return stats;
+            }
+
+            EventReader reader(*given.result);
+            stats = reader.readStats();
+            results->replay(reader.readEvents());
+            given.result = none;
+
+            return stats;
+        }
+    };
+
     class Register final: public NoCopyMove {
     public:
         static void add(unique_ptr<Context> context) {
+            context->index(rootNode);
             instance().contextList.emplace_back(move(context));
         }
 
-        static void list(const PathList& pathList, Out<Results> results) {
+        static void list(const PathFilter& filter, Out<Results> results) {
+            select(filter);
             ContextResultsRecorder resultsRecorder(results);
 
             for (const auto& context : instance().contextList) {
-                context->list(pathList, out(resultsRecorder), 0);
+                context->list(out(resultsRecorder));
+            }
+        }
+
+        // Write the shard that each selected given would run in, then how many givens and how much time from
+        // options.timings each shard has.
+        static void listShards(const PathFilter& filter, const RunOptions& options, Out<ostream> output) {
+            select(filter);
+            auto givenList = shardGivens(options);
+            vector<size_t> givenCounts(options.shardCount, 0);
+            vector<uint64_t> times(options.shardCount, 0);
+            vector<size_t> untimedCounts(options.shardCount, 0);
+
+            for (const auto& given : givenList) {
+                auto shard = given.second->shard();
+                *output << shard << " " << given.first << "\n";
+                ++givenCounts[shard];
+
+                if (options.timings && options.timings->count(given.first)) {
+                    times[shard] += options.timings->at(given.first);
+                }
+                else {
+                    ++untimedCounts[shard];
+                }
+            }
+
+            for (size_t shard = 0; shard < options.shardCount; ++shard) {
+                *output << "Shard " << shard << ": " << givenCounts[shard] << " givens, " <<
+                    formatMilliseconds(times[shard]);
+
+                if (untimedCounts[shard] > 0) {
+                    *output << ", " << untimedCounts[shard] << " without timings";
+                }
+
+                *output << "\n";
             }
         }
 
-        static Stats run(const PathList& pathList, Out<Results> results) {
+        static Stats run(const PathFilter& filter, Out<Results> results, const RunOptions& options = RunOptions()) {
+            select(filter);
+
+            if (options.shardCount > 1) {
+                shardGivens(options);
+
+                for (const auto& context : instance().contextList) {
+                    context->selectShard(options.shardIndex);
+                }
+            }
+
             Stats stats;
 
-            ContextResultsRecorder resultsRecorder(results);
+            if (options.workers > 0 || options.isolate) {
+                vector<Out<Context>> givenList;
+                NameStack contextStack;
 
-            for (const auto& context : instance().contextList) {
-                stats += context->run(pathList, out(resultsRecorder), 0);
+                for (const auto& context : instance().contextList) {
+                    context->visitGivens(out(contextStack), [&] (string, Out<Context> given) {
+                        givenList.push_back(given);
+                    });
+                }
+
+                WorkerPool workers(max<size_t>(options.workers, 1), results->notifyPassing(), options, givenList);
+                ContextResultsRecorder resultsRecorder(results, none, options, workers);
+
+                for (const auto& context : instance().contextList) {
+                    stats += context->run(out(resultsRecorder));
+                }
+            }
+            else if (options.jobs <= 1) {
+                ContextResultsRecorder resultsRecorder(results, none, options);
+
+                for (const auto& context : instance().contextList) {
+                    stats += context->run(out(resultsRecorder));
+                }
+            }
+            else {
+                Schedule schedule(results->notifyPassing(), options);
+
+                for (const auto& context : instance().contextList) {
+                    context->schedule(out(schedule));
+                }
+
+                // The pool must be destroyed before the schedule, as running tasks refer to it.
+                TaskPool pool(options.jobs - 1);
+                ContextResultsRecorder resultsRecorder(results, pool, options);
+                stats = schedule.run(out(resultsRecorder), out(pool));
             }
 
             results->finish(stats);
@@ -191,6 +899,34 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Suite {
     private:
         Register() = default;
 
+        static void select(const PathFilter& filter) {
+            for (const auto& context : instance().contextList) {
+                context->select(filter, filter.root());
+            }
+        }
+
+        // Assign each selected given to a shard. Returns the givens, with their paths, in tree order.
+        static vector<pair<string, Out<Context>>> shardGivens(const RunOptions& options) {
+            vector<pair<string, Out<Context>>> givenList;
+            vector<string> pathList;
+            NameStack contextStack;
+
+            for (const auto& context : instance().contextList) {
+                context->visitGivens(out(contextStack), [&] (string path, Out<Context> given) {
+                    pathList.push_back(path);
+                    givenList.emplace_back(move(path), given);
+                });
+            }
+
+            auto shardList = assignShards(pathList, options.shardCount, options.timings ? *options.timings : Timings());
+
+            for (size_t index = 0; index < givenList.size(); ++index) {
+                givenList[index].second->setShard(shardList[index]);
+            }
+
+            return givenList;
+        }
+
         static Register& instance() {
             static Register theInstance;
 
@@ -207,61 +943,103 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Suite {
             contextList(move(contextList))
         {}
 
-        virtual void list(const PathList& pathList, Out<ContextResultsRecorder> results, size_t depth) const override {
-            auto nextPathList = getMatchingPaths(pathList, depth);
-            results->push(name);
+        virtual void index(NodeId parent) override {
+            setNode(testIndex().child(parent, name));
+
+            for (const auto& context : contextList) {
+                context->index(node());
+            }
+        }
+
+        // A context is only selected if something in it is, unless the filter includes everything below it.
+        virtual bool select(const PathFilter& filter, const PathFilter::State& state) override {
+            auto childState = filter.match(state, name);
+            bool anySelected = false;
+
+            if (childState) {
+                anySelected = childState->all();
 
-            if (nextPathList) {
                 for (const auto& context : contextList) {
-                    context->list(*nextPathList, results, depth + 1);
+                    anySelected = context->select(filter, *childState) || anySelected;
                 }
             }
 
+            setSelected(anySelected);
+
+            return anySelected;
+        }
+
+        virtual void visitGivens(
+                Out<NameStack> contextStack,
+                const function<void(string, Out<Context>)>& visit
+            ) override
+        {
+            if ( ! selected()) return;
+
+            contextStack->push(name);
+
+            for (const auto& context : contextList) {
+                context->visitGivens(contextStack, visit);
+            }
+
+            contextStack->pop();
+        }
+
+        virtual bool selectShard(size_t shard) override {
+            if ( ! selected()) return false;
+
+            bool anySelected = false;
+
+            for (const auto& context : contextList) {
+                anySelected = context->selectShard(shard) || anySelected;
+            }
+
+            setSelected(anySelected);
+
+            return anySelected;
+        }
+
+        virtual void list(Out<ContextResultsRecorder> results) const override {
+            if ( ! selected()) return;
+
+            results->push(name);
+
+            for (const auto& context : contextList) {
+                context->list(results);
+            }
+
             Stats stats;
             results->pop(stats); // TODO
         }
 
-        virtual Stats run(const PathList& pathList, Out<ContextResultsRecorder> results, size_t depth) override {
+        virtual Stats run(Out<ContextResultsRecorder> results) override {
             Stats stats;
-            auto nextPathList = getMatchingPaths(pathList, depth);
+
+            if ( ! selected()) return stats;
+
             results->push(name);
 
-            if (nextPathList) {
-                for (const auto& context : contextList) {
-                    stats += context->run(*nextPathList, results, depth + 1);
-                }
+            for (const auto& context : contextList) {
+                stats += context->run(results);
             }
 
             results->pop(stats);
 
             return stats;
         }
-    private:
-        optional<PathList> getMatchingPaths(const PathList& pathList, size_t depth) const {
-            if (pathList.empty()) {
-                return pathList;
-            }
 
-            vector<shared_ptr<vector<regex>>> nextPathList;
+        virtual void schedule(Out<Schedule> schedule) override {
+            if ( ! selected()) return;
 
-            for (const auto& path : pathList) {
-                if (path->size() > depth) {
-                    if (regex_match(name, (*path)[depth])) {
-                        nextPathList.push_back(path);
-                    }
-                }
-                else {
-                    return pathList;
-                }
-            }
+            schedule->push(name);
 
-            if (nextPathList.empty()) {
-                return none;
+            for (const auto& context : contextList) {
+                context->schedule(schedule);
             }
 
-            return move(nextPathList);
+            schedule->pop();
         }
-
+    private:
         string name;
         vector<unique_ptr<Context>> contextList;
     };
@@ -291,6 +1069,51 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Suite {
         }
     };
 
+    // The state of a process running a given with RunOptions::forkWhens. Every process that reaches a when forks a
+    // child to run it, then waits for the child before carrying on, so whens run in the same order as a serial run.
+    // A child skips any later siblings of its when, as its parent runs those. Only leaf processes, which never
+    // fork, send their results to the test process. Each path through the whens is reported once, as it would be
+    // by a serial run, but the code leading up to a when only runs once.
+    class ForkedWhens final: public NoCopy {
+        int output_;
+        Out<EventRecorder> events_;
+        vector<bool> entered_;
+        bool forked_ = false;
+    public:
+        ForkedWhens(int output, Out<EventRecorder> events) : output_(output), events_(events) {}
+
+        // Whether this process is running one of the when's earlier siblings.
+        bool skip(size_t depth) const {
+            return depth < entered_.size() && entered_[depth];
+        }
+
+        // Called in a new child, which runs the when at depth and hasn't forked yet.
+        void enter(size_t depth) {
+            if (entered_.size() <= depth) {
+                entered_.resize(depth + 1, false);
+            }
+
+            entered_[depth] = true;
+            forked_ = false;
+        }
+
+        void forked() { forked_ = true; }
+
+        bool isLeaf() const { return ! forked_; }
+
+        const vector<Event>& events() const { return events_->events(); }
+
+        void send(const Stats& stats, const vector<Event>& eventList) {
+            string data;
+            EventWriter writer(out(data));
+            writer(stats);
+            writer(eventList);
+            writeAll(output_, data);
+        }
+    };
+
+    class Check;
+
     class WhenRunner final: public FailureHandler {
         struct StackElement {
             size_t index = 0;
@@ -301,21 +1124,66 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Suite {
         vector<StackElement> whenStack;
         WhenResultRecorder whenResultRecorder_;
         size_t whenDepth_ = 0;
+        bool forkWhens_;
+        optional<ForkedWhens&> forkedWhens_;
+        optional<const Check&> currentCheck_;
+
+        bool topWhenDone() const {
+            const auto& top = whenStack.back();
+
+            return top.current == top.index + 1;
+        }
+
+        template<typename Functor, typename... Args>
+        void runOnce(Functor&& functor, Args&&... args);
+
+        template<typename Functor, typename... Args>
+        void runParallel(Out<TaskPool> pool, Functor& functor, Args&... args);
 
-        bool topWhenDone() const {
-            const auto& top = whenStack.back();
+        template<typename Functor, typename... Args>
+        void runForked(Functor&& functor, Args&&... args);
 
-            return top.current == top.index + 1;
-        }
+        template<typename Functor, typename... Args>
+        [[noreturn]] void runForkedWhens(Functor&& functor, Args&&... args);
+
+        template<typename Functor>
+        void forkedWhen(NameRef description, Functor&& functor);
+
+        void reportCrashedWhen(const string& description, const string& failure);
     public:
         WhenRunner(Out<ContextResultsRecorder> results, string given) :
-                whenResultRecorder_(results, move(given)) {}
+                whenResultRecorder_(results, move(given)), forkWhens_(results->options().forkWhens) {}
+
+        // Run inside a process forked for ForkedWhens.
+        WhenRunner(Out<ContextResultsRecorder> results, string given, Out<ForkedWhens> forkedWhens) :
+                whenResultRecorder_(results, move(given)), forkWhens_(false), forkedWhens_(*forkedWhens) {}
 
         template<typename Functor, typename... Args>
         void run(Functor&& functor, Args&&... args);
 
+        // Run every path through the whens in this process and thread, whatever the options, so the runs can share
+        // state.
+        template<typename Functor, typename... Args>
+        void runInProcess(Functor&& functor, Args&&... args);
+
+        // Run the path through the whens that starts with prefix, then takes the first when at each depth. path is
+        // set to the index of the when taken at each depth, and siblingCounts to the number of whens seen there.
+        template<typename Functor, typename... Args>
+        void runPath(
+                const vector<size_t>& prefix,
+                Out<vector<size_t>> path,
+                Out<vector<size_t>> siblingCounts,
+                Functor&& functor,
+                Args&&... args
+            );
+
         template<typename Functor>
-        void when(string description, Functor&& functor) {
+        void when(NameRef description, Functor&& functor) {
+            if (forkedWhens_) {
+                forkedWhen(description, forward<Functor>(functor));
+                return;
+            }
+
             if (whenStack.size() <= whenDepth_) {
                 whenStack.push_back(StackElement{});
             }
@@ -324,11 +1192,13 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Suite {
 
             if (whenStack[whenDepth_].index == whenStack[whenDepth_].current) {
                 ++whenDepth_;
-                whenResultRecorder_.push(move(description));
+                whenResultRecorder_.push(description);
+                Timer timer;
 
                 Finally depth([&] {
                     --whenDepth_;
                     Stats stats; // TODO
+                    stats.addTime(timer.wall(), timer.cpu());
                     whenResultRecorder_.pop(stats);
                 });
 
@@ -346,6 +1216,12 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Suite {
             return whenResultRecorder_.pass(description, expressionText, variableList);
         }
 
+        void measured(const Measurement& measurement) {
+            whenResultRecorder_.measured(measurement);
+        }
+
+        const NameStack& whenNames() const { return whenResultRecorder_.whenStack(); }
+
         const Stats& stats() const { return stats_; }
     };
 
@@ -357,6 +1233,8 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Suite {
             return check.stats_;
         }
 
+        friend class Bench;
+
         bool addCheck(bool ok) {
             stats_.addCheck();
 
@@ -370,8 +1248,8 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Suite {
         Check(Out<WhenRunner> whenRunner) : whenRunner_(whenRunner) {}
 
         template<typename Functor>
-        void when(string description, Functor&& functor) {
-            whenRunner_->when(move(description), forward<Functor>(functor));
+        void when(NameRef description, Functor&& functor) {
+            whenRunner_->when(description, forward<Functor>(functor));
         }
 
         template<typename... Args>
@@ -397,28 +1275,117 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Suite {
         }
     };
 
+    // What a benchmark is given. Time code with measure, which reports each measurement, and check it as a given
+    // would.
+    class Bench final: public NoCopy {
+        Check& check_;
+        string name_;
+        BenchmarkOptions options_;
+        shared_ptr<const Baselines> baselines_;
+
+        // For a sweep, the arguments, formatted to add to measurement names, and where to record the measurements.
+        string arguments_;
+        optional<Sweep&> sweep_;
+
+        // A regression is a failed check, so it's reported and fails the run like any other.
+        void checkBaseline(const Measurement& measurement) {
+            if ( ! baselines_) return;
+
+            auto baseline = baselines_->find(baselineKey(check_.whenRunner_->whenNames(), measurement.name()));
+
+            if (baseline == baselines_->end()) return;
+
+            auto comparison = compareToBaseline(baseline->second, measurement);
+            const auto& significance = options_.significance;
+            const auto& regressionThreshold = options_.regressionThreshold;
+
+            check_(
+                    measurement.name() + " is no slower than its baseline, with a median of " +
+                        formatNanoseconds(comparison.median) + " against " +
+                        formatNanoseconds(comparison.baselineMedian),
+                    VAR(comparison.change) <= VAR(regressionThreshold) ||
+                        VAR(comparison.pValue) >= VAR(significance)
+                );
+        }
+    public:
+        Bench(Check& check,
+              string name,
+              BenchmarkOptions options,
+              shared_ptr<const Baselines> baselines,
+              string arguments = string(),
+              optional<Sweep&> sweep = none) :
+            check_(check),
+            name_(move(name)),
+            options_(options),
+            baselines_(move(baselines)),
+            arguments_(move(arguments)),
+            sweep_(sweep)
+        {}
+
+        // The options for the rest of this benchmark, starting with RunOptions::benchmark.
+        BenchmarkOptions& options() { return options_; }
+
+        // Time functor, named after the benchmark. If there's a baseline for the measurement, check it's no slower.
+        template<typename Functor>
+        Measurement measure(Functor&& functor) {
+            return measure(name_, forward<Functor>(functor));
+        }
+
+        // In a sweep, the arguments are added to name.
+        template<typename Functor>
+        Measurement measure(string name, Functor&& functor) {
+            auto measurement = Impl_Benchmark::measure(name + arguments_, options_, forward<Functor>(functor));
+            check_.whenRunner_->measured(measurement);
+            checkBaseline(measurement);
+
+            if (sweep_) {
+                sweep_->add(move(name), measurement);
+            }
+
+            return measurement;
+        }
+
+        template<typename Functor>
+        void when(NameRef description, Functor&& functor) {
+            check_.when(description, forward<Functor>(functor));
+        }
+
+        template<typename... Args>
+        bool operator()(Args&&... args) {
+            return check_(forward<Args>(args)...);
+        }
+
+        template<typename Exception = exception, typename... Args>
+        bool throws(Args&&... args) {
+            return check_.template throws<Exception>(forward<Args>(args)...);
+        }
+    };
+
     template<typename Functor, typename... Args>
     void WhenRunner::run(Functor&& functor, Args&&... args) {
+        if (forkWhens_) {
+            runForked(forward<Functor>(functor), forward<Args>(args)...);
+            return;
+        }
+
+        auto pool = whenResultRecorder_.pool();
+
+        if (pool && whenResultRecorder_.options().parallelWhens) {
+            runParallel(out(*pool), functor, args...);
+            return;
+        }
+
+        runInProcess(forward<Functor>(functor), forward<Args>(args)...);
+    }
+
+    template<typename Functor, typename... Args>
+    void WhenRunner::runInProcess(Functor&& functor, Args&&... args) {
         whenStack.clear();
         whenDepth_ = 0;
         stats_.addFixture(); // TODO:
 
         do {
-            for (auto& element : whenStack) {
-                element.current = 0;
-            }
-
-            Check check(out(*this));
-
-            try {
-                functor(check, forward<Args>(args)...);
-            }
-            catch (const exception& e) {
-                whenResultRecorder_.failByException(e);
-                stats_.failTest();
-            }
-
-            stats_.addTest(); // TODO
+            runOnce(functor, forward<Args>(args)...);
 
             while ( ! whenStack.empty() && topWhenDone()) {
                 whenStack.pop_back();
@@ -427,8 +1394,6 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Suite {
             if ( ! whenStack.empty()) {
                 ++whenStack.back().index;
             }
-
-            stats_ += checkStats(check);
         } while ( ! whenStack.empty());
 
         if (stats_.tests() == 0) {
@@ -436,28 +1401,280 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Suite {
         }
     }
 
+    // Run the given once, along the path through the whens set by whenStack.
+    template<typename Functor, typename... Args>
+    void WhenRunner::runOnce(Functor&& functor, Args&&... args) {
+        for (auto& element : whenStack) {
+            element.current = 0;
+        }
+
+        Timer timer;
+        Check check(out(*this));
+
+        try {
+            functor(check, forward<Args>(args)...);
+        }
+        catch (const exception& e) {
+            whenResultRecorder_.failByException(e);
+            stats_.failTest();
+        }
+
+        stats_.addTest(); // TODO
+        stats_ += checkStats(check);
+        stats_.addTime(timer.wall(), timer.cpu());
+    }
+
+    template<typename Functor, typename... Args>
+    void WhenRunner::runPath(
+            const vector<size_t>& prefix,
+            Out<vector<size_t>> path,
+            Out<vector<size_t>> siblingCounts,
+            Functor&& functor,
+            Args&&... args
+        )
+    {
+        whenStack.clear();
+        whenDepth_ = 0;
+
+        for (auto index : prefix) {
+            whenStack.push_back(StackElement{index, 0});
+        }
+
+        runOnce(functor, forward<Args>(args)...);
+        path->clear();
+        siblingCounts->clear();
+
+        for (const auto& element : whenStack) {
+            path->push_back(element.index);
+            siblingCounts->push_back(element.current);
+        }
+    }
 
+    // Each path through the whens runs as a separate task, with its own WhenRunner. The first task takes the first
+    // when at every depth, which tells us how many whens there are at each depth on its path. It then submits a task
+    // for each later sibling, and so on, so the tree is discovered as it runs and each path runs exactly once. Paths
+    // are replayed in lexicographic order of their when indices, which is the order a serial run would visit them.
     template<typename Functor, typename... Args>
-    class Runner final: public Context {
-        bool included(const PathList& pathList, size_t depth) const {
-            if (pathList.empty()) {
-                return true;
-            }
+    void WhenRunner::runParallel(Out<TaskPool> pool, Functor& functor, Args&... args) {
+        struct WhenPath final: public NoCopy {
+            explicit WhenPath(vector<size_t> prefix, bool notifyPassing) :
+                prefix(move(prefix)), events(notifyPassing)
+            {}
+
+            vector<size_t> prefix;
+            vector<size_t> path;
+            EventRecorder events;
+            Stats stats;
+            exception_ptr error;
+        };
+
+        stats_.addFixture();
+
+        mutex pathListMutex;
+        vector<unique_ptr<WhenPath>> pathList;
+        atomic<size_t> outstanding{0};
+        const string& given = whenResultRecorder_.given();
+        auto contextNode = whenResultRecorder_.contextNode();
+        bool notifyPassing = whenResultRecorder_.notifyPassing();
+        RunOptions options = whenResultRecorder_.options();
+
+        auto addPath = [&] (vector<size_t> prefix) {
+            lock_guard<mutex> lock(pathListMutex);
+            pathList.emplace_back(make_unique<WhenPath>(move(prefix), notifyPassing));
 
-            for (const auto& path : pathList) {
-                if (path->size() > depth) {
-                    if (regex_match(name, (*path)[depth])) {
-                        return true;
+            return out(*pathList.back());
+        };
+
+        function<void(vector<size_t>)> submitPath = [&] (vector<size_t> prefix) {
+            auto whenPath = addPath(move(prefix));
+            ++outstanding;
+
+            pool->submit([&, whenPath] () mutable {
+                vector<size_t> siblingCounts;
+
+                try {
+                    ContextResultsRecorder results(out(whenPath->events), *pool, options);
+                    results.setContextNode(contextNode);
+                    WhenRunner whenRunner(out(results), given);
+                    whenRunner.runPath(whenPath->prefix, out(whenPath->path), out(siblingCounts), functor, args...);
+                    whenPath->stats = whenRunner.stats();
+
+                    for (size_t depth = whenPath->prefix.size(); depth < whenPath->path.size(); ++depth) {
+                        for (size_t sibling = 1; sibling < siblingCounts[depth]; ++sibling) {
+                            vector<size_t> siblingPrefix(whenPath->path.begin(), whenPath->path.begin() + depth);
+                            siblingPrefix.push_back(sibling);
+                            submitPath(move(siblingPrefix));
+                        }
                     }
                 }
-                else {
-                    return true;
+                catch (...) {
+                    whenPath->error = current_exception();
                 }
+
+                outstanding.fetch_sub(1, memory_order_release);
+            });
+        };
+
+        submitPath(vector<size_t>());
+        pool->helpUntil([&] { return outstanding.load(memory_order_acquire) == 0; });
+
+        sort(pathList.begin(), pathList.end(), [] (const unique_ptr<WhenPath>& lhs, const unique_ptr<WhenPath>& rhs) {
+            return lhs->path < rhs->path;
+        });
+
+        for (const auto& whenPath : pathList) {
+            if (whenPath->error) {
+                rethrow_exception(whenPath->error);
+            }
+
+            whenResultRecorder_.replay(whenPath->events.events());
+            stats_ += whenPath->stats;
+        }
+    }
+
+    template<typename Functor, typename... Args>
+    void WhenRunner::runForked(Functor&& functor, Args&&... args) {
+        stats_.addFixture();
+        Timer timer;
+        Pipe pipe;
+        ProcessId child = forkProcess();
+
+        if (child == 0) {
+            pipe.closeRead();
+            EventRecorder events(whenResultRecorder_.notifyPassing());
+            ContextResultsRecorder results(out(events));
+            results.setContextNode(whenResultRecorder_.contextNode());
+            ForkedWhens forkedWhens(pipe.writeEnd(), out(events));
+            WhenRunner whenRunner(out(results), whenResultRecorder_.given(), out(forkedWhens));
+            whenRunner.runForkedWhens(forward<Functor>(functor), forward<Args>(args)...);
+        }
+
+        pipe.closeWrite();
+        auto data = readAll(pipe.readEnd());
+        auto failure = waitForProcess(child);
+
+        try {
+            EventReader reader(data);
+
+            while ( ! reader.atEnd()) {
+                stats_ += reader.readStats();
+                whenResultRecorder_.replay(reader.readEvents());
+            }
+        }
+        catch (const exception& e) {
+            whenResultRecorder_.failByException(e);
+            stats_.addTest();
+            stats_.failTest();
+        }
+
+        if (failure) {
+            whenResultRecorder_.failByException(runtime_error("The process running this given " + *failure));
+            stats_.addTest();
+            stats_.failTest();
+        }
+
+        // CPU time comes from the leaf processes.
+        stats_.addTime(timer.wall(), 0);
+
+        if (stats_.tests() == 0) {
+            stats_.addTest();
+        }
+    }
+
+    // Every process forked for the given ends here.
+    template<typename Functor, typename... Args>
+    void WhenRunner::runForkedWhens(Functor&& functor, Args&&... args) {
+        Check check(out(*this));
+        currentCheck_ = check;
+        bool failed = false;
+
+        try {
+            functor(check, forward<Args>(args)...);
+        }
+        catch (const exception& e) {
+            whenResultRecorder_.failByException(e);
+            failed = true;
+        }
+
+        if (forkedWhens_->isLeaf()) {
+            auto stats = checkStats(check);
+            stats.addTest();
+
+            // A new process starts with no CPU time, so this is the time since the last fork.
+            stats.addTime(0, threadCpuNanoseconds());
+
+            if (failed) {
+                stats.failTest();
             }
 
-            return false;
+            forkedWhens_->send(stats, forkedWhens_->events());
         }
 
+        exitProcess(0);
+    }
+
+    template<typename Functor>
+    void WhenRunner::forkedWhen(NameRef description, Functor&& functor) {
+        if (forkedWhens_->skip(whenDepth_)) {
+            return;
+        }
+
+        ProcessId child = forkProcess();
+
+        if (child != 0) {
+            forkedWhens_->forked();
+            auto failure = waitForProcess(child);
+
+            if (failure) {
+                reportCrashedWhen(description.str(), *failure);
+            }
+
+            return;
+        }
+
+        forkedWhens_->enter(whenDepth_);
+        ++whenDepth_;
+        whenResultRecorder_.push(description);
+        Timer timer;
+
+        // The when may end in a descendant process, whose CPU time starts again from zero, so only wall time is
+        // recorded.
+        Finally depth([&] {
+            --whenDepth_;
+            Stats stats; // TODO
+            stats.addTime(timer.wall(), 0);
+            whenResultRecorder_.pop(stats);
+        });
+
+        functor();
+    }
+
+    // The child's results are lost, so report what this process has seen so far, then the crash.
+    inline void WhenRunner::reportCrashedWhen(const string& description, const string& failure) {
+        auto eventList = forkedWhens_->events();
+        auto addEvent = [&] (EventType type, const string& name) {
+            eventList.push_back(Event{type, name, Stats(), optional<string>(), vector<Variable>()});
+        };
+
+        addEvent(EventType::BEGIN_WHEN, description);
+        addEvent(EventType::FAIL_BY_EXCEPTION, "The process running this when " + failure);
+        addEvent(EventType::END_WHEN, description);
+
+        auto openWhens = whenResultRecorder_.whenStack().stack();
+
+        for (auto depth = openWhens.size(); depth > 0; --depth) {
+            addEvent(EventType::END_WHEN, openWhens[depth - 1]);
+        }
+
+        auto stats = checkStats(*currentCheck_);
+        stats.addTest();
+        stats.failTest();
+        forkedWhens_->send(stats, eventList);
+    }
+
+
+    template<typename Functor, typename... Args>
+    class Runner final: public Context {
         string name;
         Functor runTest;
         StoreArgs<Args...> args;
@@ -466,8 +1683,34 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Suite {
             name(move(name)), runTest(move(runTest)), args(forward<Args>(args)...)
         {}
 
-        virtual void list(const PathList& pathList, Out<ContextResultsRecorder> results, size_t depth) const override {
-            if ( ! included(pathList, depth)) return;
+        virtual void index(NodeId parent) override {
+            setNode(testIndex().child(parent, name));
+        }
+
+        virtual bool select(const PathFilter& filter, const PathFilter::State& state) override {
+            setSelected(filter.match(state, name));
+
+            return selected();
+        }
+
+        virtual void visitGivens(
+                Out<NameStack> contextStack,
+                const function<void(string, Out<Context>)>& visit
+            ) override
+        {
+            if (selected()) {
+                visit(givenPath(*contextStack, name), out(*this));
+            }
+        }
+
+        virtual bool selectShard(size_t shard) override {
+            setSelected(selected() && this->shard() == shard);
+
+            return selected();
+        }
+
+        virtual void list(Out<ContextResultsRecorder> results) const override {
+            if ( ! selected()) return;
 
             results->beginGiven(name);
             Stats stats; // TODO
@@ -475,18 +1718,29 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Suite {
         }
 
         // Must only be called once as it forwards the constructor arguments to the class.
-        virtual Stats run(const PathList& pathList, Out<ContextResultsRecorder> results, size_t depth) override {
-            results->beginGiven(name);
+        virtual Stats run(Out<ContextResultsRecorder> results) override {
             Stats stats;
 
-            if (included(pathList, depth)) {
-                stats += args.applyExtraBefore(runTest, name, results);
+            if ( ! selected()) return stats;
+
+            auto workers = results->workers();
+
+            if (workers) {
+                return workers->replay(*this, name, results);
             }
 
+            results->beginGiven(name);
+            stats += args.applyExtraBefore(runTest, name, results);
             results->endGiven(stats, name);
 
             return stats;
         }
+
+        virtual void schedule(Out<Schedule> schedule) override {
+            if (selected()) {
+                schedule->add(out(*this));
+            }
+        }
     };
 
     template<typename Functor, typename... Args>
@@ -538,8 +1792,103 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Suite {
             );
     }
 
+    template<typename Functor, typename... Args>
+    class RunBenchmark final: public NoCopy {
+        Functor runBenchmark;
+    public:
+        RunBenchmark(Functor runBenchmark) : runBenchmark(move(runBenchmark)) {}
+
+        Stats operator()(const string& name, Out<ContextResultsRecorder> results, Args&&... args) {
+            const auto& options = results->options();
+            WhenRunner whenRunner(results, name);
+
+            whenRunner.run(
+                    [&] (Check& check, auto&&... benchmarkArgs) {
+                        Bench bench(check, name, options.benchmark, options.baselines);
+                        runBenchmark(bench, benchmarkArgs...);
+                    },
+                    forward<Args>(args)...
+                );
+
+            return whenRunner.stats();
+        }
+    };
+
+    // A given that times code, with a Bench instead of a Check. It's listed, filtered and sharded like any other
+    // given, and its measurements are reported through Results::measured.
+    template<typename Functor, typename... Args>
+    unique_ptr<Context> benchmark(string name, Functor runBenchmark, Args&&... args) {
+        return make_unique<Runner<RunBenchmark<Functor, DecayArrayAndFunction_t<Args>...>, DecayArrayAndFunction_t<Args>...>>(
+                move(name),
+                RunBenchmark<Functor, DecayArrayAndFunction_t<Args>...>(runBenchmark),
+                Forward<DecayArrayAndFunction_t<Args>>::run(args)...
+            );
+    }
+
+    template<typename Value, enable_if_t<is_arithmetic<Value>::value>* = nullptr>
+    double argumentNumber(const Value& value) {
+        return static_cast<double>(value);
+    }
+
+    template<typename Value, enable_if_t< ! is_arithmetic<Value>::value>* = nullptr>
+    double argumentNumber(const Value&) {
+        return numeric_limits<double>::quiet_NaN();
+    }
+
+    // Every combination of values from a list of containers, numbered so that the last container varies fastest.
+    // This is the same order the serial recursion in RunExhaustive uses.
+    template<typename... Containers>
+    class Combinations final: public NoCopy {
+        template<typename Container>
+        using ElementList = vector<const remove_reference_t<decltype(*begin(declval<const Container&>()))>*>;
+
+        // Declared before elementLists_, as makeElementList updates it.
+        size_t size_ = 1;
+        tuple<ElementList<Containers>...> elementLists_;
+
+        template<typename Container>
+        ElementList<Container> makeElementList(const Container& container) {
+            ElementList<Container> elementList;
+
+            for (const auto& value : container) {
+                elementList.push_back(&value);
+            }
+
+            size_ *= elementList.size();
+
+            return elementList;
+        }
+
+        template<typename Functor, size_t... indices>
+        void applyImpl(size_t combination, Functor&& functor, index_sequence<indices...>) const {
+            size_t positions[sizeof...(indices) + 1] = {};
+            size_t axisSizes[] = {0, get<indices>(elementLists_).size()...};
+
+            for (size_t axis = sizeof...(indices); axis > 0; --axis) {
+                positions[axis] = combination % axisSizes[axis];
+                combination /= axisSizes[axis];
+            }
+
+            functor(*get<indices>(elementLists_)[positions[indices + 1]]...);
+        }
+    public:
+        explicit Combinations(const Containers&... containers) :
+            elementLists_(makeElementList(containers)...)
+        {}
+
+        size_t size() const { return size_; }
+
+        // Call functor with the values for combination.
+        template<typename Functor>
+        void apply(size_t combination, Functor&& functor) const {
+            applyImpl(combination, forward<Functor>(functor), index_sequence_for<Containers...>());
+        }
+    };
+
     template<typename Functor, typename... Args>
     class RunExhaustive final: public NoCopy {
+        static constexpr const size_t rangesPerThread = 4;
+
         Functor runTest;
         StoreArgs<Args...> args;
 
@@ -578,16 +1927,122 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Suite {
 
             return stats;
         }
+
+        // Split the combinations into contiguous ranges and run them on the pool. Each range has its own results,
+        // which are replayed in order, so the output is the same as the serial version.
+        Stats parallelExhaustive(
+                const string& name,
+                Out<ContextResultsRecorder> results,
+                Out<TaskPool> pool,
+                const Args&... extractedArgs
+            )
+        {
+            Combinations<Args...> combinations(extractedArgs...);
+            size_t combinationCount = combinations.size();
+            size_t rangeCount = min(combinationCount, pool->threadCount() * rangesPerThread);
+            vector<unique_ptr<RecordedTask>> rangeList;
+            auto contextNode = results->contextStack().node();
+
+            for (size_t rangeIndex = 0; rangeIndex < rangeCount; ++rangeIndex) {
+                rangeList.emplace_back(make_unique<RecordedTask>(results->notifyPassing(), results->options()));
+                Out<RecordedTask> range(*rangeList.back());
+                size_t begin = combinationCount * rangeIndex / rangeCount;
+                size_t end = combinationCount * (rangeIndex + 1) / rangeCount;
+
+                pool->submit([this, &name, &combinations, pool, range, begin, end, contextNode] () mutable {
+                    range->run(pool, contextNode, [&] (Out<ContextResultsRecorder> rangeResults) {
+                        Stats stats;
+
+                        for (size_t combination = begin; combination < end; ++combination) {
+                            WhenRunner whenRunner(rangeResults, name);
+
+                            whenRunner.run([&] (Check& check) {
+                                combinations.apply(combination, [&] (const auto&... values) {
+                                    runTest(check, values...);
+                                });
+                            });
+
+                            stats += whenRunner.stats();
+                        }
+
+                        return stats;
+                    });
+                });
+            }
+
+            Stats stats;
+
+            for (auto& range : rangeList) {
+                stats += range->replay(results, pool);
+            }
+
+            return stats;
+        }
     public:
         RunExhaustive(Functor runTest, StoreArgs<Args...> args) : runTest(move(runTest)), args(move(args)) {}
 
         Stats operator()(const string& name, Out<ContextResultsRecorder> results) {
             return args.apply([&] (const Args&... extractedArgs) {
+                auto pool = results->pool();
+
+                if (pool) {
+                    return parallelExhaustive(name, results, out(*pool), extractedArgs...);
+                }
+
                 return exhaustive(move(runTest), name, results, extractedArgs...);
             });
         }
     };
 
+    // Run a benchmark for each combination of arguments, then check how it scales. Combinations are always run in
+    // turn, in this process and thread, so they aren't timed while another one runs.
+    template<typename Functor, typename CheckScaling, typename... Args>
+    class RunSweep final: public NoCopy {
+        Functor runBenchmark;
+        CheckScaling checkScaling;
+        StoreArgs<Args...> args;
+    public:
+        RunSweep(Functor runBenchmark, CheckScaling checkScaling, StoreArgs<Args...> args) :
+            runBenchmark(move(runBenchmark)), checkScaling(move(checkScaling)), args(move(args))
+        {}
+
+        Stats operator()(const string& name, Out<ContextResultsRecorder> results) {
+            return args.apply([&] (const Args&... extractedArgs) {
+                const auto& options = results->options();
+                Combinations<Args...> combinations(extractedArgs...);
+                Sweep sweep(name);
+                Stats stats;
+
+                for (size_t combination = 0; combination < combinations.size(); ++combination) {
+                    WhenRunner whenRunner(results, name);
+
+                    whenRunner.runInProcess([&] (Check& check) {
+                        combinations.apply(combination, [&] (const auto&... values) {
+                            vector<string> argumentList{Convert<decay_t<decltype(values)>>::toString(values)...};
+                            string arguments("(");
+
+                            for (size_t index = 0; index < argumentList.size(); ++index) {
+                                arguments += (index == 0 ? "" : ", ") + argumentList[index];
+                            }
+
+                            sweep.setArguments(move(argumentList), vector<double>{argumentNumber(values)...});
+                            Bench bench(check, name, options.benchmark, options.baselines, arguments + ")", sweep);
+                            runBenchmark(bench, values...);
+                        });
+                    });
+
+                    stats += whenRunner.stats();
+                }
+
+                WhenRunner whenRunner(results, name);
+                whenRunner.runInProcess([&] (Check& check) { checkScaling(check, sweep); });
+                stats += whenRunner.stats();
+
+                return stats;
+            });
+        }
+    };
+
     template<typename Value, typename... Args>
     vector<Value> choice(Value value, Args&&... tail) {
         return vector<Value>{value, forward<Args>(tail)...};
@@ -611,6 +2066,21 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Suite {
                     RunExhaustive<Functor, Args...>(move(runTest), move(args))
             );
         }
+
+        // A benchmark for each combination, with the arguments in each measurement's name. Once they've all run,
+        // checkScaling is called with a Check and the Sweep, to fit how the times scale with an argument.
+        template<typename Functor, typename CheckScaling>
+        unique_ptr<Context> benchmark(string name, Functor runBenchmark, CheckScaling checkScaling) {
+            return make_unique<Runner<RunSweep<Functor, CheckScaling, Args...>>>(
+                    move(name),
+                    RunSweep<Functor, CheckScaling, Args...>(move(runBenchmark), move(checkScaling), move(args))
+            );
+        }
+
+        template<typename Functor>
+        unique_ptr<Context> benchmark(string name, Functor runBenchmark) {
+            return benchmark(move(name), move(runBenchmark), [] (Check&, const Sweep&) {});
+        }
     };
 
     template<typename... Args>
@@ -618,24 +2088,28 @@ namespace Enhedron { namespace Test { namespace Impl { namespace Impl_Suite {
         return Exhaustive<DecayArrayAndFunction_t< Args>...>(forward<DecayArrayAndFunction_t< Args>>(args)...);
     }
 
-    inline void list(const PathList& pathList, Out<Results> results) {
-        Register::list(pathList, results);
+    inline void list(const PathFilter& filter, Out<Results> results) {
+        Register::list(filter, results);
     }
 
-    inline bool run(const PathList& pathList, Out<Results> results) {
-        auto stats = Register::run(pathList, results);
+    inline bool run(const PathFilter& filter, Out<Results> results, const RunOptions& options = RunOptions()) {
+        auto stats = Register::run(filter, results, options);
 
         return stats.failedTests() == 0 && stats.failedChecks() == 0;
     }
 
-    inline void list(const PathList& pathList, Verbosity verbosity) {
+    inline void listShards(const PathFilter& filter, const RunOptions& options, Out<ostream> output) {
+        Register::listShards(filter, options, output);
+    }
+
+    inline void list(const PathFilter& filter, Verbosity verbosity) {
         HumanResults results(out(cout), verbosity);
-        return list(pathList, out(results));
+        return list(filter, out(results));
     }
 
-    inline bool run(const PathList& pathList, Verbosity verbosity) {
+    inline bool run(const PathFilter& filter, Verbosity verbosity, const RunOptions& options = RunOptions()) {
         HumanResults results(out(cout), verbosity);
-        return run(pathList, out(results));
+        return run(filter, out(results), options);
     }
 }}}}
 
@@ -646,10 +2120,14 @@ namespace Enhedron { namespace Test {
     using Impl::Impl_Suite::context;
     using Impl::Impl_Suite::Check;
     using Impl::Impl_Suite::given;
+    using Impl::Impl_Suite::benchmark;
+    using Impl::Impl_Suite::Bench;
     using Impl::Impl_Suite::Exhaustive;
     using Impl::Impl_Suite::exhaustive;
     using Impl::Impl_Suite::choice;
     using Impl::Impl_Suite::constant;
     using Impl::Impl_Suite::list;
+    using Impl::Impl_Suite::listShards;
     using Impl::Impl_Suite::run;
+    using Impl::Impl_Suite::RunOptions;
 }}
@@ -0,0 +1,173 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#pragma once
+
+#include "Enhedron/Util.h"
+#include "Enhedron/Util/Optional.h"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
+
+#ifdef __linux__
+    #include <pthread.h>
+#endif
+
+namespace Enhedron { namespace Test { namespace Impl { namespace Impl_TestIndex {
+    using std::string;
+    using std::vector;
+    using std::deque;
+    using std::unordered_map;
+    using std::mutex;
+    using std::lock_guard;
+
+    using Util::optional;
+    using Util::none;
+
+    using NodeId = uint32_t;
+
+    // The parent of every top level context. It has no name.
+    static constexpr const NodeId rootNode = 0;
+
+    // Every context, given and path through the whens that's been seen in this process, numbered in the order
+    // they were first seen. Contexts and givens are added when they're registered, so their ids are the same in
+    // every run of the same executable. Whens are added as they're discovered. A node is identified by its parent
+    // and name, so two siblings with the same name share a node, as they share a test path.
+    //
+    // Ids are only meaningful in the process that made them. Results sent from another process are by name, and
+    // get ids when they're replayed here.
+    class TestIndex;
+    TestIndex& testIndex();
+
+    class TestIndex final: public NoCopyMove {
+        struct Node final {
+            NodeId parent;
+            string name;
+            unordered_map<string, NodeId> children;
+        };
+
+        // A plain mutex, as it's safe to unlock in a forked child. NameStack caches nodes, so it's rarely contended.
+        mutable mutex mutex_;
+
+        // A deque, so names stay where they are as nodes are added.
+        deque<Node> nodes_;
+
+        // A child process has one thread, so if another thread held the lock when we forked, it would never be
+        // released. Hold it ourselves across fork instead. Only testIndex() registers these, as they lock its index.
+        static void lockForFork();
+        static void unlockAfterFork();
+
+        friend TestIndex& testIndex();
+    public:
+        TestIndex() {
+            nodes_.push_back(Node{rootNode, "", {}});
+        }
+
+        // Returns the id of parent's child called name, adding it if it's new.
+        NodeId child(NodeId parent, const string& name) {
+            lock_guard<mutex> lock(mutex_);
+            auto inserted = nodes_[parent].children.emplace(name, static_cast<NodeId>(nodes_.size()));
+
+            if (inserted.second) {
+                nodes_.push_back(Node{parent, name, {}});
+            }
+
+            return inserted.first->second;
+        }
+
+        optional<NodeId> find(NodeId parent, const string& name) const {
+            lock_guard<mutex> lock(mutex_);
+            const auto& children = nodes_[parent].children;
+            auto found = children.find(name);
+
+            if (found == children.end()) {
+                return none;
+            }
+
+            return found->second;
+        }
+
+        NodeId parent(NodeId node) const {
+            lock_guard<mutex> lock(mutex_);
+
+            return nodes_[node].parent;
+        }
+
+        // Names don't change once they're added, so the reference stays valid.
+        const string& name(NodeId node) const {
+            lock_guard<mutex> lock(mutex_);
+
+            return nodes_[node].name;
+        }
+
+        // The names from the top level context down to node.
+        vector<string> path(NodeId node) const {
+            lock_guard<mutex> lock(mutex_);
+            vector<string> names;
+
+            for (; node != rootNode; node = nodes_[node].parent) {
+                names.push_back(nodes_[node].name);
+            }
+
+            return vector<string>(names.rbegin(), names.rend());
+        }
+
+        // The path, with names separated by "/", as givenPath writes them.
+        string pathName(NodeId node) const {
+            auto names = path(node);
+            string name;
+
+            for (size_t index = 0; index < names.size(); ++index) {
+                if (index > 0) {
+                    name += "/";
+                }
+
+                name += names[index];
+            }
+
+            return name;
+        }
+
+        size_t size() const {
+            lock_guard<mutex> lock(mutex_);
+
+            return nodes_.size();
+        }
+    };
+
+    // The index for this process.
+    inline TestIndex& testIndex() {
+        static TestIndex instance;
+
+        #ifdef __linux__
+            static const int forkHandlers =
+                ::pthread_atfork(TestIndex::lockForFork, TestIndex::unlockAfterFork, TestIndex::unlockAfterFork);
+            static_cast<void>(forkHandlers);
+        #endif
+
+        return instance;
+    }
+
+    inline void TestIndex::lockForFork() {
+        testIndex().mutex_.lock();
+    }
+
+    inline void TestIndex::unlockAfterFork() {
+        testIndex().mutex_.unlock();
+    }
+}}}}
+
+namespace Enhedron { namespace Test {
+    using Impl::Impl_TestIndex::NodeId;
+    using Impl::Impl_TestIndex::rootNode;
+    using Impl::Impl_TestIndex::TestIndex;
+    using Impl::Impl_TestIndex::testIndex;
+}}
@@ -15,6 +15,7 @@
 #include <stdexcept>
 #include <functional>
 #include <algorithm>
+#include <ostream>
 
 namespace Enhedron {
     using Test::context;
@@ -32,6 +33,7 @@ namespace Enhedron {
     using std::is_same;
     using std::reference_wrapper;
     using std::count;
+    using std::ostream;
 
     using Util::optional;
 
@@ -94,6 +96,39 @@ namespace Enhedron {
         bool moved_ = false;
     };
 
+    class CopyCounter final {
+    public:
+        explicit CopyCounter(Out<size_t> copies) : copies_(copies) {}
+
+        CopyCounter(const CopyCounter& source) : copies_(source.copies_) {
+            ++*copies_;
+        }
+
+        CopyCounter& operator=(const CopyCounter& source) {
+            copies_ = source.copies_;
+            ++*copies_;
+
+            return *this;
+        }
+
+        bool operator==(const CopyCounter&) const { return true; }
+    private:
+        Out<size_t> copies_;
+    };
+
+    class FormatCounter final {
+    public:
+        explicit FormatCounter(Out<size_t> formats) : formats_(*formats) {}
+
+        friend ostream& operator<<(ostream& output, const FormatCounter& value) {
+            ++value.formats_;
+
+            return output << "formatted";
+        }
+    private:
+        size_t& formats_;
+    };
+
     template<typename Expression>
     void expectFailure(Check& check, Expression expression, const char* expressionText = nullptr) {
         RecordFailures recordFailures;
@@ -362,6 +397,42 @@ namespace Enhedron {
                 "Values are stored by reference"
             );
         }),
+        given("NoCopies", [] (Check& check) {
+            size_t copies = 0;
+            CopyCounter a(out(copies));
+            CopyCounter b(out(copies));
+
+            check(VAR(a) == VAR(b));
+            check(VAR(a) == b);
+            check(a == VAR(b));
+            check(VAR([] (const CopyCounter& lhs, const CopyCounter& rhs) { return lhs == rhs; })(VAR(a), b));
+
+            check("Checking variables doesn't copy them", VAR(copies) == 0u);
+        }),
+        given("LazyVariables", [] (Check& check) {
+            size_t formats = 0;
+            FormatCounter value(out(formats));
+            vector<Variable> variableList;
+            VAR(value).appendVariables(variableList);
+
+            check("Variables are formatted on demand", VAR(formats) == 0u);
+            check(VAR(variableList.size()) == 1u);
+            check(VAR(string(variableList.front().name())) == "value");
+
+            check.when("we ask for the value", [&] {
+                check(VAR(variableList.front().value()) == "formatted");
+                check(VAR(formats) == 1u);
+            });
+
+            check.when("we copy the variable", [&] {
+                Variable copy(variableList.front());
+                check("Copies are formatted straight away", VAR(formats) == 1u);
+
+                check(VAR(copy.value()) == "formatted");
+                check(VAR(string(copy.name())) == "value");
+                check("Copies keep the formatted value", VAR(formats) == 1u);
+            });
+        }),
         given("ThrowSucceeds", [] (Check& check) {
             RecordFailures recordFailures;
             testAssertThrows<exception>(out(recordFailures), VAR([] { throw runtime_error("test"); })());
@@ -395,6 +466,25 @@ namespace Enhedron {
             testNumericOperator<std::greater<void>>(check);
             testNumericOperator<std::greater_equal<void>>(check);
         }),
+        given("ShortCircuit", [] (Check& check) {
+            int evaluations = 0;
+            const auto evaluate = [&] (bool value) { ++evaluations; return value; };
+            const auto dereference = [] (const int* pointer) { return *pointer; };
+            const int* nullPointer = nullptr;
+
+            check(VAR(false) || VAR(evaluate)(true));
+            check(VAR(true) || VAR(evaluate)(false));
+            check( ! (VAR(false) && VAR(evaluate)(true)));
+            check(VAR(true) && VAR(evaluate)(true));
+            check("The right hand side is only evaluated when it's needed", VAR(evaluations) == 2);
+
+            check(VAR(nullPointer) == nullptr || VAR(dereference)(VAR(nullPointer)) == 0);
+            expectFailure(
+                    check,
+                    VAR(nullPointer) != nullptr && VAR(dereference)(VAR(nullPointer)) == 0,
+                    "((nullPointer != nullptr) && (dereference(nullPointer) == 0))"
+                );
+        }),
         given("Arithmetic", [] (Check& check) {
             testNumericOperator<std::plus<void>>(check);
             testNumericOperator<std::minus<void>>(check);
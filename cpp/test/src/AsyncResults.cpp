@@ -0,0 +1,132 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "Enhedron/Test.h"
+
+#include <exception>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace Enhedron { namespace Impl_TestAsyncResults {
+    using namespace Test;
+
+    using Test::Impl::Impl_Suite::Context;
+    using Test::Impl::Impl_Suite::ContextResultsRecorder;
+    using Test::Impl::Impl_AsyncResults::SpscQueue;
+
+    using std::unique_ptr;
+    using std::string;
+    using std::vector;
+    using std::to_string;
+    using std::ostringstream;
+    using std::runtime_error;
+    using std::exception;
+
+    unique_ptr<Context> makeTree() {
+        return context("root",
+            given("first", [] (Check& check) {
+                check("a check", VAR(1) == 1);
+                check.when("a when", [&] {
+                    check("a failing check", VAR(1) == 2);
+
+                    check.when("a nested when", [&] {
+                        check(VAR(2) == 2);
+                    });
+                });
+                check.when("another when", [&] {
+                    throw runtime_error("an exception");
+                });
+            }),
+            context("nested",
+                given("second", [] (Check& check) {
+                    for (int index = 0; index < 100; ++index) {
+                        check(VAR(index) < 100);
+                    }
+                })
+            )
+        );
+    }
+
+    string writeResults(size_t capacity, bool async) {
+        ostringstream output;
+        HumanResults humanResults(out(output), Verbosity::VARIABLES);
+        AsyncResults asyncResults(out(humanResults), capacity);
+        Out<Results> results(humanResults);
+
+        if (async) {
+            results = out(asyncResults);
+        }
+
+        ContextResultsRecorder resultsRecorder(results);
+        auto stats = makeTree()->run(out(resultsRecorder));
+        results->finish(stats);
+
+        return output.str();
+    }
+
+    // Throws when it's told about a failure.
+    class ThrowingResults final: public ForwardingResults {
+    public:
+        using ForwardingResults::ForwardingResults;
+
+        virtual void failByException(const NameStack&, const string&, const NameStack&, const exception&) override {
+            throw runtime_error("a reporting error");
+        }
+    };
+
+    static Test::Suite s("AsyncResults",
+        given("a single producer single consumer queue", [] (Check& check) {
+            SpscQueue<int> queue(2);
+            int value = 1;
+            int popped = 0;
+
+            check(VAR(queue.empty()));
+            check(VAR(queue.tryPush(value)));
+            value = 2;
+            check(VAR(queue.tryPush(value)));
+            value = 3;
+            check("it's bounded", ! VAR(queue.tryPush(value)));
+
+            check(VAR(queue.tryPop(out(popped))));
+            check(VAR(popped) == 1);
+            check(VAR(queue.tryPush(value)));
+            check(VAR(queue.tryPop(out(popped))));
+            check(VAR(popped) == 2);
+            check(VAR(queue.tryPop(out(popped))));
+            check(VAR(popped) == 3);
+            check( ! VAR(queue.tryPop(out(popped))));
+        }),
+        given("some results written directly", [] (Check& check) {
+            auto expected = writeResults(1, false);
+
+            for (size_t capacity : {1u, 3u, 4096u}) {
+                check.when("we write them on a reporter thread, queueing " + to_string(capacity), [&] {
+                    check("the output is the same", VAR(writeResults(capacity, true)) == expected);
+                });
+            }
+        }),
+        given("results that throw", [] (Check& check) {
+            EventRecorder events(true);
+            ThrowingResults throwingResults(out(events));
+            AsyncResults asyncResults(out(throwingResults), 2);
+            ContextResultsRecorder resultsRecorder(out(asyncResults));
+            auto stats = makeTree()->run(out(resultsRecorder));
+            bool thrown = false;
+
+            try {
+                asyncResults.finish(stats);
+            }
+            catch (const runtime_error& e) {
+                thrown = string(e.what()) == "a reporting error";
+            }
+
+            check("finish throws the error", VAR(thrown));
+        })
+    );
+}}
@@ -0,0 +1,149 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "Enhedron/Test.h"
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace Enhedron { namespace Impl_TestBaseline {
+    using namespace Test;
+
+    using Test::Impl::Impl_Suite::Context;
+    using Test::Impl::Impl_Suite::ContextResultsRecorder;
+    using Test::Impl::Impl_Baseline::Baselines;
+    using Test::Impl::Impl_Baseline::readBaselines;
+    using Test::Impl::Impl_Baseline::mannWhitneyPValue;
+    using Test::Impl::Impl_Baseline::compareToBaseline;
+    using Util::none;
+
+    using std::unique_ptr;
+    using std::make_shared;
+    using std::string;
+    using std::vector;
+    using std::istringstream;
+    using std::ostringstream;
+
+    unique_ptr<Context> makeTree() {
+        return context("baselines",
+            benchmark("clobbering", [] (Bench& bench) {
+                bench.measure([] { clobberMemory(); });
+
+                bench.when("we measure in a when", [&] {
+                    bench.measure("in a when", [] { clobberMemory(); });
+                });
+            })
+        );
+    }
+
+    // Every baseline sample is the same, so the measurements are either all quicker or all slower.
+    Stats runWithBaselines(double sample, Out<EventRecorder> events) {
+        RunOptions options;
+        options.benchmark.samples = 10;
+        options.benchmark.sampleTime = 10000;
+        options.benchmark.warmupTime = 0;
+        options.baselines = make_shared<const Baselines>(Baselines{
+                {"baselines/clobbering/clobbering", vector<double>(10, sample)},
+                {"baselines/clobbering/we measure in a when/in a when", vector<double>(10, sample)}
+            });
+
+        ContextResultsRecorder results(events, none, options);
+
+        return makeTree()->run(out(results));
+    }
+
+    static Test::Suite s("Baseline",
+        given("a baselines file", [] (Check& check) {
+            istringstream input("1.5,2,3 root/a\n\n4 root/a given with spaces\n5 root/a\n");
+            auto baselines = readBaselines(out(input));
+
+            check(VAR(baselines.size()) == 2u);
+            check("samples for the same measurement are kept",
+                  VAR(baselines.at("root/a")) == vector<double>{1.5, 2, 3, 5});
+            check(VAR(baselines.at("root/a given with spaces")) == vector<double>{4});
+
+            check.when("it's invalid", [&] {
+                istringstream noPath("10\n");
+                istringstream badSample("1,x root/a\n");
+                istringstream emptySample("1,,2 root/a\n");
+
+                check.throws(VAR(readBaselines)(out(noPath)));
+                check.throws(VAR(readBaselines)(out(badSample)));
+                check.throws(VAR(readBaselines)(out(emptySample)));
+            });
+
+            check.when("we write baselines", [&] {
+                ostringstream output;
+                EventRecorder events(false);
+                BaselinesResults baselinesResults(out(events), out(output));
+                NameStack context;
+                context.push("root");
+                NameStack whenStack(givenNode(context, "a"));
+                baselinesResults.measured(context, "a", whenStack, Measurement("m", 1, vector<double>{1, 2.5}));
+                baselinesResults.measured(context, "a", whenStack, Measurement("m", 1, vector<double>{3}));
+                baselinesResults.finish(Stats());
+
+                check("they can be read back", VAR(output.str()) == "1.000,2.500,3.000 root/a/m\n");
+                check("measurements are passed on", VAR(events.events().size()) == 3u);
+            });
+        }),
+        given("two sets of samples", [] (Check& check) {
+            vector<double> quick{10, 11, 12, 10, 11, 12, 10, 11, 12, 11};
+            vector<double> slow{20, 21, 22, 20, 21, 22, 20, 21, 22, 21};
+
+            check("slower samples are significant", VAR(mannWhitneyPValue(quick, slow)) < 0.001);
+            check("quicker samples aren't", VAR(mannWhitneyPValue(slow, quick)) > 0.999);
+            check("the same samples aren't", VAR(mannWhitneyPValue(quick, quick)) > 0.4);
+            check("identical values aren't", VAR(mannWhitneyPValue(vector<double>(5, 1), vector<double>(5, 1))) == 1.0);
+            check(VAR(mannWhitneyPValue(vector<double>(), slow)) == 1.0);
+
+            auto comparison = compareToBaseline(quick, Measurement("slow", 1, slow));
+            check(VAR(comparison.baselineMedian) == 11.0);
+            check(VAR(comparison.median) == 21.0);
+            check(VAR(comparison.change) > 0.909 && VAR(comparison.change) < 0.91);
+        }),
+        given("benchmarks with quicker baselines", [] (Check& check) {
+            EventRecorder events(false);
+            auto stats = runWithBaselines(0.0001, out(events));
+
+            check("each measurement regresses", VAR(stats.failedChecks()) == 2u);
+
+            size_t failures = 0;
+
+            for (const auto& event : events.events()) {
+                if (event.type == EventType::FAIL) {
+                    check(VAR(event.description->find(" is no slower than its baseline, with a median of ")) !=
+                          string::npos);
+                    ++failures;
+                }
+            }
+
+            check(VAR(failures) == 2u);
+        }),
+        given("benchmarks with slower baselines", [] (Check& check) {
+            EventRecorder events(false);
+            auto stats = runWithBaselines(1e12, out(events));
+
+            check("nothing regresses", VAR(stats.checks()) == 2u);
+            check(VAR(stats.failedChecks()) == 0u);
+        }),
+        given("benchmarks without baselines", [] (Check& check) {
+            EventRecorder events(false);
+            RunOptions options;
+            options.benchmark.samples = 2;
+            options.benchmark.sampleTime = 1000;
+            options.benchmark.warmupTime = 0;
+            options.baselines = make_shared<const Baselines>();
+            ContextResultsRecorder results(out(events), none, options);
+            auto stats = makeTree()->run(out(results));
+
+            check("they aren't checked", VAR(stats.checks()) == 0u);
+        })
+    );
+}}
@@ -0,0 +1,183 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "Enhedron/Test.h"
+
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace Enhedron { namespace Impl_TestBenchmark {
+    using namespace Test;
+
+    using Test::Impl::Impl_Suite::Context;
+    using Test::Impl::Impl_Suite::ContextResultsRecorder;
+    using Util::none;
+
+    using std::unique_ptr;
+    using std::ostringstream;
+    using std::string;
+    using std::vector;
+    using std::fabs;
+
+    // Quick enough to run under the sanitizers.
+    RunOptions quickBenchmarks() {
+        RunOptions options;
+        options.benchmark.samples = 5;
+        options.benchmark.sampleTime = 10000;
+        options.benchmark.warmupTime = 0;
+
+        return options;
+    }
+
+    unique_ptr<Context> makeTree() {
+        return context("benchmarks",
+            benchmark("summing", [] (Bench& bench) {
+                vector<int> values(100, 1);
+
+                auto measurement = bench.measure([&] {
+                    int total = 0;
+
+                    for (auto value : values) {
+                        total += value;
+                    }
+
+                    doNotOptimize(total);
+                });
+
+                bench(VAR(measurement.samples().size()) == 5u);
+
+                bench.when("we measure twice", [&] {
+                    bench.options().samples = 3;
+                    bench.measure("clobbering", [] { clobberMemory(); });
+                });
+
+                bench.when("we measure once", [&] {});
+            }),
+            benchmark("with an argument", [] (Bench& bench, int size) {
+                bench.measure([&] { doNotOptimize(size); });
+            }, 10)
+        );
+    }
+
+    vector<Event> measuredEvents(const vector<Event>& eventList) {
+        vector<Event> measured;
+
+        for (const auto& event : eventList) {
+            if (event.type == EventType::MEASURED) {
+                measured.push_back(event);
+            }
+        }
+
+        return measured;
+    }
+
+    static Test::Suite s("Benchmark",
+        given("some samples", [] (Check& check) {
+            Measurement measurement("a measurement", 10, vector<double>{4, 1, 3, 2});
+
+            check(VAR(measurement.name()) == "a measurement");
+            check(VAR(measurement.iterations()) == 10u);
+            check(VAR(measurement.mean()) == 2.5);
+            check(VAR(measurement.median()) == 2.5);
+            check(VAR(measurement.minimum()) == 1.0);
+            check(VAR(measurement.maximum()) == 4.0);
+            check(VAR(fabs(measurement.standardDeviation() - 1.29099)) < 0.00001);
+            check("samples are kept in order", VAR(measurement.samples()) == vector<double>{4, 1, 3, 2});
+
+            check.when("there's an odd number of samples", [&] {
+                Measurement odd("odd", 1, vector<double>{5, 1, 3});
+                check(VAR(odd.median()) == 3.0);
+                check(VAR(odd.mean()) == 3.0);
+            });
+
+            check.when("there's one sample", [&] {
+                Measurement one("one", 1, vector<double>{7});
+                check(VAR(one.median()) == 7.0);
+                check(VAR(one.standardDeviation()) == 0.0);
+            });
+        }),
+        given("times to format", [] (Check& check) {
+            check(VAR(formatNanoseconds(12.3456)) == "12.346 ns");
+            check(VAR(formatNanoseconds(1234.5)) == "1.234 us");
+            check(VAR(formatNanoseconds(5e6)) == "5.000 ms");
+            check(VAR(formatNanoseconds(2.5e12)) == "2500.000 s");
+        }),
+        given("benchmarks in a context", [] (Check& check) {
+            EventRecorder events(false);
+            ContextResultsRecorder results(out(events), none, quickBenchmarks());
+            auto stats = makeTree()->run(out(results));
+            auto measured = measuredEvents(events.events());
+
+            check("benchmarks can check", VAR(stats.checks()) == 2u);
+            check(VAR(stats.failedChecks()) == 0u);
+            check("each measurement is reported", VAR(measured.size()) == 4u);
+            check("a measurement is named after its benchmark", VAR(measured.at(0).name) == "summing");
+            check(VAR(measured.at(1).name) == "clobbering");
+            check(VAR(measured.at(1).measurement->samples().size()) == 3u);
+            check(VAR(measured.at(2).name) == "summing");
+            check("options are reset for each run", VAR(measured.at(2).measurement->samples().size()) == 5u);
+            check(VAR(measured.at(3).name) == "with an argument");
+            check(VAR(measured.at(0).measurement->iterations()) > 0u);
+            check(VAR(measured.at(0).measurement->mean()) > 0.0);
+
+            check.when("the events are encoded and decoded", [&] {
+                string data;
+                EventWriter writer(out(data));
+                writer(events.events());
+                EventReader reader(data);
+                auto decoded = measuredEvents(reader.readEvents());
+
+                check(VAR(decoded.size()) == 4u);
+                check(VAR(decoded.at(1).name) == "clobbering");
+                check(VAR(decoded.at(1).measurement->samples()) == measured.at(1).measurement->samples());
+                check(VAR(decoded.at(1).measurement->iterations()) == measured.at(1).measurement->iterations());
+            });
+
+            check.when("the events are replayed into a human reporter", [&] {
+                ostringstream output;
+                HumanResults humanResults(out(output), Verbosity::SUMMARY);
+                EventReplayer replayer(out(humanResults));
+                replayer(events.events());
+                humanResults.finish(stats);
+
+                check(VAR(output.str().find("benchmarks\n    Given: summing\n    Measured: summing: mean ")) == 0u);
+                check(VAR(output.str().find("    When : we measure twice\n    Measured: clobbering: mean ")) != string::npos);
+                check(VAR(output.str().find(" (3 samples of ")) != string::npos);
+            });
+
+            check.when("the events are replayed into a JSON reporter", [&] {
+                ostringstream silent;
+                HumanResults humanResults(out(silent), Verbosity::SILENT);
+                ostringstream output;
+                JsonResults jsonResults(out(humanResults), out(output));
+                EventReplayer replayer(out(jsonResults));
+                replayer(events.events());
+                jsonResults.finish(stats);
+
+                check(VAR(output.str().find(
+                        "{\"type\":\"measurement\",\"context\":[\"benchmarks\"],\"given\":\"summing\",\"whens\":[],"
+                        "\"name\":\"summing\",\"iterations\":"
+                    )) == 0u);
+                check(VAR(output.str().find("\"samples\":5,\"mean\":")) != string::npos);
+            });
+        }),
+        given("a benchmark that's filtered out", [] (Check& check) {
+            EventRecorder events(false);
+            ContextResultsRecorder results(out(events), none, quickBenchmarks());
+            auto tree = makeTree();
+            PathFilter filter(vector<vector<string>>{{"benchmarks", "with an argument"}});
+            tree->select(filter, filter.root());
+            tree->run(out(results));
+
+            auto measured = measuredEvents(events.events());
+            check(VAR(measured.size()) == 1u);
+            check(VAR(measured.at(0).name) == "with an argument");
+        })
+    );
+}}
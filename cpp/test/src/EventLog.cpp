@@ -0,0 +1,234 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "Enhedron/Test.h"
+
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+    #include <unistd.h>
+#endif
+
+namespace Enhedron { namespace Impl_TestEventLog {
+    using namespace Test;
+
+    using Test::Impl::Impl_Suite::Context;
+    using Test::Impl::Impl_Suite::ContextResultsRecorder;
+
+    using std::unique_ptr;
+    using std::string;
+    using std::vector;
+    using std::to_string;
+    using std::ofstream;
+    using std::ifstream;
+    using std::ios;
+    using std::runtime_error;
+    using std::remove;
+
+    string logFileName(const string& name) {
+        #ifdef __linux__
+            return "/tmp/MosquitoNet-" + to_string(::getpid()) + "-" + name + ".log";
+        #else
+            return name + ".log";
+        #endif
+    }
+
+    size_t fileSize(const string& fileName) {
+        ifstream file(fileName, ios::binary | ios::ate);
+
+        return static_cast<size_t>(file.tellg());
+    }
+
+    unique_ptr<Context> makeTree() {
+        return context("root",
+            given("first", [] (Check& check) {
+                check("a check", VAR(1) == 1);
+                check.when("a when", [&] {
+                    check("a failing check", VAR(1) == 2);
+                });
+                check.when("another when", [&] {
+                    throw runtime_error("an exception");
+                });
+            }),
+            context("nested",
+                given("second", [] (Check& check) {
+                    string text("some text");
+                    check(VAR(text) == "some text");
+                })
+            ),
+            exhaustive(choice(1, 2, 3), choice(10, 20)).
+                given("some combinations", [] (Check& check, int x, int y) {
+                    check(VAR(x * y) != 40);
+                })
+        );
+    }
+
+    // Everything in each event, so we can compare them.
+    vector<string> describe(const vector<Event>& eventList) {
+        vector<string> descriptions;
+
+        for (const auto& event : eventList) {
+            auto description = to_string(static_cast<int>(event.type)) + ":" + event.name + ":" +
+                to_string(event.stats.tests()) + ":" + to_string(event.stats.checks()) + ":" +
+                to_string(event.stats.failedTests()) + ":" + to_string(event.stats.failedChecks()) + ":" +
+                to_string(event.stats.wallTime()) + ":" + (event.description ? *event.description : "-");
+
+            for (const auto& variable : event.variableList) {
+                description += string(":") + variable.name() + "=" + variable.value() + "@" + variable.file() + ":" +
+                    to_string(variable.line());
+            }
+
+            descriptions.push_back(description);
+        }
+
+        return descriptions;
+    }
+
+    static Test::Suite s("Event log",
+        given("a run recorded to an event log", [] (Check& check) {
+            auto fileName = logFileName("run");
+            EventRecorder runEvents(true);
+
+            {
+                EventLogResults results(out(runEvents), fileName, 64);
+                ContextResultsRecorder resultsRecorder(out(results));
+                auto stats = makeTree()->run(out(resultsRecorder));
+                results.finish(stats);
+            }
+
+            check.when("we replay it", [&] {
+                EventRecorder replayedEvents(true);
+                auto replay = replayEventLog(fileName, out(replayedEvents));
+
+                check("the events are the same", VAR(describe(replayedEvents.events())) == describe(runEvents.events()));
+                check(VAR(replay.finished));
+                check(VAR(replay.stats.failedTests()) == 1u);
+                check(VAR(bool(replay.lastGiven)));
+                check(VAR(*replay.lastGiven) == "root/some combinations");
+            });
+
+            check.when("we replay it into a reporter that doesn't want passing checks", [&] {
+                EventRecorder failures(false);
+                replayEventLog(fileName, out(failures));
+                size_t passes = 0;
+
+                for (const auto& event : failures.events()) {
+                    if (event.type == EventType::PASS) {
+                        ++passes;
+                    }
+                }
+
+                check(VAR(passes) == 0u);
+            });
+
+            remove(fileName.c_str());
+        }),
+        given("a reporter that doesn't want passing checks", [] (Check& check) {
+            auto fileName = logFileName("passing");
+            EventRecorder runEvents(false);
+
+            {
+                EventLogResults results(out(runEvents), fileName);
+                ContextResultsRecorder resultsRecorder(out(results));
+                auto stats = makeTree()->run(out(resultsRecorder));
+                results.finish(stats);
+            }
+
+            EventRecorder replayedEvents(true);
+            replayEventLog(fileName, out(replayedEvents));
+            size_t runPasses = 0;
+            size_t loggedPasses = 0;
+
+            for (const auto& event : runEvents.events()) {
+                if (event.type == EventType::PASS) {
+                    ++runPasses;
+                }
+            }
+
+            for (const auto& event : replayedEvents.events()) {
+                if (event.type == EventType::PASS) {
+                    ++loggedPasses;
+                }
+            }
+
+            check("they aren't passed on", VAR(runPasses) == 0u);
+            check("they're still logged", VAR(loggedPasses) == 8u);
+            remove(fileName.c_str());
+        }),
+        given("a run that stops before it finishes", [] (Check& check) {
+            auto fileName = logFileName("unfinished");
+            EventRecorder runEvents(true);
+
+            {
+                EventLogResults results(out(runEvents), fileName);
+                ContextResultsRecorder resultsRecorder(out(results));
+
+                context("root",
+                    given("first", [] (Check& check) {
+                        check(VAR(1) == 2);
+                    }),
+                    given("second", [] (Check& check) {
+                        check(VAR(true));
+                    })
+                )->run(out(resultsRecorder));
+            }
+
+            EventRecorder replayedEvents(true);
+            auto replay = replayEventLog(fileName, out(replayedEvents));
+
+            check(! VAR(replay.finished));
+            check("we know how far it got", VAR(*replay.lastGiven) == "root/second");
+            check("the givens that finished are counted", VAR(replay.stats.tests()) == 2u);
+            check(VAR(replay.stats.failedChecks()) == 1u);
+            check("results are finished", VAR(replayedEvents.events().back().type) == EventType::FINISH);
+            remove(fileName.c_str());
+        }),
+        given("the same check run many times", [] (Check& check) {
+            auto fileName = logFileName("repeated");
+            EventRecorder runEvents(true);
+
+            {
+                EventLogResults results(out(runEvents), fileName);
+                ContextResultsRecorder resultsRecorder(out(results));
+
+                auto stats = context("root",
+                    given("a loop", [] (Check& check) {
+                        for (int index = 0; index < 1000; ++index) {
+                            check("a description of the check", VAR(index) < 1000);
+                        }
+                    })
+                )->run(out(resultsRecorder));
+
+                results.finish(stats);
+            }
+
+            string encoded;
+            EventWriter writer(out(encoded));
+            writer(runEvents.events());
+
+            check("strings are only written once", VAR(fileSize(fileName)) * 8 < encoded.size());
+            remove(fileName.c_str());
+        }),
+        given("a file that isn't an event log", [] (Check& check) {
+            auto fileName = logFileName("not");
+
+            {
+                ofstream file(fileName);
+                file << "Not an event log";
+            }
+
+            EventRecorder events(true);
+            check.throws(VAR([&] { replayEventLog(fileName, out(events)); })());
+            remove(fileName.c_str());
+        })
+    );
+}}
@@ -0,0 +1,65 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "Enhedron/Test.h"
+
+#include <array>
+#include <utility>
+
+namespace Enhedron { namespace Impl_TestFinally {
+    using namespace Test;
+
+    using std::array;
+    using std::move;
+
+    static Test::Suite s("Finally",
+        given("a small functor", [] (Check& check) {
+            int calls = 0;
+
+            {
+                Finally finally([&] { ++calls; });
+                check("it's not called early", VAR(calls) == 0);
+            }
+
+            check("it's called once", VAR(calls) == 1);
+
+            check.when("it's moved", [&] {
+                {
+                    Finally first([&] { ++calls; });
+                    Finally second(move(first));
+                    Finally third([&] { calls += 10; });
+                    third = move(second);
+                    check("replacing a functor doesn't call it", VAR(calls) == 1);
+                }
+
+                check("only the moved functor is called", VAR(calls) == 2);
+            });
+
+            check.when("it's closed early", [&] {
+                {
+                    Finally finally([&] { ++calls; });
+                    finally.close();
+                    check(VAR(calls) == 2);
+                }
+
+                check("it's not called again", VAR(calls) == 2);
+            });
+        }),
+        given("a functor too large to store inline", [] (Check& check) {
+            int calls = 0;
+            array<int, 64> values{};
+            values[63] = 5;
+
+            {
+                Finally first([&calls, values] { calls += values[63]; });
+                Finally second(move(first));
+            }
+
+            check("it's called once", VAR(calls) == 5);
+        })
+    );
+}}
@@ -0,0 +1,160 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "Enhedron/Test.h"
+
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Enhedron { namespace Impl_TestFork {
+    using namespace Test;
+
+    using Test::Impl::Impl_Suite::Context;
+    using Test::Impl::Impl_Suite::ContextResultsRecorder;
+
+    using Util::none;
+
+    using std::unique_ptr;
+    using std::string;
+    using std::vector;
+    using std::to_string;
+    using std::abort;
+
+    unique_ptr<Context> makeTree() {
+        return context("root",
+            given("first", [] (Check& check) {
+                check("a check", VAR(1) == 1);
+                check.when("a when", [&] {
+                    check("a failing check", VAR(1) == 2);
+
+                    check.when("a nested when", [&] {
+                        check(VAR(2) == 2);
+                    });
+
+                    check.when("another nested when", [&] {});
+                });
+                check.when("another when", [&] {
+                    throw std::runtime_error("an exception");
+                });
+                check("a check after the whens", VAR(3) == 3);
+            }),
+            context("nested",
+                given("second", [] (Check& check) {
+                    check(VAR(true));
+                })
+            ),
+            exhaustive(choice(1, 2, 3), choice(10, 20)).
+                given("some combinations", [] (Check& check, int x, int y) {
+                    check(VAR(x * y) != 40);
+                    check.when("a when", [&] {
+                        check(VAR(x) < 3);
+                    });
+                })
+        );
+    }
+
+    vector<string> describe(const vector<Event>& eventList) {
+        vector<string> descriptions;
+
+        for (const auto& event : eventList) {
+            descriptions.push_back(
+                    to_string(static_cast<int>(event.type)) + ":" + event.name + ":" +
+                    to_string(event.stats.checks()) + ":" + to_string(event.stats.failedChecks())
+                );
+        }
+
+        return descriptions;
+    }
+
+    Stats run(unique_ptr<Context> tree, bool forkWhens, Out<EventRecorder> events) {
+        RunOptions options;
+        options.forkWhens = forkWhens;
+        ContextResultsRecorder results(events, none, options);
+
+        return tree->run(out(results));
+    }
+
+    static Test::Suite s("Fork",
+        given("a context tree", [] (Check& check) {
+            EventRecorder serialEvents(true);
+            auto serialStats = run(makeTree(), false, out(serialEvents));
+
+            check.when("we fork at each when", [&] {
+                EventRecorder forkedEvents(true);
+                auto forkedStats = run(makeTree(), true, out(forkedEvents));
+
+                check("the results are the same as a serial run",
+                      VAR(describe(forkedEvents.events())) == describe(serialEvents.events()));
+                check(VAR(forkedStats.tests()) == serialStats.tests());
+                check(VAR(forkedStats.checks()) == serialStats.checks());
+                check(VAR(forkedStats.failedTests()) == serialStats.failedTests());
+                check(VAR(forkedStats.failedChecks()) == serialStats.failedChecks());
+            });
+        }),
+        given("a given with setup", [] (Check& check) {
+            EventRecorder events(true);
+
+            auto stats = run(
+                    context("root",
+                        given("setup", [] (Check& check) {
+                            static size_t setupRuns = 0;
+                            ++setupRuns;
+
+                            check.when("a when", [&] {
+                                check.when("a nested when", [&] {
+                                    check(VAR(setupRuns) == 1u);
+                                });
+
+                                check.when("another nested when", [&] {
+                                    check(VAR(setupRuns) == 1u);
+                                });
+                            });
+
+                            check.when("another when", [&] {
+                                check(VAR(setupRuns) == 1u);
+                            });
+                        })
+                    ),
+                    true,
+                    out(events)
+                );
+
+            check("the setup only runs once", VAR(stats.failedChecks()) == 0u);
+            check("each leaf is a test", VAR(stats.tests()) == 3u);
+            check(VAR(stats.checks()) == 3u);
+        }),
+        given("a when that crashes", [] (Check& check) {
+            EventRecorder events(false);
+
+            auto stats = run(
+                    context("root",
+                        given("crash", [] (Check& check) {
+                            check.when("a crash", [&] { abort(); });
+                            check.when("another when", [&] { check(VAR(true)); });
+                        })
+                    ),
+                    true,
+                    out(events)
+                );
+
+            size_t exceptionCount = 0;
+
+            for (const auto& event : events.events()) {
+                if (event.type == EventType::FAIL_BY_EXCEPTION) {
+                    ++exceptionCount;
+                }
+            }
+
+            check("the crash is reported", VAR(exceptionCount) == 1u);
+            check(VAR(stats.failedTests()) == 1u);
+            check("the next when still runs", VAR(stats.tests()) == 2u);
+            check(VAR(stats.checks()) == 1u);
+        })
+    );
+}}
@@ -0,0 +1,105 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "Enhedron/Test.h"
+
+#include <string>
+#include <vector>
+
+namespace Enhedron { namespace Impl_TestNames {
+    using namespace Test;
+
+    using Test::Impl::Impl_Results::NameTable;
+
+    using std::string;
+    using std::vector;
+    using std::to_string;
+
+    vector<string> names(const NameStack& stack) {
+        vector<string> nameList;
+
+        for (const auto& name : stack.stack()) {
+            nameList.push_back(name);
+        }
+
+        return nameList;
+    }
+
+    static Test::Suite s("Names",
+        given("a name table", [] (Check& check) {
+            NameTable table;
+            auto first = table.intern("first");
+            auto second = table.intern(string("second"));
+
+            check("names get different ids", VAR(first) != second);
+            check("the same name gets the same id", VAR(table.intern(string("first"))) == first);
+            check(VAR(table.name(first)) == "first");
+            check(VAR(table.name(second)) == "second");
+            check(VAR(table.size()) == 2u);
+
+            check.when("we add enough names to grow the table", [&] {
+                const auto& firstName = table.name(first);
+
+                for (size_t index = 0; index < 1000; ++index) {
+                    table.intern("name " + to_string(index));
+                }
+
+                check("names don't move", VAR(&table.name(first)) == &firstName);
+                check(VAR(table.size()) == 1002u);
+                check(VAR(table.intern("name 500")) == table.intern(string("name 500")));
+                check(VAR(table.name(table.intern("name 999"))) == "name 999");
+                check("ids are stable", VAR(table.intern("second")) == second);
+            });
+
+            check.when("names differ only in length", [&] {
+                auto empty = table.intern("");
+                auto prefix = table.intern("fir");
+
+                check(VAR(empty) != first);
+                check(VAR(prefix) != first);
+                check(VAR(table.name(empty)) == "");
+                check(VAR(table.name(prefix)) == "fir");
+            });
+        }),
+        given("a name stack", [] (Check& check) {
+            NameStack stack;
+            stack.push("outer");
+            stack.push(string("inner"));
+
+            check(VAR(names(stack)) == vector<string>{"outer", "inner"});
+            check(VAR(stack.stack().size()) == 2u);
+            check(VAR(stack.stack().front()) == "outer");
+            check(VAR(stack.stack().back()) == "inner");
+            check(VAR(stack.stack()[1]) == "inner");
+            check(VAR(stack.top()) == "inner");
+
+            check.when("we pop a name", [&] {
+                const auto& top = stack.top();
+                stack.pop();
+
+                check("it stays valid", VAR(top) == "inner");
+                check(VAR(names(stack)) == vector<string>{"outer"});
+
+                stack.push("inner");
+                check("pushing it again reuses it", VAR(&stack.top()) == &top);
+            });
+
+            check.when("the same name is pushed twice", [&] {
+                stack.push("outer");
+                check(VAR(names(stack)) == vector<string>{"outer", "inner", "outer"});
+                check(VAR(stack.nameIds().front()) == stack.nameIds().back());
+            });
+        }),
+        given("whens named with temporary strings", [] (Check& check) {
+            for (int index = 0; index < 3; ++index) {
+                check.when("when " + to_string(index), [&] {
+                    check(VAR(index) < 3);
+                });
+            }
+        })
+    );
+}}
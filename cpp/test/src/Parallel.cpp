@@ -0,0 +1,160 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "Enhedron/Test.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Enhedron { namespace Impl_TestParallel {
+    using namespace Test;
+
+    using Test::Impl::Impl_Suite::Context;
+    using Test::Impl::Impl_Suite::ContextResultsRecorder;
+    using Test::Impl::Impl_Suite::Schedule;
+
+    using std::atomic;
+    using std::unique_ptr;
+    using std::string;
+    using std::vector;
+    using std::to_string;
+
+    unique_ptr<Context> makeTree() {
+        return context("root",
+            given("first", [] (Check& check) {
+                check("a check", VAR(1) == 1);
+                check.when("a when", [&] {
+                    check("a failing check", VAR(1) == 2);
+                });
+                check.when("another when", [&] {});
+            }),
+            context("nested",
+                given("second", [] (Check& check) {
+                    check(VAR(true));
+                }),
+                given("third", [] (Check& check) {
+                    throw std::runtime_error("an exception");
+                })
+            ),
+            given("fourth", [] (Check& check) {
+                check(VAR(false));
+            }),
+            given("nested whens", [] (Check& check) {
+                int x = 1;
+                check(VAR(x) == 1);
+
+                check.when("the first when", [&] {
+                    check.when("a nested when", [&] {
+                        check(VAR(x) == 2);
+                    });
+                    check.when("another nested when", [&] {
+                        check.when("a deeper when", [&] { check(VAR(x) == 1); });
+                        check.when("another deeper when", [&] { check(VAR(x) == 1); });
+                    });
+                });
+                check.when("the second when", [&] {});
+                check.when("the third when", [&] {
+                    check.when("a nested when", [&] {
+                        throw std::runtime_error("an exception");
+                    });
+                });
+            }),
+            exhaustive(choice(1, 2, 3), choice(10, 20, 30, 40)).
+                given("some combinations", [] (Check& check, int x, int y) {
+                    check(VAR(x * y) != 40);
+                    check.when("a when", [&] {
+                        check(VAR(x) < 3);
+                    });
+                })
+        );
+    }
+
+    vector<string> describe(const vector<Event>& eventList) {
+        vector<string> descriptions;
+
+        for (const auto& event : eventList) {
+            descriptions.push_back(
+                    to_string(static_cast<int>(event.type)) + ":" + event.name + ":" +
+                    to_string(event.stats.checks()) + ":" + to_string(event.stats.failedChecks())
+                );
+        }
+
+        return descriptions;
+    }
+
+    static Test::Suite s("Parallel",
+        given("a task pool", [] (Check& check) {
+            TaskPool pool(3);
+            atomic<size_t> count{0};
+            atomic<size_t> finishedOuter{0};
+            static constexpr const size_t outerCount = 10;
+            static constexpr const size_t innerCount = 10;
+
+            check.when("we run nested tasks", [&] {
+                for (size_t outer = 0; outer < outerCount; ++outer) {
+                    pool.submit([&] {
+                        atomic<size_t> finishedInner{0};
+
+                        for (size_t inner = 0; inner < innerCount; ++inner) {
+                            pool.submit([&] {
+                                ++count;
+                                ++finishedInner;
+                            });
+                        }
+
+                        pool.helpUntil([&] { return finishedInner == innerCount; });
+                        ++finishedOuter;
+                    });
+                }
+
+                pool.helpUntil([&] { return finishedOuter == outerCount; });
+
+                check("every task runs once", VAR(count.load()) == outerCount * innerCount);
+            });
+        }),
+        given("a context tree", [] (Check& check) {
+            EventRecorder serialEvents(true);
+            EventRecorder parallelEvents(true);
+
+            {
+                auto tree = makeTree();
+                ContextResultsRecorder results(out(serialEvents));
+                tree->run(out(results));
+            }
+
+            check.when("we run it in parallel", [&] {
+                auto tree = makeTree();
+                Schedule schedule(true);
+                tree->schedule(out(schedule));
+
+                TaskPool pool(3);
+                ContextResultsRecorder results(out(parallelEvents), pool);
+                schedule.run(out(results), out(pool));
+
+                check("the results are the same as a serial run",
+                      VAR(describe(parallelEvents.events())) == describe(serialEvents.events()));
+            });
+
+            check.when("we run whens in parallel", [&] {
+                auto tree = makeTree();
+                RunOptions options;
+                options.parallelWhens = true;
+                Schedule schedule(true, options);
+                tree->schedule(out(schedule));
+
+                TaskPool pool(3);
+                ContextResultsRecorder results(out(parallelEvents), pool, options);
+                schedule.run(out(results), out(pool));
+
+                check("the results are the same as a serial run",
+                      VAR(describe(parallelEvents.events())) == describe(serialEvents.events()));
+            });
+        })
+    );
+}}
@@ -0,0 +1,120 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "Enhedron/Test.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Enhedron { namespace Impl_TestPathFilter {
+    using namespace Test;
+
+    using Test::Impl::Impl_Suite::Context;
+    using Test::Impl::Impl_Suite::ContextResultsRecorder;
+    using Test::Impl::Impl_PathFilter::PathComponent;
+
+    using std::unique_ptr;
+    using std::string;
+    using std::vector;
+
+    using Kind = PathComponent::Kind;
+
+    unique_ptr<Context> makeTree() {
+        return context("root",
+            context("first",
+                given("a", [] (Check& check) {}),
+                given("b", [] (Check& check) {})
+            ),
+            context("second",
+                given("a", [] (Check& check) {}),
+                given("c", [] (Check& check) {})
+            )
+        );
+    }
+
+    // The givens that run, and the contexts that are entered, with the filter.
+    vector<string> selected(const vector<vector<string>>& pathList) {
+        auto tree = makeTree();
+        PathFilter filter(pathList);
+        tree->select(filter, filter.root());
+
+        EventRecorder events(true);
+        ContextResultsRecorder results(out(events));
+        tree->run(out(results));
+
+        vector<string> names;
+
+        for (const auto& event : events.events()) {
+            if (event.type == EventType::BEGIN_CONTEXT || event.type == EventType::BEGIN_GIVEN) {
+                names.push_back(event.name);
+            }
+        }
+
+        return names;
+    }
+
+    static Test::Suite s("PathFilter",
+        given("some path components", [] (Check& check) {
+            check(VAR(PathComponent("name").kind()) == Kind::LITERAL);
+            check(VAR(PathComponent("a\\.b").kind()) == Kind::LITERAL);
+            check(VAR(PathComponent("a\\.b").text()) == "a.b");
+            check(VAR(PathComponent(".*").kind()) == Kind::MATCH_ALL);
+            check(VAR(PathComponent("name.*").kind()) == Kind::PREFIX);
+            check(VAR(PathComponent("name.*").text()) == "name");
+            check(VAR(PathComponent("a|b").kind()) == Kind::REGEX);
+            check(VAR(PathComponent("a\\d").kind()) == Kind::REGEX);
+
+            check.when("we match names", [&] {
+                check(VAR(PathComponent("name").matches("name")));
+                check( ! VAR(PathComponent("name").matches("names")));
+                check(VAR(PathComponent("a\\.b").matches("a.b")));
+                check( ! VAR(PathComponent("a\\.b").matches("axb")));
+                check(VAR(PathComponent("name.*").matches("names")));
+                check( ! VAR(PathComponent("name.*").matches("nam")));
+                check(VAR(PathComponent(".*").matches("")));
+                check(VAR(PathComponent("a|b").matches("b")));
+                check( ! VAR(PathComponent("a|b").matches("ab")));
+            });
+        }),
+        given("a context tree", [] (Check& check) {
+            vector<string> everything{"root", "first", "a", "b", "second", "a", "c"};
+
+            check.when("there are no paths", [&] {
+                check("everything is selected", VAR(selected({})) == everything);
+            });
+
+            check.when("a path ends at a context", [&] {
+                check("everything below it is selected", VAR(selected({{"root"}})) == everything);
+                check(VAR(selected({{"root", "second"}})) == vector<string>{"root", "second", "a", "c"});
+            });
+
+            check.when("a path selects a given", [&] {
+                check("other givens aren't reported",
+                      VAR(selected({{"root", "first", "b"}})) == vector<string>{"root", "first", "b"});
+            });
+
+            check.when("paths share a prefix", [&] {
+                check(VAR(selected({{"root", "first", "a"}, {"root", "second", "c"}})) ==
+                      vector<string>{"root", "first", "a", "second", "c"});
+                check("a shorter path includes everything below it",
+                      VAR(selected({{"root", "first", "a"}, {"root", "first"}})) ==
+                      vector<string>{"root", "first", "a", "b"});
+            });
+
+            check.when("paths use patterns", [&] {
+                check(VAR(selected({{"root", ".*", "a"}})) == vector<string>{"root", "first", "a", "second", "a"});
+                check(VAR(selected({{"root", "sec.*"}})) == vector<string>{"root", "second", "a", "c"});
+                check(VAR(selected({{"root", "f[a-z]+", "a|b"}})) == vector<string>{"root", "first", "a", "b"});
+            });
+
+            check.when("nothing matches", [&] {
+                check(VAR(selected({{"root", "third"}}).empty()));
+            });
+        })
+    );
+}}
@@ -0,0 +1,195 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "Enhedron/Test.h"
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace Enhedron { namespace Impl_TestReporters {
+    using namespace Test;
+
+    using Test::Impl::Impl_Suite::ContextResultsRecorder;
+    using Test::Impl::Impl_Reporters::TextOutput;
+    using Test::Impl::Impl_Reporters::writeXml;
+    using Test::Impl::Impl_Reporters::writeJson;
+
+    using Assertion::Variable;
+
+    using std::string;
+    using std::vector;
+    using std::ostringstream;
+    using std::runtime_error;
+
+    string xml(const string& text, bool attribute) {
+        TextOutput output;
+        writeXml(output, text, attribute);
+
+        return output.text();
+    }
+
+    string json(const string& text) {
+        TextOutput output;
+        writeJson(output, text);
+
+        return output.text();
+    }
+
+    size_t count(const string& text, const string& pattern) {
+        size_t found = 0;
+
+        for (auto pos = text.find(pattern); pos != string::npos; pos = text.find(pattern, pos + 1)) {
+            ++found;
+        }
+
+        return found;
+    }
+
+    // The same calls for every reporter, with fixed times, so we can check all the output.
+    void report(Out<Results> results) {
+        NameStack context;
+        context.push("root");
+        context.push("<nested>");
+        NameStack whenStack;
+
+        results->beginContext(NameStack(), "root");
+        results->beginGiven(context, "a \"given\"");
+        results->beginWhen(context, "a \"given\"", whenStack, "a when");
+        whenStack.push("a when");
+        results->fail(context, "a \"given\"", whenStack, string("a & b"), "x == 1",
+                      vector<Variable>{Variable("x", "2", "file.cpp", 10)});
+        whenStack.pop();
+        results->endWhen(Stats(0, 0, 1, 0, 1, 1000, 0), context, "a \"given\"", whenStack, "a when");
+        results->failByException(context, "a \"given\"", whenStack, runtime_error("line 1\nline 2"));
+        results->endGiven(Stats(0, 1, 1, 1, 1, 1234567890, 0), context, "a \"given\"");
+        results->beginGiven(context, "passing");
+        results->endGiven(Stats(0, 1, 3, 0, 0, 500, 0), context, "passing");
+        results->endContext(Stats(0, 2, 4, 1, 1, 1234568390, 0), NameStack(), "root");
+        results->finish(Stats(0, 2, 4, 1, 1, 1234568390, 0));
+    }
+
+    static Test::Suite s("Reporters",
+        given("text with special characters", [] (Check& check) {
+            check("XML elements", VAR(xml("a<b>&'\"\t\n", false)) == "a&lt;b&gt;&amp;'\"\t\n");
+            check("XML attributes", VAR(xml("'\"\t\n", true)) == "&apos;&quot;&#9;&#10;");
+            check("control characters", VAR(xml(string("a\0b\x1f\r", 5), false)) == "a&#xFFFD;b&#xFFFD;&#13;");
+            check("UTF-8 is left alone", VAR(xml("caf\xc3\xa9", false)) == "caf\xc3\xa9");
+            check(VAR(xml("", true)) == "");
+
+            check("JSON", VAR(json("a\"b\\c\n\t")) == "\"a\\\"b\\\\c\\n\\t\"");
+            check("JSON control characters", VAR(json(string("\0\x1f", 2))) == "\"\\u0000\\u001f\"");
+            check(VAR(json("caf\xc3\xa9")) == "\"caf\xc3\xa9\"");
+        }),
+        given("a JUnit reporter", [] (Check& check) {
+            ostringstream silent;
+            HumanResults humanResults(out(silent), Verbosity::SILENT);
+            ostringstream output;
+
+            {
+                JUnitResults results(out(humanResults), out(output));
+                report(out(results));
+            }
+
+            check(VAR(output.str()) ==
+                "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                "<testsuites>\n"
+                "<testsuite name=\"MosquitoNet\">\n"
+                "  <testcase classname=\"root/&lt;nested&gt;\" name=\"a &quot;given&quot;\" time=\"1.234567\">\n"
+                "    <failure message=\"a &amp; b\">When: a when\n"
+                "a &amp; b\n"
+                "x == 1\n"
+                "x = 2: file \"file.cpp\", line 10.\n"
+                "</failure>\n"
+                "    <error message=\"line 1&#10;line 2\">line 1\n"
+                "line 2\n"
+                "</error>\n"
+                "  </testcase>\n"
+                "  <testcase classname=\"root/&lt;nested&gt;\" name=\"passing\" time=\"0.000000\"/>\n"
+                "</testsuite>\n"
+                "</testsuites>\n");
+        }),
+        given("a JSON reporter", [] (Check& check) {
+            ostringstream silent;
+            HumanResults humanResults(out(silent), Verbosity::SILENT);
+            ostringstream output;
+
+            {
+                JsonResults results(out(humanResults), out(output));
+                report(out(results));
+            }
+
+            check(VAR(output.str()) ==
+                "{\"type\":\"failure\",\"context\":[\"root\",\"<nested>\"],\"given\":\"a \\\"given\\\"\","
+                    "\"whens\":[\"a when\"],\"description\":\"a & b\",\"expression\":\"x == 1\","
+                    "\"variables\":[{\"name\":\"x\",\"value\":\"2\",\"file\":\"file.cpp\",\"line\":10}]}\n"
+                "{\"type\":\"when\",\"context\":[\"root\",\"<nested>\"],\"given\":\"a \\\"given\\\"\","
+                    "\"whens\":[\"a when\"],\"tests\":0,\"checks\":1,\"failedTests\":0,\"failedChecks\":1,"
+                    "\"wallTime\":1000,\"cpuTime\":0}\n"
+                "{\"type\":\"exception\",\"context\":[\"root\",\"<nested>\"],\"given\":\"a \\\"given\\\"\","
+                    "\"whens\":[],\"message\":\"line 1\\nline 2\"}\n"
+                "{\"type\":\"given\",\"context\":[\"root\",\"<nested>\"],\"given\":\"a \\\"given\\\"\","
+                    "\"tests\":1,\"checks\":1,\"failedTests\":1,\"failedChecks\":1,\"wallTime\":1234567890,"
+                    "\"cpuTime\":0}\n"
+                "{\"type\":\"given\",\"context\":[\"root\",\"<nested>\"],\"given\":\"passing\","
+                    "\"tests\":1,\"checks\":3,\"failedTests\":0,\"failedChecks\":0,\"wallTime\":500,\"cpuTime\":0}\n"
+                "{\"type\":\"finish\",\"tests\":2,\"checks\":4,\"failedTests\":1,\"failedChecks\":1,"
+                    "\"wallTime\":1234568390,\"cpuTime\":0}\n");
+        }),
+        given("a given with more failures than JUnit keeps", [] (Check& check) {
+            ostringstream silent;
+            HumanResults humanResults(out(silent), Verbosity::SILENT);
+            ostringstream output;
+            JUnitResults results(out(humanResults), out(output));
+            ContextResultsRecorder resultsRecorder(out(results));
+
+            auto stats = context("root",
+                exhaustive(choice(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11), choice(0, 1, 2, 3, 4, 5, 6, 7, 8, 9)).
+                    given("combinations", [] (Check& check, int x, int y) {
+                        check(VAR(x + y) < 0);
+                    })
+            )->run(out(resultsRecorder));
+
+            results.finish(stats);
+
+            check(VAR(stats.failedChecks()) == 120u);
+            check("the first failures are written", VAR(count(output.str(), "<failure ")) == 100u);
+            check("the rest are counted", VAR(output.str().find("20 more failures")) != string::npos);
+            check(VAR(count(output.str(), "<testcase ")) == 1u);
+        }),
+        given("a context tree with a JSON reporter", [] (Check& check) {
+            ostringstream silent;
+            HumanResults humanResults(out(silent), Verbosity::SILENT);
+            ostringstream output;
+            JsonResults results(out(humanResults), out(output));
+            ContextResultsRecorder resultsRecorder(out(results));
+
+            auto stats = context("root",
+                given("first", [] (Check& check) {
+                    check.when("a when", [&] {
+                        check(VAR(1) == 2);
+                    });
+                    check.when("another when", [&] {
+                        check(VAR(1) == 1);
+                    });
+                }),
+                given("second", [] (Check& check) {
+                    check(VAR(true));
+                })
+            )->run(out(resultsRecorder));
+
+            results.finish(stats);
+
+            check("one line per event", VAR(count(output.str(), "\n")) == 6u);
+            check(VAR(count(output.str(), "{\"type\":\"given\"")) == 2u);
+            check(VAR(count(output.str(), "{\"type\":\"when\"")) == 2u);
+            check(VAR(count(output.str(), "{\"type\":\"failure\"")) == 1u);
+            check(VAR(count(output.str(), "{\"type\":\"finish\"")) == 1u);
+        })
+    );
+}}
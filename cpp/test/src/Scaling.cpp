@@ -0,0 +1,174 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "Enhedron/Test.h"
+
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Enhedron { namespace Impl_TestScaling {
+    using namespace Test;
+
+    using Test::Impl::Impl_Suite::Context;
+    using Test::Impl::Impl_Suite::ContextResultsRecorder;
+    using Test::Impl::Impl_Scaling::fitComplexity;
+    using Util::none;
+
+    using std::unique_ptr;
+    using std::string;
+    using std::vector;
+    using std::pair;
+    using std::ostringstream;
+    using std::log2;
+    using std::numeric_limits;
+
+    // Times from curve, for n = 1000, 2000, ..., 64000.
+    template<typename Curve>
+    vector<pair<double, double>> pointsFrom(Curve curve) {
+        vector<pair<double, double>> points;
+
+        for (double n = 1000; n <= 64000; n *= 2) {
+            points.emplace_back(n, curve(n));
+        }
+
+        return points;
+    }
+
+    RunOptions quickBenchmarks() {
+        RunOptions options;
+        options.benchmark.samples = 5;
+        options.benchmark.sampleTime = 100000;
+        options.benchmark.warmupTime = 0;
+
+        return options;
+    }
+
+    static Test::Suite s("Scaling",
+        given("times that grow with n", [] (Check& check) {
+            auto constant = fitComplexity(pointsFrom([] (double) { return 5.0; }));
+            check(VAR(constant.complexity) == Complexity::CONSTANT);
+            check(VAR(constant.exponent) < 0.01 && VAR(constant.exponent) > -0.01);
+
+            auto logarithmic = fitComplexity(pointsFrom([] (double n) { return 2 * log2(n); }));
+            check(VAR(logarithmic.complexity) == Complexity::LOGARITHMIC);
+
+            auto linear = fitComplexity(pointsFrom([] (double n) { return 3 * n + 10; }));
+            check(VAR(linear.complexity) == Complexity::LINEAR);
+            check(VAR(linear.exponent) > 0.99 && VAR(linear.exponent) < 1.01);
+
+            auto nLogN = fitComplexity(pointsFrom([] (double n) { return n * log2(n); }));
+            check(VAR(nLogN.complexity) == Complexity::N_LOG_N);
+            check(VAR(nLogN.exponent) > 1.01 && VAR(nLogN.exponent) < 1.2);
+
+            auto quadratic = fitComplexity(pointsFrom([] (double n) { return n * n / 100; }));
+            check(VAR(quadratic.complexity) == Complexity::QUADRATIC);
+            check(VAR(quadratic.exponent) > 1.99 && VAR(quadratic.exponent) < 2.01);
+            check("an exact fit has no error", VAR(quadratic.error) < 1e-9);
+
+            check(VAR(complexityName(Complexity::N_LOG_N)) == string("O(n log n)"));
+
+            check.when("there's only one n", [&] {
+                check.throws(VAR(fitComplexity)(vector<pair<double, double>>{{10, 1}, {10, 2}}));
+            });
+
+            check.when("n isn't positive", [&] {
+                check.throws(VAR(fitComplexity)(vector<pair<double, double>>{{0, 1}, {10, 2}}));
+            });
+        }),
+        given("a sweep", [] (Check& check) {
+            Sweep sweep("sweep");
+            auto notANumber = numeric_limits<double>::quiet_NaN();
+
+            for (double n = 1; n <= 8; n *= 2) {
+                sweep.setArguments({"x", "1"}, {notANumber, n});
+                sweep.add("sweep", Measurement("", 1, vector<double>{n}));
+                sweep.setArguments({"y", "1"}, {notANumber, n});
+                sweep.add("sweep", Measurement("", 1, vector<double>{n * n}));
+                sweep.add("other", Measurement("", 1, vector<double>{1}));
+            }
+
+            check(VAR(sweep.rows().size()) == 12u);
+            check(VAR(sweep.rows().at(1).arguments) == vector<string>{"y", "1"});
+            check("the slowest growing group is fitted", VAR(sweep.fit(1).complexity) == Complexity::QUADRATIC);
+            check(VAR(sweep.fit(1, "other").complexity) == Complexity::CONSTANT);
+            check.throws("the axis must be numeric", VAR([&] { sweep.fit(0); })());
+            check.throws(VAR([&] { sweep.fit(2); })());
+            check.throws(VAR([&] { sweep.fit(1, "missing"); })());
+        }),
+        given("a sweep benchmark", [] (Check& check) {
+            vector<size_t> rowCounts;
+            vector<double> exponents;
+            auto tree = context("sweeps",
+                exhaustive(vector<size_t>{1000, 4000, 16000}, choice(string("a"))).benchmark("summing",
+                    [] (Bench& bench, size_t size, const string&) {
+                        vector<int> values(size, 1);
+
+                        bench.measure([&] {
+                            int total = 0;
+
+                            for (auto value : values) {
+                                total += value;
+                            }
+
+                            doNotOptimize(total);
+                        });
+                    },
+                    [&] (Check& check, const Sweep& sweep) {
+                        rowCounts.push_back(sweep.rows().size());
+                        auto fit = sweep.fit(0);
+                        exponents.push_back(fit.exponent);
+                        check(VAR(fit.exponent) < 1.8);
+                    }
+                )
+            );
+
+            EventRecorder events(false);
+            ContextResultsRecorder results(out(events), none, quickBenchmarks());
+            auto stats = tree->run(out(results));
+            vector<string> names;
+
+            for (const auto& event : events.events()) {
+                if (event.type == EventType::MEASURED) {
+                    names.push_back(event.name);
+                }
+            }
+
+            check("each combination is measured, with its arguments",
+                  VAR(names) == vector<string>{
+                          "summing(1000, \"a\")", "summing(4000, \"a\")", "summing(16000, \"a\")"
+                      });
+            check("the scaling is checked once", VAR(rowCounts) == vector<size_t>{3});
+            check("summing isn't quadratic", VAR(stats.checks()) == 1u && VAR(stats.failedChecks()) == 0u);
+            check(VAR(exponents.at(0)) > 0.0);
+        }),
+        given("measurements to write as CSV", [] (Check& check) {
+            ostringstream output;
+            EventRecorder events(false);
+
+            {
+                MeasurementsResults measurementsResults(out(events), out(output));
+                NameStack context;
+                context.push("csv");
+                NameStack whenStack(givenNode(context, "a, \"b\""));
+                measurementsResults.measured(
+                        context, "a, \"b\"", whenStack, Measurement("name", 10, vector<double>{1, 2.5})
+                    );
+                measurementsResults.finish(Stats());
+            }
+
+            check(VAR(output.str()) ==
+                "path,name,iterations,samples,mean,median,standard deviation,minimum,maximum\n"
+                "\"csv/a, \"\"b\"\"\",name,10,2,1.750,1.750,1.061,1.000,2.500\n");
+            check("measurements are passed on", VAR(events.events().size()) == 2u);
+        })
+    );
+}}
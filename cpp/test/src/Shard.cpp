@@ -0,0 +1,140 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "Enhedron/Test.h"
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace Enhedron { namespace Impl_TestShard {
+    using namespace Test;
+
+    using Test::Impl::Impl_Suite::Context;
+    using Test::Impl::Impl_Suite::ContextResultsRecorder;
+    using Test::Impl::Impl_Shard::Timings;
+    using Test::Impl::Impl_Shard::assignShards;
+    using Test::Impl::Impl_Shard::readTimings;
+
+    using std::unique_ptr;
+    using std::string;
+    using std::vector;
+    using std::istringstream;
+    using std::ostringstream;
+
+    unique_ptr<Context> makeTree() {
+        return context("root",
+            context("first",
+                given("a", [] (Check& check) {}),
+                given("b", [] (Check& check) {})
+            ),
+            given("c", [] (Check& check) {}),
+            context("second",
+                given("d", [] (Check& check) {}),
+                given("e", [] (Check& check) {})
+            )
+        );
+    }
+
+    // The givens that run in shard.
+    vector<string> runShard(size_t shard, size_t shardCount) {
+        auto tree = makeTree();
+        PathFilter filter;
+        tree->select(filter, filter.root());
+
+        vector<string> pathList;
+        vector<Out<Context>> givenList;
+        NameStack contextStack;
+
+        tree->visitGivens(out(contextStack), [&] (string path, Out<Context> given) {
+            pathList.push_back(path);
+            givenList.push_back(given);
+        });
+
+        auto shardList = assignShards(pathList, shardCount, Timings());
+
+        for (size_t index = 0; index < givenList.size(); ++index) {
+            givenList[index]->setShard(shardList[index]);
+        }
+
+        tree->selectShard(shard);
+
+        EventRecorder events(true);
+        ContextResultsRecorder results(out(events));
+        tree->run(out(results));
+        vector<string> names;
+
+        for (const auto& event : events.events()) {
+            if (event.type == EventType::BEGIN_GIVEN) {
+                names.push_back(event.name);
+            }
+        }
+
+        return names;
+    }
+
+    static Test::Suite s("Shard",
+        given("some givens without timings", [] (Check& check) {
+            vector<string> pathList{"a", "b", "c", "d", "e"};
+
+            check("they're dealt out in turn",
+                  VAR(assignShards(pathList, 2, Timings())) == vector<size_t>{0, 1, 0, 1, 0});
+            check(VAR(assignShards(pathList, 1, Timings())) == vector<size_t>{0, 0, 0, 0, 0});
+        }),
+        given("some givens with timings", [] (Check& check) {
+            vector<string> pathList{"a", "b", "c", "d", "e"};
+            Timings timings{{"a", 10}, {"b", 60}, {"c", 20}, {"d", 30}, {"e", 40}};
+
+            check("the slowest go to the least loaded shard first",
+                  VAR(assignShards(pathList, 2, timings)) == vector<size_t>{1, 0, 0, 1, 1});
+
+            check.when("some givens have no timing", [&] {
+                Timings partialTimings{{"a", 10}, {"b", 30}};
+
+                check("they take the mean time",
+                      VAR(assignShards(pathList, 3, partialTimings)) == vector<size_t>{2, 0, 1, 2, 1});
+            });
+        }),
+        given("a timings file", [] (Check& check) {
+            istringstream input("10 root/a\n\n20 root/a given with spaces\n5 root/a\n");
+            auto timings = readTimings(out(input));
+
+            check(VAR(timings.size()) == 2u);
+            check("times for the same given are added", VAR(timings.at("root/a")) == 15u);
+            check(VAR(timings.at("root/a given with spaces")) == 20u);
+
+            check.when("it's invalid", [&] {
+                istringstream noPath("10\n");
+                istringstream badTime("1x root/a\n");
+
+                check.throws(VAR(readTimings)(out(noPath)));
+                check.throws(VAR(readTimings)(out(badTime)));
+            });
+
+            check.when("we write timings", [&] {
+                ostringstream output;
+                EventRecorder events(false);
+                TimingsResults timingsResults(out(events), out(output));
+                NameStack context;
+                context.push("root");
+                timingsResults.endGiven(Stats(1, 1, 0, 0, 0, 42, 7), context, "a");
+                timingsResults.finish(Stats());
+
+                check("they can be read back", VAR(output.str()) == "42 root/a\n");
+            });
+        }),
+        given("a context tree", [] (Check& check) {
+            check("the shards cover every given once",
+                  VAR(runShard(0, 2)) == vector<string>{"a", "c", "e"} &&
+                  VAR(runShard(1, 2)) == vector<string>{"b", "d"});
+            check("with one shard, every given runs",
+                  VAR(runShard(0, 1)) == vector<string>{"a", "b", "c", "d", "e"});
+            check("a shard can be empty", VAR(runShard(5, 6).empty()));
+        })
+    );
+}}
@@ -0,0 +1,150 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "Enhedron/Test.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace Enhedron { namespace Impl_TestTestIndex {
+    using namespace Test;
+
+    using Test::Impl::Impl_Suite::ContextResultsRecorder;
+
+    using std::ostringstream;
+    using std::string;
+    using std::vector;
+
+    // The path of each given and when that finishes, found from its node.
+    class NodeResults final: public ForwardingResults {
+        vector<NodeId> nodeList_;
+    public:
+        explicit NodeResults(Out<Results> results) : ForwardingResults(results) {}
+
+        const vector<NodeId>& nodeList() const { return nodeList_; }
+
+        vector<string> pathList() const {
+            vector<string> paths;
+
+            for (auto node : nodeList_) {
+                paths.push_back(testIndex().pathName(node));
+            }
+
+            return paths;
+        }
+
+        virtual void endGiven(const Stats& stats, const NameStack& context, const string& given) override {
+            nodeList_.push_back(givenNode(context, given));
+            ForwardingResults::endGiven(stats, context, given);
+        }
+
+        virtual void endWhen(const Stats& stats,
+                             const NameStack& context,
+                             const string& given,
+                             const NameStack& whenStack,
+                             const string& when) override {
+            nodeList_.push_back(whenNode(whenStack, when));
+            ForwardingResults::endWhen(stats, context, given, whenStack, when);
+        }
+    };
+
+    static Test::Suite s("Test index",
+        given("an index", [] (Check& check) {
+            TestIndex index;
+            auto context = index.child(rootNode, "context");
+            auto given = index.child(context, "given");
+            auto when = index.child(given, "when");
+
+            check("the root has no name", VAR(index.name(rootNode)) == "");
+            check("nodes are numbered in order", VAR(context) == 1u);
+            check(VAR(given) == 2u);
+            check(VAR(when) == 3u);
+            check(VAR(index.size()) == 4u);
+            check("the same name gets the same node", VAR(index.child(context, "given")) == given);
+            check("names are per parent", VAR(index.child(rootNode, "given")) != given);
+            check(VAR(index.parent(when)) == given);
+            check(VAR(index.name(when)) == "when");
+            check(VAR(index.path(when)) == vector<string>{"context", "given", "when"});
+            check(VAR(index.pathName(when)) == "context/given/when");
+            check(VAR(index.pathName(rootNode)) == "");
+            check(VAR(*index.find(given, "when")) == when);
+            check("find doesn't add nodes", ! VAR(bool(index.find(given, "another when"))));
+        }),
+        given("a registered suite", [] (Check& check) {
+            auto context = testIndex().find(rootNode, "Test index");
+            check("its contexts and givens are indexed", VAR(bool(context)));
+            check(VAR(bool(testIndex().find(*context, "a registered suite"))));
+        }),
+        given("a stack of names", [] (Check& check) {
+            NameStack stack;
+            check("an empty stack is at its base", VAR(stack.node()) == rootNode);
+
+            stack.push("a context");
+            auto context = stack.node();
+            stack.push("a nested context");
+
+            check(VAR(testIndex().pathName(stack.node())) == "a context/a nested context");
+            check(VAR(testIndex().parent(stack.node())) == context);
+            check(VAR(stack.nodes().front()) == context);
+            check("child doesn't push", VAR(stack.child("a given")) == testIndex().child(stack.node(), "a given"));
+            check(VAR(stack.stack().size()) == 2u);
+
+            stack.pop();
+            stack.pop();
+            stack.push("a context");
+            check("the same names get the same nodes", VAR(stack.node()) == context);
+
+            stack.pop();
+            stack.setBase(context);
+            check(VAR(stack.node()) == context);
+        }),
+        given("a context tree", [] (Check& check) {
+            auto tree = context("index root",
+                given("a given", [] (Check& check) {
+                    check.when("a when", [&] {
+                        check.when("a nested when", [&] {});
+                        check.when("another nested when", [&] {});
+                    });
+                }),
+                context("nested",
+                    given("a given", [] (Check&) {})
+                )
+            );
+
+            tree->index(rootNode);
+            ostringstream silent;
+            HumanResults humanResults(out(silent), Verbosity::SILENT);
+            NodeResults results(out(humanResults));
+            ContextResultsRecorder resultsRecorder(out(results));
+            tree->run(out(resultsRecorder));
+
+            check("results are keyed by node", VAR(results.pathList()) == vector<string>{
+                    "index root/a given/a when/a nested when",
+                    "index root/a given/a when",
+                    "index root/a given/a when/another nested when",
+                    "index root/a given/a when",
+                    "index root/a given",
+                    "index root/nested/a given"
+                });
+            check("a when that runs again has the same node", VAR(results.nodeList()[1]) == results.nodeList()[3]);
+            check("givens are indexed before they run", VAR(tree->node()) == *testIndex().find(rootNode, "index root"));
+
+            check.when("the events are replayed", [&] {
+                EventRecorder events(false);
+                ContextResultsRecorder recorder(out(events));
+                tree->run(out(recorder));
+
+                NodeResults replayedResults(out(humanResults));
+                EventReplayer replayer(out(replayedResults));
+                replayer(events.events());
+
+                check("they have the same nodes", VAR(replayedResults.nodeList()) == results.nodeList());
+            });
+        })
+    );
+}}
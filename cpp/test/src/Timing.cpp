@@ -0,0 +1,91 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "Enhedron/Test.h"
+
+#include <chrono>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+
+namespace Enhedron { namespace Impl_TestTiming {
+    using namespace Test;
+
+    using Test::Impl::Impl_Suite::Context;
+    using Test::Impl::Impl_Suite::ContextResultsRecorder;
+
+    using Util::Timer;
+
+    using std::unique_ptr;
+    using std::string;
+    using std::ostringstream;
+    using std::this_thread::sleep_for;
+    using std::chrono::milliseconds;
+
+    static constexpr const uint64_t sleepTime = 20000000;
+
+    unique_ptr<Context> makeTree() {
+        return context("root",
+            given("fast", [] (Check& check) {
+                check(VAR(true));
+            }),
+            given("slow", [] (Check& check) {
+                check.when("a slow when", [&] {
+                    sleep_for(milliseconds(20));
+                });
+                check.when("a fast when", [&] {});
+            })
+        );
+    }
+
+    static Test::Suite s("Timing",
+        given("a timer", [] (Check& check) {
+            Timer timer;
+            sleep_for(milliseconds(20));
+
+            check("wall time includes the sleep", VAR(timer.wall()) >= sleepTime);
+            check("CPU time doesn't include the sleep", VAR(timer.cpu()) < sleepTime);
+        }),
+        given("a context tree", [] (Check& check) {
+            EventRecorder events(true);
+            ContextResultsRecorder results(out(events));
+            auto stats = makeTree()->run(out(results));
+
+            check("the total includes the slow when", VAR(stats.wallTime()) >= sleepTime);
+
+            for (const auto& event : events.events()) {
+                if (event.type == EventType::END_WHEN && event.name == "a slow when") {
+                    check("the slow when is timed", VAR(event.stats.wallTime()) >= sleepTime);
+                }
+
+                if (event.type == EventType::END_GIVEN && event.name == "slow") {
+                    check("the given includes its whens", VAR(event.stats.wallTime()) >= sleepTime);
+                }
+
+                if (event.type == EventType::END_GIVEN && event.name == "fast") {
+                    check("the fast given is timed separately", VAR(event.stats.wallTime()) < sleepTime);
+                }
+            }
+
+            check.when("we report the slowest", [&] {
+                ostringstream output;
+                HumanResults humanResults(out(output), Verbosity::SILENT);
+                SlowestResults slowestResults(out(humanResults), out(output), 2);
+                EventReplayer replayer(out(slowestResults));
+                replayer(events.events());
+                slowestResults.finish(stats);
+                auto report = output.str();
+
+                check("the slow given and when are first",
+                      VAR(report.find("root/slow\n")) < report.find("root/slow/a slow when\n"));
+                check("only 2 are reported", VAR(report.find("root/fast")) == string::npos);
+                check("the share of the total is shown", VAR(report.find("%")) != string::npos);
+            });
+        })
+    );
+}}
@@ -18,6 +18,7 @@ namespace Enhedron {
     using std::string;
     using std::pair;
     using std::make_pair;
+    using std::move;
 
     using namespace Test;
     using namespace Util;
@@ -99,6 +100,46 @@ namespace Enhedron {
                     });
                 }
         ),
+        given("optional", [] (Check& check) {
+            optional<string> empty;
+            optional<string> value{string(helloWorld)};
+
+            check( ! VAR(bool(empty)));
+            check(VAR(bool(value)));
+            check(VAR(*value) == helloWorld);
+            check(VAR(value->size()) == string(helloWorld).size());
+
+            check.when("we copy it", [&] {
+                optional<string> copy(value);
+                check(VAR(*copy) == helloWorld);
+                check(VAR(*value) == helloWorld);
+
+                copy = empty;
+                check( ! VAR(bool(copy)));
+            });
+
+            check.when("we move it", [&] {
+                optional<string> moved(move(value));
+                check(VAR(*moved) == helloWorld);
+
+                empty = move(moved);
+                check(VAR(*empty) == helloWorld);
+            });
+
+            check.when("we reset it", [&] {
+                value.reset();
+                check( ! VAR(bool(value)));
+            });
+
+            check.when("we refer to a value", [&] {
+                string target(helloWorld);
+                optional<string&> reference(target);
+                *reference += "!";
+
+                check(VAR(target) == string(helloWorld) + "!");
+                check( ! VAR(bool(optional<string&>(none))));
+            });
+        }),
         context("math",
             given("divideRoundingUp", [] (Check& check) {
                 check(VAR(divideRoundingUp(0u, 10u)) == 0u);
@@ -0,0 +1,249 @@
+//
+//          Copyright Simon Bourne 2015.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+//
+
+#include "Enhedron/Test.h"
+
+#include <csignal>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Enhedron { namespace Impl_TestWorkers {
+    using namespace Test;
+
+    using Test::Impl::Impl_Suite::Context;
+    using Test::Impl::Impl_Suite::ContextResultsRecorder;
+    using Test::Impl::Impl_Suite::WorkerPool;
+    using Test::Impl::Impl_Channel::makeChannelPair;
+
+    using Util::none;
+
+    using std::unique_ptr;
+    using std::string;
+    using std::vector;
+    using std::to_string;
+    using std::abort;
+    using std::terminate;
+
+    unique_ptr<Context> makeTree() {
+        return context("root",
+            given("first", [] (Check& check) {
+                check("a check", VAR(1) == 1);
+                check.when("a when", [&] {
+                    check("a failing check", VAR(1) == 2);
+                });
+                check.when("another when", [&] {
+                    throw std::runtime_error("an exception");
+                });
+            }),
+            context("nested",
+                given("second", [] (Check& check) {
+                    check(VAR(true));
+                }),
+                given("third", [] (Check& check) {
+                    check(VAR(2) == 2);
+                })
+            ),
+            exhaustive(choice(1, 2, 3), choice(10, 20)).
+                given("some combinations", [] (Check& check, int x, int y) {
+                    check(VAR(x * y) != 40);
+                })
+        );
+    }
+
+    vector<string> describe(const vector<Event>& eventList) {
+        vector<string> descriptions;
+
+        for (const auto& event : eventList) {
+            descriptions.push_back(
+                    to_string(static_cast<int>(event.type)) + ":" + event.name + ":" +
+                    to_string(event.stats.checks()) + ":" + to_string(event.stats.failedChecks())
+                );
+        }
+
+        return descriptions;
+    }
+
+    Stats run(unique_ptr<Context> tree, size_t workerCount, Out<EventRecorder> events, bool isolate = false) {
+        PathFilter filter;
+        tree->select(filter, filter.root());
+        RunOptions options;
+        options.workers = workerCount;
+        options.isolate = isolate;
+
+        if (workerCount == 0) {
+            ContextResultsRecorder results(events, none, options);
+
+            return tree->run(out(results));
+        }
+
+        vector<Out<Context>> givenList;
+        NameStack contextStack;
+
+        tree->visitGivens(out(contextStack), [&] (string, Out<Context> given) {
+            givenList.push_back(given);
+        });
+
+        WorkerPool workers(workerCount, events->notifyPassing(), options, givenList);
+        ContextResultsRecorder results(events, none, options, workers);
+
+        return tree->run(out(results));
+    }
+
+    static Test::Suite s("Workers",
+        given("a channel pair", [] (Check& check) {
+            auto channels = makeChannelPair();
+
+            check.when("we send messages", [&] {
+                channels.first.send("a message");
+                channels.first.send("");
+                auto first = channels.second.receive();
+                auto second = channels.second.receive();
+
+                check(VAR(bool(first)));
+                check(VAR(*first) == "a message");
+                check(VAR(bool(second)));
+                check(VAR(second->empty()));
+            });
+
+            check.when("one end is closed", [&] {
+                channels.first.close();
+                check("the other end sees the end of the stream", ! VAR(bool(channels.second.receive())));
+            });
+        }),
+        given("a context tree", [] (Check& check) {
+            EventRecorder serialEvents(true);
+            auto serialStats = run(makeTree(), 0, out(serialEvents));
+
+            for (size_t workerCount : {1u, 2u, 8u}) {
+                check.when("we run givens in " + to_string(workerCount) + " workers", [&] {
+                    EventRecorder workerEvents(true);
+                    auto workerStats = run(makeTree(), workerCount, out(workerEvents));
+
+                    check("the results are the same as a serial run",
+                          VAR(describe(workerEvents.events())) == describe(serialEvents.events()));
+                    check(VAR(workerStats.tests()) == serialStats.tests());
+                    check(VAR(workerStats.checks()) == serialStats.checks());
+                    check(VAR(workerStats.failedTests()) == serialStats.failedTests());
+                    check(VAR(workerStats.failedChecks()) == serialStats.failedChecks());
+                });
+
+                check.when("we isolate givens in " + to_string(workerCount) + " workers", [&] {
+                    EventRecorder isolatedEvents(true);
+                    auto isolatedStats = run(makeTree(), workerCount, out(isolatedEvents), true);
+
+                    check("the results are the same as a serial run",
+                          VAR(describe(isolatedEvents.events())) == describe(serialEvents.events()));
+                    check(VAR(isolatedStats.tests()) == serialStats.tests());
+                    check(VAR(isolatedStats.failedTests()) == serialStats.failedTests());
+                });
+            }
+        }),
+        given("some givens that crash, isolated", [] (Check& check) {
+            EventRecorder events(true);
+
+            auto stats = run(
+                    context("root",
+                        given("terminate", [] (Check& check) {
+                            terminate();
+                        }),
+                        given("segfault", [] (Check& check) {
+                            // Sanitizers catch a real segfault, so put the default handler back and raise it.
+                            signal(SIGSEGV, SIG_DFL);
+                            raise(SIGSEGV);
+                        }),
+                        given("after the crashes", [] (Check& check) {
+                            check(VAR(true));
+                        })
+                    ),
+                    1,
+                    out(events),
+                    true
+                );
+
+            vector<string> givens;
+            vector<string> failures;
+
+            for (const auto& event : events.events()) {
+                if (event.type == EventType::BEGIN_GIVEN) {
+                    givens.push_back(event.name);
+                }
+                else if (event.type == EventType::FAIL_BY_EXCEPTION) {
+                    failures.push_back(event.name);
+                }
+            }
+
+            check("the other givens still run",
+                  VAR(givens) == vector<string>{"terminate", "segfault", "after the crashes"});
+            check(VAR(failures.size()) == 2u);
+            check("the signal is named", VAR(failures.at(0).find("Aborted")) != string::npos);
+            check(VAR(failures.at(1).find("Segmentation fault")) != string::npos);
+            check(VAR(stats.failedTests()) == 2u);
+            check(VAR(stats.checks()) == 1u);
+        }),
+        given("givens that change static state, isolated", [] (Check& check) {
+            static size_t runs = 0;
+            EventRecorder events(true);
+
+            auto stats = run(
+                    context("root",
+                        given("first", [] (Check& check) {
+                            ++runs;
+                            check(VAR(runs) == 1u);
+                        }),
+                        given("second", [] (Check& check) {
+                            ++runs;
+                            check("each given starts from the zygote's state", VAR(runs) == 1u);
+                        })
+                    ),
+                    1,
+                    out(events),
+                    true
+                );
+
+            check(VAR(stats.failedChecks()) == 0u);
+            check(VAR(stats.checks()) == 2u);
+            check("nothing ran in this process", VAR(runs) == 0u);
+        }),
+        given("a given that crashes its worker", [] (Check& check) {
+            EventRecorder events(true);
+
+            auto stats = run(
+                    context("root",
+                        given("crash", [] (Check& check) {
+                            abort();
+                        }),
+                        given("after the crash", [] (Check& check) {
+                            check(VAR(true));
+                        })
+                    ),
+                    2,
+                    out(events)
+                );
+
+            vector<string> givens;
+            size_t exceptions = 0;
+
+            for (const auto& event : events.events()) {
+                if (event.type == EventType::BEGIN_GIVEN) {
+                    givens.push_back(event.name);
+                }
+                else if (event.type == EventType::FAIL_BY_EXCEPTION) {
+                    ++exceptions;
+                }
+            }
+
+            check("the other givens still run", VAR(givens) == vector<string>{"crash", "after the crash"});
+            check("the crash is reported", VAR(exceptions) == 1u);
+            check(VAR(stats.failedTests()) == 1u);
+            check(VAR(stats.checks()) == 1u);
+            check(VAR(stats.failedChecks()) == 0u);
+        })
+    );
+}}